@@ -0,0 +1,758 @@
+#include "src/in_memory_db_imp.hpp"
+#include "src/sharded_db.hpp"
+#include "src/numa_util.hpp"
+#include "src/storage_arena.hpp"
+#include "src/thread_per_core_db.hpp"
+#include "src/combining_db.hpp"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <mutex>
+#include <functional>
+
+using BenchClock = std::chrono::steady_clock;
+
+void printSeparator(const std::string& title) {
+    std::cout << "\n" << std::string(50, '=') << std::endl;
+    std::cout << " " << title << std::endl;
+    std::cout << std::string(50, '=') << std::endl;
+}
+
+double elapsedSeconds(BenchClock::time_point start) {
+    return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+void printThroughput(const std::string& label, size_t bytes, double seconds) {
+    double megabytes = static_cast<double>(bytes) / (1024.0 * 1024.0);
+    std::cout << std::left << std::setw(32) << label
+              << std::right << std::fixed << std::setprecision(3) << std::setw(9) << seconds << " s  "
+              << std::setprecision(1) << std::setw(9) << (megabytes / seconds) << " MB/s" << std::endl;
+}
+
+void printRate(const std::string& label, size_t operations, double seconds) {
+    std::cout << std::left << std::setw(32) << label
+              << std::right << std::fixed << std::setprecision(3) << std::setw(9) << seconds << " s  "
+              << std::setprecision(2) << std::setw(9) << (operations / seconds / 1e6) << " Mops/s" << std::endl;
+}
+
+void populate(InMemoryDBImpl& db, size_t recordCount) {
+    for (size_t i = 0; i < recordCount; i++) {
+        std::string recordId = "user:" + std::to_string(i);
+        db.set(recordId, "name", "User " + std::to_string(i));
+        db.set(recordId, "email", "user" + std::to_string(i) + "@example.com");
+        db.set(recordId, "department", i % 2 == 0 ? "engineering" : "marketing");
+        db.set(recordId, "status", "active");
+    }
+}
+
+void benchRestore(size_t recordCount) {
+    printSeparator("Restore throughput (" + std::to_string(recordCount) + " records)");
+    
+    InMemoryDBImpl source;
+    populate(source, recordCount);
+    
+    std::string textBackup = source.backup();
+    InMemoryDBImpl textTarget;
+    auto start = BenchClock::now();
+    textTarget.restore(textBackup);
+    printThroughput("restore (text, 1 thread)", textBackup.size(), elapsedSeconds(start));
+    
+    std::string snapshotData = source.snapshot();
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        InMemoryDBImpl target;
+        start = BenchClock::now();
+        target.restoreSnapshot(snapshotData, threads);
+        printThroughput("restoreSnapshot (" + std::to_string(threads) + " threads)",
+                        snapshotData.size(), elapsedSeconds(start));
+    }
+}
+
+void benchSnapshotCodecs(size_t recordCount) {
+    printSeparator("Snapshot codecs (" + std::to_string(recordCount) + " records)");
+    
+    InMemoryDBImpl source;
+    populate(source, recordCount);
+    
+    const std::pair<SnapshotCodec, std::string> codecs[] = {
+        {SnapshotCodec::None, "none"},
+        {SnapshotCodec::InTree, "in-tree"},
+        {SnapshotCodec::LZ4, "lz4"},
+        {SnapshotCodec::Zstd, "zstd"},
+    };
+    
+    for (const auto& codec : codecs) {
+        if (!isCodecAvailable(codec.first)) {
+            std::cout << std::left << std::setw(32) << ("snapshot (" + codec.second + ")") << "not built" << std::endl;
+            continue;
+        }
+        
+        auto start = BenchClock::now();
+        std::string data = source.snapshot(4096, codec.first);
+        double writeSeconds = elapsedSeconds(start);
+        
+        InMemoryDBImpl target;
+        start = BenchClock::now();
+        target.restoreSnapshot(data);
+        double readSeconds = elapsedSeconds(start);
+        
+        printThroughput("snapshot (" + codec.second + ")", data.size(), writeSeconds);
+        printThroughput("restoreSnapshot (" + codec.second + ")", data.size(), readSeconds);
+        std::cout << "  size: " << data.size() << " bytes" << std::endl;
+    }
+}
+
+void benchRecovery(size_t recordCount) {
+    printSeparator("Crash recovery (10% of records updated after checkpoint)");
+    
+    const std::string logPath = "bench_recovery.log";
+    const std::string checkpointPath = "bench_recovery.checkpoint";
+    
+    std::cout << std::left << std::setw(12) << "records" << std::right << std::setw(16) << "full replay (s)"
+              << std::setw(20) << "checkpoint+tail (s)" << std::endl;
+    
+    for (size_t count = std::max<size_t>(recordCount / 4, 1); count <= recordCount; count *= 2) {
+        std::remove(logPath.c_str());
+        {
+            InMemoryDBImpl primary;
+            primary.setAutoRewrite(0, 0);
+            primary.openAppendLog(logPath);
+            populate(primary, count);
+            populate(primary, count); // Overwrites: the log holds history, not just live data
+            primary.checkpoint(checkpointPath);
+            for (size_t i = 0; i < count / 10; i++) {
+                primary.set("user:" + std::to_string(i), "status", "updated");
+            }
+        }
+        
+        InMemoryDBImpl fullReplay;
+        auto start = BenchClock::now();
+        fullReplay.openAppendLog(logPath);
+        double replaySeconds = elapsedSeconds(start);
+        
+        InMemoryDBImpl recovered;
+        start = BenchClock::now();
+        recovered.recover(checkpointPath, logPath);
+        double recoverSeconds = elapsedSeconds(start);
+        
+        std::cout << std::left << std::setw(12) << count << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(16) << replaySeconds << std::setw(20) << recoverSeconds << std::endl;
+    }
+    
+    std::remove(logPath.c_str());
+    std::remove(checkpointPath.c_str());
+    std::remove((checkpointPath + ".snapshot").c_str());
+}
+
+void benchNumaPlacement(size_t recordCount) {
+    printSeparator("Shard placement (" + std::to_string(numa::nodes().size()) + " NUMA nodes)");
+    
+    const std::pair<ShardPlacement, std::string> placements[] = {
+        {ShardPlacement::Local, "local"},
+        {ShardPlacement::Interleaved, "interleaved"},
+    };
+    const size_t passes = 5;
+    
+    for (const auto& placement : placements) {
+        ShardedInMemoryDB db(0, placement.first);
+        
+        // Each owner builds its own shard, so allocation follows the placement policy
+        std::vector<std::vector<std::string>> shardIds(db.shardCount());
+        for (size_t i = 0; i < recordCount; i++) {
+            std::string recordId = "user:" + std::to_string(i);
+            shardIds[db.shardOf(recordId)].push_back(recordId);
+        }
+        for (size_t shard = 0; shard < db.shardCount(); shard++) {
+            db.execute(shard, [&](InMemoryDBImpl& local) {
+                for (const std::string& recordId : shardIds[shard]) {
+                    local.set(recordId, "name", "User " + recordId);
+                    local.set(recordId, "status", "active");
+                }
+            });
+        }
+        
+        // Reads executed by the owners in parallel: measures memory locality
+        std::atomic<size_t> found{0};
+        auto start = BenchClock::now();
+        std::vector<std::thread> clients;
+        for (size_t shard = 0; shard < db.shardCount(); shard++) {
+            clients.emplace_back([&, shard]() {
+                db.execute(shard, [&](InMemoryDBImpl& local) {
+                    size_t hits = 0;
+                    for (size_t pass = 0; pass < passes; pass++) {
+                        for (const std::string& recordId : shardIds[shard]) {
+                            hits += local.get(recordId, "status").has_value();
+                        }
+                    }
+                    found += hits;
+                });
+            });
+        }
+        for (auto& client : clients) {
+            client.join();
+        }
+        printRate("owner gets (" + placement.second + ")", recordCount * passes, elapsedSeconds(start));
+        
+        // Requests routed one by one from a client thread: adds the hand-off to the owner
+        size_t routed = std::min<size_t>(recordCount, 50000);
+        start = BenchClock::now();
+        for (size_t i = 0; i < routed; i++) {
+            db.get("user:" + std::to_string(i), "status");
+        }
+        printRate("routed gets (" + placement.second + ")", routed, elapsedSeconds(start));
+    }
+}
+
+void benchHugePages(size_t recordCount) {
+    printSeparator("Random-read latency vs page backing (" + std::to_string(recordCount) + " records)");
+    
+    const std::pair<HugePageMode, std::string> modes[] = {
+        {HugePageMode::Off, "4 KB pages"},
+        {HugePageMode::Transparent, "transparent huge pages"},
+        {HugePageMode::HugeTLB, "hugetlbfs (or THP fallback)"},
+    };
+    
+    std::vector<std::string> recordIds;
+    for (size_t i = 0; i < recordCount; i++) {
+        recordIds.push_back("user:" + std::to_string(i));
+    }
+    std::shuffle(recordIds.begin(), recordIds.end(), std::mt19937(42));
+    
+    for (const auto& mode : modes) {
+        if (!StorageArena::enable(mode.first)) {
+            std::cout << std::left << std::setw(32) << mode.second << "unavailable" << std::endl;
+            continue;
+        }
+        InMemoryDBImpl db;
+        populate(db, recordCount);
+        
+        size_t hits = 0;
+        auto start = BenchClock::now();
+        for (const std::string& recordId : recordIds) {
+            hits += db.get(recordId, "email").has_value();
+        }
+        double seconds = elapsedSeconds(start);
+        
+        StorageArena::Stats after = StorageArena::stats();
+        std::cout << std::left << std::setw(32) << mode.second << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(9) << (seconds * 1e9 / recordIds.size()) << " ns/get";
+        if (mode.first != HugePageMode::Off) {
+            // Totals: a later mode reuses chunks freed by an earlier one
+            std::cout << "  (arena: " << after.hugeTlbChunks << " hugetlb, " << after.transparentChunks << " THP chunks)";
+        }
+        std::cout << (hits == recordIds.size() ? "" : "  MISSING RECORDS") << std::endl;
+    }
+    StorageArena::enable(HugePageMode::Off);
+}
+
+void benchBatchedLookups(size_t recordCount) {
+    printSeparator("Batched lookups (" + std::to_string(recordCount) + " records, random order)");
+    
+    InMemoryDBImpl db;
+    populate(db, recordCount);
+    
+    std::vector<std::string> recordIds;
+    for (size_t i = 0; i < recordCount; i++) {
+        recordIds.push_back("user:" + std::to_string(i));
+    }
+    std::shuffle(recordIds.begin(), recordIds.end(), std::mt19937(7));
+    
+    size_t hits = 0;
+    auto start = BenchClock::now();
+    for (const std::string& recordId : recordIds) {
+        hits += db.get(recordId, "email").has_value();
+    }
+    printRate("get (one at a time)", recordIds.size(), elapsedSeconds(start));
+    
+    for (size_t batchSize : {32, 256, 4096}) {
+        std::vector<std::vector<std::string>> batches;
+        for (size_t offset = 0; offset < recordIds.size(); offset += batchSize) {
+            batches.emplace_back(recordIds.begin() + offset,
+                                 recordIds.begin() + std::min(offset + batchSize, recordIds.size()));
+        }
+        
+        start = BenchClock::now();
+        for (const auto& batch : batches) {
+            for (const auto& value : db.getMany(batch, "email")) {
+                hits += value.has_value();
+            }
+        }
+        printRate("getMany (batches of " + std::to_string(batchSize) + ")", recordIds.size(), elapsedSeconds(start));
+    }
+    
+    start = BenchClock::now();
+    for (bool present : db.hasRecords(recordIds)) {
+        hits += present;
+    }
+    printRate("hasRecords (one batch)", recordIds.size(), elapsedSeconds(start));
+    
+    if (hits != 5 * recordIds.size()) {
+        std::cout << "  MISSING RECORDS" << std::endl;
+    }
+}
+
+void benchRecordFilter(size_t recordCount) {
+    printSeparator("Negative lookups (" + std::to_string(recordCount) + " records)");
+    
+    InMemoryDBImpl db;
+    populate(db, recordCount);
+    
+    std::vector<std::string> absentIds;
+    for (size_t i = 0; i < recordCount; i++) {
+        absentIds.push_back("ghost:" + std::to_string(i));
+    }
+    
+    for (bool filtered : {false, true}) {
+        if (filtered) {
+            db.enableRecordFilter(0.01);
+        }
+        size_t hits = 0;
+        auto start = BenchClock::now();
+        for (const std::string& recordId : absentIds) {
+            hits += db.hasRecord(recordId);
+        }
+        printRate(filtered ? "hasRecord miss (filter)" : "hasRecord miss (no filter)", absentIds.size(),
+                  elapsedSeconds(start));
+        if (hits != 0) {
+            std::cout << "  UNEXPECTED HITS" << std::endl;
+        }
+    }
+    InMemoryDBImpl::RecordFilterStats stats = db.recordFilterStats();
+    std::cout << "  filter: " << stats.memoryBytes / 1024 << " KB, "
+              << std::setprecision(2) << (100.0 * stats.definiteMisses / absentIds.size())
+              << "% of misses answered by the filter" << std::endl;
+}
+
+void benchTieredStorage(size_t recordCount) {
+    printSeparator("Tiered storage (" + std::to_string(recordCount) + " records, 25% resident)");
+    
+    const std::string tierPath = "bench_db_tier.seg";
+    InMemoryDBImpl db;
+    populate(db, recordCount);
+    db.enableTiering(tierPath, SIZE_MAX);
+    size_t totalBytes = db.tieringStats().residentBytes;
+    db.enableTiering(tierPath, totalBytes / 4);
+    
+    std::vector<std::string> recordIds;
+    for (size_t i = 0; i < recordCount; i++) {
+        recordIds.push_back("user:" + std::to_string(i));
+    }
+    std::mt19937 rng(42);
+    size_t hotCount = recordCount / 5;
+    size_t found = 0;
+    
+    // Hot set: fits under the cap once loaded
+    for (size_t i = 0; i < hotCount; i++) {
+        found += db.get(recordIds[i], "email").has_value();
+    }
+    std::uniform_int_distribution<size_t> hotPick(0, hotCount - 1);
+    auto start = BenchClock::now();
+    for (size_t i = 0; i < recordCount; i++) {
+        found += db.get(recordIds[hotPick(rng)], "email").has_value();
+    }
+    printRate("get (hot, resident)", recordCount, elapsedSeconds(start));
+    
+    std::uniform_int_distribution<size_t> coldPick(hotCount, recordCount - 1);
+    uint64_t readsBefore = db.tieringStats().diskReads;
+    start = BenchClock::now();
+    for (size_t i = 0; i < hotCount; i++) {
+        found += db.get(recordIds[coldPick(rng)], "email").has_value();
+    }
+    printRate("get (cold, random)", hotCount, elapsedSeconds(start));
+    std::cout << "  disk reads: " << db.tieringStats().diskReads - readsBefore << std::endl;
+    
+    // A first pass evicts records in ID order, so the second pass loads them sequentially
+    for (const std::string& recordId : recordIds) {
+        found += db.get(recordId, "email").has_value();
+    }
+    InMemoryDBImpl::TieringStats before = db.tieringStats();
+    start = BenchClock::now();
+    for (const std::string& recordId : recordIds) {
+        found += db.get(recordId, "email").has_value();
+    }
+    printRate("get (cold, sequential)", recordCount, elapsedSeconds(start));
+    InMemoryDBImpl::TieringStats after = db.tieringStats();
+    std::cout << "  readahead hits: " << after.readaheadHits - before.readaheadHits << ", disk reads: "
+              << after.diskReads - before.diskReads << ", segment log: " << after.fileBytes / (1024 * 1024)
+              << " MB, compactions: " << after.compactions << std::endl;
+    
+    if (found != 3 * recordCount + 2 * hotCount) {
+        std::cout << "  UNEXPECTED MISSES" << std::endl;
+    }
+    db.disableTiering();
+}
+
+std::string profileJson(size_t i) {
+    std::string json = "{\"id\":" + std::to_string(i) + ",\"name\":\"User " + std::to_string(i) +
+                       "\",\"plan\":\"" + (i % 3 == 0 ? "premium" : "basic") + "\",\"history\":[";
+    for (size_t j = 0; j < 40; j++) {
+        json += "{\"event\":\"" + std::string(j % 4 == 0 ? "add_to_cart" : "page_view") + "\",\"path\":\"/products/" +
+                std::to_string((i * 7 + j) % 500) + "\",\"timestamp\":" + std::to_string(1700000000 + i * 100 + j) +
+                ",\"device\":\"" + (j % 3 == 0 ? "mobile" : "desktop") + "\"},";
+    }
+    return json + "{}]}";
+}
+
+void benchValueCompression(size_t recordCount) {
+    printSeparator("Value compression (" + std::to_string(recordCount) + " JSON values)");
+    
+    std::vector<std::string> values;
+    uint64_t rawBytes = 0;
+    uint64_t plainLzBytes = 0;
+    std::string compressed;
+    for (size_t i = 0; i < recordCount; i++) {
+        values.push_back(profileJson(i));
+        rawBytes += values.back().size();
+        compressBlock(SnapshotCodec::InTree, values.back(), compressed);
+        plainLzBytes += compressed.size();
+    }
+    
+    for (bool enabled : {false, true}) {
+        InMemoryDBImpl db;
+        if (enabled) {
+            db.enableValueCompression("profile", 1024);
+        }
+        auto start = BenchClock::now();
+        for (size_t i = 0; i < recordCount; i++) {
+            db.set("user:" + std::to_string(i), "profile", values[i]);
+        }
+        printRate(enabled ? "set (compressed)" : "set (plain)", recordCount, elapsedSeconds(start));
+        
+        size_t matches = 0;
+        start = BenchClock::now();
+        for (size_t i = 0; i < recordCount; i++) {
+            matches += db.get("user:" + std::to_string(i), "profile")->size() == values[i].size();
+        }
+        printRate(enabled ? "get (compressed)" : "get (plain)", recordCount, elapsedSeconds(start));
+        if (matches != recordCount) {
+            std::cout << "  UNEXPECTED VALUES" << std::endl;
+        }
+        
+        if (enabled) {
+            InMemoryDBImpl::ValueCompressionStats stats = db.valueCompressionStats("profile");
+            std::cout << "  " << rawBytes / 1024 << " KB raw, " << plainLzBytes / 1024 << " KB without dictionary ("
+                      << std::setprecision(3) << double(rawBytes) / plainLzBytes << "x), " << stats.storedBytes / 1024
+                      << " KB stored with a " << stats.dictionaryBytes / 1024 << " KB dictionary ("
+                      << double(stats.rawBytes) / stats.storedBytes << "x)" << std::endl;
+        }
+    }
+}
+
+void benchValueInterning(size_t recordCount) {
+    printSeparator("Value interning (" + std::to_string(recordCount) + " records)");
+    
+    const std::string plans[] = {"free", "basic-monthly-subscription", "premium-annual-subscription",
+                                 "enterprise-annual-subscription"};
+    uint64_t valueBytes = 0;
+    for (size_t i = 0; i < recordCount; i++) {
+        valueBytes += plans[i % 4].size();
+    }
+    
+    for (bool enabled : {false, true}) {
+        InMemoryDBImpl db;
+        if (enabled) {
+            db.enableValueInterning();
+        }
+        auto start = BenchClock::now();
+        for (size_t i = 0; i < recordCount; i++) {
+            db.set("user:" + std::to_string(i), "plan", plans[i % 4]);
+        }
+        printRate(enabled ? "set (interned)" : "set (plain)", recordCount, elapsedSeconds(start));
+        
+        const int scans = 10;
+        size_t matches = 0;
+        start = BenchClock::now();
+        for (int scan = 0; scan < scans; scan++) {
+            matches += db.getRecordsByFieldValue("plan", plans[1 + scan % 3]).size();
+        }
+        printRate(enabled ? "filter scan (interned)" : "filter scan (plain)", scans * recordCount,
+                  elapsedSeconds(start));
+        if (matches != scans * (recordCount / 4)) {
+            std::cout << "  UNEXPECTED MATCHES" << std::endl;
+        }
+        
+        if (enabled) {
+            InMemoryDBImpl::InternStats stats = db.internStats("plan");
+            std::cout << "  " << valueBytes / 1024 << " KB of values held as " << stats.distinctValues
+                      << " pooled values (" << stats.pooledBytes << " bytes)" << std::endl;
+        }
+    }
+}
+
+/**
+ * Baseline for the thread-per-core engine: shards guarded by a mutex each,
+ * operated on directly by the calling thread
+ */
+class LockShardedDB {
+private:
+    struct Shard {
+        std::mutex mutex;
+        InMemoryDBImpl db;
+    };
+    std::vector<std::unique_ptr<Shard>> shards_;
+    
+    Shard& shardFor(const std::string& recordId) {
+        return *shards_[std::hash<std::string>()(recordId) % shards_.size()];
+    }
+
+public:
+    explicit LockShardedDB(size_t shardCount) {
+        for (size_t i = 0; i < shardCount; i++) {
+            shards_.push_back(std::make_unique<Shard>());
+        }
+    }
+    
+    void set(const std::string& recordId, const std::string& field, const std::string& value) {
+        Shard& shard = shardFor(recordId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.db.set(recordId, field, value);
+    }
+    
+    std::optional<std::string> get(const std::string& recordId, const std::string& field) {
+        Shard& shard = shardFor(recordId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.db.get(recordId, field);
+    }
+};
+
+void benchThreadPerCore(size_t recordCount) {
+    const size_t shardCount = std::max(4u, std::thread::hardware_concurrency());
+    const size_t clientCount = shardCount;
+    const size_t keyCount = std::min<size_t>(recordCount, 100000);
+    const size_t opsPerClient = 50000;
+    const size_t batchSize = 32;
+    printSeparator("Thread-per-core vs lock sharding (" + std::to_string(shardCount) + " shards, " +
+                   std::to_string(clientCount) + " clients)");
+    
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < keyCount; i++) {
+        keys.push_back("user:" + std::to_string(i));
+    }
+    
+    // Zipf(0.99) key choice: a few hot keys (and their shards) take most operations
+    std::vector<double> cdf(keyCount);
+    double total = 0;
+    for (size_t i = 0; i < keyCount; i++) {
+        total += 1.0 / std::pow(static_cast<double>(i + 1), 0.99);
+        cdf[i] = total;
+    }
+    for (bool skewed : {false, true}) {
+        std::vector<std::vector<size_t>> choices(clientCount);
+        std::mt19937_64 rng(42);
+        std::uniform_real_distribution<double> uniform(0.0, total);
+        for (auto& sequence : choices) {
+            for (size_t i = 0; i < opsPerClient; i++) {
+                sequence.push_back(skewed ? std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin()
+                                          : rng() % keyCount);
+            }
+        }
+        std::string label = skewed ? " (zipf)" : " (uniform)";
+        
+        // Every 10th operation is a set, the rest are gets
+        auto runClients = [&](const std::function<void(size_t)>& client) {
+            auto start = BenchClock::now();
+            std::vector<std::thread> clients;
+            for (size_t c = 0; c < clientCount; c++) {
+                clients.emplace_back(client, c);
+            }
+            for (auto& thread : clients) {
+                thread.join();
+            }
+            return elapsedSeconds(start);
+        };
+        const size_t operations = clientCount * opsPerClient;
+        
+        {
+            LockShardedDB db(shardCount);
+            for (const std::string& key : keys) {
+                db.set(key, "status", "active");
+            }
+            printRate("lock-sharded" + label, operations, runClients([&](size_t c) {
+                for (size_t i = 0; i < opsPerClient; i++) {
+                    const std::string& key = keys[choices[c][i]];
+                    if (i % 10 == 0) {
+                        db.set(key, "status", "active");
+                    } else {
+                        db.get(key, "status");
+                    }
+                }
+            }));
+        }
+        {
+            ShardedInMemoryDB db(shardCount, ShardPlacement::None);
+            for (const std::string& key : keys) {
+                db.set(key, "status", "active");
+            }
+            printRate("queue-sharded" + label, operations, runClients([&](size_t c) {
+                for (size_t i = 0; i < opsPerClient; i++) {
+                    const std::string& key = keys[choices[c][i]];
+                    if (i % 10 == 0) {
+                        db.set(key, "status", "active");
+                    } else {
+                        db.get(key, "status");
+                    }
+                }
+            }));
+        }
+        {
+            ThreadPerCoreDB db(shardCount);
+            ThreadPerCoreDB::Batch load(db);
+            for (const std::string& key : keys) {
+                load.set(key, "status", "active");
+            }
+            load.submit();
+            printRate("thread-per-core" + label, operations, runClients([&](size_t c) {
+                for (size_t i = 0; i < opsPerClient; i++) {
+                    const std::string& key = keys[choices[c][i]];
+                    if (i % 10 == 0) {
+                        db.set(key, "status", "active");
+                    } else {
+                        db.get(key, "status");
+                    }
+                }
+            }));
+            printRate("thread-per-core batched" + label, operations, runClients([&](size_t c) {
+                ThreadPerCoreDB::Batch batch(db);
+                for (size_t i = 0; i < opsPerClient; i++) {
+                    const std::string& key = keys[choices[c][i]];
+                    if (i % 10 == 0) {
+                        batch.set(key, "status", "active");
+                    } else {
+                        batch.get(key, "status");
+                    }
+                    if ((i + 1) % batchSize == 0) {
+                        batch.submit();
+                    }
+                }
+                batch.submit();
+            }));
+        }
+    }
+}
+
+void benchFlatCombining() {
+    const size_t threadCount = std::max(8u, std::thread::hardware_concurrency());
+    const size_t opsPerThread = 20000;
+    printSeparator("Hot record writes (" + std::to_string(threadCount) + " threads, one record)");
+    
+    std::vector<std::string> fields;
+    for (size_t t = 0; t < threadCount; t++) {
+        fields.push_back("counter" + std::to_string(t));
+    }
+    auto runWriters = [&](InMemoryDB& db) {
+        auto start = BenchClock::now();
+        std::vector<std::thread> writers;
+        for (size_t t = 0; t < threadCount; t++) {
+            writers.emplace_back([&, t]() {
+                for (size_t i = 0; i < opsPerThread; i++) {
+                    db.set("global", fields[t], "1");
+                }
+            });
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        return elapsedSeconds(start);
+    };
+    const size_t operations = threadCount * opsPerThread;
+    
+    for (bool combining : {false, true}) {
+        CombiningDB db(4, combining);
+        double seconds = runWriters(db);
+        CombiningDB::CombiningStats stats = db.combiningStats();
+        printRate(combining ? "flat combining" : "lock per operation", operations, seconds);
+        std::cout << "  operations per lock acquisition: " << std::fixed << std::setprecision(2)
+                  << static_cast<double>(stats.operations) / std::max<uint64_t>(stats.lockAcquisitions, 1) << std::endl;
+    }
+    ShardedInMemoryDB sharded(4, ShardPlacement::None);
+    printRate("owner thread hand-off", operations, runWriters(sharded));
+}
+
+void benchLazyFree() {
+    const size_t fieldCount = 100000;
+    printSeparator("Deleting a record with " + std::to_string(fieldCount) + " fields");
+    
+    for (bool lazy : {false, true}) {
+        InMemoryDBImpl db;
+        if (lazy) {
+            db.enableLazyFree();
+        }
+        for (size_t i = 0; i < fieldCount; i++) {
+            db.set("huge", "field" + std::to_string(i), "value of field " + std::to_string(i));
+        }
+        
+        auto start = BenchClock::now();
+        db.deleteRecord("huge");
+        double seconds = elapsedSeconds(start);
+        std::cout << std::left << std::setw(32) << (lazy ? "deleteRecord (lazy free)" : "deleteRecord")
+                  << std::fixed << std::setprecision(3) << seconds * 1000 << " ms" << std::endl;
+        if (lazy) {
+            start = BenchClock::now();
+            db.waitForLazyFree();
+            std::cout << std::left << std::setw(32) << "  background free" << std::fixed << std::setprecision(3)
+                      << elapsedSeconds(start) * 1000 << " ms" << std::endl;
+        }
+    }
+}
+
+void benchRecordIndex(size_t recordCount) {
+    printSeparator("Prefix listing (" + std::to_string(recordCount) + " hierarchical IDs)");
+    
+    InMemoryDBImpl db;
+    for (size_t i = 0; i < recordCount; i++) {
+        db.set("tenant:" + std::to_string(i % 100) + ":user:" + std::to_string(i), "name", "u");
+    }
+    const size_t queries = 100;
+    
+    for (bool indexed : {false, true}) {
+        if (indexed) {
+            db.enableRecordIndex();
+        }
+        size_t listed = 0;
+        auto start = BenchClock::now();
+        for (size_t q = 0; q < queries; q++) {
+            listed += db.getRecordIdsByPrefix("tenant:" + std::to_string(q % 100) + ":user:").size();
+        }
+        double seconds = elapsedSeconds(start);
+        std::cout << std::left << std::setw(32) << (indexed ? "getRecordIdsByPrefix (index)" : "getRecordIdsByPrefix (scan)")
+                  << std::fixed << std::setprecision(3) << seconds * 1000 / queries << " ms per query" << std::endl;
+        if (listed != recordCount) {
+            std::cout << "  unexpected listing size " << listed << std::endl;
+        }
+    }
+    
+    InMemoryDBImpl::RecordIndexStats stats = db.recordIndexStats();
+    std::cout << "  index: " << stats.nodes << " nodes, " << stats.labelBytes / 1024 << " KB of labels for "
+              << stats.keyBytes / 1024 << " KB of IDs, " << stats.memoryBytes / 1024 << " KB in total" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t recordCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    
+    printSeparator("In-Memory Database Benchmarks");
+    
+    benchRestore(recordCount);
+    benchSnapshotCodecs(recordCount);
+    benchRecovery(recordCount);
+    benchNumaPlacement(recordCount);
+    benchHugePages(recordCount);
+    benchBatchedLookups(recordCount);
+    benchRecordFilter(recordCount);
+    benchTieredStorage(recordCount);
+    benchValueCompression(recordCount / 10);
+    benchValueInterning(recordCount);
+    benchThreadPerCore(recordCount);
+    benchFlatCombining();
+    benchLazyFree();
+    benchRecordIndex(recordCount);
+    
+    return 0;
+}
@@ -32,7 +32,7 @@ mkdir -p build
 
 # Compile the test program
 echo -e "${BLUE}Compiling...${NC}"
-g++ -std=c++17 -Wall -Wextra -O2 -I. test_db.cpp src/in_memory_db_imp.cpp -o build/test_db
+g++ -std=c++17 -Wall -Wextra -O2 -I. -pthread test_db.cpp src/in_memory_db_imp.cpp src/snapshot_codec.cpp src/append_log.cpp src/change_stream.cpp src/replication.cpp src/numa_util.cpp src/read_replicas.cpp src/sharded_db.cpp src/storage_arena.cpp src/record_filter.cpp src/tier_store.cpp src/intern_pool.cpp src/field_map.cpp src/collection.cpp src/sketch.cpp src/async_db.cpp src/thread_per_core_db.cpp src/combining_db.cpp src/lazy_free.cpp src/radix_index.cpp -o build/test_db
 
 if [ $? -ne 0 ]; then
     echo -e "${RED}Compilation failed!${NC}"
@@ -0,0 +1,390 @@
+#include "append_log.hpp"
+#include "snapshot_codec.hpp"
+#include <fstream>
+#include <iterator>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// Frame layout (little-endian): PAYLOAD_SIZE(u32) CRC32(u32) PAYLOAD
+// Payload: SEQ(u64) OP(u8) RECORD_ID FIELD VALUE EXPIRES_AT_MS(i64)
+// Strings are stored as LENGTH(u32) followed by the raw bytes.
+const size_t FRAME_HEADER_SIZE = 8;
+const size_t WRITE_BATCH_BYTES = 64 * 1024;
+
+void putInt(std::string& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+void putString(std::string& out, const std::string& value) {
+    putInt(out, value.size(), 4);
+    out.append(value);
+}
+
+bool getInt(const char* data, size_t size, size_t& pos, uint64_t& value, int bytes) {
+    if (size - pos < static_cast<size_t>(bytes)) return false;
+    value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(data[pos + i])) << (8 * i);
+    }
+    pos += bytes;
+    return true;
+}
+
+bool getString(const char* data, size_t size, size_t& pos, std::string& value) {
+    uint64_t length;
+    if (!getInt(data, size, pos, length, 4) || size - pos < length) return false;
+    value.assign(data + pos, length);
+    pos += length;
+    return true;
+}
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+void syncDirectoryOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int dirFd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        ::fsync(dirFd);
+        ::close(dirFd);
+    }
+}
+
+} // namespace
+
+void encodeLogEntry(const LogEntry& entry, std::string& out) {
+    std::string payload;
+    payload.reserve(32 + entry.recordId.size() + entry.field.size() + entry.value.size());
+    putInt(payload, entry.seq, 8);
+    putInt(payload, static_cast<uint8_t>(entry.op), 1);
+    putString(payload, entry.recordId);
+    putString(payload, entry.field);
+    putString(payload, entry.value);
+    putInt(payload, static_cast<uint64_t>(entry.expiresAtMs), 8);
+    
+    putInt(out, payload.size(), 4);
+    putInt(out, blockChecksum(payload.data(), payload.size()), 4);
+    out.append(payload);
+}
+
+size_t decodeLogEntry(const char* data, size_t size, LogEntry& entry) {
+    size_t pos = 0;
+    uint64_t payloadSize;
+    uint64_t checksum;
+    if (!getInt(data, size, pos, payloadSize, 4) || !getInt(data, size, pos, checksum, 4)) return 0;
+    if (size - pos < payloadSize) return 0;
+    
+    const char* payload = data + pos;
+    if (blockChecksum(payload, payloadSize) != checksum) return 0;
+    
+    size_t p = 0;
+    uint64_t seq;
+    uint64_t op;
+    uint64_t expiresAtMs;
+    if (!getInt(payload, payloadSize, p, seq, 8) || !getInt(payload, payloadSize, p, op, 1) ||
+        !getString(payload, payloadSize, p, entry.recordId) || !getString(payload, payloadSize, p, entry.field) ||
+        !getString(payload, payloadSize, p, entry.value) || !getInt(payload, payloadSize, p, expiresAtMs, 8) ||
+        p != payloadSize || op < static_cast<uint8_t>(LogOp::Set) || op > static_cast<uint8_t>(LogOp::Collection)) {
+        return 0;
+    }
+    
+    entry.seq = seq;
+    entry.op = static_cast<LogOp>(op);
+    entry.expiresAtMs = static_cast<int64_t>(expiresAtMs);
+    return FRAME_HEADER_SIZE + payloadSize;
+}
+
+bool replayLogFile(const std::string& path, const std::function<void(const LogEntry&)>& apply, uint64_t* validBytes,
+                   uint64_t afterSeq) {
+    if (validBytes) *validBytes = 0;
+    
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return ::access(path.c_str(), F_OK) != 0; // Missing file: empty log
+    }
+    
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (file.bad()) {
+        return false;
+    }
+    
+    size_t pos = 0;
+    LogEntry entry;
+    while (pos < data.size()) {
+        // Fast path: entries already covered by a checkpoint are checksummed
+        // but not decoded. A frame failing the checksum falls through to the
+        // slow path, which ends the valid log there, so a corrupt covered
+        // frame is truncated away rather than kept for a later full replay
+        size_t headerPos = pos;
+        uint64_t payloadSize;
+        uint64_t checksum;
+        uint64_t seq;
+        if (afterSeq > 0 && getInt(data.data(), data.size(), headerPos, payloadSize, 4) &&
+            getInt(data.data(), data.size(), headerPos, checksum, 4) && payloadSize >= 8 &&
+            data.size() - headerPos >= payloadSize &&
+            blockChecksum(data.data() + headerPos, payloadSize) == checksum &&
+            getInt(data.data(), data.size(), headerPos, seq, 8) && seq <= afterSeq) {
+            pos += FRAME_HEADER_SIZE + payloadSize;
+            continue;
+        }
+        
+        size_t consumed = decodeLogEntry(data.data() + pos, data.size() - pos, entry);
+        if (consumed == 0) {
+            break; // Torn or corrupt tail
+        }
+        if (apply && entry.seq > afterSeq) {
+            apply(entry);
+        }
+        pos += consumed;
+    }
+    
+    if (validBytes) *validBytes = pos;
+    return true;
+}
+
+bool writeFileAtomically(const std::string& path, const std::string& data) {
+    std::string tempPath = path + ".tmp";
+    int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    
+    bool ok = writeAll(fd, data.data(), data.size()) && ::fsync(fd) == 0;
+    ::close(fd);
+    
+    if (!ok || ::rename(tempPath.c_str(), path.c_str()) != 0) {
+        ::unlink(tempPath.c_str());
+        return false;
+    }
+    
+    syncDirectoryOf(path);
+    return true;
+}
+
+AppendLog::~AppendLog() {
+    waitForRewrite();
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ >= 0) {
+        writePending();
+        ::fsync(fd_);
+        ::close(fd_);
+    }
+}
+
+bool AppendLog::open(const std::string& path, bool syncEveryWrite,
+                     const std::function<void(const LogEntry&)>& replay, uint64_t afterSeq) {
+    waitForRewrite();
+    
+    uint64_t validBytes = 0;
+    if (!replayLogFile(path, replay, &validBytes, afterSeq)) {
+        return false;
+    }
+    
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    
+    // Drop a torn tail so new entries follow the last valid one
+    if (::ftruncate(fd, static_cast<off_t>(validBytes)) != 0) {
+        ::close(fd);
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ >= 0) {
+        writePending();
+        ::close(fd_);
+    }
+    
+    path_ = path;
+    fd_ = fd;
+    syncEveryWrite_ = syncEveryWrite;
+    pending_.clear();
+    fileSize_ = validBytes;
+    sizeAfterRewrite_ = validBytes;
+    return true;
+}
+
+bool AppendLog::writePending() {
+    if (pending_.empty()) {
+        return true;
+    }
+    if (fd_ < 0 || !writeAll(fd_, pending_.data(), pending_.size())) {
+        return false;
+    }
+    pending_.clear();
+    return true;
+}
+
+void AppendLog::append(const LogEntry& entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    size_t before = pending_.size();
+    encodeLogEntry(entry, pending_);
+    fileSize_ += pending_.size() - before;
+    
+    if (rewriting_) {
+        rewriteBuffer_.append(pending_, before, std::string::npos);
+    }
+    
+    if (syncEveryWrite_) {
+        if (writePending()) {
+            ::fsync(fd_);
+        }
+    } else if (pending_.size() >= WRITE_BATCH_BYTES) {
+        writePending();
+    }
+}
+
+bool AppendLog::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return writePending() && fd_ >= 0 && ::fsync(fd_) == 0;
+}
+
+bool AppendLog::beginRewrite() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (rewriting_ || fd_ < 0) {
+        return false;
+    }
+    if (rewriteThread_.joinable()) {
+        rewriteThread_.join(); // Previous rewrite has finished
+    }
+    
+    rewriting_ = true;
+    rewriteBuffer_.clear();
+    rewriteBase_.clear();
+    rewriteBaseEnded_ = false;
+    rewriteAbandoned_ = false;
+    rewriteThread_ = std::thread(&AppendLog::rewriteWorker, this);
+    return true;
+}
+
+void AppendLog::appendRewriteBase(std::string entries) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!rewriting_ || rewriteBaseEnded_ || entries.empty()) {
+            return;
+        }
+        rewriteBase_.push_back(std::move(entries));
+    }
+    rewriteCondition_.notify_one();
+}
+
+void AppendLog::endRewriteBase() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rewriteBaseEnded_ = true;
+    }
+    rewriteCondition_.notify_one();
+}
+
+void AppendLog::rewriteWorker() {
+    std::string tempPath;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tempPath = path_ + ".rewrite";
+    }
+    int tempFd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = tempFd >= 0;
+    uint64_t baseBytes = 0;
+    
+    // The bulk of the work happens without the lock, while appends continue
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        rewriteCondition_.wait(lock, [this]() {
+            return !rewriteBase_.empty() || rewriteBaseEnded_ || rewriteAbandoned_;
+        });
+        if (rewriteAbandoned_ || (rewriteBase_.empty() && rewriteBaseEnded_)) {
+            break;
+        }
+        std::string entries = std::move(rewriteBase_.front());
+        rewriteBase_.pop_front();
+        lock.unlock();
+        ok = ok && writeAll(tempFd, entries.data(), entries.size());
+        baseBytes += entries.size();
+        lock.lock();
+    }
+    lock.unlock();
+    ok = ok && !rewriteAbandoned_ && ::fsync(tempFd) == 0;
+    lock.lock();
+    
+    // Entries appended during the rewrite (including unwritten pending_ ones)
+    // go to the new file; then it atomically replaces the old one
+    ok = ok && !rewriteAbandoned_ && writeAll(tempFd, rewriteBuffer_.data(), rewriteBuffer_.size()) &&
+         ::fsync(tempFd) == 0 && ::rename(tempPath.c_str(), path_.c_str()) == 0;
+    
+    if (ok) {
+        syncDirectoryOf(path_);
+        ::close(fd_);
+        fd_ = tempFd;
+        pending_.clear();
+        fileSize_ = baseBytes + rewriteBuffer_.size();
+        sizeAfterRewrite_ = fileSize_;
+    } else {
+        if (tempFd >= 0) {
+            ::close(tempFd);
+        }
+        ::unlink(tempPath.c_str());
+    }
+    
+    rewriting_ = false;
+    rewriteBase_.clear();
+    rewriteBuffer_.clear();
+    rewriteBuffer_.shrink_to_fit();
+}
+
+bool AppendLog::isRewriting() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rewriting_;
+}
+
+void AppendLog::waitForRewrite() {
+    std::thread finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (rewriting_ && !rewriteBaseEnded_) {
+            rewriteAbandoned_ = true; // Nobody is left to finish the base
+        }
+        finished.swap(rewriteThread_);
+    }
+    rewriteCondition_.notify_one();
+    if (finished.joinable()) {
+        finished.join();
+    }
+}
+
+uint64_t AppendLog::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fileSize_;
+}
+
+uint64_t AppendLog::sizeAfterRewrite() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sizeAfterRewrite_;
+}
+
+bool AppendLog::needsRewrite(int growthPercent, uint64_t minBytes) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (rewriting_ || fileSize_ < minBytes) {
+        return false;
+    }
+    return fileSize_ >= sizeAfterRewrite_ + sizeAfterRewrite_ * static_cast<uint64_t>(growthPercent) / 100;
+}
@@ -0,0 +1,199 @@
+#ifndef APPEND_LOG_HPP
+#define APPEND_LOG_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+/**
+ * Mutation types recorded in the append-only log
+ */
+enum class LogOp : uint8_t {
+    Set = 1,
+    DeleteField = 2,
+    DeleteRecord = 3,
+    SetTTL = 4,
+    Clear = 5,
+    Expire = 6,     // Record removed because its TTL passed
+    Collection = 7  // In-place collection update; value holds the encoded command
+};
+
+/**
+ * A single logged mutation
+ */
+struct LogEntry {
+    uint64_t seq = 0;            // Mutation sequence number, increasing through the log
+    LogOp op = LogOp::Set;
+    std::string recordId;
+    std::string field;           // Set, DeleteField
+    std::string value;           // Set, Collection
+    int64_t expiresAtMs = 0;     // SetTTL: wall-clock expiry in milliseconds since the Unix epoch
+};
+
+/**
+ * Append a framed, checksummed encoding of an entry to a buffer
+ * @param entry Entry to encode
+ * @param out Buffer to append to
+ */
+void encodeLogEntry(const LogEntry& entry, std::string& out);
+
+/**
+ * Decode one framed entry
+ * @param data Start of the frame
+ * @param size Bytes available
+ * @param entry Receives the decoded entry
+ * @return Number of bytes consumed, or 0 if the frame is truncated or corrupt
+ */
+size_t decodeLogEntry(const char* data, size_t size, LogEntry& entry);
+
+/**
+ * Read every valid entry of a log file, stopping at a torn or corrupt tail
+ * @param path Log file path
+ * @param apply Called for each entry in order
+ * @param validBytes Receives the length of the valid prefix (may be nullptr)
+ * @param afterSeq Only entries with a sequence number above this are applied
+ * @return false if the file exists but cannot be read; a missing file is an empty log
+ */
+bool replayLogFile(const std::string& path, const std::function<void(const LogEntry&)>& apply,
+                   uint64_t* validBytes = nullptr, uint64_t afterSeq = 0);
+
+/**
+ * Replace a file's contents atomically (temporary file, fsync, rename)
+ * @param path File path
+ * @param data New contents
+ * @return true if the file was replaced
+ */
+bool writeFileAtomically(const std::string& path, const std::string& data);
+
+/**
+ * Append-only operation log with background rewrite
+ *
+ * Entries are buffered and written in batches (or on every append when
+ * syncEveryWrite is set). A rewrite writes a minimal log to a temporary
+ * file on a background thread. The caller streams the base entries,
+ * describing the state when the rewrite began, in chunks; entries appended
+ * meanwhile are buffered and added to the new file after the base, and the
+ * new file then atomically replaces the old one.
+ */
+class AppendLog {
+private:
+    mutable std::mutex mutex_;
+    std::string path_;
+    int fd_ = -1;
+    bool syncEveryWrite_ = false;
+    
+    // Encoded entries not yet written to fd_
+    std::string pending_;
+    uint64_t fileSize_ = 0;
+    uint64_t sizeAfterRewrite_ = 0;
+    
+    // Entries appended while a rewrite is in progress
+    bool rewriting_ = false;
+    std::string rewriteBuffer_;
+    std::thread rewriteThread_;
+    
+    // Base entries handed over but not yet written by the rewrite thread
+    std::deque<std::string> rewriteBase_;
+    bool rewriteBaseEnded_ = false;
+    bool rewriteAbandoned_ = false;
+    std::condition_variable rewriteCondition_;
+    
+    /**
+     * Helper function to write pending entries (caller holds mutex_)
+     * @return true if everything was written
+     */
+    bool writePending();
+    
+    /**
+     * Background rewrite body: write the base entries as they arrive, then switch files
+     */
+    void rewriteWorker();
+
+public:
+    AppendLog() = default;
+    ~AppendLog();
+    
+    AppendLog(const AppendLog&) = delete;
+    AppendLog& operator=(const AppendLog&) = delete;
+    
+    /**
+     * Open a log for appending, truncating any torn tail left by a crash
+     * @param path Log file path (created if missing)
+     * @param syncEveryWrite Write and fsync on every append instead of batching
+     * @param replay Called for each valid entry already in the log (may be empty)
+     * @param afterSeq Only entries with a sequence number above this are replayed
+     * @return true if the log was opened
+     */
+    bool open(const std::string& path, bool syncEveryWrite,
+              const std::function<void(const LogEntry&)>& replay = nullptr, uint64_t afterSeq = 0);
+    
+    /**
+     * Append an entry
+     * @param entry Entry to append
+     */
+    void append(const LogEntry& entry);
+    
+    /**
+     * Write buffered entries and fsync the file
+     * @return true if the data reached the file
+     */
+    bool flush();
+    
+    /**
+     * Start a background rewrite; its base entries follow through appendRewriteBase()
+     * @return false if a rewrite is already running or the log is not open
+     */
+    bool beginRewrite();
+    
+    /**
+     * Hand encoded base entries to the running rewrite
+     * @param entries Encoded entries, in log order
+     */
+    void appendRewriteBase(std::string entries);
+    
+    /**
+     * Mark the base as complete; the rewrite then switches files in the background
+     */
+    void endRewriteBase();
+    
+    /**
+     * Check if a rewrite is in progress
+     */
+    bool isRewriting() const;
+    
+    /**
+     * Block until the running rewrite (if any) has switched files; a rewrite whose
+     * base was not ended is abandoned and the current file kept
+     */
+    void waitForRewrite();
+    
+    /**
+     * Current log size in bytes, including buffered entries
+     */
+    uint64_t size() const;
+    
+    /**
+     * Log size in bytes right after the last rewrite (or open)
+     */
+    uint64_t sizeAfterRewrite() const;
+    
+    /**
+     * Check if the log has grown enough since the last rewrite to warrant another one
+     * @param growthPercent Required growth over the post-rewrite size, in percent
+     * @param minBytes Minimum log size before a rewrite is worthwhile
+     * @return true if no rewrite is running and both thresholds are exceeded
+     */
+    bool needsRewrite(int growthPercent, uint64_t minBytes) const;
+    
+    /**
+     * Log file path
+     */
+    const std::string& path() const { return path_; }
+};
+
+#endif // APPEND_LOG_HPP
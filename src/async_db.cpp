@@ -0,0 +1,116 @@
+#include "async_db.hpp"
+#include <atomic>
+
+void inlineExecutor(std::function<void()> completion) {
+    completion();
+}
+
+Executor CompletionQueue::executor() {
+    return [this](std::function<void()> completion) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back(std::move(completion));
+        }
+        ready_.notify_one();
+    };
+}
+
+size_t CompletionQueue::runPending() {
+    std::deque<std::function<void()>> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batch.swap(pending_);
+    }
+    
+    // Completions may queue more (a resumed coroutine starting new operations); those wait for the next call
+    for (auto& completion : batch) {
+        completion();
+    }
+    return batch.size();
+}
+
+size_t CompletionQueue::waitAndRun(std::chrono::milliseconds timeout) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!ready_.wait_for(lock, timeout, [this]() { return !pending_.empty(); })) {
+            return 0;
+        }
+    }
+    return runPending();
+}
+
+AsyncInMemoryDB::AsyncInMemoryDB(ShardedInMemoryDB& db, Executor executor)
+    : db_(db), executor_(std::move(executor)) {}
+
+template <typename T>
+AsyncResult<T> AsyncInMemoryDB::dispatch(const std::string& recordId, std::function<T(InMemoryDBImpl&)> operation) {
+    AsyncResult<T> result(executor_);
+    db_.post(db_.shardOf(recordId), [result, operation = std::move(operation)](InMemoryDBImpl& db) {
+        result.complete(operation(db));
+    });
+    return result;
+}
+
+AsyncResult<bool> AsyncInMemoryDB::asyncSet(const std::string& recordId, const std::string& field,
+                                            const std::string& value) {
+    return dispatch<bool>(recordId, [recordId, field, value](InMemoryDBImpl& db) {
+        db.set(recordId, field, value);
+        return true;
+    });
+}
+
+AsyncResult<std::optional<std::string>> AsyncInMemoryDB::asyncGet(const std::string& recordId,
+                                                                  const std::string& field) {
+    return dispatch<std::optional<std::string>>(recordId, [recordId, field](InMemoryDBImpl& db) {
+        return db.get(recordId, field);
+    });
+}
+
+AsyncResult<bool> AsyncInMemoryDB::asyncDeleteField(const std::string& recordId, const std::string& field) {
+    return dispatch<bool>(recordId, [recordId, field](InMemoryDBImpl& db) { return db.deleteField(recordId, field); });
+}
+
+AsyncResult<bool> AsyncInMemoryDB::asyncDeleteRecord(const std::string& recordId) {
+    return dispatch<bool>(recordId, [recordId](InMemoryDBImpl& db) { return db.deleteRecord(recordId); });
+}
+
+AsyncResult<std::vector<std::string>> AsyncInMemoryDB::asyncGetFields(const std::string& recordId) {
+    return dispatch<std::vector<std::string>>(recordId, [recordId](InMemoryDBImpl& db) {
+        return db.getFields(recordId);
+    });
+}
+
+AsyncResult<bool> AsyncInMemoryDB::asyncHasRecord(const std::string& recordId) {
+    return dispatch<bool>(recordId, [recordId](InMemoryDBImpl& db) { return db.hasRecord(recordId); });
+}
+
+AsyncResult<bool> AsyncInMemoryDB::asyncSetTTL(const std::string& recordId, int ttlSeconds) {
+    return dispatch<bool>(recordId, [recordId, ttlSeconds](InMemoryDBImpl& db) {
+        db.setTTL(recordId, ttlSeconds);
+        return true;
+    });
+}
+
+AsyncResult<std::string> AsyncInMemoryDB::asyncBackup() {
+    struct Gather {
+        std::vector<std::string> parts;
+        std::atomic<size_t> remaining;
+    };
+    
+    AsyncResult<std::string> result(executor_);
+    size_t shardCount = db_.shardCount();
+    auto gather = std::make_shared<Gather>();
+    gather->parts.resize(shardCount);
+    gather->remaining = shardCount;
+    
+    // Each shard fills its own slot; the last one to finish merges on its thread
+    for (size_t shard = 0; shard < shardCount; shard++) {
+        db_.post(shard, [result, gather, shard](InMemoryDBImpl& db) {
+            gather->parts[shard] = db.backup();
+            if (gather->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                result.complete(ShardedInMemoryDB::mergeBackups(gather->parts));
+            }
+        });
+    }
+    return result;
+}
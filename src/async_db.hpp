@@ -0,0 +1,212 @@
+#ifndef ASYNC_DB_HPP
+#define ASYNC_DB_HPP
+
+#include "sharded_db.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <utility>
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define IMDB_HAS_COROUTINES 1
+#endif
+
+/**
+ * Runs the completions of asynchronous operations; an executor decides on
+ * which thread a caller's continuation (callback or resumed coroutine) runs
+ */
+using Executor = std::function<void(std::function<void()>)>;
+
+/**
+ * Executor running completions right away on the shard thread that finished the operation
+ *
+ * Only for continuations that do not block: one that makes a blocking
+ * ShardedInMemoryDB call to the shard it runs on waits on its own queue
+ * forever. Continuations that call back into the database need an executor
+ * running on the caller's thread, such as a CompletionQueue.
+ */
+void inlineExecutor(std::function<void()> completion);
+
+/**
+ * Executor for an event loop: completions are queued and run by whichever
+ * thread calls runPending or waitAndRun, typically the loop's own thread
+ */
+class CompletionQueue {
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::function<void()>> pending_;
+
+public:
+    /**
+     * Get an executor queuing completions here; the queue must outlive the operations using it
+     */
+    Executor executor();
+    
+    /**
+     * Run every queued completion on the calling thread
+     * @return Number of completions run
+     */
+    size_t runPending();
+    
+    /**
+     * Wait until a completion is queued, then run every queued completion
+     * @param timeout Longest time to wait
+     * @return Number of completions run (0 on timeout)
+     */
+    size_t waitAndRun(std::chrono::milliseconds timeout);
+};
+
+/**
+ * Result of an asynchronous database operation
+ *
+ * Copies share one result, which has a single consumer: take it with get,
+ * then, or (in C++20) co_await. Continuations run on the executor the
+ * operation was started with.
+ */
+template <typename T>
+class AsyncResult {
+private:
+    struct State {
+        std::mutex mutex;
+        std::condition_variable done;
+        std::optional<T> value;
+        std::function<void()> continuation;
+        Executor executor;
+    };
+    
+    std::shared_ptr<State> state_;
+    
+    explicit AsyncResult(Executor executor) : state_(std::make_shared<State>()) {
+        state_->executor = std::move(executor);
+    }
+    
+    /**
+     * Store the result and hand the waiting continuation to the executor
+     */
+    void complete(T value) const {
+        std::function<void()> continuation;
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            state_->value = std::move(value);
+            continuation = std::move(state_->continuation);
+        }
+        state_->done.notify_all();
+        if (continuation) {
+            state_->executor(std::move(continuation));
+        }
+    }
+    
+    /**
+     * Register a continuation to run on the executor once the result is set
+     * @return false (and nothing registered) if the result is already set
+     */
+    bool setContinuation(std::function<void()> continuation) const {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (state_->value) {
+            return false;
+        }
+        state_->continuation = std::move(continuation);
+        return true;
+    }
+    
+    friend class AsyncInMemoryDB;
+
+public:
+    bool ready() const {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->value.has_value();
+    }
+    
+    /**
+     * Block until the operation finished and take its result
+     */
+    T get() {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->done.wait(lock, [this]() { return state_->value.has_value(); });
+        return std::move(*state_->value);
+    }
+    
+    /**
+     * Take the result in a callback run on the executor once the operation finished
+     */
+    void then(std::function<void(T)> callback) {
+        std::shared_ptr<State> state = state_;
+        auto deliver = [state, callback = std::move(callback)]() { callback(std::move(*state->value)); };
+        if (!setContinuation(deliver)) {
+            state_->executor(std::move(deliver));
+        }
+    }
+
+#ifdef IMDB_HAS_COROUTINES
+    bool await_ready() const { return ready(); }
+    
+    bool await_suspend(std::coroutine_handle<> waiting) const {
+        return setContinuation([waiting]() { waiting.resume(); });
+    }
+    
+    T await_resume() {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return std::move(*state_->value);
+    }
+#endif
+};
+
+/**
+ * Asynchronous facade over a ShardedInMemoryDB
+ *
+ * Every operation is posted to the owner thread of the record's shard and
+ * returns at once, so a caller can keep many operations in flight and
+ * never blocks on a shard or on its append log. Operations on one record
+ * run in the order they were issued. Results are delivered through the
+ * executor given at construction; with a CompletionQueue, a coroutine
+ * awaiting a result is resumed on the thread running the queue.
+ */
+class AsyncInMemoryDB {
+private:
+    ShardedInMemoryDB& db_;
+    Executor executor_;
+    
+    /**
+     * Run an operation on a record's shard and complete its result there
+     */
+    template <typename T>
+    AsyncResult<T> dispatch(const std::string& recordId, std::function<T(InMemoryDBImpl&)> operation);
+
+public:
+    /**
+     * @param db Database to operate on; must outlive the facade and its pending operations
+     * @param executor Runs the continuations of every operation, e.g. CompletionQueue::executor()
+     *                 to resume callers on their own thread
+     */
+    AsyncInMemoryDB(ShardedInMemoryDB& db, Executor executor);
+    
+    /**
+     * Set a field; the result is true once the write is applied
+     */
+    AsyncResult<bool> asyncSet(const std::string& recordId, const std::string& field, const std::string& value);
+    AsyncResult<std::optional<std::string>> asyncGet(const std::string& recordId, const std::string& field);
+    AsyncResult<bool> asyncDeleteField(const std::string& recordId, const std::string& field);
+    AsyncResult<bool> asyncDeleteRecord(const std::string& recordId);
+    AsyncResult<std::vector<std::string>> asyncGetFields(const std::string& recordId);
+    AsyncResult<bool> asyncHasRecord(const std::string& recordId);
+    
+    /**
+     * Set a record's TTL; the result is true once it is applied
+     */
+    AsyncResult<bool> asyncSetTTL(const std::string& recordId, int ttlSeconds);
+    
+    /**
+     * Back up every shard in parallel; the result completes with the merged
+     * backup when the last shard finishes
+     */
+    AsyncResult<std::string> asyncBackup();
+};
+
+#endif // ASYNC_DB_HPP
@@ -0,0 +1,62 @@
+#include "change_stream.hpp"
+#include <algorithm>
+
+ChangeStream::ChangeStream(size_t capacity) : slots_(std::max<size_t>(capacity, 1)) {
+}
+
+uint64_t ChangeStream::publish(LogEntry event) {
+    uint64_t seq = head_.load(std::memory_order_relaxed) + 1;
+    event.seq = seq;
+    
+    // Publish the slot before advancing head_, so readers that see the new
+    // head always find the event (or a newer one, if they are too slow)
+    std::atomic_store(&slots_[seq % slots_.size()], std::make_shared<const LogEntry>(std::move(event)));
+    head_.store(seq);
+    
+    if (waiters_.load() > 0) {
+        std::lock_guard<std::mutex> lock(waitMutex_);
+        waitCondition_.notify_all();
+    }
+    return seq;
+}
+
+uint64_t ChangeStream::headSeq() const {
+    return head_.load(std::memory_order_acquire);
+}
+
+uint64_t ChangeStream::oldestSeq() const {
+    uint64_t head = headSeq();
+    return head > slots_.size() ? head - slots_.size() + 1 : 1;
+}
+
+size_t ChangeStream::capacity() const {
+    return slots_.size();
+}
+
+bool ChangeStream::read(uint64_t& cursor, std::vector<LogEntry>& out, size_t maxEvents) const {
+    uint64_t head = headSeq();
+    
+    for (uint64_t seq = cursor + 1; seq <= head && maxEvents > 0; seq++, maxEvents--) {
+        std::shared_ptr<const LogEntry> event = std::atomic_load(&slots_[seq % slots_.size()]);
+        if (!event || event->seq != seq) {
+            cursor = oldestSeq() - 1; // Overwritten by the writer: events were lost
+            return false;
+        }
+        out.push_back(*event);
+        cursor = seq;
+    }
+    
+    return true;
+}
+
+bool ChangeStream::waitForEvents(uint64_t cursor, std::chrono::milliseconds timeout) {
+    if (headSeq() > cursor) {
+        return true;
+    }
+    
+    std::unique_lock<std::mutex> lock(waitMutex_);
+    waiters_++;
+    bool available = waitCondition_.wait_for(lock, timeout, [&]() { return headSeq() > cursor; });
+    waiters_--;
+    return available;
+}
@@ -0,0 +1,86 @@
+#ifndef CHANGE_STREAM_HPP
+#define CHANGE_STREAM_HPP
+
+#include "append_log.hpp"
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+/**
+ * Bounded in-memory stream of mutation events (change data capture)
+ *
+ * A single writer publishes events into a ring buffer, numbering them with
+ * consecutive sequence numbers starting at 1. Any number of readers consume
+ * at their own pace by keeping their own cursor (the last sequence number
+ * they processed). Writers never wait for readers: a reader that falls more
+ * than capacity() events behind loses the overwritten events and is told so.
+ *
+ * Events use the log entry layout; seq is the stream sequence number.
+ * A Clear event means the whole dataset was replaced (restore) and readers
+ * must resynchronize from a snapshot.
+ */
+class ChangeStream {
+private:
+    // Each slot holds the most recent event whose seq maps to it
+    std::vector<std::shared_ptr<const LogEntry>> slots_;
+    
+    // Sequence number of the latest published event (0 = none yet)
+    std::atomic<uint64_t> head_{0};
+    
+    // Readers blocked in waitForEvents()
+    std::mutex waitMutex_;
+    std::condition_variable waitCondition_;
+    std::atomic<int> waiters_{0};
+
+public:
+    /**
+     * Constructor
+     * @param capacity Number of events retained for slow readers
+     */
+    explicit ChangeStream(size_t capacity);
+    
+    /**
+     * Publish an event (single writer)
+     * @param event Event to publish; its seq is overwritten
+     * @return Sequence number assigned to the event
+     */
+    uint64_t publish(LogEntry event);
+    
+    /**
+     * Sequence number of the latest event (0 if none)
+     */
+    uint64_t headSeq() const;
+    
+    /**
+     * Sequence number of the oldest event still retained
+     */
+    uint64_t oldestSeq() const;
+    
+    /**
+     * Number of events retained
+     */
+    size_t capacity() const;
+    
+    /**
+     * Read events after a cursor
+     * @param cursor Last sequence number processed by the reader; advanced past the events read
+     * @param out Receives the events, in order
+     * @param maxEvents Maximum number of events to read
+     * @return false if events after the cursor were already overwritten; the cursor is then
+     *         moved to just before the oldest retained event and the reader must resynchronize
+     */
+    bool read(uint64_t& cursor, std::vector<LogEntry>& out, size_t maxEvents = 1024) const;
+    
+    /**
+     * Block until an event after the cursor is published or the timeout expires
+     * @param cursor Last sequence number processed by the reader
+     * @param timeout Maximum time to wait
+     * @return true if events after the cursor are available
+     */
+    bool waitForEvents(uint64_t cursor, std::chrono::milliseconds timeout);
+};
+
+#endif // CHANGE_STREAM_HPP
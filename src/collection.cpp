@@ -0,0 +1,351 @@
+#include "collection.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+inline bool precedes(double score, const std::string& member, double otherScore, const std::string& otherMember) {
+    return score < otherScore || (score == otherScore && member < otherMember);
+}
+
+void appendMember(std::string& out, const std::string& member) {
+    out += std::to_string(member.size());
+    out += ':';
+    out += member;
+}
+
+bool readMember(const std::string& data, size_t& pos, std::string& member) {
+    size_t length = 0;
+    auto parsed = std::from_chars(data.data() + pos, data.data() + data.size(), length);
+    if (parsed.ec != std::errc() || parsed.ptr == data.data() + data.size() || *parsed.ptr != ':') {
+        return false;
+    }
+    pos = parsed.ptr - data.data() + 1;
+    if (length > data.size() - pos) {
+        return false;
+    }
+    member.assign(data, pos, length);
+    pos += length;
+    return true;
+}
+
+bool readScore(const std::string& data, size_t& pos, double& score) {
+    size_t comma = data.find(',', pos);
+    if (comma == std::string::npos || comma == pos || comma - pos > 32) {
+        return false;
+    }
+    std::string text(data, pos, comma - pos);
+    char* end = nullptr;
+    score = std::strtod(text.c_str(), &end);
+    if (end != text.c_str() + text.size() || std::isnan(score)) {
+        return false;
+    }
+    pos = comma + 1;
+    return true;
+}
+
+} // namespace
+
+SortedSet::SortedSet() {
+    head_.score = 0;
+    head_.links.resize(MAX_LEVEL);
+}
+
+SortedSet::~SortedSet() {
+    Node* node = head_.links[0].next;
+    while (node != nullptr) {
+        Node* next = node->links[0].next;
+        delete node;
+        node = next;
+    }
+}
+
+int SortedSet::randomLevel() {
+    // xorshift64; each level is kept with probability 1/4
+    int level = 1;
+    for (;;) {
+        randomState_ ^= randomState_ << 13;
+        randomState_ ^= randomState_ >> 7;
+        randomState_ ^= randomState_ << 17;
+        if ((randomState_ & 3) != 0 || level == MAX_LEVEL) {
+            return level;
+        }
+        level++;
+    }
+}
+
+void SortedSet::insert(const std::string& member, double score) {
+    Node* update[MAX_LEVEL];
+    size_t rank[MAX_LEVEL];
+    
+    Node* node = &head_;
+    for (int i = level_ - 1; i >= 0; i--) {
+        rank[i] = i == level_ - 1 ? 0 : rank[i + 1];
+        while (node->links[i].next != nullptr &&
+               precedes(node->links[i].next->score, node->links[i].next->member, score, member)) {
+            rank[i] += node->links[i].span;
+            node = node->links[i].next;
+        }
+        update[i] = node;
+    }
+    
+    int level = randomLevel();
+    if (level > level_) {
+        for (int i = level_; i < level; i++) {
+            rank[i] = 0;
+            update[i] = &head_;
+            head_.links[i].span = size_;
+        }
+        level_ = level;
+    }
+    
+    Node* inserted = new Node{member, score, std::vector<Link>(level)};
+    for (int i = 0; i < level; i++) {
+        inserted->links[i].next = update[i]->links[i].next;
+        update[i]->links[i].next = inserted;
+        inserted->links[i].span = update[i]->links[i].span - (rank[0] - rank[i]);
+        update[i]->links[i].span = rank[0] - rank[i] + 1;
+    }
+    for (int i = level; i < level_; i++) {
+        update[i]->links[i].span++;
+    }
+    
+    size_++;
+    index_.emplace(std::string_view(inserted->member), inserted);
+}
+
+void SortedSet::erase(Node* target) {
+    Node* update[MAX_LEVEL];
+    Node* node = &head_;
+    for (int i = level_ - 1; i >= 0; i--) {
+        while (node->links[i].next != nullptr &&
+               precedes(node->links[i].next->score, node->links[i].next->member, target->score, target->member)) {
+            node = node->links[i].next;
+        }
+        update[i] = node;
+    }
+    
+    for (int i = 0; i < level_; i++) {
+        if (update[i]->links[i].next == target) {
+            update[i]->links[i].span += target->links[i].span - 1;
+            update[i]->links[i].next = target->links[i].next;
+        } else {
+            update[i]->links[i].span--;
+        }
+    }
+    while (level_ > 1 && head_.links[level_ - 1].next == nullptr) {
+        level_--;
+    }
+    
+    size_--;
+    index_.erase(std::string_view(target->member));
+    delete target;
+}
+
+bool SortedSet::add(const std::string& member, double score) {
+    auto found = index_.find(std::string_view(member));
+    if (found == index_.end()) {
+        insert(member, score);
+        return true;
+    }
+    if (found->second->score != score) {
+        erase(found->second);
+        insert(member, score);
+    }
+    return false;
+}
+
+bool SortedSet::remove(const std::string& member) {
+    auto found = index_.find(std::string_view(member));
+    if (found == index_.end()) {
+        return false;
+    }
+    erase(found->second);
+    return true;
+}
+
+std::optional<double> SortedSet::score(const std::string& member) const {
+    auto found = index_.find(std::string_view(member));
+    if (found == index_.end()) {
+        return std::nullopt;
+    }
+    return found->second->score;
+}
+
+std::optional<size_t> SortedSet::rank(const std::string& member) const {
+    auto found = index_.find(std::string_view(member));
+    if (found == index_.end()) {
+        return std::nullopt;
+    }
+    
+    // Sum the spans of the links followed up to and including the member
+    const Node* target = found->second;
+    const Node* node = &head_;
+    size_t traversed = 0;
+    for (int i = level_ - 1; i >= 0; i--) {
+        while (node->links[i].next != nullptr &&
+               (node->links[i].next == target ||
+                precedes(node->links[i].next->score, node->links[i].next->member, target->score, target->member))) {
+            traversed += node->links[i].span;
+            node = node->links[i].next;
+        }
+        if (node == target) {
+            return traversed - 1;
+        }
+    }
+    return std::nullopt;
+}
+
+void SortedSet::range(size_t start, size_t stop, std::vector<std::pair<std::string, double>>& out) const {
+    if (start >= size_ || start > stop) {
+        return;
+    }
+    stop = std::min(stop, size_ - 1);
+    
+    // Descend to the node at 1-based position start + 1
+    const Node* node = &head_;
+    size_t traversed = 0;
+    for (int i = level_ - 1; i >= 0; i--) {
+        while (node->links[i].next != nullptr && traversed + node->links[i].span <= start + 1) {
+            traversed += node->links[i].span;
+            node = node->links[i].next;
+        }
+    }
+    
+    out.reserve(out.size() + (stop - start + 1));
+    for (size_t rank = start; rank <= stop && node != nullptr; rank++) {
+        out.emplace_back(node->member, node->score);
+        node = node->links[0].next;
+    }
+}
+
+Collection::Collection(Kind kind) {
+    switch (kind) {
+        case Kind::List:
+            items_.emplace<List>();
+            break;
+        case Kind::Set:
+            items_.emplace<Set>();
+            break;
+        case Kind::SortedSet:
+            items_.emplace<SortedSet>();
+            break;
+        case Kind::HyperLogLog:
+            items_.emplace<HyperLogLog>();
+            break;
+        case Kind::CountMin:
+            items_.emplace<CountMinSketch>();
+            break;
+    }
+}
+
+Collection::Kind Collection::kind() const {
+    if (std::holds_alternative<List>(items_)) {
+        return Kind::List;
+    }
+    if (std::holds_alternative<Set>(items_)) {
+        return Kind::Set;
+    }
+    if (std::holds_alternative<SortedSet>(items_)) {
+        return Kind::SortedSet;
+    }
+    return std::holds_alternative<HyperLogLog>(items_) ? Kind::HyperLogLog : Kind::CountMin;
+}
+
+size_t Collection::size() const {
+    switch (kind()) {
+        case Kind::List:
+            return list().size();
+        case Kind::Set:
+            return set().size();
+        case Kind::SortedSet:
+            return sortedSet().size();
+        case Kind::HyperLogLog:
+        case Kind::CountMin:
+            return 1;
+    }
+    return 0;
+}
+
+void Collection::serialize(std::string& out) const {
+    out.push_back(TAG);
+    out.push_back(static_cast<char>(kind()));
+    
+    switch (kind()) {
+        case Kind::List:
+            for (const std::string& member : list()) {
+                appendMember(out, member);
+            }
+            break;
+        case Kind::Set:
+            for (const std::string& member : set()) {
+                appendMember(out, member);
+            }
+            break;
+        case Kind::SortedSet: {
+            std::vector<std::pair<std::string, double>> members;
+            sortedSet().range(0, sortedSet().size(), members);
+            char score[32];
+            for (const auto& member : members) {
+                std::snprintf(score, sizeof(score), "%.17g,", member.second);
+                out += score;
+                appendMember(out, member.first);
+            }
+            break;
+        }
+        case Kind::HyperLogLog:
+            hyperLogLog().serialize(out);
+            break;
+        case Kind::CountMin:
+            countMin().serialize(out);
+            break;
+    }
+}
+
+std::unique_ptr<Collection> Collection::deserialize(const std::string& data) {
+    if (!looksSerialized(data)) {
+        return nullptr;
+    }
+    Kind kind = static_cast<Kind>(data[1]);
+    if (kind == Kind::HyperLogLog || kind == Kind::CountMin) {
+        auto sketch = std::make_unique<Collection>(kind);
+        bool loaded = kind == Kind::HyperLogLog ? sketch->hyperLogLog().deserialize(data.data() + 2, data.size() - 2)
+                                                : sketch->countMin().deserialize(data.data() + 2, data.size() - 2);
+        return loaded ? std::move(sketch) : nullptr;
+    }
+    if (kind != Kind::List && kind != Kind::Set && kind != Kind::SortedSet) {
+        return nullptr;
+    }
+    
+    auto collection = std::make_unique<Collection>(kind);
+    size_t pos = 2;
+    std::string member;
+    while (pos < data.size()) {
+        double score = 0;
+        if ((kind == Kind::SortedSet && !readScore(data, pos, score)) || !readMember(data, pos, member)) {
+            return nullptr;
+        }
+        switch (kind) {
+            case Kind::List:
+                collection->list().push_back(member);
+                break;
+            case Kind::Set:
+                collection->set().insert(member);
+                break;
+            case Kind::SortedSet:
+                collection->sortedSet().add(member, score);
+                break;
+            default:
+                break;
+        }
+    }
+    
+    // Empty collections are never stored, so this is an ordinary value
+    if (collection->size() == 0) {
+        return nullptr;
+    }
+    return collection;
+}
@@ -0,0 +1,146 @@
+#ifndef COLLECTION_HPP
+#define COLLECTION_HPP
+
+#include "sketch.hpp"
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <variant>
+#include <optional>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Members ordered by (score, member) in a skip list whose links record how
+ * many members they skip, so rank and range-by-rank are O(log n) like
+ * insertion and removal. A hash index maps members to their nodes.
+ */
+class SortedSet {
+private:
+    static constexpr int MAX_LEVEL = 32;
+    
+    struct Node;
+    struct Link {
+        Node* next = nullptr;
+        size_t span = 0; // Members passed by following next
+    };
+    struct Node {
+        std::string member;
+        double score;
+        std::vector<Link> links; // One per level
+    };
+    
+    Node head_;
+    int level_ = 1;
+    size_t size_ = 0;
+    uint64_t randomState_ = 0x9E3779B97F4A7C15ULL;
+    std::unordered_map<std::string_view, Node*> index_; // Views into the nodes' members
+    
+    int randomLevel();
+    void insert(const std::string& member, double score);
+    void erase(Node* node);
+
+public:
+    SortedSet();
+    ~SortedSet();
+    
+    SortedSet(const SortedSet&) = delete;
+    SortedSet& operator=(const SortedSet&) = delete;
+    
+    /**
+     * Add a member or update its score
+     * @return true if the member is new
+     */
+    bool add(const std::string& member, double score);
+    
+    /**
+     * Remove a member
+     * @return true if the member was present
+     */
+    bool remove(const std::string& member);
+    
+    std::optional<double> score(const std::string& member) const;
+    
+    /**
+     * Get a member's 0-based position in ascending (score, member) order
+     */
+    std::optional<size_t> rank(const std::string& member) const;
+    
+    /**
+     * Get the members at ranks [start, stop] with their scores
+     * @param out Receives the members in rank order
+     */
+    void range(size_t start, size_t stop, std::vector<std::pair<std::string, double>>& out) const;
+    
+    size_t size() const { return size_; }
+};
+
+/**
+ * Native collection stored in a field: a list, a set, a sorted set, or a
+ * HyperLogLog or count-min sketch of fixed size
+ *
+ * Outside the database a collection travels as its serialized form, a
+ * string starting with TAG and a kind byte. Backups and snapshots escape
+ * plain values starting with a tag byte and logs mark collections with
+ * their own op, so a plain value is never read back as a collection.
+ */
+class Collection {
+public:
+    enum class Kind : char { List = 'L', Set = 'S', SortedSet = 'Z', HyperLogLog = 'H', CountMin = 'C' };
+    
+    static constexpr char TAG = '\x04';
+    
+    using List = std::deque<std::string>;
+    using Set = std::unordered_set<std::string>;
+
+private:
+    std::variant<std::monostate, List, Set, SortedSet, HyperLogLog, CountMinSketch> items_;
+
+public:
+    explicit Collection(Kind kind);
+    
+    Kind kind() const;
+    
+    /**
+     * Get the number of members; a sketch counts as one
+     */
+    size_t size() const;
+    
+    List& list() { return std::get<List>(items_); }
+    const List& list() const { return std::get<List>(items_); }
+    Set& set() { return std::get<Set>(items_); }
+    const Set& set() const { return std::get<Set>(items_); }
+    SortedSet& sortedSet() { return std::get<SortedSet>(items_); }
+    const SortedSet& sortedSet() const { return std::get<SortedSet>(items_); }
+    HyperLogLog& hyperLogLog() { return std::get<HyperLogLog>(items_); }
+    const HyperLogLog& hyperLogLog() const { return std::get<HyperLogLog>(items_); }
+    CountMinSketch& countMin() { return std::get<CountMinSketch>(items_); }
+    const CountMinSketch& countMin() const { return std::get<CountMinSketch>(items_); }
+    
+    /**
+     * Append the serialized form: TAG KIND, then LENGTH:MEMBER per member,
+     * each prefixed by SCORE, for sorted sets; sketches append their
+     * fixed-size binary state instead
+     * @param out String to append to
+     */
+    void serialize(std::string& out) const;
+    
+    /**
+     * Check if a value may be a serialized collection (cheap first-byte test)
+     */
+    static bool looksSerialized(const std::string& value) { return value.size() >= 2 && value[0] == TAG; }
+    
+    /**
+     * Rebuild a collection from its serialized form
+     * @param data Serialized collection
+     * @return nullptr if data is not a well-formed serialized collection
+     */
+    static std::unique_ptr<Collection> deserialize(const std::string& data);
+};
+
+#endif // COLLECTION_HPP
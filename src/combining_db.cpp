@@ -0,0 +1,248 @@
+#include "combining_db.hpp"
+#include "sharded_db.hpp"
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+namespace {
+
+// Scans of the slots per lock acquisition; later scans pick up operations published meanwhile
+const int COMBINE_PASSES = 3;
+
+} // namespace
+
+thread_local CombiningDB::ThreadRegistrations CombiningDB::registrations_;
+
+CombiningDB::ThreadRegistrations::~ThreadRegistrations() {
+    for (const auto& registration : slots) {
+        registration.first->taken[registration.second].store(false, std::memory_order_release);
+    }
+}
+
+CombiningDB::CombiningDB(size_t shardCount, bool combining)
+    : combining_(combining), slotTable_(std::make_shared<SlotTable>()) {
+    if (shardCount == 0) {
+        shardCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < shardCount; i++) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+}
+
+size_t CombiningDB::slotIndex() const {
+    std::vector<std::pair<std::shared_ptr<SlotTable>, size_t>>& slots = registrations_.slots;
+    for (const auto& registration : slots) {
+        if (registration.first == slotTable_) {
+            return registration.second;
+        }
+    }
+    
+    // Forget engines that no longer exist before registering with this one
+    slots.erase(std::remove_if(slots.begin(), slots.end(),
+                               [](const auto& registration) { return registration.first.use_count() == 1; }),
+                slots.end());
+    
+    SlotTable& table = *slotTable_;
+    for (size_t index = 0; index < MAX_THREADS; index++) {
+        bool expected = false;
+        if (table.taken[index].load(std::memory_order_relaxed) ||
+            !table.taken[index].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            continue;
+        }
+        size_t used = table.used.load(std::memory_order_relaxed);
+        while (used <= index && !table.used.compare_exchange_weak(used, index + 1, std::memory_order_release)) {
+        }
+        slots.emplace_back(slotTable_, index);
+        return index;
+    }
+    return MAX_THREADS; // Not registered, so a slot freed later can still be taken
+}
+
+size_t CombiningDB::combine(Shard& shard) const {
+    size_t applied = 0;
+    size_t slotCount = slotTable_->used.load(std::memory_order_acquire);
+    for (int pass = 0; pass < COMBINE_PASSES; pass++) {
+        size_t appliedInPass = 0;
+        for (size_t i = 0; i < slotCount; i++) {
+            Slot& slot = shard.slots[i];
+            const std::function<void(InMemoryDBImpl&)>* request = slot.request.load(std::memory_order_acquire);
+            if (request) {
+                (*request)(shard.db);
+                slot.request.store(nullptr, std::memory_order_release); // The caller may return from here on
+                appliedInPass++;
+            }
+        }
+        if (appliedInPass == 0) {
+            break;
+        }
+        applied += appliedInPass;
+    }
+    return applied;
+}
+
+void CombiningDB::apply(size_t index, const std::function<void(InMemoryDBImpl&)>& operation) const {
+    Shard& shard = *shards_[index];
+    size_t slot = combining_ ? slotIndex() : MAX_THREADS;
+    if (slot == MAX_THREADS) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        operation(shard.db);
+        shard.lockAcquisitions.fetch_add(1, std::memory_order_relaxed);
+        shard.operations.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    // Publish, then either become the combiner or wait for the current one to apply the operation
+    std::atomic<const std::function<void(InMemoryDBImpl&)>*>& request = shard.slots[slot].request;
+    request.store(&operation, std::memory_order_release);
+    for (int spins = 0; request.load(std::memory_order_acquire); spins++) {
+        if (shard.mutex.try_lock()) {
+            size_t applied = combine(shard);
+            shard.mutex.unlock();
+            shard.lockAcquisitions.fetch_add(1, std::memory_order_relaxed);
+            shard.operations.fetch_add(applied, std::memory_order_relaxed);
+            continue; // Own slot was published before combining, so it is clear now
+        }
+        if (spins >= 64) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+template <typename Result>
+Result CombiningDB::call(size_t shard, const std::function<Result(InMemoryDBImpl&)>& request) const {
+    std::optional<Result> result;
+    apply(shard, [&](InMemoryDBImpl& db) { result = request(db); });
+    return std::move(*result);
+}
+
+template <typename Result>
+std::vector<Result> CombiningDB::callAll(const std::function<Result(InMemoryDBImpl&)>& request) const {
+    std::vector<Result> results;
+    results.reserve(shards_.size());
+    for (size_t i = 0; i < shards_.size(); i++) {
+        results.push_back(call<Result>(i, request));
+    }
+    return results;
+}
+
+// Level 1: Basic operations
+void CombiningDB::set(const std::string& recordId, const std::string& field, const std::string& value) {
+    apply(shardOf(recordId), [&](InMemoryDBImpl& db) { db.set(recordId, field, value); });
+}
+
+std::optional<std::string> CombiningDB::get(const std::string& recordId, const std::string& field) const {
+    return call<std::optional<std::string>>(shardOf(recordId), [&](InMemoryDBImpl& db) {
+        return db.get(recordId, field);
+    });
+}
+
+bool CombiningDB::deleteField(const std::string& recordId, const std::string& field) {
+    return call<bool>(shardOf(recordId), [&](InMemoryDBImpl& db) { return db.deleteField(recordId, field); });
+}
+
+bool CombiningDB::deleteRecord(const std::string& recordId) {
+    return call<bool>(shardOf(recordId), [&](InMemoryDBImpl& db) { return db.deleteRecord(recordId); });
+}
+
+std::vector<std::string> CombiningDB::getFields(const std::string& recordId) const {
+    return call<std::vector<std::string>>(shardOf(recordId), [&](InMemoryDBImpl& db) {
+        return db.getFields(recordId);
+    });
+}
+
+bool CombiningDB::hasRecord(const std::string& recordId) const {
+    return call<bool>(shardOf(recordId), [&](InMemoryDBImpl& db) { return db.hasRecord(recordId); });
+}
+
+std::vector<std::string> CombiningDB::getAllRecordIds() const {
+    return ShardedInMemoryDB::mergeSortedIds(callAll<std::vector<std::string>>([](InMemoryDBImpl& db) {
+        return db.getAllRecordIds();
+    }));
+}
+
+// Level 2: Filtering
+std::vector<std::string> CombiningDB::getRecordsByFieldValue(const std::string& field, const std::string& value) const {
+    return ShardedInMemoryDB::mergeSortedIds(callAll<std::vector<std::string>>([&](InMemoryDBImpl& db) {
+        return db.getRecordsByFieldValue(field, value);
+    }));
+}
+
+// Level 3: TTL
+void CombiningDB::setTTL(const std::string& recordId, int ttlSeconds) {
+    apply(shardOf(recordId), [&](InMemoryDBImpl& db) { db.setTTL(recordId, ttlSeconds); });
+}
+
+int CombiningDB::expireRecords() {
+    int expired = 0;
+    for (int count : callAll<int>([](InMemoryDBImpl& db) { return db.expireRecords(); })) {
+        expired += count;
+    }
+    return expired;
+}
+
+// Level 4: Backup and restore
+std::string CombiningDB::backup() const {
+    return ShardedInMemoryDB::mergeBackups(callAll<std::string>([](InMemoryDBImpl& db) { return db.backup(); }));
+}
+
+bool CombiningDB::restore(const std::string& backupData) {
+    InMemoryDBImpl::Dataset full;
+    if (!InMemoryDBImpl::prepareRestore(backupData, full)) {
+        return false;
+    }
+    
+    std::vector<InMemoryDBImpl::Dataset> partitions(shards_.size());
+    for (const auto& record : full.records) {
+        InMemoryDBImpl::Dataset& partition = partitions[shardOf(record.first)];
+        partition.records.insert(record);
+        auto ttlIt = full.ttlMap.find(record.first);
+        if (ttlIt != full.ttlMap.end()) {
+            partition.ttlMap.insert(*ttlIt);
+        }
+    }
+    for (size_t i = 0; i < shards_.size(); i++) {
+        apply(i, [&](InMemoryDBImpl& db) { db.commitRestore(partitions[i]); });
+    }
+    return true;
+}
+
+size_t CombiningDB::shardCount() const {
+    return shards_.size();
+}
+
+size_t CombiningDB::shardOf(const std::string& recordId) const {
+    return std::hash<std::string>()(recordId) % shards_.size();
+}
+
+void CombiningDB::execute(size_t shard, const std::function<void(InMemoryDBImpl&)>& batch) {
+    apply(shard, batch);
+}
+
+std::optional<InMemoryDBImpl::RateLimitResult> CombiningDB::checkRateLimit(const std::string& recordId,
+                                                                           const std::string& field, uint64_t limit,
+                                                                           uint64_t windowMs, uint64_t cost) {
+    return call<std::optional<InMemoryDBImpl::RateLimitResult>>(shardOf(recordId), [&](InMemoryDBImpl& db) {
+        return db.checkRateLimit(recordId, field, limit, windowMs, cost);
+    });
+}
+
+size_t CombiningDB::getRecordCount() const {
+    size_t count = 0;
+    for (size_t shardRecords : callAll<size_t>([](InMemoryDBImpl& db) { return db.getRecordCount(); })) {
+        count += shardRecords;
+    }
+    return count;
+}
+
+CombiningDB::CombiningStats CombiningDB::combiningStats() const {
+    CombiningStats stats;
+    for (const auto& shard : shards_) {
+        stats.lockAcquisitions += shard->lockAcquisitions.load(std::memory_order_relaxed);
+        stats.operations += shard->operations.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+size_t CombiningDB::slotsScanned() const {
+    return slotTable_->used.load(std::memory_order_relaxed);
+}
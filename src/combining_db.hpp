@@ -0,0 +1,188 @@
+#ifndef COMBINING_DB_HPP
+#define COMBINING_DB_HPP
+
+#include "in_memory_db_imp.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <atomic>
+#include <optional>
+#include <cstdint>
+
+/**
+ * Thread-safe database of lock-protected shards with a flat-combining write path
+ *
+ * There are no owner threads: callers operate on a shard themselves while
+ * holding its lock. Without combining, every operation takes the lock,
+ * so a hot record hands the lock (and the shard's cache lines) from
+ * thread to thread once per operation. With combining, a caller publishes
+ * its operation in its own slot on the shard; whichever caller gets the
+ * lock applies every published operation before releasing it, and the
+ * other callers just wait for their slot to be cleared. One lock
+ * acquisition then serves a whole batch of contending callers.
+ */
+class CombiningDB : public InMemoryDB {
+public:
+    /**
+     * Threads beyond this many at once take the shard lock for each operation instead of publishing it;
+     * a thread's slot is released when it exits
+     */
+    static constexpr size_t MAX_THREADS = 64;
+    
+    /**
+     * Lock acquisitions and operations applied, summed over all shards
+     */
+    struct CombiningStats {
+        uint64_t lockAcquisitions = 0;
+        uint64_t operations = 0;
+    };
+
+private:
+    /**
+     * A thread's publication slot on a shard; null when nothing is pending
+     */
+    struct alignas(64) Slot {
+        std::atomic<const std::function<void(InMemoryDBImpl&)>*> request{nullptr};
+    };
+    
+    struct Shard {
+        std::mutex mutex;
+        InMemoryDBImpl db;
+        Slot slots[MAX_THREADS];
+        
+        std::atomic<uint64_t> lockAcquisitions{0};
+        std::atomic<uint64_t> operations{0};
+    };
+    
+    /**
+     * Which slot indices are taken; shared with the registered threads, so a
+     * thread exiting after the engine is gone can still release its slot
+     */
+    struct SlotTable {
+        std::atomic<bool> taken[MAX_THREADS];
+        std::atomic<size_t> used{0}; // One past the highest index ever taken; combiners scan this many
+        
+        SlotTable() {
+            for (auto& slot : taken) {
+                slot.store(false, std::memory_order_relaxed);
+            }
+        }
+    };
+    
+    /**
+     * The calling thread's slots, one per engine it used; released when the thread exits
+     */
+    struct ThreadRegistrations {
+        std::vector<std::pair<std::shared_ptr<SlotTable>, size_t>> slots;
+        ~ThreadRegistrations();
+    };
+    
+    static thread_local ThreadRegistrations registrations_;
+    
+    std::vector<std::unique_ptr<Shard>> shards_;
+    bool combining_;
+    std::shared_ptr<SlotTable> slotTable_;
+    
+    /**
+     * Get the calling thread's slot index, taking a free slot on first use
+     * @return MAX_THREADS while every slot is taken
+     */
+    size_t slotIndex() const;
+    
+    /**
+     * Apply every operation published on a shard; called with its lock held
+     * @return Number of operations applied
+     */
+    size_t combine(Shard& shard) const;
+    
+    /**
+     * Run an operation on a shard, directly or through its combiner, and wait for it
+     */
+    void apply(size_t shard, const std::function<void(InMemoryDBImpl&)>& operation) const;
+    
+    /**
+     * Run a request on a shard and return its result
+     */
+    template <typename Result>
+    Result call(size_t shard, const std::function<Result(InMemoryDBImpl&)>& request) const;
+    
+    /**
+     * Run a request on every shard in turn
+     * @return Results in shard order
+     */
+    template <typename Result>
+    std::vector<Result> callAll(const std::function<Result(InMemoryDBImpl&)>& request) const;
+
+public:
+    /**
+     * @param shardCount Number of shards (0 = hardware concurrency)
+     * @param combining Combine contending operations; false takes the lock once per operation
+     */
+    explicit CombiningDB(size_t shardCount = 0, bool combining = true);
+    
+    CombiningDB(const CombiningDB&) = delete;
+    CombiningDB& operator=(const CombiningDB&) = delete;
+    
+    // Level 1: Basic operations
+    void set(const std::string& recordId, const std::string& field, const std::string& value) override;
+    std::optional<std::string> get(const std::string& recordId, const std::string& field) const override;
+    bool deleteField(const std::string& recordId, const std::string& field) override;
+    bool deleteRecord(const std::string& recordId) override;
+    std::vector<std::string> getFields(const std::string& recordId) const override;
+    bool hasRecord(const std::string& recordId) const override;
+    std::vector<std::string> getAllRecordIds() const override;
+    
+    // Level 2: Filtering
+    std::vector<std::string> getRecordsByFieldValue(const std::string& field, const std::string& value) const override;
+    
+    // Level 3: TTL
+    void setTTL(const std::string& recordId, int ttlSeconds) override;
+    int expireRecords() override;
+    
+    // Level 4: Backup and restore (same format as InMemoryDBImpl; a failed restore keeps the current state)
+    std::string backup() const override;
+    bool restore(const std::string& backupData) override;
+    
+    /**
+     * Number of shards
+     */
+    size_t shardCount() const;
+    
+    /**
+     * Shard holding a record
+     * @param recordId Record identifier
+     */
+    size_t shardOf(const std::string& recordId) const;
+    
+    /**
+     * Run a batch of operations on a shard under one lock acquisition
+     * @param shard Shard index
+     * @param batch Called with the shard's database; must not call back into this database
+     */
+    void execute(size_t shard, const std::function<void(InMemoryDBImpl&)>& batch);
+    
+    /**
+     * Check and count a request against a rate limit (see InMemoryDBImpl::checkRateLimit)
+     */
+    std::optional<InMemoryDBImpl::RateLimitResult> checkRateLimit(const std::string& recordId, const std::string& field,
+                                                                  uint64_t limit, uint64_t windowMs, uint64_t cost = 1);
+    
+    /**
+     * Total number of records
+     */
+    size_t getRecordCount() const;
+    
+    /**
+     * Lock acquisitions and operations so far; operations per acquisition shows how much combining happened
+     */
+    CombiningStats combiningStats() const;
+    
+    /**
+     * Number of slots combiners scan: one past the highest slot index taken so far
+     */
+    size_t slotsScanned() const;
+};
+
+#endif // COMBINING_DB_HPP
@@ -0,0 +1,225 @@
+#include "field_map.hpp"
+#include <new>
+
+namespace {
+
+const uint32_t PACKED_INITIAL_CAPACITY = 2;
+
+} // namespace
+
+FieldMap::FieldMap(const FieldMap& other) {
+    if (other.hashed_) {
+        hashed_ = StorageAllocator<HashMap>().allocate(1);
+        new (hashed_) HashMap(*other.hashed_);
+        return;
+    }
+    if (other.size_ == 0) {
+        return;
+    }
+    
+    packed_ = StorageAllocator<value_type>().allocate(other.size_);
+    capacity_ = other.size_;
+    for (; size_ < other.size_; size_++) {
+        new (packed_ + size_) value_type(other.packed_[size_]);
+    }
+}
+
+FieldMap& FieldMap::operator=(const FieldMap& other) {
+    if (this != &other) {
+        FieldMap copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+FieldMap& FieldMap::operator=(FieldMap&& other) noexcept {
+    if (this != &other) {
+        FieldMap moved(std::move(other));
+        swap(moved);
+    }
+    return *this;
+}
+
+FieldMap::~FieldMap() {
+    releasePacked();
+    if (hashed_) {
+        hashed_->~HashMap();
+        StorageAllocator<HashMap>().deallocate(hashed_, 1);
+    }
+}
+
+void FieldMap::swap(FieldMap& other) noexcept {
+    std::swap(packed_, other.packed_);
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(hashed_, other.hashed_);
+}
+
+uint32_t FieldMap::packedIndex(const std::string& field) const {
+    uint32_t index = 0;
+    while (index < size_ && packed_[index].first != field) {
+        index++;
+    }
+    return index;
+}
+
+void FieldMap::growPacked() {
+    uint32_t capacity = capacity_ == 0 ? PACKED_INITIAL_CAPACITY : capacity_ * 2;
+    value_type* packed = StorageAllocator<value_type>().allocate(capacity);
+    for (uint32_t i = 0; i < size_; i++) {
+        // The const key is copied, which for short field names stays inside the string
+        new (packed + i) value_type(std::move(packed_[i]));
+        packed_[i].~value_type();
+    }
+    if (packed_) {
+        StorageAllocator<value_type>().deallocate(packed_, capacity_);
+    }
+    packed_ = packed;
+    capacity_ = capacity;
+}
+
+void FieldMap::promote() {
+    HashMap* hashed = StorageAllocator<HashMap>().allocate(1);
+    new (hashed) HashMap();
+    hashed->reserve(size_ + 1);
+    for (uint32_t i = 0; i < size_; i++) {
+        hashed->emplace(packed_[i].first, std::move(packed_[i].second));
+    }
+    releasePacked();
+    hashed_ = hashed;
+}
+
+void FieldMap::releasePacked() {
+    for (uint32_t i = 0; i < size_; i++) {
+        packed_[i].~value_type();
+    }
+    if (packed_) {
+        StorageAllocator<value_type>().deallocate(packed_, capacity_);
+    }
+    packed_ = nullptr;
+    size_ = 0;
+    capacity_ = 0;
+}
+
+FieldMap::iterator FieldMap::find(const std::string& field) {
+    if (hashed_) {
+        return iterator(hashed_->find(field));
+    }
+    return iterator(packed_ + packedIndex(field));
+}
+
+FieldMap::const_iterator FieldMap::find(const std::string& field) const {
+    if (hashed_) {
+        return const_iterator(static_cast<const HashMap*>(hashed_)->find(field));
+    }
+    return const_iterator(packed_ + packedIndex(field));
+}
+
+std::string& FieldMap::operator[](const std::string& field) {
+    if (hashed_) {
+        return (*hashed_)[field];
+    }
+    
+    uint32_t index = packedIndex(field);
+    if (index < size_) {
+        return packed_[index].second;
+    }
+    if (size_ >= PACKED_MAX_FIELDS) {
+        promote();
+        return (*hashed_)[field];
+    }
+    if (size_ == capacity_) {
+        growPacked();
+    }
+    new (packed_ + size_) value_type(field, std::string());
+    return packed_[size_++].second;
+}
+
+std::pair<FieldMap::iterator, bool> FieldMap::emplace(std::string field, std::string value) {
+    if (hashed_) {
+        auto inserted = hashed_->emplace(std::move(field), std::move(value));
+        return {iterator(inserted.first), inserted.second};
+    }
+    
+    uint32_t index = packedIndex(field);
+    if (index < size_) {
+        return {iterator(packed_ + index), false};
+    }
+    if (size_ >= PACKED_MAX_FIELDS) {
+        promote();
+        auto inserted = hashed_->emplace(std::move(field), std::move(value));
+        return {iterator(inserted.first), inserted.second};
+    }
+    if (size_ == capacity_) {
+        growPacked();
+    }
+    new (packed_ + size_) value_type(std::move(field), std::move(value));
+    return {iterator(packed_ + size_++), true};
+}
+
+FieldMap::iterator FieldMap::erase(const_iterator position) {
+    if (hashed_) {
+        return iterator(hashed_->erase(position.hashed_));
+    }
+    
+    // Fill the hole with the last pair; its key is const, so it is rebuilt in place
+    uint32_t index = static_cast<uint32_t>(position.packed_ - packed_);
+    uint32_t last = size_ - 1;
+    packed_[index].~value_type();
+    if (index != last) {
+        new (packed_ + index) value_type(std::move(packed_[last]));
+        packed_[last].~value_type();
+    }
+    size_--;
+    return iterator(packed_ + index);
+}
+
+size_t FieldMap::erase(const std::string& field) {
+    auto position = find(field);
+    if (position == end()) {
+        return 0;
+    }
+    erase(position);
+    return 1;
+}
+
+void FieldMap::clear() {
+    if (hashed_) {
+        hashed_->clear();
+    } else {
+        releasePacked();
+    }
+}
+
+void FieldMap::reserve(size_t fieldCount) {
+    if (hashed_) {
+        hashed_->reserve(fieldCount);
+        return;
+    }
+    if (fieldCount > PACKED_MAX_FIELDS) {
+        promote();
+        hashed_->reserve(fieldCount);
+        return;
+    }
+    while (capacity_ < fieldCount) {
+        growPacked();
+    }
+}
+
+void FieldMap::shrink() {
+    if (!hashed_ || hashed_->size() > PACKED_MAX_FIELDS / 2) {
+        return;
+    }
+    
+    HashMap* hashed = hashed_;
+    hashed_ = nullptr;
+    if (!hashed->empty()) {
+        packed_ = StorageAllocator<value_type>().allocate(hashed->size());
+        capacity_ = static_cast<uint32_t>(hashed->size());
+        for (auto& pair : *hashed) {
+            new (packed_ + size_++) value_type(pair.first, std::move(pair.second));
+        }
+    }
+    hashed->~HashMap();
+    StorageAllocator<HashMap>().deallocate(hashed, 1);
+}
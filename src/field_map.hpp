@@ -0,0 +1,186 @@
+#ifndef FIELD_MAP_HPP
+#define FIELD_MAP_HPP
+
+#include "storage_arena.hpp"
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <iterator>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Field-value map of one record with two layouts
+ *
+ * Small records keep their pairs packed in one contiguous buffer that is
+ * scanned linearly; values up to 15 bytes sit inside the std::string
+ * objects themselves, so such a record costs a single allocation. A record
+ * that grows past PACKED_MAX_FIELDS fields is promoted to a hash table;
+ * shrink() packs it again once deletes leave half that many. The
+ * interface is the subset of std::unordered_map used by the database;
+ * erasing from the packed layout moves the last pair into the hole, so
+ * iteration order is unspecified in both layouts.
+ */
+class FieldMap {
+public:
+    using key_type = std::string;
+    using mapped_type = std::string;
+    using value_type = std::pair<const std::string, std::string>;
+    using size_type = size_t;
+    
+    static constexpr size_t PACKED_MAX_FIELDS = 8;
+
+private:
+    using HashMap = std::unordered_map<std::string, std::string, std::hash<std::string>, std::equal_to<std::string>,
+                                       StorageAllocator<value_type>>;
+    
+    value_type* packed_ = nullptr; // Packed layout: size_ pairs in a buffer of capacity_
+    uint32_t size_ = 0;
+    uint32_t capacity_ = 0;
+    HashMap* hashed_ = nullptr;    // Hash layout once promoted
+    
+    template <bool Const>
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = FieldMap::value_type;
+        using difference_type = std::ptrdiff_t;
+    
+    private:
+        friend class FieldMap;
+        using Entry = std::conditional_t<Const, const value_type, value_type>;
+        using HashIterator = std::conditional_t<Const, HashMap::const_iterator, HashMap::iterator>;
+        
+        Entry* packed_ = nullptr;
+        HashIterator hashed_{};
+        bool isHashed_ = false;
+        
+        explicit Iterator(Entry* packed) : packed_(packed) {}
+        explicit Iterator(HashIterator hashed) : hashed_(hashed), isHashed_(true) {}
+    
+    public:
+        using pointer = Entry*;
+        using reference = Entry&;
+        
+        Iterator() = default;
+        
+        template <bool OtherConst, typename = std::enable_if_t<Const && !OtherConst>>
+        Iterator(const Iterator<OtherConst>& other)
+            : packed_(other.packed_), hashed_(other.hashed_), isHashed_(other.isHashed_) {}
+        
+        reference operator*() const { return isHashed_ ? *hashed_ : *packed_; }
+        pointer operator->() const { return isHashed_ ? &*hashed_ : packed_; }
+        
+        Iterator& operator++() {
+            if (isHashed_) {
+                ++hashed_;
+            } else {
+                ++packed_;
+            }
+            return *this;
+        }
+        
+        Iterator operator++(int) {
+            Iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+        
+        bool operator==(const Iterator& other) const {
+            return isHashed_ ? hashed_ == other.hashed_ : packed_ == other.packed_;
+        }
+        bool operator!=(const Iterator& other) const { return !(*this == other); }
+        
+        template <bool>
+        friend class Iterator;
+    };
+    
+    /**
+     * Index of a field in the packed layout
+     * @return size_ if the field is absent
+     */
+    uint32_t packedIndex(const std::string& field) const;
+    
+    /**
+     * Grow the packed buffer to hold at least one more pair
+     */
+    void growPacked();
+    
+    /**
+     * Move every pair into a hash table
+     */
+    void promote();
+    
+    /**
+     * Destroy the packed pairs and free their buffer
+     */
+    void releasePacked();
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+    
+    FieldMap() = default;
+    FieldMap(const FieldMap& other);
+    FieldMap(FieldMap&& other) noexcept { swap(other); }
+    FieldMap& operator=(const FieldMap& other);
+    FieldMap& operator=(FieldMap&& other) noexcept;
+    ~FieldMap();
+    
+    void swap(FieldMap& other) noexcept;
+    
+    iterator begin() { return hashed_ ? iterator(hashed_->begin()) : iterator(packed_); }
+    iterator end() { return hashed_ ? iterator(hashed_->end()) : iterator(packed_ + size_); }
+    const_iterator begin() const { return hashed_ ? const_iterator(hashed_->cbegin()) : const_iterator(packed_); }
+    const_iterator end() const { return hashed_ ? const_iterator(hashed_->cend()) : const_iterator(packed_ + size_); }
+    
+    size_t size() const { return hashed_ ? hashed_->size() : size_; }
+    bool empty() const { return size() == 0; }
+    
+    /**
+     * Check if the record still uses the packed layout
+     */
+    bool isPacked() const { return hashed_ == nullptr; }
+    
+    iterator find(const std::string& field);
+    const_iterator find(const std::string& field) const;
+    size_t count(const std::string& field) const { return find(field) != end() ? 1 : 0; }
+    
+    /**
+     * Get a field's value, inserting an empty one if the field is absent
+     */
+    std::string& operator[](const std::string& field);
+    
+    /**
+     * Insert a field unless it is already present
+     * @return Iterator to the field and whether it was inserted
+     */
+    std::pair<iterator, bool> emplace(std::string field, std::string value);
+    
+    /**
+     * Erase a field
+     * @return Iterator to the next pair to visit
+     */
+    iterator erase(const_iterator position);
+    size_t erase(const std::string& field);
+    
+    /**
+     * Remove every field; a promoted record keeps its hash layout
+     */
+    void clear();
+    
+    /**
+     * Reserve room for a number of fields, promoting if they exceed the packed layout
+     */
+    void reserve(size_t fieldCount);
+    
+    /**
+     * Return a promoted map to the packed layout if it holds at most
+     * PACKED_MAX_FIELDS / 2 fields; the gap keeps a record that hovers at the
+     * threshold from switching layouts on every write. Invalidates iterators.
+     */
+    void shrink();
+};
+
+#endif // FIELD_MAP_HPP
@@ -1,9 +1,379 @@
 #include "in_memory_db_imp.hpp"
 #include <algorithm>
 #include <iomanip>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <charconv>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Snapshot layout (all integers are little-endian uint32):
+// MAGIC (8 bytes) BLOCK_COUNT RECORD_COUNT
+// For each block: STORED_SIZE RECORD_COUNT CODEC RAW_SIZE CHECKSUM PAYLOAD
+// The payload is compressed with CODEC and CHECKSUM is the CRC-32 of the four
+// header fields before it followed by the stored (compressed) bytes, so
+// corruption is caught before decompressing. RAW_SIZE is at most
+// SNAPSHOT_MAX_EXPANSION times STORED_SIZE; blocks compressing better are stored raw.
+// Raw payload, for each record: ID FIELD_COUNT (FIELD VALUE)* TTL_SECONDS (0xFFFFFFFF if none)
+// Strings are stored as LENGTH followed by the raw bytes.
+const std::string SNAPSHOT_MAGIC = "IMDBSNP3";
+const uint32_t SNAPSHOT_NO_TTL = 0xFFFFFFFF;
+const size_t SNAPSHOT_BLOCK_HEADER_SIZE = 20;
+const size_t SNAPSHOT_CHECKED_HEADER_SIZE = 16; // The header fields before CHECKSUM
+const size_t SNAPSHOT_MAX_EXPANSION = 256;
+
+struct SnapshotRecord {
+    std::string recordId;
+    InMemoryDBImpl::FieldMap fields;
+    uint32_t ttlSeconds = SNAPSHOT_NO_TTL;
+};
+
+void putU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+void putString(std::string& out, const std::string& value) {
+    putU32(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+}
+
+/**
+ * Bounds-checked cursor over a byte range of a snapshot
+ */
+class SnapshotReader {
+private:
+    const char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+
+public:
+    SnapshotReader(const char* data, size_t size) : data_(data), size_(size) {}
+    
+    bool readU32(uint32_t& value) {
+        if (size_ - pos_ < 4) return false;
+        value = 0;
+        for (int i = 0; i < 4; i++) {
+            value |= static_cast<uint32_t>(static_cast<unsigned char>(data_[pos_ + i])) << (8 * i);
+        }
+        pos_ += 4;
+        return true;
+    }
+    
+    bool readString(std::string& value) {
+        uint32_t length;
+        if (!readU32(length) || size_ - pos_ < length) return false;
+        value.assign(data_ + pos_, length);
+        pos_ += length;
+        return true;
+    }
+    
+    bool skip(size_t count) {
+        if (size_ - pos_ < count) return false;
+        pos_ += count;
+        return true;
+    }
+    
+    size_t position() const { return pos_; }
+    size_t remaining() const { return size_ - pos_; }
+    bool atEnd() const { return pos_ == size_; }
+};
+
+// Smallest encodings, used to bound counts read from the data before allocating for them:
+// a record is an empty ID, a field count and a TTL; a field is an empty name and an empty value
+const size_t MIN_SNAPSHOT_RECORD_SIZE = 12;
+const size_t MIN_SNAPSHOT_FIELD_SIZE = 8;
+
+bool decodeSnapshotBlock(const char* payload, size_t payloadSize, uint32_t recordCount,
+                         std::vector<SnapshotRecord>& out) {
+    SnapshotReader reader(payload, payloadSize);
+    if (recordCount > payloadSize / MIN_SNAPSHOT_RECORD_SIZE) return false;
+    out.resize(recordCount);
+    
+    for (SnapshotRecord& record : out) {
+        uint32_t fieldCount;
+        if (!reader.readString(record.recordId) || !reader.readU32(fieldCount)) return false;
+        if (fieldCount > reader.remaining() / MIN_SNAPSHOT_FIELD_SIZE) return false;
+        
+        record.fields.reserve(fieldCount);
+        for (uint32_t j = 0; j < fieldCount; j++) {
+            std::string field;
+            std::string value;
+            if (!reader.readString(field) || !reader.readString(value)) return false;
+            record.fields.emplace(std::move(field), std::move(value));
+        }
+        
+        if (!reader.readU32(record.ttlSeconds)) return false;
+    }
+    
+    return reader.atEnd();
+}
+
+// Log rewrite base capture: records visited per flushAppendLog(), and bytes captured before a hand-off
+const size_t REWRITE_STEP_RECORDS = 4096;
+const size_t REWRITE_CHUNK_BYTES = 1 << 20;
+
+// Memory estimate for tiering: hash nodes, buckets and string headers on top of the data
+// (a packed record stores only the string headers per field)
+const size_t RECORD_OVERHEAD_BYTES = 96;
+const size_t FIELD_OVERHEAD_BYTES = 96;
+const size_t PACKED_FIELD_OVERHEAD_BYTES = 64;
+
+size_t estimateRecordBytes(const std::string& recordId, const InMemoryDBImpl::FieldMap& fields) {
+    size_t bytes = RECORD_OVERHEAD_BYTES + recordId.size();
+    size_t fieldOverhead = fields.isPacked() ? PACKED_FIELD_OVERHEAD_BYTES : FIELD_OVERHEAD_BYTES;
+    for (const auto& fieldPair : fields) {
+        bytes += fieldOverhead + fieldPair.first.size() + fieldPair.second.size();
+    }
+    return bytes;
+}
+
+// Tier payload: FIELD_COUNT(u32) then FIELD VALUE pairs
+void encodeFields(const InMemoryDBImpl::FieldMap& fields, std::string& out) {
+    putU32(out, static_cast<uint32_t>(fields.size()));
+    for (const auto& fieldPair : fields) {
+        putString(out, fieldPair.first);
+        putString(out, fieldPair.second);
+    }
+}
+
+bool decodeFields(const std::string& payload, InMemoryDBImpl::FieldMap& fields) {
+    SnapshotReader reader(payload.data(), payload.size());
+    uint32_t fieldCount;
+    fields.clear();
+    if (!reader.readU32(fieldCount) || fieldCount > reader.remaining() / MIN_SNAPSHOT_FIELD_SIZE) return false;
+    
+    fields.reserve(fieldCount);
+    for (uint32_t i = 0; i < fieldCount; i++) {
+        std::string field;
+        std::string value;
+        if (!reader.readString(field) || !reader.readString(value)) return false;
+        fields.emplace(std::move(field), std::move(value));
+    }
+    return reader.atEnd();
+}
+
+// Stored form of a compressed field's values:
+// COMPRESSED_TAG DICTIONARY(u8, 1 = the field's dictionary) RAW_SIZE(u32) DATA for compressed values,
+// ESCAPED_TAG VALUE for other values starting with a tag byte, and the value itself otherwise.
+// Every value of an interned field is stored as INTERNED_TAG ID(u32) instead.
+const char COMPRESSED_TAG = '\x01';
+const char ESCAPED_TAG = '\x02';
+const char INTERNED_TAG = '\x03';
+const size_t COMPRESSED_HEADER_SIZE = 6;
+const size_t INTERNED_HANDLE_SIZE = 5;
+const size_t DICTIONARY_SAMPLES = 16;
+
+// A field is interned when its first INTERN_OBSERVED_VALUES values hold at most
+// INTERN_MAX_DISTINCT distinct ones, and reverted if its pool grows past INTERN_MAX_VALUES
+const size_t INTERN_OBSERVED_VALUES = 1024;
+const size_t INTERN_MAX_DISTINCT = 64;
+const size_t INTERN_MAX_VALUES = 4096;
+
+// A collection field stores Collection::TAG SLOT(u32) NONCE(u64)
+const size_t COLLECTION_HANDLE_SIZE = 13;
+
+// Logged collection commands: OP, then OPERAND(u64) for COLLECTION_SORTED_ADD (score bits)
+// and COLLECTION_COUNT_MIN_ADD (count), then the member
+const char COLLECTION_PUSH_BACK = 'p';
+const char COLLECTION_PUSH_FRONT = 'P';
+const char COLLECTION_POP_BACK = 'o';
+const char COLLECTION_POP_FRONT = 'O';
+const char COLLECTION_SET_ADD = 'a';
+const char COLLECTION_SET_REMOVE = 'r';
+const char COLLECTION_SORTED_ADD = 'z';
+const char COLLECTION_SORTED_REMOVE = 'Z';
+const char COLLECTION_HLL_ADD = 'h';
+const char COLLECTION_COUNT_MIN_ADD = 'c';
+const char COLLECTION_REPLACE = '='; // The member is the whole serialized collection
+
+bool isTagged(const std::string& stored) {
+    return !stored.empty() && stored[0] >= COMPRESSED_TAG && stored[0] <= Collection::TAG;
+}
+
+std::string internedHandle(uint32_t id) {
+    std::string handle(1, INTERNED_TAG);
+    putU32(handle, id);
+    return handle;
+}
+
+std::string collectionHandle(uint32_t slot, uint64_t nonce) {
+    std::string handle(1, Collection::TAG);
+    putU32(handle, slot);
+    putU32(handle, static_cast<uint32_t>(nonce));
+    putU32(handle, static_cast<uint32_t>(nonce >> 32));
+    return handle;
+}
+
+bool collectionSlot(const std::string& stored, uint32_t& slot, uint64_t& nonce) {
+    if (stored.size() != COLLECTION_HANDLE_SIZE || stored[0] != Collection::TAG) {
+        return false;
+    }
+    SnapshotReader reader(stored.data() + 1, COLLECTION_HANDLE_SIZE - 1);
+    uint32_t low = 0;
+    uint32_t high = 0;
+    if (!reader.readU32(slot) || !reader.readU32(low) || !reader.readU32(high)) {
+        return false;
+    }
+    nonce = (static_cast<uint64_t>(high) << 32) | low;
+    return true;
+}
+
+bool hasCommandOperand(char op) {
+    return op == COLLECTION_SORTED_ADD || op == COLLECTION_COUNT_MIN_ADD;
+}
+
+std::string collectionCommand(char op, const std::string& member, uint64_t operand) {
+    std::string command(1, op);
+    if (hasCommandOperand(op)) {
+        putU32(command, static_cast<uint32_t>(operand));
+        putU32(command, static_cast<uint32_t>(operand >> 32));
+    }
+    command.append(member);
+    return command;
+}
+
+bool internedId(const std::string& stored, uint32_t& id) {
+    if (stored.size() != INTERNED_HANDLE_SIZE || stored[0] != INTERNED_TAG) {
+        return false;
+    }
+    SnapshotReader reader(stored.data() + 1, 4);
+    return reader.readU32(id);
+}
+
+bool compressedRawSize(const std::string& stored, uint32_t& rawSize) {
+    if (stored.size() < COMPRESSED_HEADER_SIZE || stored[0] != COMPRESSED_TAG) {
+        return false;
+    }
+    SnapshotReader reader(stored.data() + 2, 4);
+    return reader.readU32(rawSize);
+}
+
+int64_t toWallClockMs(std::chrono::steady_clock::time_point expiration) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(expiration - std::chrono::steady_clock::now());
+    auto wallNow = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch());
+    return (wallNow + remaining).count();
+}
+
+/**
+ * Parse a rate limiter counter, WINDOW_START:PREVIOUS:CURRENT
+ */
+bool parseRateCounter(const std::string& value, uint64_t& windowStart, uint64_t& previous, uint64_t& current) {
+    const char* pos = value.data();
+    const char* end = value.data() + value.size();
+    uint64_t* parts[] = {&windowStart, &previous, &current};
+    for (size_t i = 0; i < 3; i++) {
+        auto parsed = std::from_chars(pos, end, *parts[i]);
+        if (parsed.ec != std::errc() || (i < 2 && (parsed.ptr == end || *parsed.ptr != ':'))) {
+            return false;
+        }
+        pos = parsed.ptr + (i < 2 ? 1 : 0);
+    }
+    return pos == end;
+}
+
+std::chrono::steady_clock::time_point fromWallClockMs(int64_t wallClockMs) {
+    auto wallNow = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch());
+    return std::chrono::steady_clock::now() + (std::chrono::milliseconds(wallClockMs) - wallNow);
+}
+
+// Batched lookups process keys in groups of this size, so the cache misses
+// of a whole group are in flight at once instead of one after another
+const size_t PROBE_GROUP_SIZE = 32;
+
+inline void prefetchAddress(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+}
+
+/**
+ * Look up a group of keys in a hash table with group prefetching: hash every
+ * key, then load every bucket head and prefetch its first node, then walk the
+ * chains, which by then are (mostly) in cache
+ * @param tables Table to probe for each key (nullptr = not found)
+ * @param keyAt Returns the i-th key
+ * @param count Number of keys (at most PROBE_GROUP_SIZE)
+ * @param found Receives the matching entry for each key, or nullptr
+ */
+template <typename Table, typename KeyAt>
+void probeGroup(const Table* const* tables, const KeyAt& keyAt, size_t count,
+                const typename Table::value_type** found) {
+    size_t buckets[PROBE_GROUP_SIZE];
+    typename Table::const_local_iterator heads[PROBE_GROUP_SIZE];
+    
+    for (size_t i = 0; i < count; i++) {
+        if (tables[i] != nullptr && !tables[i]->empty()) {
+            buckets[i] = tables[i]->bucket(keyAt(i));
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (tables[i] != nullptr && !tables[i]->empty()) {
+            heads[i] = tables[i]->begin(buckets[i]);
+            if (heads[i] != tables[i]->end(buckets[i])) {
+                prefetchAddress(&*heads[i]);
+            }
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        found[i] = nullptr;
+        if (tables[i] == nullptr || tables[i]->empty()) {
+            continue;
+        }
+        const std::string& key = keyAt(i);
+        for (auto it = heads[i]; it != tables[i]->end(buckets[i]); ++it) {
+            if (it->first == key) {
+                found[i] = &*it;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Look up one field in a group of records: prefetch every packed field
+ * buffer, then scan them (promoted records are looked up directly)
+ * @param tables Field map of each record (nullptr = record not found)
+ * @param field Field to look up
+ * @param count Number of records (at most PROBE_GROUP_SIZE)
+ * @param found Receives the matching pair for each record, or nullptr
+ */
+void probeFieldGroup(const InMemoryDBImpl::FieldMap* const* tables, const std::string& field, size_t count,
+                     const InMemoryDBImpl::FieldMap::value_type** found) {
+    for (size_t i = 0; i < count; i++) {
+        if (tables[i] != nullptr && tables[i]->isPacked() && !tables[i]->empty()) {
+            prefetchAddress(&*tables[i]->begin());
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        found[i] = nullptr;
+        if (tables[i] == nullptr) {
+            continue;
+        }
+        auto fieldIt = tables[i]->find(field);
+        if (fieldIt != tables[i]->end()) {
+            found[i] = &*fieldIt;
+        }
+    }
+}
+
+} // namespace
 
 InMemoryDBImpl::InMemoryDBImpl() {
     // Initialize empty database
+    std::random_device seed;
+    collectionNonce_ = (static_cast<uint64_t>(seed()) << 32) | seed();
 }
 
 // Helper functions
@@ -13,291 +383,2477 @@ bool InMemoryDBImpl::isRecordExpired(const std::string& recordId) const {
         return false; // No TTL set, record doesn't expire
     }
     
-    auto now = std::chrono::steady_clock::now();
-    return now >= it->second;
+    auto now = std::chrono::steady_clock::now();
+    return now >= it->second;
+}
+
+void InMemoryDBImpl::cleanupExpiredRecord(const std::string& recordId) {
+    captureForRewrite(recordId);
+    auto recordIt = records_.find(recordId);
+    if (recordIt != records_.end()) {
+        eraseRecord(recordIt);
+        trackRemovedRecord(recordId);
+    }
+    ttlMap_.erase(recordId);
+    markDirty(recordId);
+    logMutation(LogOp::Expire, recordId);
+}
+
+bool InMemoryDBImpl::dropIfExpired(const std::string& recordId) {
+    if (replaying_ || !isRecordExpired(recordId)) {
+        return false;
+    }
+    cleanupExpiredRecord(recordId);
+    return true;
+}
+
+void InMemoryDBImpl::markDirty(const std::string& recordId) {
+    changeEpochs_[recordId] = ++changeEpoch_;
+}
+
+bool InMemoryDBImpl::isDefinitelyAbsent(const std::string& recordId) const {
+    if (!recordFilter_ || recordFilter_->mayContain(recordId)) {
+        return false;
+    }
+    filteredLookups_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void InMemoryDBImpl::trackNewRecord(const std::string& recordId) {
+    if (recordIndex_) {
+        recordIndex_->insert(recordId);
+    }
+    if (!recordFilter_) {
+        return;
+    }
+    if (recordFilter_->size() >= recordFilter_->capacity()) {
+        rebuildRecordFilter(); // Sized for twice the current records
+    } else {
+        recordFilter_->add(recordId);
+    }
+}
+
+void InMemoryDBImpl::trackRemovedRecord(const std::string& recordId) {
+    if (recordFilter_) {
+        recordFilter_->remove(recordId);
+    }
+    if (recordIndex_) {
+        recordIndex_->erase(recordId);
+    }
+    if (tierStore_) {
+        tierStore_->drop(recordId);
+        residentRecords_.remove(recordId);
+    }
+}
+
+void InMemoryDBImpl::rebuildRecordFilter() {
+    if (!recordFilter_) {
+        return;
+    }
+    recordFilter_ = std::make_unique<RecordFilter>(std::max<size_t>(2 * records_.size(), 1024), recordFilterRate_);
+    for (const auto& record : records_) {
+        recordFilter_->add(record.first);
+    }
+}
+
+void InMemoryDBImpl::rebuildRecordIndex() {
+    if (!recordIndex_) {
+        return;
+    }
+    recordIndex_->clear();
+    for (const auto& record : records_) {
+        recordIndex_->insert(record.first);
+    }
+}
+
+void InMemoryDBImpl::promoteRecord(RecordMap::iterator recordIt) const {
+    if (!tierStore_ || !recordIt->second.empty()) {
+        return;
+    }
+    std::string payload;
+    if (tierStore_->load(recordIt->first, payload) && decodeFields(payload, recordIt->second)) {
+        tierStore_->drop(recordIt->first);
+    }
+}
+
+void InMemoryDBImpl::touchRecord(RecordMap::iterator recordIt) const {
+    if (!tierStore_) {
+        return;
+    }
+    residentRecords_.touch(recordIt->first, estimateRecordBytes(recordIt->first, recordIt->second));
+    evictColdRecords();
+}
+
+void InMemoryDBImpl::evictColdRecords() const {
+    std::string payload;
+    
+    // The most recently used record always stays resident
+    while (residentRecords_.totalBytes() > maxResidentBytes_ && residentRecords_.size() > 1) {
+        std::string recordId = *residentRecords_.coldest();
+        auto recordIt = records_.find(recordId);
+        if (recordIt != records_.end() && !recordIt->second.empty()) {
+            payload.clear();
+            encodeFields(recordIt->second, payload);
+            if (!tierStore_->store(recordId, payload)) {
+                return; // Keep records in memory while the tier cannot be written
+            }
+            FieldMap().swap(recordIt->second);
+        }
+        residentRecords_.remove(recordId);
+    }
+}
+
+const InMemoryDBImpl::FieldMap& InMemoryDBImpl::fieldsOf(const RecordMap::value_type& record, FieldMap& scratch,
+                                                          bool exported) const {
+    const FieldMap* fields = &record.second;
+    if (tierStore_ && record.second.empty()) {
+        std::string payload;
+        if (!tierStore_->load(record.first, payload) || !decodeFields(payload, scratch)) {
+            scratch.clear();
+        }
+        fields = &scratch;
+    }
+    if (!exported) {
+        return *fields;
+    }
+    
+    // Untagged values are the same in both forms
+    bool converted = false;
+    for (const auto& fieldPair : *fields) {
+        converted = converted || isTagged(fieldPair.second);
+    }
+    if (!converted) {
+        return *fields;
+    }
+    if (fields != &scratch) {
+        scratch = *fields;
+    }
+    for (auto& fieldPair : scratch) {
+        if (isTagged(fieldPair.second)) {
+            fieldPair.second = exportValue(fieldPair.first, fieldPair.second);
+        }
+    }
+    return scratch;
+}
+
+void InMemoryDBImpl::resetTiering() {
+    if (!tierStore_) {
+        return;
+    }
+    tierStore_->clear();
+    residentRecords_.clear();
+    for (const auto& record : records_) {
+        residentRecords_.touch(record.first, estimateRecordBytes(record.first, record.second));
+    }
+    evictColdRecords();
+}
+
+std::string InMemoryDBImpl::encodeValue(const std::string& field, const std::string& value) {
+    auto codecIt = valueCodecs_.find(field);
+    if (codecIt == valueCodecs_.end()) {
+        auto profileIt = internValues_ ? fieldProfiles_.find(field) : fieldProfiles_.end();
+        if (profileIt != fieldProfiles_.end() && profileIt->second.state == InternState::Interned) {
+            return internedHandle(profileIt->second.pool.acquire(value));
+        }
+        return value;
+    }
+    
+    ValueCodec& codec = codecIt->second;
+    if (value.size() >= codec.minSize && value.size() <= UINT32_MAX) {
+        if (!codec.dictionary) {
+            codec.samples.push_back(value);
+            if (codec.samples.size() >= DICTIONARY_SAMPLES) {
+                codec.dictionary = std::make_shared<const CompressionDictionary>(
+                    CompressionDictionary::train(codec.samples));
+                std::vector<std::string>().swap(codec.samples);
+            }
+        }
+        
+        std::string compressed;
+        if (codec.dictionary) {
+            codec.dictionary->compress(value, compressed);
+        } else {
+            compressBlock(SnapshotCodec::InTree, value, compressed);
+        }
+        if (compressed.size() + COMPRESSED_HEADER_SIZE < value.size()) {
+            std::string stored;
+            stored.reserve(COMPRESSED_HEADER_SIZE + compressed.size());
+            stored.push_back(COMPRESSED_TAG);
+            stored.push_back(codec.dictionary ? 1 : 0);
+            putU32(stored, static_cast<uint32_t>(value.size()));
+            stored.append(compressed);
+            return stored;
+        }
+    }
+    
+    return isTagged(value) ? ESCAPED_TAG + value : value;
+}
+
+std::string InMemoryDBImpl::decodeValue(const std::string& field, const std::string& stored) const {
+    if (!isTagged(stored)) {
+        return stored;
+    }
+    if (stored[0] == Collection::TAG) {
+        const Collection* collection = collectionOf(stored);
+        if (!collection) {
+            return stored;
+        }
+        std::string value;
+        collection->serialize(value);
+        return value;
+    }
+    if (stored[0] == INTERNED_TAG) {
+        const InternPool* pool = internPoolOf(field);
+        uint32_t id = 0;
+        return pool && internedId(stored, id) ? pool->value(id) : stored;
+    }
+    auto codecIt = valueCodecs_.find(field);
+    if (codecIt == valueCodecs_.end()) {
+        return stored;
+    }
+    if (stored[0] == ESCAPED_TAG) {
+        return stored.substr(1);
+    }
+    
+    uint32_t rawSize = 0;
+    std::string value;
+    if (!compressedRawSize(stored, rawSize)) {
+        return std::string();
+    }
+    const char* data = stored.data() + COMPRESSED_HEADER_SIZE;
+    size_t size = stored.size() - COMPRESSED_HEADER_SIZE;
+    bool decoded = stored[1] != 0
+        ? codecIt->second.dictionary && codecIt->second.dictionary->decompress(data, size, rawSize, value)
+        : decompressBlock(SnapshotCodec::InTree, data, size, rawSize, value);
+    if (!decoded) {
+        value.clear();
+    }
+    return value;
+}
+
+std::string InMemoryDBImpl::exportValue(const std::string& field, const std::string& stored) const {
+    const Collection* collection = collectionOf(stored);
+    if (collection) {
+        std::string serialized;
+        collection->serialize(serialized);
+        return serialized;
+    }
+    std::string value = decodeValue(field, stored);
+    return isTagged(value) ? ESCAPED_TAG + value : value;
+}
+
+void InMemoryDBImpl::loggedValue(const std::string& field, const std::string& stored, LogEntry& entry) const {
+    const Collection* collection = collectionOf(stored);
+    if (collection) {
+        entry.op = LogOp::Collection;
+        entry.value.assign(1, COLLECTION_REPLACE);
+        collection->serialize(entry.value);
+    } else {
+        entry.op = LogOp::Set;
+        entry.value = decodeValue(field, stored);
+    }
+}
+
+bool InMemoryDBImpl::storedValueEquals(const std::string& field, const std::string& stored,
+                                       const std::string& value) const {
+    if (!isTagged(stored)) {
+        return stored == value;
+    }
+    if (stored[0] == Collection::TAG) {
+        return Collection::looksSerialized(value) && decodeValue(field, stored) == value;
+    }
+    if (stored[0] == INTERNED_TAG) {
+        const InternPool* pool = internPoolOf(field);
+        uint32_t id = 0;
+        return pool && internedId(stored, id) ? pool->value(id) == value : stored == value;
+    }
+    if (valueCodecs_.count(field) == 0) {
+        return stored == value;
+    }
+    if (stored[0] == ESCAPED_TAG) {
+        return stored.compare(1, std::string::npos, value) == 0;
+    }
+    
+    // Compare the recorded size before paying for decompression
+    uint32_t rawSize = 0;
+    if (!compressedRawSize(stored, rawSize) || rawSize != value.size()) {
+        return false;
+    }
+    return decodeValue(field, stored) == value;
+}
+
+void InMemoryDBImpl::encodeValues(FieldMap& fields) {
+    bool encode = internValues_ || !valueCodecs_.empty();
+    for (auto& fieldPair : fields) {
+        if (Collection::looksSerialized(fieldPair.second)) {
+            std::unique_ptr<Collection> collection = Collection::deserialize(fieldPair.second);
+            if (collection) {
+                fieldPair.second = storeCollection(std::move(collection));
+                continue;
+            }
+        } else if (!fieldPair.second.empty() && fieldPair.second[0] == ESCAPED_TAG) {
+            fieldPair.second.erase(0, 1); // A plain value that starts with a tag byte
+        }
+        if (encode) {
+            fieldPair.second = encodeValue(fieldPair.first, fieldPair.second);
+        }
+    }
+}
+
+void InMemoryDBImpl::recodeField(const std::string& field, bool encode) {
+    FieldMap scratch;
+    std::string payload;
+    
+    for (auto& record : records_) {
+        FieldMap* fields = &record.second;
+        bool cold = tierStore_ && record.second.empty();
+        if (cold) {
+            if (!tierStore_->load(record.first, payload) || !decodeFields(payload, scratch)) {
+                continue;
+            }
+            fields = &scratch;
+        }
+        
+        auto fieldIt = fields->find(field);
+        if (fieldIt == fields->end() || collectionOf(fieldIt->second)) {
+            continue;
+        }
+        fieldIt->second = encode ? encodeValue(field, fieldIt->second) : decodeValue(field, fieldIt->second);
+        
+        if (cold) {
+            payload.clear();
+            encodeFields(scratch, payload);
+            tierStore_->store(record.first, payload);
+        }
+    }
+}
+
+void InMemoryDBImpl::releaseValue(const std::string& field, const std::string& stored,
+                                  std::vector<std::unique_ptr<Collection>>* detached) {
+    uint32_t id = 0;
+    uint64_t nonce = 0;
+    if (collectionSlot(stored, id, nonce)) {
+        if (id < collections_.size() && collections_[id].collection && collections_[id].nonce == nonce) {
+            if (detached) {
+                detached->push_back(std::move(collections_[id].collection)); // The slot is free either way
+            } else {
+                collections_[id].collection.reset();
+            }
+            freeCollectionSlots_.push_back(id);
+            liveCollections_--;
+        }
+        return;
+    }
+    if (!internedId(stored, id)) {
+        return;
+    }
+    auto profileIt = fieldProfiles_.find(field);
+    if (profileIt != fieldProfiles_.end() && profileIt->second.state == InternState::Interned) {
+        profileIt->second.pool.release(id);
+    }
+}
+
+void InMemoryDBImpl::releaseRecordValues(const RecordMap::value_type& record,
+                                         std::vector<std::unique_ptr<Collection>>* detached) {
+    if (!internValues_ && liveCollections_ == 0) {
+        return;
+    }
+    FieldMap scratch;
+    for (const auto& fieldPair : fieldsOf(record, scratch, false)) {
+        releaseValue(fieldPair.first, fieldPair.second, detached);
+    }
+}
+
+void InMemoryDBImpl::discardValue(const std::string& field, const std::string& stored) {
+    if (!lazyFreer_ || StorageArena::mode() != HugePageMode::Off) {
+        releaseValue(field, stored);
+        return;
+    }
+    std::vector<std::unique_ptr<Collection>> detached;
+    releaseValue(field, stored, &detached);
+    if (!detached.empty() && detached.front()->size() >= lazyFreeMinFields_) {
+        lazyFreer_->free(std::move(detached.front()));
+    }
+}
+
+void InMemoryDBImpl::eraseRecord(RecordMap::iterator recordIt) {
+    if (!lazyFreer_ || StorageArena::mode() != HugePageMode::Off) {
+        releaseRecordValues(*recordIt);
+        syncFreedRecords_ += lazyFreer_ ? 1 : 0;
+        records_.erase(recordIt);
+        return;
+    }
+    
+    // Collection members weigh like fields: a huge sorted set blocks as long as a huge record
+    std::vector<std::unique_ptr<Collection>> collections;
+    releaseRecordValues(*recordIt, &collections);
+    size_t weight = recordIt->second.size();
+    for (const auto& collection : collections) {
+        weight += collection->size();
+    }
+    if (weight >= lazyFreeMinFields_) {
+        lazyFreer_->free(std::move(recordIt->second), std::move(collections)); // Leaves an empty map to erase
+    } else {
+        syncFreedRecords_++;
+    }
+    records_.erase(recordIt);
+}
+
+void InMemoryDBImpl::observeValue(const std::string& field, const std::string& value) {
+    FieldProfile& profile = fieldProfiles_[field];
+    if (profile.state == InternState::Interned) {
+        if (profile.pool.size() > INTERN_MAX_VALUES) {
+            // Cardinality outgrew the pool; store the field's values as is again
+            recodeField(field, false);
+            profile.pool.clear();
+            profile.state = InternState::Plain;
+        }
+        return;
+    }
+    if (profile.state == InternState::Plain) {
+        return;
+    }
+    if (valueCodecs_.count(field) > 0) {
+        profile.state = InternState::Plain;
+        return;
+    }
+    
+    profile.observedValues++;
+    profile.distinctValues.insert(value);
+    if (profile.distinctValues.size() > INTERN_MAX_DISTINCT) {
+        profile.state = InternState::Plain;
+        std::unordered_set<std::string>().swap(profile.distinctValues);
+    } else if (profile.observedValues >= INTERN_OBSERVED_VALUES) {
+        profile.state = InternState::Interned;
+        std::unordered_set<std::string>().swap(profile.distinctValues);
+        recodeField(field, true);
+    }
+}
+
+const InternPool* InMemoryDBImpl::internPoolOf(const std::string& field) const {
+    if (!internValues_) {
+        return nullptr;
+    }
+    auto profileIt = fieldProfiles_.find(field);
+    if (profileIt == fieldProfiles_.end() || profileIt->second.state != InternState::Interned) {
+        return nullptr;
+    }
+    return &profileIt->second.pool;
+}
+
+void InMemoryDBImpl::resetValuePools() {
+    for (auto& profile : fieldProfiles_) {
+        profile.second.pool.clear();
+    }
+    collections_.clear();
+    freeCollectionSlots_.clear();
+    liveCollections_ = 0;
+}
+
+std::string InMemoryDBImpl::storeCollection(std::unique_ptr<Collection> collection) {
+    uint32_t slot;
+    if (!freeCollectionSlots_.empty()) {
+        slot = freeCollectionSlots_.back();
+        freeCollectionSlots_.pop_back();
+    } else {
+        slot = static_cast<uint32_t>(collections_.size());
+        collections_.emplace_back();
+    }
+    
+    // Successive nonces of one database differ in every handle
+    collectionNonce_ += 0x9E3779B97F4A7C15ULL;
+    collections_[slot].collection = std::move(collection);
+    collections_[slot].nonce = collectionNonce_;
+    liveCollections_++;
+    return collectionHandle(slot, collectionNonce_);
+}
+
+Collection* InMemoryDBImpl::collectionOf(const std::string& stored) const {
+    uint32_t slot = 0;
+    uint64_t nonce = 0;
+    if (liveCollections_ == 0 || !collectionSlot(stored, slot, nonce) || slot >= collections_.size() ||
+        collections_[slot].nonce != nonce) {
+        return nullptr;
+    }
+    return collections_[slot].collection.get();
+}
+
+void InMemoryDBImpl::writeRecord(std::ostream& out, const std::string& recordId, const FieldMap& fields) {
+    out << recordId << "\n";
+    out << fields.size() << "\n";
+    
+    for (const auto& fieldPair : fields) {
+        out << fieldPair.first << "\n";
+        out << fieldPair.second << "\n";
+    }
+}
+
+// Level 1: Basic operations
+void InMemoryDBImpl::set(const std::string& recordId, const std::string& field, const std::string& value) {
+    // Drop the record first if it is expired
+    dropIfExpired(recordId);
+    
+    auto inserted = records_.try_emplace(recordId);
+    if (!inserted.second) {
+        promoteRecord(inserted.first);
+    }
+    assignValue(inserted.first, inserted.second, recordId, field, value);
+}
+
+void InMemoryDBImpl::assignValue(RecordMap::iterator recordIt, bool created, const std::string& recordId,
+                                 const std::string& field, const std::string& value,
+                                 std::unique_ptr<Collection> collection) {
+    captureForRewrite(recordId);
+    bool isCollection = collection != nullptr;
+    if (!isCollection && valueCodecs_.empty() && !internValues_ && liveCollections_ == 0) {
+        recordIt->second[field] = value;
+    } else {
+        std::string& stored = recordIt->second[field];
+        discardValue(field, stored);
+        stored = isCollection ? storeCollection(std::move(collection)) : encodeValue(field, value);
+    }
+    if (created) {
+        trackNewRecord(recordId);
+    }
+    if (internValues_ && !isCollection) {
+        observeValue(field, value);
+    }
+    touchRecord(recordIt);
+    markDirty(recordId);
+    if (isCollection) {
+        logMutation(LogOp::Collection, recordId, field, COLLECTION_REPLACE + value);
+    } else {
+        logMutation(LogOp::Set, recordId, field, value);
+    }
+}
+
+std::optional<std::string> InMemoryDBImpl::get(const std::string& recordId, const std::string& field) const {
+    // Check if record is absent or expired
+    if (isDefinitelyAbsent(recordId) || isRecordExpired(recordId)) {
+        return std::nullopt;
+    }
+    
+    auto recordIt = records_.find(recordId);
+    if (recordIt == records_.end()) {
+        return std::nullopt; // Record doesn't exist
+    }
+    promoteRecord(recordIt);
+    touchRecord(recordIt);
+    
+    auto fieldIt = recordIt->second.find(field);
+    if (fieldIt == recordIt->second.end()) {
+        return std::nullopt; // Field doesn't exist
+    }
+    
+    return decodeValue(field, fieldIt->second);
+}
+
+bool InMemoryDBImpl::deleteField(const std::string& recordId, const std::string& field) {
+    if (isDefinitelyAbsent(recordId)) {
+        return false;
+    }
+    
+    // Check if record is expired
+    if (dropIfExpired(recordId)) {
+        return false;
+    }
+    
+    auto recordIt = records_.find(recordId);
+    if (recordIt == records_.end()) {
+        return false; // Record doesn't exist
+    }
+    promoteRecord(recordIt);
+    
+    auto fieldIt = recordIt->second.find(field);
+    if (fieldIt == recordIt->second.end()) {
+        return false; // Field doesn't exist
+    }
+    
+    captureForRewrite(recordId);
+    discardValue(field, fieldIt->second);
+    recordIt->second.erase(fieldIt);
+    recordIt->second.shrink();
+    
+    // If record becomes empty, remove it entirely
+    if (recordIt->second.empty()) {
+        records_.erase(recordIt);
+        ttlMap_.erase(recordId);
+        trackRemovedRecord(recordId);
+    } else {
+        touchRecord(recordIt);
+    }
+    
+    markDirty(recordId);
+    logMutation(LogOp::DeleteField, recordId, field);
+    return true;
+}
+
+bool InMemoryDBImpl::deleteRecord(const std::string& recordId) {
+    if (isDefinitelyAbsent(recordId)) {
+        return false;
+    }
+    
+    auto recordIt = records_.find(recordId);
+    if (recordIt == records_.end()) {
+        return false; // Record doesn't exist
+    }
+    
+    captureForRewrite(recordId);
+    eraseRecord(recordIt);
+    ttlMap_.erase(recordId);
+    trackRemovedRecord(recordId);
+    markDirty(recordId);
+    logMutation(LogOp::DeleteRecord, recordId);
+    return true;
+}
+
+std::vector<std::string> InMemoryDBImpl::getFields(const std::string& recordId) const {
+    // Check if record is absent or expired
+    if (isDefinitelyAbsent(recordId) || isRecordExpired(recordId)) {
+        return {}; // Return empty vector for expired records
+    }
+    
+    auto recordIt = records_.find(recordId);
+    if (recordIt == records_.end()) {
+        return {}; // Record doesn't exist
+    }
+    promoteRecord(recordIt);
+    touchRecord(recordIt);
+    
+    std::vector<std::string> fields;
+    fields.reserve(recordIt->second.size());
+    
+    for (const auto& pair : recordIt->second) {
+        fields.push_back(pair.first);
+    }
+    
+    std::sort(fields.begin(), fields.end()); // Sort for consistent ordering
+    return fields;
+}
+
+bool InMemoryDBImpl::hasRecord(const std::string& recordId) const {
+    // Check if record is absent or expired
+    if (isDefinitelyAbsent(recordId) || isRecordExpired(recordId)) {
+        return false;
+    }
+    
+    return records_.find(recordId) != records_.end();
+}
+
+std::vector<std::string> InMemoryDBImpl::getAllRecordIds() const {
+    std::vector<std::string> recordIds;
+    
+    for (const auto& pair : records_) {
+        // Only include non-expired records
+        if (!isRecordExpired(pair.first)) {
+            recordIds.push_back(pair.first);
+        }
+    }
+    
+    std::sort(recordIds.begin(), recordIds.end()); // Sort for consistent ordering
+    return recordIds;
+}
+
+// Batched lookups
+void InMemoryDBImpl::probeRecords(const std::string* recordIds, size_t count,
+                                  const RecordMap::value_type** found) const {
+    const RecordMap* tables[PROBE_GROUP_SIZE];
+    for (size_t i = 0; i < count; i++) {
+        tables[i] = isDefinitelyAbsent(recordIds[i]) ? nullptr : &records_;
+    }
+    probeGroup(tables, [&](size_t i) -> const std::string& { return recordIds[i]; }, count, found);
+    
+    if (!ttlMap_.empty()) {
+        for (size_t i = 0; i < count; i++) {
+            if (found[i] != nullptr && isRecordExpired(recordIds[i])) {
+                found[i] = nullptr;
+            }
+        }
+    }
+}
+
+std::vector<std::optional<std::string>> InMemoryDBImpl::getMany(const std::vector<std::string>& recordIds,
+                                                                const std::string& field) const {
+    std::vector<std::optional<std::string>> values(recordIds.size());
+    const RecordMap::value_type* records[PROBE_GROUP_SIZE];
+    const FieldMap* fieldTables[PROBE_GROUP_SIZE];
+    const FieldMap::value_type* fields[PROBE_GROUP_SIZE];
+    
+    for (size_t start = 0; start < recordIds.size(); start += PROBE_GROUP_SIZE) {
+        size_t count = std::min(PROBE_GROUP_SIZE, recordIds.size() - start);
+        probeRecords(&recordIds[start], count, records);
+        
+        if (tierStore_) {
+            // Loading a record can evict others of the group, so finish each one in turn
+            for (size_t i = 0; i < count; i++) {
+                if (records[i] == nullptr) {
+                    continue;
+                }
+                auto recordIt = records_.find(recordIds[start + i]);
+                promoteRecord(recordIt);
+                touchRecord(recordIt);
+                auto fieldIt = recordIt->second.find(field);
+                if (fieldIt != recordIt->second.end()) {
+                    values[start + i] = decodeValue(field, fieldIt->second);
+                }
+            }
+            continue;
+        }
+        
+        // Second stage: the field tables of the records found
+        for (size_t i = 0; i < count; i++) {
+            fieldTables[i] = records[i] != nullptr ? &records[i]->second : nullptr;
+        }
+        probeFieldGroup(fieldTables, field, count, fields);
+        
+        for (size_t i = 0; i < count; i++) {
+            if (fields[i] != nullptr) {
+                values[start + i] = decodeValue(field, fields[i]->second);
+            }
+        }
+    }
+    return values;
+}
+
+std::vector<bool> InMemoryDBImpl::hasRecords(const std::vector<std::string>& recordIds) const {
+    std::vector<bool> present(recordIds.size());
+    const RecordMap::value_type* records[PROBE_GROUP_SIZE];
+    
+    for (size_t start = 0; start < recordIds.size(); start += PROBE_GROUP_SIZE) {
+        size_t count = std::min(PROBE_GROUP_SIZE, recordIds.size() - start);
+        probeRecords(&recordIds[start], count, records);
+        for (size_t i = 0; i < count; i++) {
+            present[start + i] = records[i] != nullptr;
+        }
+    }
+    return present;
+}
+
+// Level 2: Filtering functionality
+std::vector<std::string> InMemoryDBImpl::getRecordsByFieldValue(const std::string& field, const std::string& value) const {
+    std::vector<std::string> matchingRecords;
+    FieldMap scratch;
+    
+    // Interned values are compared by handle; a value missing from the pool matches nothing
+    const InternPool* pool = internPoolOf(field);
+    std::string handle;
+    if (pool) {
+        uint32_t id = 0;
+        if (!pool->find(value, id)) {
+            return matchingRecords;
+        }
+        handle = internedHandle(id);
+    }
+    
+    for (const auto& recordPair : records_) {
+        const std::string& recordId = recordPair.first;
+        
+        // Skip expired records
+        if (isRecordExpired(recordId)) {
+            continue;
+        }
+        
+        const auto& fields = fieldsOf(recordPair, scratch, false);
+        auto fieldIt = fields.find(field);
+        if (fieldIt != fields.end() &&
+            (pool ? fieldIt->second == handle : storedValueEquals(field, fieldIt->second, value))) {
+            matchingRecords.push_back(recordId);
+        }
+    }
+    
+    std::sort(matchingRecords.begin(), matchingRecords.end()); // Sort for consistent ordering
+    return matchingRecords;
+}
+
+// Level 3: TTL functionality
+void InMemoryDBImpl::setTTL(const std::string& recordId, int ttlSeconds) {
+    // Only set TTL if record exists
+    if (records_.find(recordId) == records_.end()) {
+        return; // Record doesn't exist
+    }
+    
+    auto expirationTime = std::chrono::steady_clock::now() + std::chrono::seconds(ttlSeconds);
+    captureForRewrite(recordId);
+    ttlMap_[recordId] = expirationTime;
+    markDirty(recordId);
+    logMutation(LogOp::SetTTL, recordId, std::string(), std::string(), toWallClockMs(expirationTime));
+}
+
+int InMemoryDBImpl::expireRecords() {
+    int expiredCount = 0;
+    auto now = std::chrono::steady_clock::now();
+    
+    // Collect expired record IDs to avoid iterator invalidation
+    std::vector<std::string> expiredRecords;
+    
+    for (const auto& ttlPair : ttlMap_) {
+        if (now >= ttlPair.second) {
+            expiredRecords.push_back(ttlPair.first);
+        }
+    }
+    
+    // Remove expired records
+    for (const std::string& recordId : expiredRecords) {
+        cleanupExpiredRecord(recordId);
+        expiredCount++;
+    }
+    
+    return expiredCount;
+}
+
+// Level 4: Backup and restore
+std::string InMemoryDBImpl::backup() const {
+    std::ostringstream backup;
+    
+    // Format: RECORD_COUNT\n
+    // For each record: RECORD_ID\nFIELD_COUNT\nFIELD1\nVALUE1\nFIELD2\nVALUE2\n...
+    // TTL_COUNT\n
+    // For each TTL: RECORD_ID\nTTL_SECONDS_REMAINING\n
+    
+    std::vector<std::string> validRecordIds;
+    for (const auto& recordPair : records_) {
+        if (!isRecordExpired(recordPair.first)) {
+            validRecordIds.push_back(recordPair.first);
+        }
+    }
+    
+    backup << validRecordIds.size() << "\n";
+    
+    FieldMap scratch;
+    for (const std::string& recordId : validRecordIds) {
+        writeRecord(backup, recordId, fieldsOf(*records_.find(recordId), scratch));
+    }
+    
+    // Backup TTL information
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::pair<std::string, int>> validTTLs;
+    
+    for (const std::string& recordId : validRecordIds) {
+        auto ttlIt = ttlMap_.find(recordId);
+        if (ttlIt != ttlMap_.end()) {
+            auto remainingTime = std::chrono::duration_cast<std::chrono::seconds>(ttlIt->second - now);
+            if (remainingTime.count() > 0) {
+                validTTLs.push_back({recordId, static_cast<int>(remainingTime.count())});
+            }
+        }
+    }
+    
+    backup << validTTLs.size() << "\n";
+    for (const auto& ttlPair : validTTLs) {
+        backup << ttlPair.first << "\n";
+        backup << ttlPair.second << "\n";
+    }
+    
+    return backup.str();
+}
+
+bool InMemoryDBImpl::restore(const std::string& backupData) {
+    Dataset staged;
+    if (!prepareRestore(backupData, staged)) {
+        // Clear database on restore failure
+        records_.clear();
+        ttlMap_.clear();
+        changeEpochs_.clear();
+        baselineEpoch_ = ++changeEpoch_;
+        resetValuePools();
+        rebuildRecordFilter();
+        rebuildRecordIndex();
+        resetTiering();
+        logMutation(LogOp::Clear, std::string());
+        return false;
+    }
+    
+    commitRestore(staged);
+    return true;
+}
+
+bool InMemoryDBImpl::parseBackup(const std::string& backupData, Dataset& staged) {
+    try {
+        std::istringstream stream(backupData);
+        std::string line;
+        
+        // Read record count
+        if (!std::getline(stream, line)) return false;
+        int recordCount = std::stoi(line);
+        staged.records.reserve(recordCount > 0 ? recordCount : 0);
+        
+        // Read records
+        for (int i = 0; i < recordCount; i++) {
+            if (!std::getline(stream, line)) return false;
+            std::string recordId = line;
+            
+            if (!std::getline(stream, line)) return false;
+            int fieldCount = std::stoi(line);
+            
+            for (int j = 0; j < fieldCount; j++) {
+                if (!std::getline(stream, line)) return false;
+                std::string field = line;
+                
+                if (!std::getline(stream, line)) return false;
+                std::string value = line;
+                
+                staged.records[recordId][field] = value;
+            }
+        }
+        
+        // Read TTL count
+        if (!std::getline(stream, line)) return false;
+        int ttlCount = std::stoi(line);
+        
+        // Read TTLs
+        auto now = std::chrono::steady_clock::now();
+        for (int i = 0; i < ttlCount; i++) {
+            if (!std::getline(stream, line)) return false;
+            std::string recordId = line;
+            
+            if (!std::getline(stream, line)) return false;
+            int ttlSeconds = std::stoi(line);
+            
+            staged.ttlMap[recordId] = now + std::chrono::seconds(ttlSeconds);
+        }
+        
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+bool InMemoryDBImpl::prepareRestore(const std::string& data, Dataset& staged, unsigned threadCount) {
+    staged.records.clear();
+    staged.ttlMap.clear();
+    
+    bool parsed = data.compare(0, SNAPSHOT_MAGIC.size(), SNAPSHOT_MAGIC) == 0
+        ? decodeSnapshot(data, staged, threadCount)
+        : parseBackup(data, staged);
+    
+    if (!parsed) {
+        staged.records.clear();
+        staged.ttlMap.clear();
+    }
+    return parsed;
+}
+
+void InMemoryDBImpl::commitRestore(Dataset& staged) {
+    // O(1) swap; the previous state is handed back to the caller to free
+    records_.swap(staged.records);
+    ttlMap_.swap(staged.ttlMap);
+    
+    // The rest is O(n): encoding depends on this instance's pools and codecs, which
+    // prepareRestore() cannot use from another thread
+    resetValuePools();
+    for (auto& record : records_) {
+        encodeValues(record.second);
+    }
+    rebuildRecordFilter();
+    rebuildRecordIndex();
+    resetTiering();
+    
+    // Tokens taken before the restore no longer describe this state
+    changeEpochs_.clear();
+    baselineEpoch_ = ++changeEpoch_;
+    
+    // The whole new state is one logged mutation; it starts with a Clear, so a
+    // rewrite's base needs nothing more
+    ++mutationSeq_;
+    if (rewriteCapturing_) {
+        finishLogRewriteCapture();
+    }
+    if (appendLog_) {
+        forEachStateEntry(mutationSeq_, [this](const LogEntry& entry) { appendLog_->append(entry); });
+    }
+    
+    // Stream readers only learn that the dataset was replaced
+    if (changeStream_) {
+        LogEntry entry;
+        entry.op = LogOp::Clear;
+        changeStream_->publish(std::move(entry));
+    }
+}
+
+bool InMemoryDBImpl::restoreAtomic(const std::string& data, unsigned threadCount) {
+    Dataset staged;
+    if (!prepareRestore(data, staged, threadCount)) {
+        return false; // Current state is untouched
+    }
+    
+    commitRestore(staged);
+    return true;
+}
+
+// Incremental backups
+uint64_t InMemoryDBImpl::backupToken() const {
+    return changeEpoch_;
+}
+
+std::string InMemoryDBImpl::backupIncremental(uint64_t sinceToken) const {
+    std::ostringstream delta;
+    
+    // Format: DELTA\nSINCE_TOKEN\nUPTO_TOKEN\nRESET\n
+    // CHANGED_COUNT\n
+    // For each changed record: RECORD_ID\nFIELD_COUNT\nFIELD1\nVALUE1\n...TTL_SECONDS_REMAINING (-1 if none)\n
+    // DELETED_COUNT\n
+    // For each deleted record: RECORD_ID\n
+    //
+    // RESET is 1 when the token predates the last restore (or is unknown), in
+    // which case the delta carries every live record and replaces the state.
+    
+    bool reset = sinceToken < baselineEpoch_ || sinceToken > changeEpoch_;
+    auto now = std::chrono::steady_clock::now();
+    
+    std::vector<std::string> changedRecordIds;
+    std::vector<std::string> deletedRecordIds;
+    
+    if (reset) {
+        for (const auto& recordPair : records_) {
+            if (!isRecordExpired(recordPair.first)) {
+                changedRecordIds.push_back(recordPair.first);
+            }
+        }
+    } else {
+        for (const auto& epochPair : changeEpochs_) {
+            if (epochPair.second <= sinceToken) {
+                continue; // Unchanged since the previous backup
+            }
+            
+            if (records_.find(epochPair.first) != records_.end() && !isRecordExpired(epochPair.first)) {
+                changedRecordIds.push_back(epochPair.first);
+            } else {
+                deletedRecordIds.push_back(epochPair.first);
+            }
+        }
+        
+        // Records that expired without being cleaned up yet are deletions too
+        for (const auto& ttlPair : ttlMap_) {
+            if (now >= ttlPair.second) {
+                auto epochIt = changeEpochs_.find(ttlPair.first);
+                if (epochIt == changeEpochs_.end() || epochIt->second <= sinceToken) {
+                    deletedRecordIds.push_back(ttlPair.first);
+                }
+            }
+        }
+    }
+    
+    delta << "DELTA\n" << sinceToken << "\n" << changeEpoch_ << "\n" << (reset ? 1 : 0) << "\n";
+    
+    delta << changedRecordIds.size() << "\n";
+    FieldMap scratch;
+    for (const std::string& recordId : changedRecordIds) {
+        writeRecord(delta, recordId, fieldsOf(*records_.find(recordId), scratch));
+        
+        int ttlSeconds = -1;
+        auto ttlIt = ttlMap_.find(recordId);
+        if (ttlIt != ttlMap_.end()) {
+            auto remainingTime = std::chrono::duration_cast<std::chrono::seconds>(ttlIt->second - now);
+            ttlSeconds = static_cast<int>(std::max<long long>(remainingTime.count(), 0));
+        }
+        delta << ttlSeconds << "\n";
+    }
+    
+    delta << deletedRecordIds.size() << "\n";
+    for (const std::string& recordId : deletedRecordIds) {
+        delta << recordId << "\n";
+    }
+    
+    return delta.str();
+}
+
+bool InMemoryDBImpl::applyIncremental(const std::string& deltaData) {
+    // Parse the whole delta before touching the database so that a malformed
+    // delta leaves the current state untouched
+    std::vector<std::pair<std::string, FieldMap>> changedRecords;
+    std::vector<int> changedTTLs;
+    std::vector<std::string> deletedRecordIds;
+    bool reset = false;
+    
+    try {
+        std::istringstream stream(deltaData);
+        std::string line;
+        
+        if (!std::getline(stream, line) || line != "DELTA") return false;
+        if (!std::getline(stream, line)) return false; // Since token
+        if (!std::getline(stream, line)) return false; // Upto token
+        if (!std::getline(stream, line)) return false;
+        reset = std::stoi(line) != 0;
+        
+        if (!std::getline(stream, line)) return false;
+        int changedCount = std::stoi(line);
+        
+        for (int i = 0; i < changedCount; i++) {
+            if (!std::getline(stream, line)) return false;
+            std::string recordId = line;
+            
+            if (!std::getline(stream, line)) return false;
+            int fieldCount = std::stoi(line);
+            
+            FieldMap fields;
+            for (int j = 0; j < fieldCount; j++) {
+                if (!std::getline(stream, line)) return false;
+                std::string field = line;
+                
+                if (!std::getline(stream, line)) return false;
+                fields[field] = line;
+            }
+            
+            if (!std::getline(stream, line)) return false;
+            changedTTLs.push_back(std::stoi(line));
+            changedRecords.emplace_back(std::move(recordId), std::move(fields));
+        }
+        
+        if (!std::getline(stream, line)) return false;
+        int deletedCount = std::stoi(line);
+        
+        for (int i = 0; i < deletedCount; i++) {
+            if (!std::getline(stream, line)) return false;
+            deletedRecordIds.push_back(line);
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    
+    if (reset) {
+        records_.clear();
+        ttlMap_.clear();
+        resetValuePools();
+        rebuildRecordFilter();
+        rebuildRecordIndex();
+        resetTiering();
+        logMutation(LogOp::Clear, std::string());
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < changedRecords.size(); i++) {
+        const std::string& recordId = changedRecords[i].first;
+        captureForRewrite(recordId);
+        auto existing = records_.find(recordId);
+        if (existing != records_.end()) {
+            releaseRecordValues(*existing);
+        }
+        encodeValues(changedRecords[i].second);
+        auto assigned = records_.insert_or_assign(recordId, std::move(changedRecords[i].second));
+        if (assigned.second) {
+            trackNewRecord(recordId);
+        } else if (tierStore_) {
+            tierStore_->drop(recordId); // The cold copy is superseded
+        }
+        touchRecord(assigned.first);
+        
+        if (changedTTLs[i] >= 0) {
+            ttlMap_[recordId] = now + std::chrono::seconds(changedTTLs[i]);
+        } else {
+            ttlMap_.erase(recordId);
+        }
+        markDirty(recordId);
+        logRecordState(recordId);
+    }
+    
+    for (const std::string& recordId : deletedRecordIds) {
+        captureForRewrite(recordId);
+        auto recordIt = records_.find(recordId);
+        if (recordIt != records_.end()) {
+            eraseRecord(recordIt);
+            trackRemovedRecord(recordId);
+        }
+        ttlMap_.erase(recordId);
+        markDirty(recordId);
+        logMutation(LogOp::DeleteRecord, recordId);
+    }
+    
+    return true;
+}
+
+bool InMemoryDBImpl::restoreIncremental(const std::string& baseData, const std::vector<std::string>& deltas) {
+    if (!restore(baseData)) {
+        return false;
+    }
+    
+    for (const std::string& delta : deltas) {
+        if (!applyIncremental(delta)) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+void InMemoryDBImpl::discardChangesBefore(uint64_t token) {
+    // Entries at or before the token can never appear in a delta again
+    for (auto it = changeEpochs_.begin(); it != changeEpochs_.end();) {
+        if (it->second <= token) {
+            it = changeEpochs_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    
+    baselineEpoch_ = std::max(baselineEpoch_, token);
+}
+
+// Block-structured snapshots
+std::string InMemoryDBImpl::snapshot(size_t recordsPerBlock, SnapshotCodec codec) const {
+    if (recordsPerBlock == 0) {
+        recordsPerBlock = 1;
+    }
+    if (!isCodecAvailable(codec)) {
+        codec = SnapshotCodec::InTree;
+    }
+    
+    std::vector<const RecordMap::value_type*> liveRecords;
+    liveRecords.reserve(records_.size());
+    for (const auto& recordPair : records_) {
+        if (!isRecordExpired(recordPair.first)) {
+            liveRecords.push_back(&recordPair);
+        }
+    }
+    
+    size_t blockCount = (liveRecords.size() + recordsPerBlock - 1) / recordsPerBlock;
+    std::string out = SNAPSHOT_MAGIC;
+    putU32(out, static_cast<uint32_t>(blockCount));
+    putU32(out, static_cast<uint32_t>(liveRecords.size()));
+    
+    auto now = std::chrono::steady_clock::now();
+    std::string payload;
+    std::string compressed;
+    FieldMap scratch;
+    
+    for (size_t begin = 0; begin < liveRecords.size(); begin += recordsPerBlock) {
+        size_t end = std::min(begin + recordsPerBlock, liveRecords.size());
+        payload.clear();
+        
+        for (size_t i = begin; i < end; i++) {
+            const std::string& recordId = liveRecords[i]->first;
+            const auto& fields = fieldsOf(*liveRecords[i], scratch);
+            
+            putString(payload, recordId);
+            putU32(payload, static_cast<uint32_t>(fields.size()));
+            for (const auto& fieldPair : fields) {
+                putString(payload, fieldPair.first);
+                putString(payload, fieldPair.second);
+            }
+            
+            uint32_t ttlSeconds = SNAPSHOT_NO_TTL;
+            auto ttlIt = ttlMap_.find(recordId);
+            if (ttlIt != ttlMap_.end()) {
+                auto remainingTime = std::chrono::duration_cast<std::chrono::seconds>(ttlIt->second - now);
+                ttlSeconds = static_cast<uint32_t>(std::max<long long>(remainingTime.count(), 0));
+            }
+            putU32(payload, ttlSeconds);
+        }
+        
+        // Store the block raw when compression does not pay off, or pays off more than a reader accepts
+        SnapshotCodec blockCodec = codec;
+        if (codec == SnapshotCodec::None || !compressBlock(codec, payload, compressed) ||
+            compressed.size() >= payload.size() || payload.size() / SNAPSHOT_MAX_EXPANSION > compressed.size()) {
+            blockCodec = SnapshotCodec::None;
+            compressed.swap(payload);
+        }
+        
+        putU32(out, static_cast<uint32_t>(compressed.size()));
+        putU32(out, static_cast<uint32_t>(end - begin));
+        putU32(out, static_cast<uint32_t>(blockCodec));
+        putU32(out, static_cast<uint32_t>(blockCodec == SnapshotCodec::None ? compressed.size() : payload.size()));
+        uint32_t headerChecksum = blockChecksum(out.data() + out.size() - SNAPSHOT_CHECKED_HEADER_SIZE,
+                                                SNAPSHOT_CHECKED_HEADER_SIZE);
+        putU32(out, blockChecksum(compressed.data(), compressed.size(), headerChecksum));
+        out.append(compressed);
+    }
+    
+    return out;
+}
+
+bool InMemoryDBImpl::restoreSnapshot(const std::string& snapshotData, unsigned threadCount) {
+    Dataset staged;
+    if (!decodeSnapshot(snapshotData, staged, threadCount)) {
+        return false;
+    }
+    
+    commitRestore(staged);
+    return true;
+}
+
+bool InMemoryDBImpl::decodeSnapshot(const std::string& snapshotData, Dataset& staged, unsigned threadCount) {
+    if (snapshotData.compare(0, SNAPSHOT_MAGIC.size(), SNAPSHOT_MAGIC) != 0) {
+        return false;
+    }
+    
+    // Index the blocks; only the small block headers are read here
+    SnapshotReader reader(snapshotData.data() + SNAPSHOT_MAGIC.size(), snapshotData.size() - SNAPSHOT_MAGIC.size());
+    uint32_t blockCount;
+    uint32_t totalRecords;
+    if (!reader.readU32(blockCount) || !reader.readU32(totalRecords)) {
+        return false;
+    }
+    
+    struct BlockRef {
+        size_t offset;
+        uint32_t size;
+        uint32_t recordCount;
+        uint32_t codec;
+        uint32_t rawSize;
+        uint32_t checksum;
+    };
+    std::vector<BlockRef> blocks;
+    blocks.reserve(std::min<size_t>(blockCount, reader.remaining() / SNAPSHOT_BLOCK_HEADER_SIZE));
+    size_t blockRecords = 0;
+    
+    for (uint32_t b = 0; b < blockCount; b++) {
+        BlockRef block;
+        if (!reader.readU32(block.size) || !reader.readU32(block.recordCount) || !reader.readU32(block.codec) ||
+            !reader.readU32(block.rawSize) || !reader.readU32(block.checksum)) {
+            return false;
+        }
+        block.offset = SNAPSHOT_MAGIC.size() + reader.position();
+        if (!reader.skip(block.size)) {
+            return false;
+        }
+        blocks.push_back(block);
+        blockRecords += block.recordCount;
+    }
+    
+    if (!reader.atEnd()) {
+        return false;
+    }
+    
+    // Decode blocks in parallel; each worker claims the next undecoded block
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadCount = std::min<unsigned>(threadCount, std::max<size_t>(blocks.size(), 1));
+    
+    std::vector<std::vector<SnapshotRecord>> decoded(blocks.size());
+    std::atomic<size_t> nextBlock{0};
+    std::atomic<bool> failed{false};
+    
+    auto worker = [&]() {
+        std::string raw;
+        for (;;) {
+            size_t b = nextBlock.fetch_add(1);
+            if (b >= blocks.size() || failed.load()) {
+                return;
+            }
+            
+            const BlockRef& block = blocks[b];
+            const char* stored = snapshotData.data() + block.offset;
+            const char* header = stored - SNAPSHOT_BLOCK_HEADER_SIZE;
+            uint32_t headerChecksum = blockChecksum(header, SNAPSHOT_CHECKED_HEADER_SIZE);
+            if (blockChecksum(stored, block.size, headerChecksum) != block.checksum) {
+                failed.store(true); // Corrupt block, detected without decompressing it
+                return;
+            }
+            
+            const char* payload = stored;
+            size_t payloadSize = block.size;
+            if (static_cast<SnapshotCodec>(block.codec) != SnapshotCodec::None) {
+                if (block.rawSize / SNAPSHOT_MAX_EXPANSION > block.size ||
+                    !decompressBlock(static_cast<SnapshotCodec>(block.codec), stored, block.size, block.rawSize, raw)) {
+                    failed.store(true);
+                    return;
+                }
+                payload = raw.data();
+                payloadSize = raw.size();
+            }
+            
+            if (!decodeSnapshotBlock(payload, payloadSize, block.recordCount, decoded[b])) {
+                failed.store(true);
+            }
+        }
+    };
+    
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threadCount; t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    
+    if (failed.load()) {
+        return false;
+    }
+    
+    // Move decoded records into a pre-sized table; the header total is only a hint, the blocks hold the records
+    staged.records.reserve(std::min<size_t>(totalRecords, blockRecords));
+    
+    auto now = std::chrono::steady_clock::now();
+    for (std::vector<SnapshotRecord>& block : decoded) {
+        for (SnapshotRecord& record : block) {
+            if (record.ttlSeconds != SNAPSHOT_NO_TTL) {
+                staged.ttlMap[record.recordId] = now + std::chrono::seconds(record.ttlSeconds);
+            }
+            staged.records[std::move(record.recordId)] = std::move(record.fields);
+        }
+    }
+    
+    return true;
+}
+
+// Append-only log
+void InMemoryDBImpl::logMutation(LogOp op, const std::string& recordId, const std::string& field,
+                                 const std::string& value, int64_t expiresAtMs) {
+    ++mutationSeq_;
+    if (!appendLog_ && !changeStream_) {
+        return;
+    }
+    
+    LogEntry entry;
+    entry.seq = mutationSeq_;
+    entry.op = op;
+    entry.recordId = recordId;
+    entry.field = field;
+    entry.value = value;
+    entry.expiresAtMs = expiresAtMs;
+    
+    if (appendLog_) {
+        appendLog_->append(entry);
+        
+        // A Clear makes the rest of a rewrite's base irrelevant. Otherwise only note that
+        // a rewrite is due; flushAppendLog() starts it
+        if (op == LogOp::Clear && rewriteCapturing_) {
+            finishLogRewriteCapture();
+        } else if (autoRewritePercent_ > 0 && !rewriteDue_ && !rewriteCapturing_ &&
+                   appendLog_->needsRewrite(autoRewritePercent_, autoRewriteMinBytes_)) {
+            rewriteDue_ = true;
+        }
+    }
+    
+    if (changeStream_) {
+        changeStream_->publish(std::move(entry));
+    }
+}
+
+void InMemoryDBImpl::logRecordState(const std::string& recordId) {
+    logMutation(LogOp::DeleteRecord, recordId);
+    
+    auto recordIt = records_.find(recordId);
+    if (recordIt == records_.end()) {
+        return;
+    }
+    FieldMap scratch;
+    LogEntry entry;
+    for (const auto& fieldPair : fieldsOf(*recordIt, scratch, false)) {
+        loggedValue(fieldPair.first, fieldPair.second, entry);
+        logMutation(entry.op, recordId, fieldPair.first, entry.value);
+    }
+    
+    auto ttlIt = ttlMap_.find(recordId);
+    if (ttlIt != ttlMap_.end()) {
+        logMutation(LogOp::SetTTL, recordId, std::string(), std::string(), toWallClockMs(ttlIt->second));
+    }
+}
+
+void InMemoryDBImpl::forEachStateEntry(uint64_t seq, const std::function<void(const LogEntry&)>& visit) const {
+    LogEntry entry;
+    entry.seq = seq;
+    entry.op = LogOp::Clear;
+    visit(entry);
+    
+    for (const auto& recordPair : records_) {
+        forEachRecordEntry(recordPair, seq, visit);
+    }
+}
+
+void InMemoryDBImpl::forEachRecordEntry(const RecordMap::value_type& record, uint64_t seq,
+                                        const std::function<void(const LogEntry&)>& visit) const {
+    if (isRecordExpired(record.first)) {
+        return;
+    }
+    
+    LogEntry entry;
+    entry.seq = seq;
+    entry.recordId = record.first;
+    FieldMap scratch;
+    for (const auto& fieldPair : fieldsOf(record, scratch, false)) {
+        entry.field = fieldPair.first;
+        loggedValue(fieldPair.first, fieldPair.second, entry);
+        visit(entry);
+    }
+    
+    auto ttlIt = ttlMap_.find(record.first);
+    if (ttlIt != ttlMap_.end()) {
+        entry.op = LogOp::SetTTL;
+        entry.field.clear();
+        entry.value.clear();
+        entry.expiresAtMs = toWallClockMs(ttlIt->second);
+        visit(entry);
+    }
+}
+
+void InMemoryDBImpl::applyLogEntry(const LogEntry& entry) {
+    // Entries were valid when written; a TTL that has passed since is handled by the sweep after replay
+    bool wasReplaying = replaying_;
+    replaying_ = true;
+    switch (entry.op) {
+        case LogOp::Set:
+            set(entry.recordId, entry.field, entry.value);
+            break;
+        case LogOp::DeleteField:
+            deleteField(entry.recordId, entry.field);
+            break;
+        case LogOp::DeleteRecord:
+        case LogOp::Expire:
+            deleteRecord(entry.recordId);
+            break;
+        case LogOp::SetTTL:
+            if (records_.find(entry.recordId) != records_.end()) {
+                captureForRewrite(entry.recordId);
+                ttlMap_[entry.recordId] = fromWallClockMs(entry.expiresAtMs);
+                markDirty(entry.recordId);
+            }
+            break;
+        case LogOp::Collection:
+            applyCollectionCommand(entry.recordId, entry.field, entry.value);
+            break;
+        case LogOp::Clear:
+            records_.clear();
+            ttlMap_.clear();
+            changeEpochs_.clear();
+            baselineEpoch_ = ++changeEpoch_;
+            resetValuePools();
+            rebuildRecordFilter();
+            rebuildRecordIndex();
+            resetTiering();
+            break;
+    }
+    replaying_ = wasReplaying;
+}
+
+bool InMemoryDBImpl::openLog(const std::string& path, bool syncEveryWrite, uint64_t afterSeq) {
+    closeLog(); // Close the current log, if any, before replaying
+    
+    auto log = std::make_unique<AppendLog>();
+    bool opened = log->open(path, syncEveryWrite, [this](const LogEntry& entry) {
+        applyLogEntry(entry);
+        mutationSeq_ = std::max(mutationSeq_, entry.seq);
+    }, afterSeq);
+    if (!opened) {
+        return false;
+    }
+    
+    appendLog_ = std::move(log);
+    
+    // Records whose TTL passed while the log was closed expire now, and the expiry is logged
+    expireRecords();
+    return true;
+}
+
+bool InMemoryDBImpl::openAppendLog(const std::string& path, bool syncEveryWrite) {
+    return openLog(path, syncEveryWrite, 0);
+}
+
+bool InMemoryDBImpl::flushAppendLog() {
+    if (!appendLog_) {
+        return false;
+    }
+    if (rewriteDue_ && !rewriteCapturing_) {
+        rewriteAppendLog();
+    }
+    advanceLogRewrite(REWRITE_STEP_RECORDS);
+    return appendLog_->flush();
+}
+
+bool InMemoryDBImpl::rewriteAppendLog() {
+    if (!appendLog_ || rewriteCapturing_ || !appendLog_->beginRewrite()) {
+        return false;
+    }
+    
+    // Nothing is encoded here: the base is captured by later steps and write paths
+    rewriteDue_ = false;
+    rewriteCapturing_ = true;
+    rewriteSeq_ = mutationSeq_;
+    rewriteBucket_ = 0;
+    rewriteBucketCount_ = records_.bucket_count();
+    rewriteChanged_.clear();
+    
+    LogEntry entry;
+    entry.seq = rewriteSeq_;
+    entry.op = LogOp::Clear;
+    rewriteChunk_.clear();
+    encodeLogEntry(entry, rewriteChunk_);
+    return true;
+}
+
+void InMemoryDBImpl::captureForRewrite(const std::string& recordId) {
+    if (!rewriteCapturing_ || !rewriteChanged_.insert(recordId).second) {
+        return; // Not capturing, or already captured before an earlier change
+    }
+    
+    auto recordIt = records_.find(recordId);
+    if (recordIt != records_.end()) {
+        forEachRecordEntry(*recordIt, rewriteSeq_, [this](const LogEntry& entry) {
+            encodeLogEntry(entry, rewriteChunk_);
+        });
+    }
+    if (rewriteChunk_.size() >= REWRITE_CHUNK_BYTES) {
+        appendLog_->appendRewriteBase(std::move(rewriteChunk_));
+        rewriteChunk_.clear();
+    }
+}
+
+void InMemoryDBImpl::advanceLogRewrite(size_t recordBudget) {
+    if (!rewriteCapturing_) {
+        return;
+    }
+    
+    // A rehash reorders the buckets, so the scan starts over. Records seen
+    // before are captured again unchanged, which replays to the same state.
+    if (records_.bucket_count() != rewriteBucketCount_) {
+        rewriteBucket_ = 0;
+        rewriteBucketCount_ = records_.bucket_count();
+    }
+    
+    auto capture = [this](const LogEntry& entry) { encodeLogEntry(entry, rewriteChunk_); };
+    size_t visited = 0;
+    while (rewriteBucket_ < rewriteBucketCount_ && visited < recordBudget) {
+        for (auto it = records_.begin(rewriteBucket_); it != records_.end(rewriteBucket_); ++it) {
+            // Records changed since the rewrite began were captured before their change
+            if (rewriteChanged_.count(it->first) == 0) {
+                forEachRecordEntry(*it, rewriteSeq_, capture);
+            }
+            visited++;
+        }
+        rewriteBucket_++;
+        visited++;
+        
+        if (rewriteChunk_.size() >= REWRITE_CHUNK_BYTES) {
+            appendLog_->appendRewriteBase(std::move(rewriteChunk_));
+            rewriteChunk_.clear();
+        }
+    }
+    
+    if (rewriteBucket_ == rewriteBucketCount_) {
+        finishLogRewriteCapture();
+    }
+}
+
+void InMemoryDBImpl::finishLogRewriteCapture() {
+    appendLog_->appendRewriteBase(std::move(rewriteChunk_));
+    appendLog_->endRewriteBase();
+    rewriteChunk_.clear();
+    rewriteCapturing_ = false;
+    std::unordered_set<std::string>().swap(rewriteChanged_);
+}
+
+void InMemoryDBImpl::closeLog() {
+    appendLog_.reset();
+    rewriteDue_ = false;
+    rewriteCapturing_ = false;
+    rewriteChunk_.clear();
+    std::unordered_set<std::string>().swap(rewriteChanged_);
+}
+
+void InMemoryDBImpl::waitForAppendLogRewrite() {
+    if (appendLog_) {
+        advanceLogRewrite(std::numeric_limits<size_t>::max());
+        appendLog_->waitForRewrite();
+    }
+}
+
+void InMemoryDBImpl::setAutoRewrite(int growthPercent, uint64_t minBytes) {
+    autoRewritePercent_ = growthPercent;
+    autoRewriteMinBytes_ = minBytes;
+}
+
+uint64_t InMemoryDBImpl::appendLogSize() const {
+    return appendLog_ ? appendLog_->size() : 0;
+}
+
+// Record ID index
+void InMemoryDBImpl::enableRecordIndex() {
+    recordIndex_ = std::make_unique<RadixIndex>();
+    rebuildRecordIndex();
+}
+
+void InMemoryDBImpl::disableRecordIndex() {
+    recordIndex_.reset();
+}
+
+std::vector<std::string> InMemoryDBImpl::getRecordIdsByPrefix(const std::string& prefix) const {
+    std::vector<std::string> recordIds;
+    if (recordIndex_) {
+        recordIds = recordIndex_->keysWithPrefix(prefix); // Already sorted
+    } else {
+        for (const auto& record : records_) {
+            if (record.first.compare(0, prefix.size(), prefix) == 0) {
+                recordIds.push_back(record.first);
+            }
+        }
+        std::sort(recordIds.begin(), recordIds.end());
+    }
+    
+    if (!ttlMap_.empty()) {
+        recordIds.erase(std::remove_if(recordIds.begin(), recordIds.end(),
+                                       [this](const std::string& recordId) { return isRecordExpired(recordId); }),
+                        recordIds.end());
+    }
+    return recordIds;
+}
+
+InMemoryDBImpl::RecordIndexStats InMemoryDBImpl::recordIndexStats() const {
+    RecordIndexStats stats;
+    if (!recordIndex_) {
+        return stats;
+    }
+    
+    stats.enabled = true;
+    stats.keys = recordIndex_->size();
+    stats.nodes = recordIndex_->nodeCount();
+    stats.keyBytes = recordIndex_->keyBytes();
+    stats.labelBytes = recordIndex_->labelBytes();
+    stats.memoryBytes = recordIndex_->memoryBytes();
+    return stats;
+}
+
+// Negative-lookup filter
+void InMemoryDBImpl::enableRecordFilter(double falsePositiveRate) {
+    recordFilterRate_ = falsePositiveRate;
+    recordFilter_ = std::make_unique<RecordFilter>(1, falsePositiveRate);
+    rebuildRecordFilter();
+}
+
+void InMemoryDBImpl::disableRecordFilter() {
+    recordFilter_.reset();
+}
+
+InMemoryDBImpl::RecordFilterStats InMemoryDBImpl::recordFilterStats() const {
+    RecordFilterStats stats;
+    if (recordFilter_) {
+        stats.enabled = true;
+        stats.keys = recordFilter_->size();
+        stats.capacity = recordFilter_->capacity();
+        stats.memoryBytes = recordFilter_->memoryBytes();
+    }
+    stats.definiteMisses = filteredLookups_.load();
+    return stats;
+}
+
+// Tiered storage
+bool InMemoryDBImpl::enableTiering(const std::string& path, size_t maxResidentBytes) {
+    disableTiering(); // Records spilled to a previous tier come back first
+    
+    auto store = std::make_unique<TierStore>();
+    if (!store->open(path)) {
+        return false;
+    }
+    tierStore_ = std::move(store);
+    maxResidentBytes_ = maxResidentBytes;
+    resetTiering();
+    return true;
+}
+
+void InMemoryDBImpl::disableTiering() {
+    if (!tierStore_) {
+        return;
+    }
+    for (auto recordIt = records_.begin(); recordIt != records_.end(); ++recordIt) {
+        promoteRecord(recordIt);
+    }
+    tierStore_.reset();
+    residentRecords_.clear();
+}
+
+InMemoryDBImpl::TieringStats InMemoryDBImpl::tieringStats() const {
+    TieringStats stats;
+    if (!tierStore_) {
+        return stats;
+    }
+    
+    TierStore::Stats tier = tierStore_->stats();
+    stats.enabled = true;
+    stats.residentRecords = residentRecords_.size();
+    stats.coldRecords = tier.records;
+    stats.residentBytes = residentRecords_.totalBytes();
+    stats.maxResidentBytes = maxResidentBytes_;
+    stats.fileBytes = tier.fileBytes;
+    stats.garbageBytes = tier.garbageBytes;
+    stats.diskReads = tier.diskReads;
+    stats.readaheadHits = tier.readaheadHits;
+    stats.compactions = tier.compactions;
+    return stats;
+}
+
+// Value compression
+void InMemoryDBImpl::enableValueCompression(const std::string& field, size_t minSize) {
+    auto profileIt = fieldProfiles_.find(field);
+    if (profileIt != fieldProfiles_.end() && profileIt->second.state == InternState::Interned) {
+        recodeField(field, false);
+        profileIt->second.pool.clear();
+    }
+    if (profileIt != fieldProfiles_.end()) {
+        profileIt->second.state = InternState::Plain;
+        std::unordered_set<std::string>().swap(profileIt->second.distinctValues);
+    }
+    
+    auto inserted = valueCodecs_.try_emplace(field);
+    inserted.first->second.minSize = minSize;
+    if (inserted.second) {
+        recodeField(field, true);
+    }
+}
+
+void InMemoryDBImpl::disableValueCompression(const std::string& field) {
+    if (valueCodecs_.count(field) == 0) {
+        return;
+    }
+    recodeField(field, false);
+    valueCodecs_.erase(field);
+}
+
+InMemoryDBImpl::ValueCompressionStats InMemoryDBImpl::valueCompressionStats(const std::string& field) const {
+    ValueCompressionStats stats;
+    auto codecIt = valueCodecs_.find(field);
+    if (codecIt == valueCodecs_.end()) {
+        return stats;
+    }
+    
+    stats.enabled = true;
+    stats.dictionaryBytes = codecIt->second.dictionary ? codecIt->second.dictionary->size() : 0;
+    FieldMap scratch;
+    for (const auto& record : records_) {
+        const auto& fields = fieldsOf(record, scratch, false);
+        auto fieldIt = fields.find(field);
+        uint32_t rawSize = 0;
+        if (fieldIt != fields.end() && compressedRawSize(fieldIt->second, rawSize)) {
+            stats.compressedValues++;
+            stats.storedBytes += fieldIt->second.size();
+            stats.rawBytes += rawSize;
+        }
+    }
+    return stats;
+}
+
+// Value interning
+void InMemoryDBImpl::enableValueInterning() {
+    if (internValues_) {
+        return;
+    }
+    internValues_ = true;
+    
+    FieldMap scratch;
+    for (const auto& record : records_) {
+        for (const auto& fieldPair : fieldsOf(record, scratch, false)) {
+            if (collectionOf(fieldPair.second)) {
+                continue; // Collections are never interned
+            }
+            auto profileIt = fieldProfiles_.find(fieldPair.first);
+            if (profileIt == fieldProfiles_.end() || profileIt->second.state == InternState::Observing) {
+                observeValue(fieldPair.first, decodeValue(fieldPair.first, fieldPair.second));
+            }
+        }
+    }
+}
+
+void InMemoryDBImpl::disableValueInterning() {
+    for (auto& profile : fieldProfiles_) {
+        if (profile.second.state == InternState::Interned) {
+            recodeField(profile.first, false);
+        }
+    }
+    fieldProfiles_.clear();
+    internValues_ = false;
+}
+
+InMemoryDBImpl::InternStats InMemoryDBImpl::internStats(const std::string& field) const {
+    InternStats stats;
+    const InternPool* pool = internPoolOf(field);
+    if (!pool) {
+        return stats;
+    }
+    
+    stats.interned = true;
+    stats.distinctValues = pool->size();
+    stats.references = pool->references();
+    stats.pooledBytes = pool->valueBytes();
+    return stats;
+}
+
+// Lazy freeing
+void InMemoryDBImpl::enableLazyFree(size_t minFields) {
+    lazyFreeMinFields_ = std::max<size_t>(minFields, 1);
+    if (!lazyFreer_) {
+        lazyFreer_ = std::make_unique<LazyFreer>();
+        syncFreedRecords_ = 0;
+    }
+}
+
+void InMemoryDBImpl::disableLazyFree() {
+    lazyFreer_.reset(); // Frees what is still pending first
+}
+
+void InMemoryDBImpl::waitForLazyFree() const {
+    if (lazyFreer_) {
+        lazyFreer_->drain();
+    }
+}
+
+InMemoryDBImpl::LazyFreeStats InMemoryDBImpl::lazyFreeStats() const {
+    LazyFreeStats stats;
+    if (!lazyFreer_) {
+        return stats;
+    }
+    
+    LazyFreer::Stats freer = lazyFreer_->stats();
+    stats.enabled = true;
+    stats.pendingRecords = freer.pendingRecords;
+    stats.lazyFreedRecords = freer.freedRecords;
+    stats.lazyFreedFields = freer.freedFields;
+    stats.lazyFreedCollections = freer.freedCollections;
+    stats.syncFreedRecords = syncFreedRecords_;
+    return stats;
+}
+
+// Native collections
+const Collection* InMemoryDBImpl::findCollection(const std::string& recordId, const std::string& field) const {
+    if (liveCollections_ == 0 || isDefinitelyAbsent(recordId) || isRecordExpired(recordId)) {
+        return nullptr;
+    }
+    auto recordIt = records_.find(recordId);
+    if (recordIt == records_.end()) {
+        return nullptr;
+    }
+    promoteRecord(recordIt);
+    touchRecord(recordIt);
+    
+    auto fieldIt = recordIt->second.find(field);
+    return fieldIt != recordIt->second.end() ? collectionOf(fieldIt->second) : nullptr;
+}
+
+Collection* InMemoryDBImpl::writableCollection(const std::string& recordId, const std::string& field,
+                                               Collection::Kind kind, bool create, RecordMap::iterator& recordIt) {
+    dropIfExpired(recordId);
+    captureForRewrite(recordId);
+    if (!create && isDefinitelyAbsent(recordId)) {
+        return nullptr;
+    }
+    
+    recordIt = records_.find(recordId);
+    if (recordIt == records_.end()) {
+        if (!create) {
+            return nullptr;
+        }
+        recordIt = records_.try_emplace(recordId).first;
+        trackNewRecord(recordId);
+    } else {
+        promoteRecord(recordIt);
+    }
+    
+    auto fieldIt = recordIt->second.find(field);
+    if (fieldIt != recordIt->second.end()) {
+        Collection* collection = collectionOf(fieldIt->second);
+        return collection && collection->kind() == kind ? collection : nullptr;
+    }
+    if (!create) {
+        return nullptr;
+    }
+    std::string& stored = recordIt->second[field];
+    stored = storeCollection(std::make_unique<Collection>(kind));
+    return collectionOf(stored);
+}
+
+void InMemoryDBImpl::commitCollectionWrite(const std::string& recordId, RecordMap::iterator recordIt,
+                                           const std::string& field, const Collection& collection, char op,
+                                           const std::string& member, uint64_t operand) {
+    std::string logged;
+    if (appendLog_ || changeStream_) {
+        if (op == COLLECTION_REPLACE) {
+            logged.assign(1, COLLECTION_REPLACE);
+            collection.serialize(logged);
+        } else {
+            logged = collectionCommand(op, member, operand);
+        }
+    }
+    
+    if (collection.size() > 0) {
+        touchRecord(recordIt);
+    } else {
+        auto fieldIt = recordIt->second.find(field);
+        releaseValue(field, fieldIt->second);
+        recordIt->second.erase(fieldIt);
+        if (recordIt->second.empty()) {
+            records_.erase(recordIt);
+            ttlMap_.erase(recordId);
+            trackRemovedRecord(recordId);
+        } else {
+            touchRecord(recordIt);
+        }
+    }
+    
+    markDirty(recordId);
+    logMutation(LogOp::Collection, recordId, field, logged);
+}
+
+void InMemoryDBImpl::applyCollectionCommand(const std::string& recordId, const std::string& field,
+                                            const std::string& command) {
+    if (command.empty()) {
+        return;
+    }
+    
+    uint64_t operand = 0;
+    size_t memberStart = 1;
+    if (hasCommandOperand(command[0])) {
+        SnapshotReader reader(command.data() + 1, command.size() - 1);
+        uint32_t low = 0;
+        uint32_t high = 0;
+        if (!reader.readU32(low) || !reader.readU32(high)) {
+            return;
+        }
+        operand = (static_cast<uint64_t>(high) << 32) | low;
+        memberStart = 9;
+    }
+    
+    std::string member = command.substr(memberStart);
+    switch (command[0]) {
+        case COLLECTION_PUSH_BACK:
+        case COLLECTION_PUSH_FRONT:
+            listPush(recordId, field, member, command[0] == COLLECTION_PUSH_FRONT);
+            break;
+        case COLLECTION_POP_BACK:
+        case COLLECTION_POP_FRONT:
+            listPop(recordId, field, command[0] == COLLECTION_POP_FRONT);
+            break;
+        case COLLECTION_SET_ADD:
+            setAdd(recordId, field, member);
+            break;
+        case COLLECTION_SET_REMOVE:
+            setRemove(recordId, field, member);
+            break;
+        case COLLECTION_SORTED_ADD: {
+            double score;
+            std::memcpy(&score, &operand, sizeof(score));
+            sortedSetAdd(recordId, field, member, score);
+            break;
+        }
+        case COLLECTION_SORTED_REMOVE:
+            sortedSetRemove(recordId, field, member);
+            break;
+        case COLLECTION_HLL_ADD:
+            hllAdd(recordId, field, member);
+            break;
+        case COLLECTION_COUNT_MIN_ADD:
+            countMinAdd(recordId, field, member, operand);
+            break;
+        case COLLECTION_REPLACE: {
+            std::unique_ptr<Collection> collection = Collection::deserialize(member);
+            if (!collection) {
+                return;
+            }
+            dropIfExpired(recordId);
+            auto inserted = records_.try_emplace(recordId);
+            if (!inserted.second) {
+                promoteRecord(inserted.first);
+            }
+            assignValue(inserted.first, inserted.second, recordId, field, member, std::move(collection));
+            break;
+        }
+    }
+}
+
+bool InMemoryDBImpl::listPush(const std::string& recordId, const std::string& field, const std::string& value,
+                              bool front) {
+    RecordMap::iterator recordIt;
+    Collection* collection = writableCollection(recordId, field, Collection::Kind::List, true, recordIt);
+    if (!collection) {
+        return false;
+    }
+    
+    if (front) {
+        collection->list().push_front(value);
+    } else {
+        collection->list().push_back(value);
+    }
+    commitCollectionWrite(recordId, recordIt, field, *collection, front ? COLLECTION_PUSH_FRONT : COLLECTION_PUSH_BACK,
+                          value);
+    return true;
+}
+
+std::optional<std::string> InMemoryDBImpl::listPop(const std::string& recordId, const std::string& field, bool front) {
+    RecordMap::iterator recordIt;
+    Collection* collection = writableCollection(recordId, field, Collection::Kind::List, false, recordIt);
+    if (!collection) {
+        return std::nullopt;
+    }
+    
+    Collection::List& list = collection->list();
+    std::string value;
+    if (front) {
+        value = std::move(list.front());
+        list.pop_front();
+    } else {
+        value = std::move(list.back());
+        list.pop_back();
+    }
+    commitCollectionWrite(recordId, recordIt, field, *collection, front ? COLLECTION_POP_FRONT : COLLECTION_POP_BACK,
+                          std::string());
+    return value;
+}
+
+std::vector<std::string> InMemoryDBImpl::listRange(const std::string& recordId, const std::string& field, size_t start,
+                                                   size_t count) const {
+    std::vector<std::string> values;
+    const Collection* collection = findCollection(recordId, field);
+    if (!collection || collection->kind() != Collection::Kind::List || start >= collection->size()) {
+        return values;
+    }
+    
+    const Collection::List& list = collection->list();
+    size_t end = start + std::min(count, list.size() - start);
+    values.assign(list.begin() + start, list.begin() + end);
+    return values;
+}
+
+bool InMemoryDBImpl::setAdd(const std::string& recordId, const std::string& field, const std::string& member) {
+    RecordMap::iterator recordIt;
+    Collection* collection = writableCollection(recordId, field, Collection::Kind::Set, true, recordIt);
+    if (!collection) {
+        return false;
+    }
+    
+    if (!collection->set().insert(member).second) {
+        touchRecord(recordIt);
+        return false;
+    }
+    commitCollectionWrite(recordId, recordIt, field, *collection, COLLECTION_SET_ADD, member);
+    return true;
+}
+
+bool InMemoryDBImpl::setRemove(const std::string& recordId, const std::string& field, const std::string& member) {
+    RecordMap::iterator recordIt;
+    Collection* collection = writableCollection(recordId, field, Collection::Kind::Set, false, recordIt);
+    if (!collection || collection->set().erase(member) == 0) {
+        return false;
+    }
+    commitCollectionWrite(recordId, recordIt, field, *collection, COLLECTION_SET_REMOVE, member);
+    return true;
+}
+
+bool InMemoryDBImpl::setContains(const std::string& recordId, const std::string& field,
+                                 const std::string& member) const {
+    const Collection* collection = findCollection(recordId, field);
+    return collection && collection->kind() == Collection::Kind::Set && collection->set().count(member) > 0;
+}
+
+std::vector<std::string> InMemoryDBImpl::setMembers(const std::string& recordId, const std::string& field) const {
+    const Collection* collection = findCollection(recordId, field);
+    if (!collection || collection->kind() != Collection::Kind::Set) {
+        return {};
+    }
+    return std::vector<std::string>(collection->set().begin(), collection->set().end());
+}
+
+bool InMemoryDBImpl::sortedSetAdd(const std::string& recordId, const std::string& field, const std::string& member,
+                                  double score) {
+    if (std::isnan(score)) {
+        return false;
+    }
+    RecordMap::iterator recordIt;
+    Collection* collection = writableCollection(recordId, field, Collection::Kind::SortedSet, true, recordIt);
+    if (!collection) {
+        return false;
+    }
+    
+    bool added = collection->sortedSet().add(member, score);
+    uint64_t bits;
+    std::memcpy(&bits, &score, sizeof(bits));
+    commitCollectionWrite(recordId, recordIt, field, *collection, COLLECTION_SORTED_ADD, member, bits);
+    return added;
 }
 
-void InMemoryDBImpl::cleanupExpiredRecord(const std::string& recordId) {
-    records_.erase(recordId);
-    ttlMap_.erase(recordId);
+bool InMemoryDBImpl::sortedSetRemove(const std::string& recordId, const std::string& field,
+                                     const std::string& member) {
+    RecordMap::iterator recordIt;
+    Collection* collection = writableCollection(recordId, field, Collection::Kind::SortedSet, false, recordIt);
+    if (!collection || !collection->sortedSet().remove(member)) {
+        return false;
+    }
+    commitCollectionWrite(recordId, recordIt, field, *collection, COLLECTION_SORTED_REMOVE, member);
+    return true;
 }
 
-// Level 1: Basic operations
-void InMemoryDBImpl::set(const std::string& recordId, const std::string& field, const std::string& value) {
-    // Check if record is expired before setting
-    if (isRecordExpired(recordId)) {
-        cleanupExpiredRecord(recordId);
+std::optional<double> InMemoryDBImpl::sortedSetScore(const std::string& recordId, const std::string& field,
+                                                     const std::string& member) const {
+    const Collection* collection = findCollection(recordId, field);
+    if (!collection || collection->kind() != Collection::Kind::SortedSet) {
+        return std::nullopt;
     }
-    
-    records_[recordId][field] = value;
+    return collection->sortedSet().score(member);
 }
 
-std::optional<std::string> InMemoryDBImpl::get(const std::string& recordId, const std::string& field) const {
-    // Check if record is expired
-    if (isRecordExpired(recordId)) {
+std::optional<size_t> InMemoryDBImpl::sortedSetRank(const std::string& recordId, const std::string& field,
+                                                    const std::string& member) const {
+    const Collection* collection = findCollection(recordId, field);
+    if (!collection || collection->kind() != Collection::Kind::SortedSet) {
         return std::nullopt;
     }
-    
-    auto recordIt = records_.find(recordId);
-    if (recordIt == records_.end()) {
-        return std::nullopt; // Record doesn't exist
+    return collection->sortedSet().rank(member);
+}
+
+std::vector<std::pair<std::string, double>> InMemoryDBImpl::sortedSetRange(const std::string& recordId,
+                                                                           const std::string& field, size_t start,
+                                                                           size_t stop) const {
+    std::vector<std::pair<std::string, double>> members;
+    const Collection* collection = findCollection(recordId, field);
+    if (collection && collection->kind() == Collection::Kind::SortedSet) {
+        collection->sortedSet().range(start, stop, members);
     }
-    
-    auto fieldIt = recordIt->second.find(field);
-    if (fieldIt == recordIt->second.end()) {
-        return std::nullopt; // Field doesn't exist
+    return members;
+}
+
+size_t InMemoryDBImpl::collectionSize(const std::string& recordId, const std::string& field) const {
+    const Collection* collection = findCollection(recordId, field);
+    return collection ? collection->size() : 0;
+}
+
+bool InMemoryDBImpl::hllAdd(const std::string& recordId, const std::string& field, const std::string& element) {
+    RecordMap::iterator recordIt;
+    Collection* collection = writableCollection(recordId, field, Collection::Kind::HyperLogLog, true, recordIt);
+    if (!collection) {
+        return false;
     }
     
-    return fieldIt->second;
+    if (!collection->hyperLogLog().add(element)) {
+        touchRecord(recordIt);
+        return false;
+    }
+    commitCollectionWrite(recordId, recordIt, field, *collection, COLLECTION_HLL_ADD, element);
+    return true;
 }
 
-bool InMemoryDBImpl::deleteField(const std::string& recordId, const std::string& field) {
-    // Check if record is expired
-    if (isRecordExpired(recordId)) {
-        cleanupExpiredRecord(recordId);
+std::optional<uint64_t> InMemoryDBImpl::hllCount(const std::string& recordId, const std::string& field) const {
+    const Collection* collection = findCollection(recordId, field);
+    if (!collection || collection->kind() != Collection::Kind::HyperLogLog) {
+        return std::nullopt;
+    }
+    return collection->hyperLogLog().count();
+}
+
+bool InMemoryDBImpl::hllMerge(const std::string& recordId, const std::string& field, const std::string& sourceRecordId,
+                              const std::string& sourceField) {
+    // Collections never move once stored, so the source stays valid while the destination is created
+    const Collection* source = findCollection(sourceRecordId, sourceField);
+    if (!source || source->kind() != Collection::Kind::HyperLogLog) {
         return false;
     }
-    
-    auto recordIt = records_.find(recordId);
-    if (recordIt == records_.end()) {
-        return false; // Record doesn't exist
+    RecordMap::iterator recordIt;
+    Collection* collection = writableCollection(recordId, field, Collection::Kind::HyperLogLog, true, recordIt);
+    if (!collection) {
+        return false;
     }
     
-    auto fieldIt = recordIt->second.find(field);
-    if (fieldIt == recordIt->second.end()) {
-        return false; // Field doesn't exist
+    collection->hyperLogLog().merge(source->hyperLogLog());
+    commitCollectionWrite(recordId, recordIt, field, *collection, COLLECTION_REPLACE, std::string());
+    return true;
+}
+
+bool InMemoryDBImpl::countMinAdd(const std::string& recordId, const std::string& field, const std::string& element,
+                                 uint64_t count) {
+    if (count == 0) {
+        return false;
     }
-    
-    recordIt->second.erase(fieldIt);
-    
-    // If record becomes empty, remove it entirely
-    if (recordIt->second.empty()) {
-        records_.erase(recordIt);
-        ttlMap_.erase(recordId);
+    RecordMap::iterator recordIt;
+    Collection* collection = writableCollection(recordId, field, Collection::Kind::CountMin, true, recordIt);
+    if (!collection) {
+        return false;
     }
     
+    collection->countMin().add(element, count);
+    commitCollectionWrite(recordId, recordIt, field, *collection, COLLECTION_COUNT_MIN_ADD, element, count);
     return true;
 }
 
-bool InMemoryDBImpl::deleteRecord(const std::string& recordId) {
-    auto recordIt = records_.find(recordId);
-    if (recordIt == records_.end()) {
-        return false; // Record doesn't exist
+std::optional<uint64_t> InMemoryDBImpl::countMinEstimate(const std::string& recordId, const std::string& field,
+                                                         const std::string& element) const {
+    const Collection* collection = findCollection(recordId, field);
+    if (!collection || collection->kind() != Collection::Kind::CountMin) {
+        return std::nullopt;
+    }
+    return collection->countMin().estimate(element);
+}
+
+bool InMemoryDBImpl::countMinMerge(const std::string& recordId, const std::string& field,
+                                   const std::string& sourceRecordId, const std::string& sourceField) {
+    const Collection* source = findCollection(sourceRecordId, sourceField);
+    if (!source || source->kind() != Collection::Kind::CountMin) {
+        return false;
+    }
+    RecordMap::iterator recordIt;
+    Collection* collection = writableCollection(recordId, field, Collection::Kind::CountMin, true, recordIt);
+    if (!collection) {
+        return false;
     }
     
-    records_.erase(recordIt);
-    ttlMap_.erase(recordId);
+    collection->countMin().merge(source->countMin());
+    commitCollectionWrite(recordId, recordIt, field, *collection, COLLECTION_REPLACE, std::string());
     return true;
 }
 
-std::vector<std::string> InMemoryDBImpl::getFields(const std::string& recordId) const {
-    // Check if record is expired
-    if (isRecordExpired(recordId)) {
-        return {}; // Return empty vector for expired records
+// Rate limiting
+std::optional<InMemoryDBImpl::RateLimitResult> InMemoryDBImpl::checkRateLimit(const std::string& recordId,
+                                                                             const std::string& field, uint64_t limit,
+                                                                             uint64_t windowMs, uint64_t cost) {
+    if (windowMs == 0) {
+        return std::nullopt;
     }
+    dropIfExpired(recordId);
     
+    uint64_t windowStart = 0;
+    uint64_t previous = 0;
+    uint64_t current = 0;
     auto recordIt = records_.find(recordId);
-    if (recordIt == records_.end()) {
-        return {}; // Record doesn't exist
+    bool created = recordIt == records_.end();
+    if (!created) {
+        promoteRecord(recordIt);
+        auto fieldIt = recordIt->second.find(field);
+        if (fieldIt != recordIt->second.end() &&
+            !parseRateCounter(decodeValue(field, fieldIt->second), windowStart, previous, current)) {
+            return std::nullopt;
+        }
     }
     
-    std::vector<std::string> fields;
-    fields.reserve(recordIt->second.size());
-    
-    for (const auto& pair : recordIt->second) {
-        fields.push_back(pair.first);
+    // Roll the fixed windows forward to the one containing now
+    auto now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    uint64_t nowWindow = now - now % windowMs;
+    bool rolled = nowWindow != windowStart;
+    if (rolled) {
+        previous = nowWindow == windowStart + windowMs ? current : 0;
+        current = 0;
+        windowStart = nowWindow;
     }
     
-    std::sort(fields.begin(), fields.end()); // Sort for consistent ordering
-    return fields;
-}
-
-bool InMemoryDBImpl::hasRecord(const std::string& recordId) const {
-    // Check if record is expired
-    if (isRecordExpired(recordId)) {
-        return false;
+    uint64_t elapsed = now - windowStart;
+    double weight = static_cast<double>(windowMs - elapsed) / static_cast<double>(windowMs);
+    double used = static_cast<double>(previous) * weight + static_cast<double>(current);
+    
+    RateLimitResult result;
+    result.allowed = used + static_cast<double>(cost) <= static_cast<double>(limit);
+    if (result.allowed) {
+        current += cost;
+        used += static_cast<double>(cost);
+        result.retryAfterMs = 0;
+    } else if (current + cost <= limit && previous > 0) {
+        // Wait until enough of the previous window has slid out of range
+        double admissible = static_cast<double>(limit - current - cost) / static_cast<double>(previous);
+        auto until = static_cast<uint64_t>(std::ceil(static_cast<double>(windowMs) * (1 - admissible)));
+        result.retryAfterMs = until > elapsed ? until - elapsed : 1;
+    } else {
+        result.retryAfterMs = windowMs - elapsed;
     }
+    result.remaining = used < static_cast<double>(limit) ? static_cast<uint64_t>(static_cast<double>(limit) - used) : 0;
     
-    return records_.find(recordId) != records_.end();
-}
-
-std::vector<std::string> InMemoryDBImpl::getAllRecordIds() const {
-    std::vector<std::string> recordIds;
+    if (!result.allowed && (!rolled || created)) {
+        return result; // Nothing changed; a denied request leaves no trace
+    }
+    if (created) {
+        recordIt = records_.try_emplace(recordId).first;
+    }
+    assignValue(recordIt, created, recordId, field,
+                std::to_string(windowStart) + ":" + std::to_string(previous) + ":" + std::to_string(current));
     
-    for (const auto& pair : records_) {
-        // Only include non-expired records
-        if (!isRecordExpired(pair.first)) {
-            recordIds.push_back(pair.first);
+    // Let the TTL machinery drop idle counters, without shortening a longer TTL
+    // or giving a TTL to a record that had none
+    auto ttlIt = ttlMap_.find(recordId);
+    if (created || ttlIt != ttlMap_.end()) {
+        auto expiration = std::chrono::steady_clock::now() + std::chrono::milliseconds(2 * windowMs);
+        if (created || ttlIt->second < expiration) {
+            ttlMap_[recordId] = expiration;
+            logMutation(LogOp::SetTTL, recordId, std::string(), std::string(), toWallClockMs(expiration));
         }
     }
-    
-    std::sort(recordIds.begin(), recordIds.end()); // Sort for consistent ordering
-    return recordIds;
+    return result;
 }
 
-// Level 2: Filtering functionality
-std::vector<std::string> InMemoryDBImpl::getRecordsByFieldValue(const std::string& field, const std::string& value) const {
-    std::vector<std::string> matchingRecords;
-    
-    for (const auto& recordPair : records_) {
-        const std::string& recordId = recordPair.first;
-        const auto& fields = recordPair.second;
-        
-        // Skip expired records
-        if (isRecordExpired(recordId)) {
-            continue;
-        }
-        
-        auto fieldIt = fields.find(field);
-        if (fieldIt != fields.end() && fieldIt->second == value) {
-            matchingRecords.push_back(recordId);
-        }
+// Change data capture
+std::shared_ptr<ChangeStream> InMemoryDBImpl::enableChangeStream(size_t capacity) {
+    if (!changeStream_) {
+        changeStream_ = std::make_shared<ChangeStream>(capacity);
     }
-    
-    std::sort(matchingRecords.begin(), matchingRecords.end()); // Sort for consistent ordering
-    return matchingRecords;
+    return changeStream_;
 }
 
-// Level 3: TTL functionality
-void InMemoryDBImpl::setTTL(const std::string& recordId, int ttlSeconds) {
-    // Only set TTL if record exists
-    if (records_.find(recordId) == records_.end()) {
-        return; // Record doesn't exist
-    }
-    
-    auto expirationTime = std::chrono::steady_clock::now() + std::chrono::seconds(ttlSeconds);
-    ttlMap_[recordId] = expirationTime;
+std::shared_ptr<ChangeStream> InMemoryDBImpl::changeStream() const {
+    return changeStream_;
 }
 
-int InMemoryDBImpl::expireRecords() {
-    int expiredCount = 0;
-    auto now = std::chrono::steady_clock::now();
-    
-    // Collect expired record IDs to avoid iterator invalidation
-    std::vector<std::string> expiredRecords;
-    
-    for (const auto& ttlPair : ttlMap_) {
-        if (now >= ttlPair.second) {
-            expiredRecords.push_back(ttlPair.first);
-        }
+void InMemoryDBImpl::disableChangeStream() {
+    changeStream_.reset();
+}
+
+// Checkpoints and crash recovery
+bool InMemoryDBImpl::checkpoint(const std::string& checkpointPath, SnapshotCodec codec) const {
+    std::string snapshotData = snapshot(4096, codec);
+    if (!writeFileAtomically(checkpointPath + ".snapshot", snapshotData)) {
+        return false;
     }
     
-    // Remove expired records
-    for (const std::string& recordId : expiredRecords) {
-        cleanupExpiredRecord(recordId);
-        expiredCount++;
-    }
+    // Format: CHECKPOINT\nLOG_SEQ\nWALL_CLOCK_MS\nSNAPSHOT_SIZE\nSNAPSHOT_CRC32\n
+    // The size and checksum detect a snapshot that does not belong to this metadata
+    // (e.g. a crash between writing the two files).
+    auto wallNow = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch());
+    std::ostringstream meta;
+    meta << "CHECKPOINT\n" << mutationSeq_ << "\n" << wallNow.count() << "\n" << snapshotData.size() << "\n"
+         << blockChecksum(snapshotData.data(), snapshotData.size()) << "\n";
     
-    return expiredCount;
+    return writeFileAtomically(checkpointPath, meta.str());
 }
 
-// Level 4: Backup and restore
-std::string InMemoryDBImpl::backup() const {
-    std::ostringstream backup;
+bool InMemoryDBImpl::loadCheckpoint(const std::string& checkpointPath, Dataset& staged, uint64_t& logSeq,
+                                    unsigned threadCount) {
+    std::ifstream metaFile(checkpointPath);
+    std::string line;
+    uint64_t snapshotSize;
+    uint32_t snapshotChecksum;
+    int64_t checkpointWallMs;
     
-    // Format: RECORD_COUNT\n
-    // For each record: RECORD_ID\nFIELD_COUNT\nFIELD1\nVALUE1\nFIELD2\nVALUE2\n...
-    // TTL_COUNT\n
-    // For each TTL: RECORD_ID\nTTL_SECONDS_REMAINING\n
-    
-    std::vector<std::string> validRecordIds;
-    for (const auto& recordPair : records_) {
-        if (!isRecordExpired(recordPair.first)) {
-            validRecordIds.push_back(recordPair.first);
-        }
+    try {
+        if (!std::getline(metaFile, line) || line != "CHECKPOINT") return false;
+        if (!std::getline(metaFile, line)) return false;
+        logSeq = std::stoull(line);
+        if (!std::getline(metaFile, line)) return false;
+        checkpointWallMs = std::stoll(line);
+        if (!std::getline(metaFile, line)) return false;
+        snapshotSize = std::stoull(line);
+        if (!std::getline(metaFile, line)) return false;
+        snapshotChecksum = static_cast<uint32_t>(std::stoul(line));
+    } catch (const std::exception&) {
+        return false;
     }
     
-    backup << validRecordIds.size() << "\n";
-    
-    for (const std::string& recordId : validRecordIds) {
-        const auto& fields = records_.at(recordId);
-        backup << recordId << "\n";
-        backup << fields.size() << "\n";
-        
-        for (const auto& fieldPair : fields) {
-            backup << fieldPair.first << "\n";
-            backup << fieldPair.second << "\n";
-        }
+    std::ifstream snapshotFile(checkpointPath + ".snapshot", std::ios::binary);
+    std::string snapshotData((std::istreambuf_iterator<char>(snapshotFile)), std::istreambuf_iterator<char>());
+    if (snapshotData.size() != snapshotSize ||
+        blockChecksum(snapshotData.data(), snapshotData.size()) != snapshotChecksum) {
+        return false;
     }
     
-    // Backup TTL information
-    auto now = std::chrono::steady_clock::now();
-    std::vector<std::pair<std::string, int>> validTTLs;
-    
-    for (const std::string& recordId : validRecordIds) {
-        auto ttlIt = ttlMap_.find(recordId);
-        if (ttlIt != ttlMap_.end()) {
-            auto remainingTime = std::chrono::duration_cast<std::chrono::seconds>(ttlIt->second - now);
-            if (remainingTime.count() > 0) {
-                validTTLs.push_back({recordId, static_cast<int>(remainingTime.count())});
-            }
-        }
+    if (!decodeSnapshot(snapshotData, staged, threadCount)) {
+        return false;
     }
     
-    backup << validTTLs.size() << "\n";
-    for (const auto& ttlPair : validTTLs) {
-        backup << ttlPair.first << "\n";
-        backup << ttlPair.second << "\n";
+    // Snapshot TTLs are relative to the checkpoint; age them by the downtime
+    auto wallNow = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch());
+    auto downtime = wallNow - std::chrono::milliseconds(checkpointWallMs);
+    for (auto& ttlPair : staged.ttlMap) {
+        ttlPair.second -= downtime;
     }
     
-    return backup.str();
+    return true;
 }
 
-bool InMemoryDBImpl::restore(const std::string& backupData) {
-    try {
-        std::istringstream stream(backupData);
-        std::string line;
-        
-        // Clear current database
-        records_.clear();
-        ttlMap_.clear();
-        
-        // Read record count
-        if (!std::getline(stream, line)) return false;
-        int recordCount = std::stoi(line);
-        
-        // Read records
-        for (int i = 0; i < recordCount; i++) {
-            if (!std::getline(stream, line)) return false;
-            std::string recordId = line;
-            
-            if (!std::getline(stream, line)) return false;
-            int fieldCount = std::stoi(line);
-            
-            for (int j = 0; j < fieldCount; j++) {
-                if (!std::getline(stream, line)) return false;
-                std::string field = line;
-                
-                if (!std::getline(stream, line)) return false;
-                std::string value = line;
-                
-                records_[recordId][field] = value;
-            }
-        }
-        
-        // Read TTL count
-        if (!std::getline(stream, line)) return false;
-        int ttlCount = std::stoi(line);
-        
-        // Read TTLs
-        auto now = std::chrono::steady_clock::now();
-        for (int i = 0; i < ttlCount; i++) {
-            if (!std::getline(stream, line)) return false;
-            std::string recordId = line;
-            
-            if (!std::getline(stream, line)) return false;
-            int ttlSeconds = std::stoi(line);
-            
-            ttlMap_[recordId] = now + std::chrono::seconds(ttlSeconds);
-        }
-        
-        return true;
-    } catch (const std::exception&) {
-        // Clear database on restore failure
-        records_.clear();
-        ttlMap_.clear();
-        return false;
+bool InMemoryDBImpl::recover(const std::string& checkpointPath, const std::string& logPath, bool syncEveryWrite,
+                             unsigned threadCount) {
+    closeLog(); // Nothing below is logged; the log already holds it
+    
+    uint64_t checkpointSeq = 0;
+    Dataset staged;
+    if (loadCheckpoint(checkpointPath, staged, checkpointSeq, threadCount)) {
+        commitRestore(staged);
+        mutationSeq_ = checkpointSeq;
+    } else {
+        checkpointSeq = 0; // Replay the whole log instead
     }
+    
+    return openLog(logPath, syncEveryWrite, checkpointSeq);
 }
 
 // Utility functions
@@ -336,3 +2892,18 @@ void InMemoryDBImpl::printAllRecords() const {
 size_t InMemoryDBImpl::getRecordCount() const {
     return getAllRecordIds().size();
 }
+
+InMemoryDBImpl::RecordLayoutStats InMemoryDBImpl::recordLayoutStats() const {
+    RecordLayoutStats stats;
+    for (const auto& record : records_) {
+        if (tierStore_ && record.second.empty()) {
+            continue; // Cold
+        }
+        if (record.second.isPacked()) {
+            stats.packedRecords++;
+        } else {
+            stats.hashedRecords++;
+        }
+    }
+    return stats;
+}
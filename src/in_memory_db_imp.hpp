@@ -2,8 +2,25 @@
 #define IN_MEMORY_DB_IMP_HPP
 
 #include "in_memory_db.hpp"
+#include "snapshot_codec.hpp"
+#include "append_log.hpp"
+#include "change_stream.hpp"
+#include "storage_arena.hpp"
+#include "record_filter.hpp"
+#include "tier_store.hpp"
+#include "intern_pool.hpp"
+#include "field_map.hpp"
+#include "collection.hpp"
+#include "lazy_free.hpp"
+#include "radix_index.hpp"
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <memory>
+#include <functional>
 #include <chrono>
+#include <cstdint>
+#include <atomic>
 #include <sstream>
 #include <iostream>
 
@@ -11,13 +28,109 @@
  * Concrete implementation of the InMemoryDB interface
  */
 class InMemoryDBImpl : public InMemoryDB {
+public:
+    // Storage tables, allocated through StorageArena so they can be backed by huge pages.
+    // Records with few fields use FieldMap's packed layout.
+    using FieldMap = ::FieldMap;
+    using RecordMap = std::unordered_map<std::string, FieldMap, std::hash<std::string>, std::equal_to<std::string>,
+                                         StorageAllocator<std::pair<const std::string, FieldMap>>>;
+
 private:
     // Record structure: recordId -> (field -> value)
-    std::unordered_map<std::string, std::unordered_map<std::string, std::string>> records_;
+    // Mutable because with tiering enabled, reads load cold records back in
+    mutable RecordMap records_;
     
     // TTL structure: recordId -> expiration timestamp
     std::unordered_map<std::string, std::chrono::steady_clock::time_point> ttlMap_;
     
+    // Change tracking: recordId -> epoch of the last modification or deletion
+    std::unordered_map<std::string, uint64_t> changeEpochs_;
+    
+    // Monotonic mutation counter; its current value is the backup token
+    uint64_t changeEpoch_ = 0;
+    
+    // Incremental backups since a token older than this must resend everything
+    uint64_t baselineEpoch_ = 0;
+    
+    // Append-only operation log (null when disabled)
+    std::unique_ptr<AppendLog> appendLog_;
+    
+    // Sequence number of the last logged mutation
+    uint64_t mutationSeq_ = 0;
+    
+    // Set while applying a log entry: writes apply as recorded, without dropping records whose TTL has passed
+    bool replaying_ = false;
+    
+    // Change data capture stream (null when disabled)
+    std::shared_ptr<ChangeStream> changeStream_;
+    
+    // Rewrite the log automatically once it grows by this percentage (0 = never)
+    int autoRewritePercent_ = 100;
+    uint64_t autoRewriteMinBytes_ = 64 * 1024 * 1024;
+    bool rewriteDue_ = false;
+    
+    // Log rewrite base capture. The base is the state when the rewrite began:
+    // records are captured in bounded steps, and a record about to change for
+    // the first time is captured just before (copy-on-write).
+    bool rewriteCapturing_ = false;
+    uint64_t rewriteSeq_ = 0;
+    size_t rewriteBucket_ = 0;                       // Next bucket of records_ to capture
+    size_t rewriteBucketCount_ = 0;                  // Bucket count the scan runs over
+    std::unordered_set<std::string> rewriteChanged_; // Captured before changing, or created since
+    std::string rewriteChunk_;                       // Captured entries not yet handed to the log
+    
+    // Filter over record IDs answering definite misses (null when disabled)
+    std::unique_ptr<RecordFilter> recordFilter_;
+    double recordFilterRate_ = 0.01;
+    mutable std::atomic<uint64_t> filteredLookups_{0};
+    
+    // Ordered index of record IDs for prefix listing (null when disabled)
+    std::unique_ptr<RadixIndex> recordIndex_;
+    
+    // On-disk tier for cold records (null when tiering is disabled). A cold
+    // record keeps its key in records_ with an empty field map.
+    std::unique_ptr<TierStore> tierStore_;
+    mutable RecencyList residentRecords_;
+    size_t maxResidentBytes_ = 0;
+    
+    // Per-field value compression (empty when no field is compressed)
+    struct ValueCodec {
+        size_t minSize = 1024;
+        std::vector<std::string> samples;                        // Collected until the dictionary is trained
+        std::shared_ptr<const CompressionDictionary> dictionary; // null until trained
+    };
+    std::unordered_map<std::string, ValueCodec> valueCodecs_;
+    
+    // Value interning for low-cardinality fields. Each field's first values
+    // are observed; fields with few distinct values store handles into a
+    // per-field pool instead of the values themselves.
+    enum class InternState : uint8_t { Observing, Interned, Plain };
+    struct FieldProfile {
+        InternState state = InternState::Observing;
+        size_t observedValues = 0;
+        std::unordered_set<std::string> distinctValues; // Only kept while observing
+        InternPool pool;                                // Only used once interned
+    };
+    bool internValues_ = false;
+    std::unordered_map<std::string, FieldProfile> fieldProfiles_;
+    
+    // Native collections. A collection field stores a handle (tag, slot, nonce)
+    // into collections_; the random nonce keeps a plain value from ever
+    // passing for a handle.
+    struct CollectionSlot {
+        std::unique_ptr<Collection> collection; // null while the slot is free
+        uint64_t nonce = 0;
+    };
+    std::vector<CollectionSlot> collections_;
+    std::vector<uint32_t> freeCollectionSlots_;
+    size_t liveCollections_ = 0;
+    uint64_t collectionNonce_;
+    
+    // Background freeing of large deleted records (null when disabled)
+    std::unique_ptr<LazyFreer> lazyFreer_;
+    size_t lazyFreeMinFields_ = 64;
+    uint64_t syncFreedRecords_ = 0;
+    
     /**
      * Helper function to check if a record has expired
      * @param recordId Unique identifier for the record
@@ -30,6 +143,325 @@ private:
      * @param recordId Unique identifier for the record
      */
     void cleanupExpiredRecord(const std::string& recordId);
+    
+    /**
+     * Helper function for write paths: clean up a record whose TTL has passed
+     * (skipped while replaying a log, which sweeps once at its end)
+     * @param recordId Unique identifier for the record
+     * @return true if the record was cleaned up
+     */
+    bool dropIfExpired(const std::string& recordId);
+    
+    /**
+     * Helper function to record that a record was modified or deleted
+     * @param recordId Unique identifier for the record
+     */
+    void markDirty(const std::string& recordId);
+    
+    /**
+     * Helper function to answer a lookup from the record filter
+     * @param recordId Unique identifier for the record
+     * @return true if the record definitely does not exist
+     */
+    bool isDefinitelyAbsent(const std::string& recordId) const;
+    
+    /**
+     * Helper functions to keep the record filter, the record index (and the tier) in sync with records_
+     * @param recordId Record that was created or removed
+     */
+    void trackNewRecord(const std::string& recordId);
+    void trackRemovedRecord(const std::string& recordId);
+    
+    /**
+     * Helper function to rebuild the record filter after records_ was replaced or cleared
+     */
+    void rebuildRecordFilter();
+    
+    /**
+     * Helper function to rebuild the record index after records_ was replaced or cleared
+     */
+    void rebuildRecordIndex();
+    
+    /**
+     * Load a cold record's fields back from the tier (no-op for resident records)
+     * @param recordIt Record to load
+     */
+    void promoteRecord(RecordMap::iterator recordIt) const;
+    
+    /**
+     * Mark a resident record as most recently used, then evict the coldest
+     * records to the tier while resident records exceed the memory cap
+     * @param recordIt Record that was used
+     */
+    void touchRecord(RecordMap::iterator recordIt) const;
+    void evictColdRecords() const;
+    
+    /**
+     * Get a record's fields without promoting it (for scans)
+     * @param record Record to read
+     * @param scratch Receives the fields of a cold record, or of a record with converted values
+     * @param exported Return values in their exported form (false returns them as stored)
+     * @return The record's fields, or scratch
+     */
+    const FieldMap& fieldsOf(const RecordMap::value_type& record, FieldMap& scratch, bool exported = true) const;
+    
+    /**
+     * Empty the tier and track every record again after the dataset was replaced
+     */
+    void resetTiering();
+    
+    /**
+     * Helper functions to convert between values and their stored form, which
+     * for compressed fields may be compressed or escaped and for interned
+     * fields is a pool handle. Encoding an interned value takes a reference
+     * that releaseValue gives back.
+     * @param field Field the value belongs to
+     */
+    std::string encodeValue(const std::string& field, const std::string& value);
+    std::string decodeValue(const std::string& field, const std::string& stored) const;
+    bool storedValueEquals(const std::string& field, const std::string& stored, const std::string& value) const;
+    
+    /**
+     * Convert a stored value to the form written to backups and snapshots:
+     * collections serialized, plain values decoded, and plain values starting
+     * with a tag byte escaped so restoring never mistakes them for collections
+     */
+    std::string exportValue(const std::string& field, const std::string& stored) const;
+    
+    /**
+     * Fill in the op and value of a log entry recreating a stored value: a
+     * Set of the plain value, or a Collection command replacing the whole collection
+     */
+    void loggedValue(const std::string& field, const std::string& stored, LogEntry& entry) const;
+    
+    /**
+     * Store a field value in a record looked up (or created) by the caller and
+     * track, touch and log the write like set
+     * @param recordIt Record to write
+     * @param created true if the caller just inserted the record
+     * @param collection Collection to store instead of a plain value; value is then its serialized form
+     */
+    void assignValue(RecordMap::iterator recordIt, bool created, const std::string& recordId,
+                     const std::string& field, const std::string& value,
+                     std::unique_ptr<Collection> collection = nullptr);
+    
+    /**
+     * Encode the values of a record that was inserted without going through set
+     * @param fields Record fields, holding values in their exported form
+     */
+    void encodeValues(FieldMap& fields);
+    
+    /**
+     * Encode (or decode) one field's values in every record, resident or cold
+     * @param field Field to convert
+     * @param encode true to encode plain values, false to decode stored ones
+     */
+    void recodeField(const std::string& field, bool encode);
+    
+    /**
+     * Drop the pool references held by a stored value, or by every value of
+     * a record (loading it from the tier if cold), before they are discarded
+     * @param detached If set, receives released collections instead of destroying them
+     */
+    void releaseValue(const std::string& field, const std::string& stored,
+                      std::vector<std::unique_ptr<Collection>>* detached = nullptr);
+    void releaseRecordValues(const RecordMap::value_type& record,
+                             std::vector<std::unique_ptr<Collection>>* detached = nullptr);
+    
+    /**
+     * Release a field's value before it is erased or overwritten, handing a
+     * large collection to the lazy freer
+     */
+    void discardValue(const std::string& field, const std::string& stored);
+    
+    /**
+     * Release a record's values and erase it, handing its field map and
+     * collections to the lazy freer if they are large enough
+     */
+    void eraseRecord(RecordMap::iterator recordIt);
+    
+    /**
+     * Count a value written to a field, interning the field once its observed
+     * cardinality turns out low and reverting it if the pool outgrows that
+     * @param field Field that was written
+     * @param value Plain value that was written
+     */
+    void observeValue(const std::string& field, const std::string& value);
+    
+    /**
+     * Get a field's intern pool
+     * @return nullptr unless the field is interned
+     */
+    const InternPool* internPoolOf(const std::string& field) const;
+    
+    /**
+     * Empty every intern pool and drop every collection after the dataset was
+     * replaced or cleared
+     */
+    void resetValuePools();
+    
+    /**
+     * Helper functions to keep collections in their slots
+     * @param collection Collection to store
+     * @return Handle to put in the field
+     */
+    std::string storeCollection(std::unique_ptr<Collection> collection);
+    
+    /**
+     * Get the collection behind a stored value
+     * @return nullptr unless stored is a live collection handle
+     */
+    Collection* collectionOf(const std::string& stored) const;
+    
+    /**
+     * Find a collection for reading, promoting its record like get
+     * @return nullptr if the field is absent or not a collection
+     */
+    const Collection* findCollection(const std::string& recordId, const std::string& field) const;
+    
+    /**
+     * Find a collection for writing, creating the record and field if allowed
+     * @param recordIt Receives the record
+     * @return nullptr if the field holds another kind of value, or is absent and create is false
+     */
+    Collection* writableCollection(const std::string& recordId, const std::string& field, Collection::Kind kind,
+                                   bool create, RecordMap::iterator& recordIt);
+    
+    /**
+     * Finish an in-place collection write: drop the field once the collection
+     * is empty (and the record once it has no fields), then log the command
+     * @param op Command code (COLLECTION_* in the implementation); COLLECTION_REPLACE
+     *           logs the whole collection as a Set of its serialized form
+     * @param member Member the command applies to
+     * @param operand Score bits of a sorted set add, or the count of a count-min add
+     */
+    void commitCollectionWrite(const std::string& recordId, RecordMap::iterator recordIt, const std::string& field,
+                               const Collection& collection, char op, const std::string& member,
+                               uint64_t operand = 0);
+    
+    /**
+     * Replay a logged collection command
+     */
+    void applyCollectionCommand(const std::string& recordId, const std::string& field, const std::string& command);
+    
+    /**
+     * Helper function to serialize a single record in backup format
+     * @param out Stream to write to
+     * @param recordId Unique identifier for the record
+     * @param fields Field-value pairs of the record
+     */
+    static void writeRecord(std::ostream& out, const std::string& recordId, const FieldMap& fields);
+    
+    /**
+     * Helper function to record a mutation in the append-only log and the change stream
+     * @param op Mutation type
+     * @param recordId Unique identifier for the record
+     * @param field Field name (Set, DeleteField)
+     * @param value Field value (Set)
+     * @param expiresAtMs Wall-clock expiry in milliseconds since the Unix epoch (SetTTL)
+     */
+    void logMutation(LogOp op, const std::string& recordId, const std::string& field = std::string(),
+                     const std::string& value = std::string(), int64_t expiresAtMs = 0);
+    
+    /**
+     * Helper function to log the full current state of one record, replacing any previous state
+     * @param recordId Unique identifier for the record
+     */
+    void logRecordState(const std::string& recordId);
+    
+    /**
+     * Helper function to look up a group of up to 32 records with prefetching
+     * @param recordIds First record ID of the group
+     * @param count Number of records in the group
+     * @param found Receives each live record, or nullptr if missing or expired
+     */
+    void probeRecords(const std::string* recordIds, size_t count, const RecordMap::value_type** found) const;
+    
+    /**
+     * Helper function to produce log entries that rebuild the current state from scratch
+     * @param seq Sequence number stamped on every entry
+     * @param visit Called for each entry
+     */
+    void forEachStateEntry(uint64_t seq, const std::function<void(const LogEntry&)>& visit) const;
+    
+    /**
+     * Helper function to produce the log entries that rebuild one record (none if it has expired)
+     * @param record Record to describe
+     * @param seq Sequence number stamped on every entry
+     * @param visit Called for each entry
+     */
+    void forEachRecordEntry(const RecordMap::value_type& record, uint64_t seq,
+                            const std::function<void(const LogEntry&)>& visit) const;
+    
+    /**
+     * Helper function for write paths: while a log rewrite captures its base, capture
+     * a record's state before its first change
+     * @param recordId Unique identifier for the record
+     */
+    void captureForRewrite(const std::string& recordId);
+    
+    /**
+     * Helper function to capture more of a running log rewrite's base
+     * @param recordBudget Roughly how many records (and buckets) to visit
+     */
+    void advanceLogRewrite(size_t recordBudget);
+    
+    /**
+     * Helper function to hand the rest of the captured base to the log and end it
+     */
+    void finishLogRewriteCapture();
+    
+    /**
+     * Helper function to close the log, abandoning a rewrite still capturing its base
+     */
+    void closeLog();
+    
+    /**
+     * Helper function to replay a log after a sequence number and keep it open for appending
+     * @param path Log file path
+     * @param syncEveryWrite fsync on every mutation instead of writing in batches
+     * @param afterSeq Entries up to and including this sequence number are skipped
+     * @return true if the log was replayed and opened
+     */
+    bool openLog(const std::string& path, bool syncEveryWrite, uint64_t afterSeq);
+
+public:
+    /**
+     * A complete database state, built off to the side by prepareRestore()
+     */
+    struct Dataset {
+        RecordMap records;
+        std::unordered_map<std::string, std::chrono::steady_clock::time_point> ttlMap;
+    };
+
+private:
+    /**
+     * Helper function to parse a text backup produced by backup()
+     * @param backupData String representation of database state
+     * @param staged Dataset receiving the parsed state
+     * @return true if the backup was parsed completely
+     */
+    static bool parseBackup(const std::string& backupData, Dataset& staged);
+    
+    /**
+     * Helper function to decode a snapshot produced by snapshot()
+     * @param snapshotData Snapshot data
+     * @param staged Dataset receiving the decoded state
+     * @param threadCount Number of decoder threads (0 = hardware concurrency)
+     * @return true if every block was verified and decoded
+     */
+    static bool decodeSnapshot(const std::string& snapshotData, Dataset& staged, unsigned threadCount);
+    
+    /**
+     * Helper function to load a checkpoint written by checkpoint()
+     * @param checkpointPath Checkpoint metadata path
+     * @param staged Dataset receiving the snapshot state, with TTLs aged by the downtime
+     * @param logSeq Receives the log sequence number the snapshot covers
+     * @param threadCount Number of snapshot decoder threads (0 = hardware concurrency)
+     * @return false if the checkpoint is missing or does not match its snapshot
+     */
+    static bool loadCheckpoint(const std::string& checkpointPath, Dataset& staged, uint64_t& logSeq,
+                               unsigned threadCount);
 
 public:
     /**
@@ -51,6 +483,25 @@ public:
     bool hasRecord(const std::string& recordId) const override;
     std::vector<std::string> getAllRecordIds() const override;
     
+    // Batched lookups
+    /**
+     * Get a field from many records. Lookups run in groups of 32 whose hash
+     * computations and memory accesses are overlapped (group prefetching),
+     * which hides most of the cache-miss latency on large datasets.
+     * @param recordIds Records to look up
+     * @param field Field name to retrieve
+     * @return One value per record ID, as get() would return it
+     */
+    std::vector<std::optional<std::string>> getMany(const std::vector<std::string>& recordIds,
+                                                    const std::string& field) const;
+    
+    /**
+     * Check the existence of many records, with the same batching as getMany()
+     * @param recordIds Records to check
+     * @return One flag per record ID, as hasRecord() would return it
+     */
+    std::vector<bool> hasRecords(const std::vector<std::string>& recordIds) const;
+    
     // Level 2: Filtering functionality
     std::vector<std::string> getRecordsByFieldValue(const std::string& field, const std::string& value) const override;
     
@@ -62,9 +513,552 @@ public:
     std::string backup() const override;
     bool restore(const std::string& backupData) override;
     
+    // Incremental backups
+    /**
+     * Get the token identifying the state captured by a backup taken now
+     * @return Token to pass to backupIncremental() later
+     */
+    uint64_t backupToken() const;
+    
+    /**
+     * Create a delta containing only records modified or deleted since a token
+     * @param sinceToken Token returned by backupToken() at the previous backup
+     * @return String representation of the changes, applicable with applyIncremental()
+     */
+    std::string backupIncremental(uint64_t sinceToken) const;
+    
+    /**
+     * Apply a delta produced by backupIncremental() on top of the current state
+     * @param deltaData String representation of the changes
+     * @return true if the delta was applied, false if it was malformed (state is unchanged)
+     */
+    bool applyIncremental(const std::string& deltaData);
+    
+    /**
+     * Restore a base backup followed by a chain of deltas
+     * @param baseData Full backup produced by backup()
+     * @param deltas Deltas in the order they were taken
+     * @return true if the base and every delta were applied successfully
+     */
+    bool restoreIncremental(const std::string& baseData, const std::vector<std::string>& deltas);
+    
+    /**
+     * Forget change tracking up to a token no longer needed by any backup chain
+     * @param token Oldest token that will still be passed to backupIncremental();
+     *              deltas requested since an older token carry the full state
+     */
+    void discardChangesBefore(uint64_t token);
+    
+    // Block-structured snapshots
+    /**
+     * Create a binary snapshot split into independently decodable blocks
+     * @param recordsPerBlock Maximum number of records stored in one block
+     * @param codec Block compression codec; unavailable codecs fall back to the in-tree codec
+     * @return Snapshot data, restorable with restoreSnapshot()
+     */
+    std::string snapshot(size_t recordsPerBlock = 4096, SnapshotCodec codec = SnapshotCodec::None) const;
+    
+    /**
+     * Restore database from a snapshot, decoding its blocks on a pool of threads
+     * @param snapshotData Data produced by snapshot()
+     * @param threadCount Number of decoder threads (0 = hardware concurrency)
+     * @return true if restore was successful; on failure (including a block whose
+     *         checksum does not match) the current state is kept
+     */
+    bool restoreSnapshot(const std::string& snapshotData, unsigned threadCount = 0);
+    
+    // Online restore
+    /**
+     * Build the state described by a backup or snapshot without touching this database.
+     * Uses no instance state, so it may run on another thread while the database serves requests.
+     * @param data Data produced by backup() or snapshot()
+     * @param staged Dataset receiving the new state
+     * @param threadCount Number of snapshot decoder threads (0 = hardware concurrency)
+     * @return true if the data was parsed completely
+     */
+    static bool prepareRestore(const std::string& data, Dataset& staged, unsigned threadCount = 0);
+    
+    /**
+     * Replace the current state with a prepared dataset, all at once. The swap is O(1),
+     * but the commit then re-encodes interned and compressed values, rebuilds the record
+     * filter, ID index and tiering, and logs the new state: O(n) on the calling thread.
+     * Parsing, the bulk of a restore, stays in prepareRestore().
+     * @param staged Prepared dataset; receives the previous state, to be freed by the caller
+     */
+    void commitRestore(Dataset& staged);
+    
+    /**
+     * Restore from a backup or snapshot so that the database holds either the old or
+     * the new state, never a partial one
+     * @param data Data produced by backup() or snapshot()
+     * @param threadCount Number of snapshot decoder threads (0 = hardware concurrency)
+     * @return true if restore was successful; on failure the current state is kept
+     */
+    bool restoreAtomic(const std::string& data, unsigned threadCount = 0);
+    
+    // Append-only log
+    /**
+     * Replay an existing log into the database, then record every mutation in it.
+     * Intended to be called at startup on an empty database.
+     * @param path Log file path (created if missing)
+     * @param syncEveryWrite fsync on every mutation instead of writing in batches
+     * @return true if the log was replayed and opened
+     */
+    bool openAppendLog(const std::string& path, bool syncEveryWrite = false);
+    
+    /**
+     * Write buffered log entries and fsync the log. Also starts a due automatic rewrite
+     * and captures the next bounded step of a running rewrite's base.
+     * @return true if the log is open and was flushed
+     */
+    bool flushAppendLog();
+    
+    /**
+     * Start a background rewrite of the log into a minimal log of the current state.
+     * Mutations made meanwhile are buffered and carried over to the new log.
+     * Starting is O(1): the state is captured in steps by flushAppendLog(), each
+     * record just before its first change, and written by a background thread.
+     * @return true if the rewrite was started
+     */
+    bool rewriteAppendLog();
+    
+    /**
+     * Capture the rest of a running log rewrite's base, then block until it has switched files
+     */
+    void waitForAppendLogRewrite();
+    
+    /**
+     * Configure automatic log rewrites. Mutations only mark a rewrite as due; it
+     * starts at the next flushAppendLog().
+     * @param growthPercent Rewrite once the log grows by this percentage over its last rewritten size (0 = never)
+     * @param minBytes Do not rewrite logs smaller than this
+     */
+    void setAutoRewrite(int growthPercent, uint64_t minBytes);
+    
+    /**
+     * Current log size in bytes (0 when the log is disabled)
+     */
+    uint64_t appendLogSize() const;
+    
+    // Checkpoints and crash recovery
+    /**
+     * Write a snapshot to <checkpointPath>.snapshot and metadata linking it to the
+     * current log position to checkpointPath
+     * @param checkpointPath Checkpoint metadata path
+     * @param codec Snapshot block compression codec
+     * @return true if both files were written
+     */
+    bool checkpoint(const std::string& checkpointPath, SnapshotCodec codec = SnapshotCodec::None) const;
+    
+    /**
+     * Recover after a restart: load the checkpoint snapshot, replay only the log entries
+     * written after it, and keep logging to the log. Falls back to replaying the whole
+     * log when the checkpoint is missing or inconsistent.
+     * Intended to be called at startup on an empty database.
+     * @param checkpointPath Checkpoint metadata path
+     * @param logPath Log file path
+     * @param syncEveryWrite fsync on every mutation instead of writing in batches
+     * @param threadCount Number of snapshot decoder threads (0 = hardware concurrency)
+     * @return true if the database was recovered and the log opened
+     */
+    bool recover(const std::string& checkpointPath, const std::string& logPath, bool syncEveryWrite = false,
+                 unsigned threadCount = 0);
+    
+    // Negative-lookup filter
+    /**
+     * Record filter statistics
+     */
+    struct RecordFilterStats {
+        bool enabled = false;
+        size_t keys = 0;
+        size_t capacity = 0;
+        size_t memoryBytes = 0;
+        uint64_t definiteMisses = 0; // Lookups answered by the filter alone
+    };
+    
+    /**
+     * Maintain a counting Bloom filter over record IDs, so lookups of absent records
+     * (get, hasRecord, getFields, deletes, batched lookups) are answered without
+     * probing the record table. The filter resizes itself as the dataset grows.
+     * @param falsePositiveRate Target fraction of absent IDs that still probe the table
+     */
+    void enableRecordFilter(double falsePositiveRate = 0.01);
+    
+    /**
+     * Drop the record filter
+     */
+    void disableRecordFilter();
+    
+    /**
+     * Get record filter statistics
+     */
+    RecordFilterStats recordFilterStats() const;
+    
+    // Record ID index
+    /**
+     * Record index statistics
+     */
+    struct RecordIndexStats {
+        bool enabled = false;
+        size_t keys = 0;
+        size_t nodes = 0;
+        size_t keyBytes = 0;    // Total length of the indexed IDs
+        size_t labelBytes = 0;  // ID bytes the tree stores; shared prefixes count once
+        size_t memoryBytes = 0; // Tree size including node overhead
+    };
+    
+    /**
+     * Maintain a radix tree over record IDs, so getRecordIdsByPrefix walks only
+     * the matching IDs instead of scanning every record
+     */
+    void enableRecordIndex();
+    
+    /**
+     * Drop the record index
+     */
+    void disableRecordIndex();
+    
+    /**
+     * Get the IDs of the unexpired records starting with a prefix, sorted; O(prefix
+     * length + matches) with the record index, a scan of every record without it
+     * @param prefix ID prefix ("" lists every record)
+     */
+    std::vector<std::string> getRecordIdsByPrefix(const std::string& prefix) const;
+    
+    /**
+     * Get record index statistics
+     */
+    RecordIndexStats recordIndexStats() const;
+    
+    // Tiered storage
+    /**
+     * Tiering statistics
+     */
+    struct TieringStats {
+        bool enabled = false;
+        size_t residentRecords = 0;
+        size_t coldRecords = 0;
+        size_t residentBytes = 0;     // Estimated memory used by resident records
+        size_t maxResidentBytes = 0;
+        uint64_t fileBytes = 0;       // Segment log size, garbage included
+        uint64_t garbageBytes = 0;
+        uint64_t diskReads = 0;
+        uint64_t readaheadHits = 0;
+        uint64_t compactions = 0;
+    };
+    
+    /**
+     * Cap the memory used by record contents, evicting the least recently used
+     * records to an append-only segment log on disk. Cold records keep their
+     * IDs in memory and are loaded back transparently by point reads and
+     * writes; scans and backups read them without loading them back. With
+     * tiering enabled even const methods modify state, so calls must not overlap.
+     * @param path Segment log path (created or truncated; removed when tiering stops)
+     * @param maxResidentBytes Memory cap for resident records
+     * @return true if the segment log was opened
+     */
+    bool enableTiering(const std::string& path, size_t maxResidentBytes);
+    
+    /**
+     * Load every cold record back into memory and stop tiering
+     */
+    void disableTiering();
+    
+    /**
+     * Get tiering statistics
+     */
+    TieringStats tieringStats() const;
+    
+    // Value compression
+    /**
+     * Value compression statistics for one field
+     */
+    struct ValueCompressionStats {
+        bool enabled = false;
+        size_t compressedValues = 0;
+        uint64_t rawBytes = 0;      // Decompressed size of the compressed values
+        uint64_t storedBytes = 0;   // Their size as stored
+        size_t dictionaryBytes = 0; // 0 until enough samples were seen to train one
+    };
+    
+    /**
+     * Store a field's values compressed when they reach a size threshold.
+     * The first large values train a dictionary shared by the field's later
+     * values. get and every other API keep returning the original values.
+     * @param field Field to compress (existing values are compressed now)
+     * @param minSize Values shorter than this are stored as is
+     */
+    void enableValueCompression(const std::string& field, size_t minSize = 1024);
+    
+    /**
+     * Decompress a field's values and store them as is from now on
+     * @param field Field to stop compressing
+     */
+    void disableValueCompression(const std::string& field);
+    
+    /**
+     * Get value compression statistics for a field
+     * @param field Field name
+     */
+    ValueCompressionStats valueCompressionStats(const std::string& field) const;
+    
+    // Value interning
+    /**
+     * Value interning statistics for one field
+     */
+    struct InternStats {
+        bool interned = false;
+        size_t distinctValues = 0; // Values held by the pool
+        uint64_t references = 0;   // Stored values pointing into the pool
+        size_t pooledBytes = 0;    // Total length of the pooled values
+    };
+    
+    /**
+     * Observe the values written to each field and intern fields with low
+     * cardinality, so records sharing a value share one copy of it and
+     * getRecordsByFieldValue compares handles instead of strings. Existing
+     * records are observed right away. Compressed fields are never interned.
+     */
+    void enableValueInterning();
+    
+    /**
+     * Store every interned value as is again and stop observing fields
+     */
+    void disableValueInterning();
+    
+    /**
+     * Get value interning statistics for a field
+     * @param field Field name
+     */
+    InternStats internStats(const std::string& field) const;
+    
+    // Lazy freeing
+    /**
+     * Lazy freeing statistics
+     */
+    struct LazyFreeStats {
+        bool enabled = false;
+        size_t pendingRecords = 0;     // Handed to the background thread, not freed yet
+        uint64_t lazyFreedRecords = 0; // Freed by the background thread
+        uint64_t lazyFreedFields = 0;
+        uint64_t lazyFreedCollections = 0;
+        uint64_t syncFreedRecords = 0; // Below the threshold, freed by the deleting call
+    };
+    
+    /**
+     * Free large records off the caller's thread: deleteRecord, expiry and
+     * incremental restores unlink a record of at least minFields fields and
+     * collection members in O(1) and leave freeing its fields, values and
+     * collections to a background thread. Deleting or overwriting a field
+     * holding a collection of at least minFields members does the same.
+     * Interned values are still released right away. Records are freed
+     * synchronously while huge page storage is enabled, since the arena
+     * keeps freed blocks on the freeing thread.
+     * @param minFields Smallest record (fields plus collection members) or collection handed to the background thread
+     */
+    void enableLazyFree(size_t minFields = 64);
+    
+    /**
+     * Wait for pending frees and stop the background thread
+     */
+    void disableLazyFree();
+    
+    /**
+     * Wait until every record handed to the background thread is freed
+     */
+    void waitForLazyFree() const;
+    
+    /**
+     * Get lazy freeing statistics
+     */
+    LazyFreeStats lazyFreeStats() const;
+    
+    // Native collections
+    // Collection fields show up in get, backups, snapshots and logs as their
+    // serialized form (see Collection::serialize); setting a field to such a
+    // value recreates the collection. Writes fail (return false or nullopt)
+    // when the field holds a value of another kind. A collection field is
+    // removed when its last member is.
+    /**
+     * Push a value onto a list, creating the list if the field is absent
+     * @param front true to push at the front instead of the back
+     * @return false if the field holds something other than a list
+     */
+    bool listPush(const std::string& recordId, const std::string& field, const std::string& value, bool front = false);
+    
+    /**
+     * Pop a value from a list
+     * @param front true to pop from the front instead of the back
+     * @return The value, or std::nullopt if the field is not a list
+     */
+    std::optional<std::string> listPop(const std::string& recordId, const std::string& field, bool front = false);
+    
+    /**
+     * Get up to count list values starting at index start
+     */
+    std::vector<std::string> listRange(const std::string& recordId, const std::string& field, size_t start,
+                                       size_t count) const;
+    
+    /**
+     * Add a member to a set, creating the set if the field is absent
+     * @return true if the member was added
+     */
+    bool setAdd(const std::string& recordId, const std::string& field, const std::string& member);
+    
+    /**
+     * Remove a member from a set
+     * @return true if the member was removed
+     */
+    bool setRemove(const std::string& recordId, const std::string& field, const std::string& member);
+    
+    bool setContains(const std::string& recordId, const std::string& field, const std::string& member) const;
+    
+    /**
+     * Get every member of a set, in no particular order
+     */
+    std::vector<std::string> setMembers(const std::string& recordId, const std::string& field) const;
+    
+    /**
+     * Add a member to a sorted set or change its score, creating the sorted
+     * set if the field is absent
+     * @param score Score ordering the member (NaN is rejected)
+     * @return true if the member was added
+     */
+    bool sortedSetAdd(const std::string& recordId, const std::string& field, const std::string& member, double score);
+    
+    /**
+     * Remove a member from a sorted set
+     * @return true if the member was removed
+     */
+    bool sortedSetRemove(const std::string& recordId, const std::string& field, const std::string& member);
+    
+    std::optional<double> sortedSetScore(const std::string& recordId, const std::string& field,
+                                         const std::string& member) const;
+    
+    /**
+     * Get a member's 0-based rank in ascending score order, in O(log n)
+     */
+    std::optional<size_t> sortedSetRank(const std::string& recordId, const std::string& field,
+                                        const std::string& member) const;
+    
+    /**
+     * Get the members ranked start to stop (inclusive) with their scores
+     */
+    std::vector<std::pair<std::string, double>> sortedSetRange(const std::string& recordId, const std::string& field,
+                                                               size_t start, size_t stop) const;
+    
+    /**
+     * Get the number of members of a collection
+     * @return 0 if the field is absent or not a collection
+     */
+    size_t collectionSize(const std::string& recordId, const std::string& field) const;
+    
+    // Probabilistic fields
+    // HyperLogLog and count-min sketch fields are collections of fixed size
+    // (4 KB and 16 KB in memory) and travel in the same serialized form.
+    /**
+     * Add an element to a HyperLogLog, creating it if the field is absent
+     * @return true if the estimate may have changed
+     */
+    bool hllAdd(const std::string& recordId, const std::string& field, const std::string& element);
+    
+    /**
+     * Estimate the number of distinct elements added to a HyperLogLog (about 1.6% standard error)
+     * @return std::nullopt if the field is not a HyperLogLog
+     */
+    std::optional<uint64_t> hllCount(const std::string& recordId, const std::string& field) const;
+    
+    /**
+     * Merge a HyperLogLog into another, creating the destination if absent,
+     * so it counts the union of both
+     * @return false if the source is not a HyperLogLog or the destination holds another kind of value
+     */
+    bool hllMerge(const std::string& recordId, const std::string& field, const std::string& sourceRecordId,
+                  const std::string& sourceField);
+    
+    /**
+     * Add occurrences of an element to a count-min sketch, creating it if the field is absent
+     * @param count Occurrences to add (0 is rejected)
+     * @return false if the field holds another kind of value
+     */
+    bool countMinAdd(const std::string& recordId, const std::string& field, const std::string& element,
+                     uint64_t count = 1);
+    
+    /**
+     * Estimate how often an element was added; never an undercount
+     * @return std::nullopt if the field is not a count-min sketch
+     */
+    std::optional<uint64_t> countMinEstimate(const std::string& recordId, const std::string& field,
+                                             const std::string& element) const;
+    
+    /**
+     * Merge a count-min sketch into another, creating the destination if absent
+     * @return false if the source is not a count-min sketch or the destination holds another kind of value
+     */
+    bool countMinMerge(const std::string& recordId, const std::string& field, const std::string& sourceRecordId,
+                       const std::string& sourceField);
+    
+    // Rate limiting
+    struct RateLimitResult {
+        bool allowed;
+        uint64_t remaining;    // Further cost that would be admitted right now
+        uint64_t retryAfterMs; // 0 if allowed; otherwise a lower bound on the wait
+    };
+    
+    /**
+     * Check and count a request against a sliding-window limit in one call
+     *
+     * The field holds the counter as WINDOW_START:PREVIOUS:CURRENT (wall-clock
+     * milliseconds and counts of the current and previous fixed window); the
+     * sliding count weights PREVIOUS by the part of the last window still in
+     * range. A record created by the limiter, or one that already has a TTL,
+     * expires two windows after its last admitted request.
+     * @param limit Cost admitted per window
+     * @param windowMs Window length in milliseconds
+     * @param cost Cost of this request
+     * @return std::nullopt if windowMs is 0 or the field holds something other than a counter
+     */
+    std::optional<RateLimitResult> checkRateLimit(const std::string& recordId, const std::string& field,
+                                                  uint64_t limit, uint64_t windowMs, uint64_t cost = 1);
+    
+    // Change data capture
+    /**
+     * Start publishing every mutation (set, deleteField, deleteRecord, expire, TTL
+     * changes and restores) to a bounded change stream
+     * @param capacity Number of events retained for slow readers
+     * @return The stream; readers may hold it and consume from other threads
+     */
+    std::shared_ptr<ChangeStream> enableChangeStream(size_t capacity = 65536);
+    
+    /**
+     * Get the change stream
+     * @return The stream, or nullptr if change data capture is disabled
+     */
+    std::shared_ptr<ChangeStream> changeStream() const;
+    
+    /**
+     * Stop publishing mutations; readers holding the stream can drain what is left
+     */
+    void disableChangeStream();
+    
+    /**
+     * Apply a mutation read from a log, change stream or replication link
+     * @param entry Entry to apply
+     */
+    void applyLogEntry(const LogEntry& entry);
+    
     // Utility functions for debugging/testing
     void printAllRecords() const;
     size_t getRecordCount() const;
+    
+    /**
+     * Count resident records by field layout
+     */
+    struct RecordLayoutStats {
+        size_t packedRecords = 0; // Up to FieldMap::PACKED_MAX_FIELDS fields in one buffer
+        size_t hashedRecords = 0; // Promoted to a hash table
+    };
+    RecordLayoutStats recordLayoutStats() const;
 };
 
 #endif // IN_MEMORY_DB_IMP_HPP
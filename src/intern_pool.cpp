@@ -0,0 +1,62 @@
+#include "intern_pool.hpp"
+
+uint32_t InternPool::acquire(const std::string& value) {
+    auto found = ids_.find(std::string_view(value));
+    if (found != ids_.end()) {
+        entries_[found->second].references++;
+        references_++;
+        return found->second;
+    }
+    
+    uint32_t id;
+    if (!freeIds_.empty()) {
+        id = freeIds_.back();
+        freeIds_.pop_back();
+    } else {
+        id = static_cast<uint32_t>(entries_.size());
+        entries_.emplace_back();
+    }
+    
+    Entry& entry = entries_[id];
+    entry.value = value;
+    entry.references = 1;
+    ids_.emplace(std::string_view(entry.value), id);
+    references_++;
+    valueBytes_ += value.size();
+    return id;
+}
+
+void InternPool::release(uint32_t id) {
+    if (id >= entries_.size() || entries_[id].references == 0) {
+        return;
+    }
+    
+    Entry& entry = entries_[id];
+    references_--;
+    if (--entry.references > 0) {
+        return;
+    }
+    
+    ids_.erase(std::string_view(entry.value));
+    valueBytes_ -= entry.value.size();
+    std::string().swap(entry.value);
+    freeIds_.push_back(id);
+}
+
+bool InternPool::find(const std::string& value, uint32_t& id) const {
+    auto found = ids_.find(std::string_view(value));
+    if (found == ids_.end()) {
+        return false;
+    }
+    
+    id = found->second;
+    return true;
+}
+
+void InternPool::clear() {
+    ids_.clear();
+    entries_.clear();
+    freeIds_.clear();
+    references_ = 0;
+    valueBytes_ = 0;
+}
@@ -0,0 +1,82 @@
+#ifndef INTERN_POOL_HPP
+#define INTERN_POOL_HPP
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Reference-counted pool of distinct strings addressed by 32-bit IDs
+ *
+ * Every holder of an ID owns one reference; a value is freed when its last
+ * reference is released and its ID is reused by a later value. Equal
+ * values always map to the same ID, so two interned values can be compared
+ * by ID alone.
+ */
+class InternPool {
+private:
+    struct Entry {
+        std::string value;
+        uint32_t references = 0;
+    };
+    
+    std::deque<Entry> entries_; // Indexed by ID; a deque keeps the values in place as it grows
+    std::vector<uint32_t> freeIds_;
+    std::unordered_map<std::string_view, uint32_t> ids_; // Views into entries_
+    uint64_t references_ = 0;
+    size_t valueBytes_ = 0;
+
+public:
+    /**
+     * Take a reference to a value, adding it to the pool if needed
+     * @param value Value to intern
+     * @return ID of the value
+     */
+    uint32_t acquire(const std::string& value);
+    
+    /**
+     * Drop one reference; the value is freed with its last reference
+     * @param id ID returned by acquire
+     */
+    void release(uint32_t id);
+    
+    /**
+     * Look up a value without taking a reference
+     * @param value Value to find
+     * @param id Receives the ID of the value
+     * @return true if the value is in the pool
+     */
+    bool find(const std::string& value, uint32_t& id) const;
+    
+    /**
+     * Get the value behind an ID
+     * @param id ID of a live value
+     */
+    const std::string& value(uint32_t id) const { return entries_[id].value; }
+    
+    /**
+     * Forget every value
+     */
+    void clear();
+    
+    /**
+     * Number of distinct live values
+     */
+    size_t size() const { return ids_.size(); }
+    
+    /**
+     * Number of references held across all values
+     */
+    uint64_t references() const { return references_; }
+    
+    /**
+     * Total length of the distinct live values
+     */
+    size_t valueBytes() const { return valueBytes_; }
+};
+
+#endif // INTERN_POOL_HPP
@@ -0,0 +1,91 @@
+#include "lazy_free.hpp"
+#include <utility>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+LazyFreer::LazyFreer() : thread_([this]() { run(); }) {}
+
+LazyFreer::~LazyFreer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_.notify_one();
+    thread_.join();
+}
+
+void LazyFreer::run() {
+#ifdef __linux__
+    // Run only when a CPU would otherwise idle, so freeing never delays the database's own threads
+    sched_param param{};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        work_.wait(lock, [this]() { return !queue_.empty() || stopping_; });
+        if (queue_.empty()) {
+            return; // Stopping with nothing left
+        }
+        
+        std::deque<Garbage> batch;
+        batch.swap(queue_);
+        inFlight_ = batch.size();
+        lock.unlock();
+        
+        uint64_t records = 0;
+        uint64_t fields = 0;
+        uint64_t collections = 0;
+        for (const Garbage& garbage : batch) {
+            records += garbage.isRecord ? 1 : 0;
+            fields += garbage.fields.size();
+            collections += garbage.collections.size();
+        }
+        batch.clear(); // The actual freeing, outside the lock
+        
+        lock.lock();
+        freedRecords_ += records;
+        inFlight_ = 0;
+        freedFields_ += fields;
+        freedCollections_ += collections;
+        if (queue_.empty()) {
+            idle_.notify_all();
+        }
+    }
+}
+
+void LazyFreer::enqueue(Garbage garbage) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(garbage));
+    }
+    work_.notify_one();
+}
+
+void LazyFreer::free(FieldMap fields, std::vector<std::unique_ptr<Collection>> collections) {
+    enqueue(Garbage{std::move(fields), std::move(collections), true});
+}
+
+void LazyFreer::free(std::unique_ptr<Collection> collection) {
+    Garbage garbage{FieldMap(), {}, false};
+    garbage.collections.push_back(std::move(collection));
+    enqueue(std::move(garbage));
+}
+
+void LazyFreer::drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return queue_.empty() && inFlight_ == 0; });
+}
+
+LazyFreer::Stats LazyFreer::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.pendingRecords = queue_.size() + inFlight_;
+    stats.freedRecords = freedRecords_;
+    stats.freedFields = freedFields_;
+    stats.freedCollections = freedCollections_;
+    return stats;
+}
@@ -0,0 +1,94 @@
+#ifndef LAZY_FREE_HPP
+#define LAZY_FREE_HPP
+
+#include "field_map.hpp"
+#include "collection.hpp"
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Background thread freeing the field maps and collections of deleted records
+ *
+ * Destroying a record with many fields frees every field and value string
+ * one by one, and destroying a large collection frees every member. A
+ * database hands such maps and collections over here instead (moving them
+ * is O(1)), so deleting a large record or collection field returns at once
+ * and the memory is released off the caller's thread. On Linux the thread runs at idle
+ * priority, so it only uses CPU time the database's threads leave over.
+ */
+class LazyFreer {
+public:
+    struct Stats {
+        size_t pendingRecords = 0; // Records (or single collections) handed over but not freed yet
+        uint64_t freedRecords = 0;
+        uint64_t freedFields = 0;
+        uint64_t freedCollections = 0; // Whether they came with a record or alone
+    };
+
+private:
+    /**
+     * One hand-over: a record's fields and collections, or a single collection
+     */
+    struct Garbage {
+        FieldMap fields;
+        std::vector<std::unique_ptr<Collection>> collections;
+        bool isRecord;
+    };
+    
+    mutable std::mutex mutex_;
+    std::condition_variable work_;
+    std::condition_variable idle_;
+    std::deque<Garbage> queue_;
+    size_t inFlight_ = 0; // Hand-overs taken off the queue and being freed
+    bool stopping_ = false;
+    uint64_t freedRecords_ = 0;
+    uint64_t freedFields_ = 0;
+    uint64_t freedCollections_ = 0;
+    
+    void enqueue(Garbage garbage);
+    
+    std::thread thread_;
+    
+    /**
+     * Thread loop: free queued maps until stopped
+     */
+    void run();
+
+public:
+    LazyFreer();
+    
+    /**
+     * Destructor; frees whatever is still queued, then stops the thread
+     */
+    ~LazyFreer();
+    
+    LazyFreer(const LazyFreer&) = delete;
+    LazyFreer& operator=(const LazyFreer&) = delete;
+    
+    /**
+     * Take over a deleted record to free in the background
+     * @param fields The record's field map
+     * @param collections Collections its fields referred to
+     */
+    void free(FieldMap fields, std::vector<std::unique_ptr<Collection>> collections);
+    
+    /**
+     * Take over a collection whose field was deleted or overwritten
+     */
+    void free(std::unique_ptr<Collection> collection);
+    
+    /**
+     * Wait until everything handed over so far is freed
+     */
+    void drain();
+    
+    Stats stats() const;
+};
+
+#endif // LAZY_FREE_HPP
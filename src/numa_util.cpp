@@ -0,0 +1,174 @@
+#include "numa_util.hpp"
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace numa {
+
+namespace {
+
+const char* NODE_ROOT = "/sys/devices/system/node/";
+
+// Kernel memory policy modes (linux/mempolicy.h)
+const int MPOL_DEFAULT_MODE = 0;
+const int MPOL_PREFERRED_MODE = 1;
+const int MPOL_INTERLEAVE_MODE = 3;
+
+std::string readLine(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+std::vector<int> allCpus() {
+    unsigned count = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> cpus(count);
+    for (unsigned i = 0; i < count; i++) {
+        cpus[i] = static_cast<int>(i);
+    }
+    return cpus;
+}
+
+bool setMemoryPolicy(int mode, const std::vector<int>& nodeList) {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    const size_t bitsPerWord = 8 * sizeof(unsigned long);
+    int maxNode = nodeList.empty() ? 0 : *std::max_element(nodeList.begin(), nodeList.end());
+    std::vector<unsigned long> mask(maxNode / bitsPerWord + 1, 0);
+    for (int node : nodeList) {
+        mask[node / bitsPerWord] |= 1UL << (node % bitsPerWord);
+    }
+    
+    if (mode == MPOL_DEFAULT_MODE) {
+        return ::syscall(SYS_set_mempolicy, mode, nullptr, 0) == 0;
+    }
+    // maxnode counts bits and the kernel ignores the last one
+    return ::syscall(SYS_set_mempolicy, mode, mask.data(), mask.size() * bitsPerWord + 1) == 0;
+#else
+    (void)mode;
+    (void)nodeList;
+    return false;
+#endif
+}
+
+} // namespace
+
+std::vector<int> parseList(const std::string& list) {
+    std::vector<int> values;
+    std::stringstream stream(list);
+    std::string range;
+    
+    while (std::getline(stream, range, ',')) {
+        if (range.empty()) continue;
+        try {
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int value = first; value <= last; value++) {
+                values.push_back(value);
+            }
+        } catch (const std::exception&) {
+            return {};
+        }
+    }
+    
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    return values;
+}
+
+std::vector<int> nodes() {
+    std::vector<int> online = parseList(readLine(std::string(NODE_ROOT) + "online"));
+    return online.empty() ? std::vector<int>{0} : online;
+}
+
+std::vector<int> cpusOfNode(int node) {
+    std::vector<int> cpus = parseList(readLine(std::string(NODE_ROOT) + "node" + std::to_string(node) + "/cpulist"));
+    if (cpus.empty() && nodes().size() == 1) {
+        return allCpus();
+    }
+    return cpus;
+}
+
+int nodeOfCpu(int cpu) {
+    for (int node : nodes()) {
+        std::vector<int> cpus = cpusOfNode(node);
+        if (std::binary_search(cpus.begin(), cpus.end(), cpu)) {
+            return node;
+        }
+    }
+    return 0;
+}
+
+int currentCpu() {
+#ifdef __linux__
+    return ::sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+bool bindCurrentThreadToNode(int node) {
+#ifdef __linux__
+    std::vector<int> cpus = cpusOfNode(node);
+    if (cpus.empty()) {
+        return false;
+    }
+    
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    if (::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) != 0) {
+        return false;
+    }
+    
+    // Preferred rather than bound, so allocations still succeed when the node is full
+    setMemoryPolicy(MPOL_PREFERRED_MODE, {node});
+    return true;
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+bool bindCurrentThreadToCpu(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) != 0) {
+        return false;
+    }
+    setMemoryPolicy(MPOL_PREFERRED_MODE, {nodeOfCpu(cpu)});
+    return true;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+bool interleaveCurrentThread() {
+    return setMemoryPolicy(MPOL_INTERLEAVE_MODE, nodes());
+}
+
+bool resetCurrentThreadPolicy() {
+    return setMemoryPolicy(MPOL_DEFAULT_MODE, {});
+}
+
+} // namespace numa
@@ -0,0 +1,75 @@
+#ifndef NUMA_UTIL_HPP
+#define NUMA_UTIL_HPP
+
+#include <string>
+#include <vector>
+
+/**
+ * Minimal NUMA topology and placement helpers
+ *
+ * Topology is read from /sys/devices/system/node; placement uses thread
+ * affinity and the kernel memory policy directly, so libnuma is not needed.
+ * On systems without NUMA information everything behaves as a single node 0
+ * holding every CPU, and placement calls report failure without side effects.
+ */
+namespace numa {
+
+/**
+ * Parse a kernel CPU/node list such as "0-3,8,10-11"
+ * @param list List to parse
+ * @return The listed numbers in ascending order
+ */
+std::vector<int> parseList(const std::string& list);
+
+/**
+ * Online NUMA nodes (at least {0})
+ */
+std::vector<int> nodes();
+
+/**
+ * CPUs belonging to a node (every CPU when topology is unavailable)
+ * @param node NUMA node
+ */
+std::vector<int> cpusOfNode(int node);
+
+/**
+ * Node a CPU belongs to (0 when unknown)
+ * @param cpu CPU number
+ */
+int nodeOfCpu(int cpu);
+
+/**
+ * CPU the calling thread is running on (-1 when unknown)
+ */
+int currentCpu();
+
+/**
+ * Restrict the calling thread to a node's CPUs and prefer that node for its allocations,
+ * so memory it touches first is node-local
+ * @param node NUMA node
+ * @return true if the thread was pinned
+ */
+bool bindCurrentThreadToNode(int node);
+
+/**
+ * Restrict the calling thread to one CPU and prefer that CPU's node for its allocations
+ * @param cpu CPU number
+ * @return true if the thread was pinned
+ */
+bool bindCurrentThreadToCpu(int cpu);
+
+/**
+ * Interleave the calling thread's future allocations across all nodes
+ * @return true if the memory policy was applied
+ */
+bool interleaveCurrentThread();
+
+/**
+ * Reset the calling thread's memory policy to the system default (local allocation)
+ * @return true if the memory policy was applied
+ */
+bool resetCurrentThreadPolicy();
+
+} // namespace numa
+
+#endif // NUMA_UTIL_HPP
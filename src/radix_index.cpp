@@ -0,0 +1,368 @@
+#include "radix_index.hpp"
+#include <algorithm>
+#include <cstring>
+
+std::string_view RadixIndex::labelOf(const Node& node) {
+    return std::string_view(node.labelSize > INLINE_LABEL ? node.heapLabel : node.inlineLabel, node.labelSize);
+}
+
+void RadixIndex::setLabel(Node& node, const char* data, size_t size) {
+    // data may point into the node's current label, so it is freed only after the copy
+    char* old = node.labelSize > INLINE_LABEL ? node.heapLabel : nullptr;
+    if (size > INLINE_LABEL) {
+        char* heap = new char[size];
+        std::memcpy(heap, data, size);
+        node.heapLabel = heap;
+    } else {
+        std::memmove(node.inlineLabel, data, size);
+    }
+    node.labelSize = static_cast<uint32_t>(size);
+    delete[] old;
+}
+
+void RadixIndex::release(Node& node) {
+    if (node.children) {
+        size_t used = slotsOf(node) == DENSE_SLOTS ? DENSE_SLOTS : node.childCount;
+        for (size_t slot = 0; slot < used; slot++) {
+            delete node.children[slot];
+        }
+        delete[] node.children;
+    }
+    if (node.labelSize > INLINE_LABEL) {
+        delete[] node.heapLabel;
+    }
+    node.children = nullptr;
+    node.labelSize = 0;
+    node.childCount = 0;
+    node.sizeClass = 0;
+    node.terminal = false;
+}
+
+unsigned char* RadixIndex::branchesOf(const Node& node) {
+    return reinterpret_cast<unsigned char*>(node.children + slotsOf(node));
+}
+
+size_t RadixIndex::slotBytes(uint16_t slots) {
+    if (slots == DENSE_SLOTS) {
+        return DENSE_SLOTS * sizeof(Node*);
+    }
+    // Branch bytes are rounded up to whole pointers so the array is a single new[]
+    return (slots + (slots + sizeof(Node*) - 1) / sizeof(Node*)) * sizeof(Node*);
+}
+
+void RadixIndex::resizeSlots(Node& node, uint8_t sizeClass) {
+    uint16_t slots = SLOT_SIZES[sizeClass];
+    Node** resized = slots == 0 ? nullptr : new Node*[slotBytes(slots) / sizeof(Node*)]();
+    if (slots == DENSE_SLOTS) {
+        const unsigned char* branches = branchesOf(node);
+        for (size_t i = 0; i < node.childCount; i++) {
+            resized[branches[i]] = node.children[i];
+        }
+    } else if (slotsOf(node) == DENSE_SLOTS) {
+        unsigned char* branches = reinterpret_cast<unsigned char*>(resized + slots);
+        size_t count = 0;
+        for (size_t slot = 0; slot < DENSE_SLOTS; slot++) {
+            if (node.children[slot]) {
+                branches[count] = static_cast<unsigned char>(slot);
+                resized[count++] = node.children[slot];
+            }
+        }
+    } else if (node.childCount > 0) {
+        std::copy(node.children, node.children + node.childCount, resized);
+        std::memcpy(resized + slots, branchesOf(node), node.childCount);
+    }
+    delete[] node.children;
+    node.children = resized;
+    node.sizeClass = sizeClass;
+}
+
+void RadixIndex::moveChildren(Node& to, Node& from) {
+    to.children = from.children;
+    to.childCount = from.childCount;
+    to.sizeClass = from.sizeClass;
+    from.children = nullptr;
+    from.childCount = 0;
+    from.sizeClass = 0;
+}
+
+RadixIndex::Node* RadixIndex::findChild(const Node& node, unsigned char branch) {
+    if (slotsOf(node) == DENSE_SLOTS) {
+        return node.children[branch];
+    }
+    const unsigned char* branches = branchesOf(node);
+    const unsigned char* end = branches + node.childCount;
+    const unsigned char* it = std::lower_bound(branches, end, branch);
+    if (it == end || *it != branch) {
+        return nullptr;
+    }
+    return node.children[it - branches];
+}
+
+void RadixIndex::addChild(Node& node, unsigned char branch, Node* child) {
+    if (node.childCount == slotsOf(node)) {
+        resizeSlots(node, node.sizeClass + 1);
+    }
+    if (slotsOf(node) == DENSE_SLOTS) {
+        node.children[branch] = child;
+        node.childCount++;
+        return;
+    }
+    
+    unsigned char* branches = branchesOf(node);
+    size_t pos = std::lower_bound(branches, branches + node.childCount, branch) - branches;
+    std::memmove(branches + pos + 1, branches + pos, node.childCount - pos);
+    std::copy_backward(node.children + pos, node.children + node.childCount, node.children + node.childCount + 1);
+    branches[pos] = branch;
+    node.children[pos] = child;
+    node.childCount++;
+}
+
+void RadixIndex::removeChild(Node& node, unsigned char branch) {
+    Node* child;
+    if (slotsOf(node) == DENSE_SLOTS) {
+        child = node.children[branch];
+        node.children[branch] = nullptr;
+    } else {
+        unsigned char* branches = branchesOf(node);
+        size_t pos = std::lower_bound(branches, branches + node.childCount, branch) - branches;
+        child = node.children[pos];
+        std::memmove(branches + pos, branches + pos + 1, node.childCount - pos - 1);
+        std::copy(node.children + pos + 1, node.children + node.childCount, node.children + pos);
+    }
+    node.childCount--;
+    nodeCount_--;
+    labelBytes_ -= child->labelSize;
+    delete child;
+    
+    // Shrink only once the smaller array would be half empty, so a node at a boundary does not flip back and forth
+    if (node.childCount <= SLOT_SIZES[node.sizeClass - 1] / 2) {
+        resizeSlots(node, node.sizeClass - 1);
+    }
+}
+
+void RadixIndex::mergeWithChild(Node& node) {
+    size_t slot = 0;
+    while (!node.children[slot]) {
+        slot++;
+    }
+    Node* child = node.children[slot];
+    unsigned char branch = slotsOf(node) == DENSE_SLOTS ? static_cast<unsigned char>(slot) : branchesOf(node)[slot];
+    
+    std::string label(labelOf(node));
+    label.push_back(static_cast<char>(branch));
+    label += labelOf(*child);
+    setLabel(node, label.data(), label.size());
+    node.terminal = child->terminal;
+    
+    delete[] node.children;
+    moveChildren(node, *child);
+    delete child;
+    nodeCount_--;
+    labelBytes_++; // The branch byte joins the label
+}
+
+bool RadixIndex::insert(const std::string& key) {
+    Node* node = &root_;
+    size_t pos = 0;
+    while (true) {
+        std::string_view label = labelOf(*node);
+        size_t matched = 0;
+        while (matched < label.size() && pos + matched < key.size() && label[matched] == key[pos + matched]) {
+            matched++;
+        }
+        
+        if (matched < label.size()) {
+            // Split: the node keeps the shared part, a new child takes the rest and the node's children
+            Node* tail = new Node();
+            setLabel(*tail, label.data() + matched + 1, label.size() - matched - 1);
+            tail->terminal = node->terminal;
+            moveChildren(*tail, *node);
+            unsigned char branch = static_cast<unsigned char>(label[matched]);
+            
+            setLabel(*node, label.data(), matched);
+            node->terminal = false;
+            addChild(*node, branch, tail);
+            nodeCount_++;
+            labelBytes_--; // The branch byte leaves the label
+        }
+        pos += matched;
+        
+        if (pos == key.size()) {
+            if (node->terminal) {
+                return false;
+            }
+            node->terminal = true;
+            break;
+        }
+        
+        unsigned char branch = static_cast<unsigned char>(key[pos]);
+        Node* child = findChild(*node, branch);
+        if (!child) {
+            Node* leaf = new Node();
+            setLabel(*leaf, key.data() + pos + 1, key.size() - pos - 1);
+            leaf->terminal = true;
+            labelBytes_ += leaf->labelSize;
+            addChild(*node, branch, leaf);
+            nodeCount_++;
+            break;
+        }
+        node = child;
+        pos++;
+    }
+    
+    keyCount_++;
+    keyBytes_ += key.size();
+    return true;
+}
+
+bool RadixIndex::erase(const std::string& key) {
+    Node* parent = nullptr;
+    unsigned char parentBranch = 0;
+    Node* node = &root_;
+    size_t pos = 0;
+    while (true) {
+        std::string_view label = labelOf(*node);
+        if (key.compare(pos, label.size(), label.data(), label.size()) != 0) {
+            return false;
+        }
+        pos += label.size();
+        if (pos == key.size()) {
+            break;
+        }
+        
+        unsigned char branch = static_cast<unsigned char>(key[pos]);
+        Node* child = findChild(*node, branch);
+        if (!child) {
+            return false;
+        }
+        parent = node;
+        parentBranch = branch;
+        node = child;
+        pos++;
+    }
+    if (!node->terminal) {
+        return false;
+    }
+    
+    node->terminal = false;
+    keyCount_--;
+    keyBytes_ -= key.size();
+    
+    // Keep the tree compressed: drop empty leaves and fold single-child chains (the root stays unlabeled)
+    if (parent) {
+        if (node->childCount == 0) {
+            removeChild(*parent, parentBranch);
+            if (parent != &root_ && !parent->terminal && parent->childCount == 1) {
+                mergeWithChild(*parent);
+            }
+        } else if (node->childCount == 1) {
+            mergeWithChild(*node);
+        }
+    }
+    return true;
+}
+
+bool RadixIndex::contains(const std::string& key) const {
+    const Node* node = &root_;
+    size_t pos = 0;
+    while (true) {
+        std::string_view label = labelOf(*node);
+        if (key.compare(pos, label.size(), label.data(), label.size()) != 0) {
+            return false;
+        }
+        pos += label.size();
+        if (pos == key.size()) {
+            return node->terminal;
+        }
+        node = findChild(*node, static_cast<unsigned char>(key[pos]));
+        if (!node) {
+            return false;
+        }
+        pos++;
+    }
+}
+
+void RadixIndex::collect(const Node& node, std::string& path, std::vector<std::string>& keys) {
+    size_t length = path.size();
+    path += labelOf(node);
+    if (node.terminal) {
+        keys.push_back(path);
+    }
+    
+    // Both layouts keep children in branch byte order
+    if (slotsOf(node) == DENSE_SLOTS) {
+        for (size_t slot = 0; slot < DENSE_SLOTS; slot++) {
+            if (node.children[slot]) {
+                path.push_back(static_cast<char>(slot));
+                collect(*node.children[slot], path, keys);
+                path.pop_back();
+            }
+        }
+    } else {
+        const unsigned char* branches = branchesOf(node);
+        for (size_t i = 0; i < node.childCount; i++) {
+            path.push_back(static_cast<char>(branches[i]));
+            collect(*node.children[i], path, keys);
+            path.pop_back();
+        }
+    }
+    path.resize(length);
+}
+
+std::vector<std::string> RadixIndex::keysWithPrefix(const std::string& prefix) const {
+    std::vector<std::string> keys;
+    const Node* node = &root_;
+    size_t pos = 0;
+    while (true) {
+        std::string_view label = labelOf(*node);
+        size_t remaining = prefix.size() - pos;
+        if (remaining <= label.size()) {
+            // The prefix ends inside this node's label: every key below matches
+            if (label.compare(0, remaining, prefix.data() + pos, remaining) == 0) {
+                std::string path(prefix, 0, pos);
+                collect(*node, path, keys);
+            }
+            return keys;
+        }
+        
+        if (prefix.compare(pos, label.size(), label.data(), label.size()) != 0) {
+            return keys;
+        }
+        pos += label.size();
+        node = findChild(*node, static_cast<unsigned char>(prefix[pos]));
+        if (!node) {
+            return keys;
+        }
+        pos++;
+    }
+}
+
+void RadixIndex::clear() {
+    release(root_);
+    keyCount_ = 0;
+    nodeCount_ = 1;
+    keyBytes_ = 0;
+    labelBytes_ = 0;
+}
+
+size_t RadixIndex::nodeBytes(const Node& node) {
+    size_t bytes = sizeof(Node);
+    if (node.labelSize > INLINE_LABEL) {
+        bytes += node.labelSize;
+    }
+    if (slotsOf(node) == 0) {
+        return bytes;
+    }
+    bytes += slotBytes(slotsOf(node));
+    size_t used = slotsOf(node) == DENSE_SLOTS ? DENSE_SLOTS : node.childCount;
+    for (size_t slot = 0; slot < used; slot++) {
+        if (node.children[slot]) {
+            bytes += nodeBytes(*node.children[slot]);
+        }
+    }
+    return bytes;
+}
+
+size_t RadixIndex::memoryBytes() const {
+    return nodeBytes(root_);
+}
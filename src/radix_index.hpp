@@ -0,0 +1,138 @@
+#ifndef RADIX_INDEX_HPP
+#define RADIX_INDEX_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Ordered set of record IDs in a path-compressed radix tree, answering
+ * prefix queries in key order
+ *
+ * Each node stores only the bytes its keys add to its parent's path, so IDs
+ * sharing a long prefix ("tenant:42:user:") keep a single copy of it. As in
+ * an adaptive radix tree, a node's child array grows through 4, 16 and 48
+ * sorted slots, whose branch bytes sit in a block after the pointers, and
+ * then becomes a table of 256 pointers indexed by the branch byte, keeping
+ * lookups O(key length) either way. Nodes are 32 bytes and keep labels of
+ * up to 16 bytes inline. The tree is an addition to the record table, which
+ * still holds every full ID.
+ */
+class RadixIndex {
+private:
+    // Child array sizes; a node drops to the next smaller one once its children fit in half of that
+    static constexpr uint16_t SLOT_SIZES[] = {0, 4, 16, 48, 256};
+    static constexpr uint16_t DENSE_SLOTS = 256;
+    static constexpr size_t INLINE_LABEL = 16;
+    
+    struct Node {
+        Node** children = nullptr;   // Owned; below 256 slots, sorted branch bytes follow the pointers
+        uint32_t labelSize = 0;      // Label: bytes after the branch byte leading here
+        uint16_t childCount = 0;
+        uint8_t sizeClass = 0;       // Index of the child array size in SLOT_SIZES
+        bool terminal = false;       // A key ends here
+        union {
+            char inlineLabel[INLINE_LABEL] = {};
+            char* heapLabel;         // Labels longer than INLINE_LABEL
+        };
+        
+        Node() = default;
+        Node(const Node&) = delete;
+        Node& operator=(const Node&) = delete;
+        ~Node() { release(*this); }
+    };
+    
+    static_assert(sizeof(Node) == 32, "Node should fill half a cache line");
+    
+    Node root_;
+    size_t keyCount_ = 0;
+    size_t nodeCount_ = 1;
+    size_t keyBytes_ = 0;
+    size_t labelBytes_ = 0;
+    
+    static uint16_t slotsOf(const Node& node) { return SLOT_SIZES[node.sizeClass]; }
+    static std::string_view labelOf(const Node& node);
+    static void setLabel(Node& node, const char* data, size_t size);
+    
+    /**
+     * Free a node's children and label, leaving it empty
+     */
+    static void release(Node& node);
+    
+    static unsigned char* branchesOf(const Node& node);
+    static size_t slotBytes(uint16_t slots);
+    
+    /**
+     * Move a node's children into a child array of another size
+     */
+    static void resizeSlots(Node& node, uint8_t sizeClass);
+    
+    /**
+     * Hand a node's child array to another node with none
+     */
+    static void moveChildren(Node& to, Node& from);
+    
+    static Node* findChild(const Node& node, unsigned char branch);
+    static void addChild(Node& node, unsigned char branch, Node* child);
+    void removeChild(Node& node, unsigned char branch);
+    
+    /**
+     * Fold a non-terminal node's only child into it
+     */
+    void mergeWithChild(Node& node);
+    
+    /**
+     * Append every key under a node, in order
+     * @param path Key bytes leading to the node, before its label; restored on return
+     */
+    static void collect(const Node& node, std::string& path, std::vector<std::string>& keys);
+    
+    static size_t nodeBytes(const Node& node);
+
+public:
+    /**
+     * Add a key
+     * @return false if it was already present
+     */
+    bool insert(const std::string& key);
+    
+    /**
+     * Remove a key
+     * @return false if it was absent
+     */
+    bool erase(const std::string& key);
+    
+    bool contains(const std::string& key) const;
+    
+    /**
+     * Get every key starting with prefix, sorted, in O(prefix length + keys returned)
+     */
+    std::vector<std::string> keysWithPrefix(const std::string& prefix) const;
+    
+    /**
+     * Remove every key
+     */
+    void clear();
+    
+    size_t size() const { return keyCount_; }
+    size_t nodeCount() const { return nodeCount_; }
+    
+    /**
+     * Total length of the keys held
+     */
+    size_t keyBytes() const { return keyBytes_; }
+    
+    /**
+     * Total length of the node labels: the key bytes actually stored
+     */
+    size_t labelBytes() const { return labelBytes_; }
+    
+    /**
+     * Estimated memory used by the tree, including its labels
+     */
+    size_t memoryBytes() const;
+};
+
+#endif // RADIX_INDEX_HPP
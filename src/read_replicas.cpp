@@ -0,0 +1,291 @@
+#include "read_replicas.hpp"
+#include "numa_util.hpp"
+#include <shared_mutex>
+#include <thread>
+#include <limits>
+
+namespace {
+
+const size_t EVENTS_PER_BATCH = 1024;
+const auto POLL_INTERVAL = std::chrono::milliseconds(100);
+
+int64_t toNanos(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+} // namespace
+
+/**
+ * One replica: a database copy and the thread applying the change stream to it
+ */
+struct ReadReplicaSet::Replica {
+    int node = 0;
+    InMemoryDBImpl db;
+    mutable std::shared_mutex dbMutex;
+    
+    // Set once the first full sync is loaded
+    std::atomic<bool> loaded{false};
+    std::atomic<uint64_t> appliedSeq{0};
+    
+    // Every write published before this steady-clock time (ns) has been applied
+    std::atomic<int64_t> freshAtNs{std::numeric_limits<int64_t>::min()};
+    
+    // Readers waiting for the replica to catch up
+    std::mutex freshMutex;
+    std::condition_variable freshCondition;
+    std::atomic<int> waiters{0};
+    
+    std::thread worker;
+    
+    void markFresh(std::chrono::steady_clock::time_point observedAt) {
+        freshAtNs.store(toNanos(observedAt));
+        wakeReaders();
+    }
+    
+    void wakeReaders() {
+        if (waiters.load() > 0) {
+            std::lock_guard<std::mutex> lock(freshMutex);
+            freshCondition.notify_all();
+        }
+    }
+};
+
+ReadReplicaSet::ReadReplicaSet(InMemoryDBImpl& db, size_t replicaCount, std::chrono::milliseconds maxStaleness,
+                               bool pinToNodes, size_t backlogSize)
+    : db_(db), stream_(db.changeStream() ? db.changeStream() : db.enableChangeStream(backlogSize)),
+      pinned_(pinToNodes),
+      maxStalenessNs_(std::chrono::duration_cast<std::chrono::nanoseconds>(maxStaleness).count()) {
+    std::vector<int> nodes = pinToNodes ? numa::nodes() : std::vector<int>{0};
+    
+    for (size_t i = 0; i < replicaCount; i++) {
+        replicas_.push_back(std::make_unique<Replica>());
+        replicas_.back()->node = nodes[i % nodes.size()];
+        allReplicas_.push_back(i);
+    }
+    
+    // Map every CPU to the replicas on its node; CPUs of nodes without a replica use them all
+    if (pinToNodes) {
+        for (int node : nodes) {
+            std::vector<size_t> local;
+            for (size_t i = 0; i < replicas_.size(); i++) {
+                if (replicas_[i]->node == node) {
+                    local.push_back(i);
+                }
+            }
+            for (int cpu : numa::cpusOfNode(node)) {
+                if (replicasByCpu_.size() <= static_cast<size_t>(cpu)) {
+                    replicasByCpu_.resize(cpu + 1);
+                }
+                replicasByCpu_[cpu] = local;
+            }
+        }
+    }
+    
+    for (auto& replica : replicas_) {
+        Replica* target = replica.get();
+        replica->worker = std::thread([this, target]() { run(*target); });
+    }
+}
+
+ReadReplicaSet::~ReadReplicaSet() {
+    {
+        std::lock_guard<std::mutex> lock(syncMutex_);
+        stopping_.store(true);
+    }
+    syncCondition_.notify_all();
+    
+    for (auto& replica : replicas_) {
+        {
+            std::lock_guard<std::mutex> lock(replica->freshMutex);
+            replica->freshCondition.notify_all();
+        }
+        replica->worker.join();
+    }
+}
+
+void ReadReplicaSet::run(Replica& replica) {
+    if (pinned_) {
+        // Everything this thread allocates (the whole copy) then lands on the replica's node
+        numa::bindCurrentThreadToNode(replica.node);
+    }
+    
+    uint64_t cursor = 0;
+    bool needsFullSync = true;
+    std::vector<LogEntry> events;
+    
+    while (!stopping_.load()) {
+        if (needsFullSync) {
+            if (!fullSync(replica, cursor)) {
+                break;
+            }
+            needsFullSync = false;
+        }
+        
+        auto observedAt = std::chrono::steady_clock::now();
+        uint64_t head = stream_->headSeq();
+        if (cursor >= head) {
+            replica.markFresh(observedAt);
+            stream_->waitForEvents(cursor, POLL_INTERVAL);
+            continue;
+        }
+        
+        events.clear();
+        bool complete = stream_->read(cursor, events, EVENTS_PER_BATCH);
+        
+        // A restore on the primary (Clear) or a lapped stream requires a full sync
+        needsFullSync = !complete;
+        {
+            std::unique_lock<std::shared_mutex> lock(replica.dbMutex);
+            for (const LogEntry& event : events) {
+                if (event.op == LogOp::Clear) {
+                    needsFullSync = true;
+                    break;
+                }
+                replica.db.applyLogEntry(event);
+            }
+        }
+        
+        if (!needsFullSync) {
+            replica.appliedSeq.store(cursor);
+            if (cursor >= head) {
+                replica.markFresh(observedAt);
+            } else {
+                replica.wakeReaders(); // They may only need what was just applied
+            }
+        }
+    }
+}
+
+bool ReadReplicaSet::fullSync(Replica& replica, uint64_t& cursor) {
+    auto request = std::make_shared<FullSyncRequest>();
+    {
+        std::unique_lock<std::mutex> lock(syncMutex_);
+        pendingSyncs_.push_back(request);
+        syncCondition_.wait(lock, [&]() { return request->ready || stopping_.load(); });
+        if (!request->ready) {
+            return false;
+        }
+    }
+    
+    // Decode on this thread only, so the copy is allocated on the replica's node
+    InMemoryDBImpl::Dataset staged;
+    if (!InMemoryDBImpl::prepareRestore(*request->snapshot, staged, 1)) {
+        return false;
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(replica.dbMutex);
+        replica.db.commitRestore(staged);
+    }
+    
+    cursor = request->seq;
+    replica.appliedSeq.store(request->seq);
+    replica.loaded.store(true);
+    replica.markFresh(request->takenAt);
+    return true;
+}
+
+size_t ReadReplicaSet::pump() {
+    std::vector<std::shared_ptr<FullSyncRequest>> requests;
+    {
+        std::lock_guard<std::mutex> lock(syncMutex_);
+        requests.swap(pendingSyncs_);
+    }
+    if (requests.empty()) {
+        return 0;
+    }
+    
+    auto takenAt = std::chrono::steady_clock::now();
+    uint64_t seq = stream_->headSeq();
+    auto snapshotData = std::make_shared<const std::string>(db_.snapshot());
+    
+    {
+        std::lock_guard<std::mutex> lock(syncMutex_);
+        for (auto& request : requests) {
+            request->seq = seq;
+            request->takenAt = takenAt;
+            request->snapshot = snapshotData;
+            request->ready = true;
+        }
+    }
+    syncCondition_.notify_all();
+    return requests.size();
+}
+
+void ReadReplicaSet::setMaxStaleness(std::chrono::milliseconds maxStaleness) {
+    maxStalenessNs_.store(std::chrono::duration_cast<std::chrono::nanoseconds>(maxStaleness).count());
+}
+
+ReadReplicaSet::Replica& ReadReplicaSet::replicaForRead() const {
+    // Spread a thread's reads over the replicas of its node
+    static thread_local size_t next = 0;
+    
+    const std::vector<size_t>* candidates = &allReplicas_;
+    int cpu = pinned_ ? numa::currentCpu() : -1;
+    if (cpu >= 0 && static_cast<size_t>(cpu) < replicasByCpu_.size() && !replicasByCpu_[cpu].empty()) {
+        candidates = &replicasByCpu_[cpu];
+    }
+    Replica& replica = *replicas_[(*candidates)[next++ % candidates->size()]];
+    
+    // Fresh enough if it applied everything published so far, or everything up to the staleness bound
+    int64_t required = toNanos(std::chrono::steady_clock::now()) - maxStalenessNs_.load();
+    auto isFresh = [&]() {
+        return replica.loaded.load() &&
+               (replica.appliedSeq.load() >= stream_->headSeq() || replica.freshAtNs.load() >= required);
+    };
+    
+    if (!isFresh()) {
+        replica.waiters++;
+        std::unique_lock<std::mutex> lock(replica.freshMutex);
+        replica.freshCondition.wait(lock, [&]() { return isFresh() || stopping_.load(); });
+        replica.waiters--;
+    }
+    return replica;
+}
+
+std::optional<std::string> ReadReplicaSet::get(const std::string& recordId, const std::string& field) const {
+    Replica& replica = replicaForRead();
+    std::shared_lock<std::shared_mutex> lock(replica.dbMutex);
+    return replica.db.get(recordId, field);
+}
+
+std::vector<std::string> ReadReplicaSet::getRecordsByFieldValue(const std::string& field,
+                                                                const std::string& value) const {
+    Replica& replica = replicaForRead();
+    std::shared_lock<std::shared_mutex> lock(replica.dbMutex);
+    return replica.db.getRecordsByFieldValue(field, value);
+}
+
+bool ReadReplicaSet::hasRecord(const std::string& recordId) const {
+    Replica& replica = replicaForRead();
+    std::shared_lock<std::shared_mutex> lock(replica.dbMutex);
+    return replica.db.hasRecord(recordId);
+}
+
+void ReadReplicaSet::read(const std::function<void(const InMemoryDBImpl&)>& reader) const {
+    Replica& replica = replicaForRead();
+    std::shared_lock<std::shared_mutex> lock(replica.dbMutex);
+    reader(replica.db);
+}
+
+size_t ReadReplicaSet::size() const {
+    return replicas_.size();
+}
+
+int ReadReplicaSet::replicaNode(size_t index) const {
+    return replicas_[index]->node;
+}
+
+uint64_t ReadReplicaSet::appliedSeq(size_t index) const {
+    return replicas_[index]->appliedSeq.load();
+}
+
+std::chrono::nanoseconds ReadReplicaSet::staleness(size_t index) const {
+    const Replica& replica = *replicas_[index];
+    if (!replica.loaded.load()) {
+        return std::chrono::nanoseconds::max();
+    }
+    if (replica.appliedSeq.load() >= stream_->headSeq()) {
+        return std::chrono::nanoseconds(0);
+    }
+    return std::chrono::nanoseconds(toNanos(std::chrono::steady_clock::now()) - replica.freshAtNs.load());
+}
@@ -0,0 +1,154 @@
+#ifndef READ_REPLICAS_HPP
+#define READ_REPLICAS_HPP
+
+#include "in_memory_db_imp.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <optional>
+
+/**
+ * In-process read-only replicas of a database
+ *
+ * Each replica owns a copy of the database, kept up to date by its own
+ * thread applying the primary's change stream asynchronously from the
+ * writer. Replica threads can be pinned to different NUMA nodes so the
+ * copies live in node-local memory; reads are then served by a replica on
+ * the caller's node.
+ *
+ * Reads honour a maximum staleness: a read reflects at least every write
+ * published before (now - maxStaleness), waiting for its replica to catch
+ * up if necessary. A staleness of zero gives read-your-writes.
+ *
+ * As with ReplicationPrimary, replicas that need a full copy (at start, after
+ * falling behind the change stream or after a restore) get a snapshot taken by
+ * pump(), which the thread owning the database must call regularly. Reads
+ * wait for such a replica, so that thread should pump rather than read
+ * while replicas are syncing.
+ */
+class ReadReplicaSet {
+private:
+    struct Replica;
+    
+    /**
+     * A full sync waiting for pump() to take a snapshot
+     */
+    struct FullSyncRequest {
+        bool ready = false;
+        uint64_t seq = 0;
+        std::chrono::steady_clock::time_point takenAt;
+        std::shared_ptr<const std::string> snapshot;
+    };
+    
+    InMemoryDBImpl& db_;
+    std::shared_ptr<ChangeStream> stream_;
+    std::vector<std::unique_ptr<Replica>> replicas_;
+    
+    // Replica indices serving each CPU (those on the CPU's NUMA node), for node-local reads
+    std::vector<std::vector<size_t>> replicasByCpu_;
+    std::vector<size_t> allReplicas_;
+    bool pinned_;
+    
+    std::atomic<int64_t> maxStalenessNs_;
+    std::atomic<bool> stopping_{false};
+    
+    std::mutex syncMutex_;
+    std::condition_variable syncCondition_;
+    std::vector<std::shared_ptr<FullSyncRequest>> pendingSyncs_;
+    
+    /**
+     * Apply the change stream to one replica until stopped
+     * @param replica Replica to maintain
+     */
+    void run(Replica& replica);
+    
+    /**
+     * Replace a replica's copy with a snapshot taken by pump()
+     * @param replica Replica to resynchronize
+     * @param cursor Receives the stream sequence number the snapshot covers
+     * @return true if the snapshot was loaded
+     */
+    bool fullSync(Replica& replica, uint64_t& cursor);
+    
+    /**
+     * Pick the replica serving the calling thread (one on its NUMA node when possible)
+     * and wait until it is fresh enough
+     */
+    Replica& replicaForRead() const;
+
+public:
+    /**
+     * Start the replicas
+     * @param db Database to replicate; its change stream is enabled if needed
+     * @param replicaCount Number of replicas
+     * @param maxStaleness Maximum age of the data served by reads
+     * @param pinToNodes Spread replicas over the NUMA nodes round-robin and pin each
+     *                   replica's thread and memory to its node
+     * @param backlogSize Change stream capacity, i.e. how far a replica may fall behind
+     *                    before needing a full sync
+     */
+    ReadReplicaSet(InMemoryDBImpl& db, size_t replicaCount,
+                   std::chrono::milliseconds maxStaleness = std::chrono::milliseconds(10),
+                   bool pinToNodes = true, size_t backlogSize = 65536);
+    
+    /**
+     * Destructor; stops the replica threads
+     */
+    ~ReadReplicaSet();
+    
+    ReadReplicaSet(const ReadReplicaSet&) = delete;
+    ReadReplicaSet& operator=(const ReadReplicaSet&) = delete;
+    
+    /**
+     * Serve pending full syncs; must be called from the thread that owns the database
+     * @return Number of replicas that received the snapshot
+     */
+    size_t pump();
+    
+    /**
+     * Change the maximum staleness of subsequent reads
+     * @param maxStaleness Maximum age of the data served by reads
+     */
+    void setMaxStaleness(std::chrono::milliseconds maxStaleness);
+    
+    // Reads served by a replica on the caller's NUMA node
+    std::optional<std::string> get(const std::string& recordId, const std::string& field) const;
+    std::vector<std::string> getRecordsByFieldValue(const std::string& field, const std::string& value) const;
+    bool hasRecord(const std::string& recordId) const;
+    
+    /**
+     * Run an arbitrary read against a consistent view of a node-local replica
+     * @param reader Called with the replica's database while updates are held off
+     */
+    void read(const std::function<void(const InMemoryDBImpl&)>& reader) const;
+    
+    /**
+     * Number of replicas
+     */
+    size_t size() const;
+    
+    /**
+     * NUMA node a replica is placed on
+     * @param index Replica index
+     */
+    int replicaNode(size_t index) const;
+    
+    /**
+     * Stream sequence number of the last event a replica applied
+     * @param index Replica index
+     */
+    uint64_t appliedSeq(size_t index) const;
+    
+    /**
+     * Time since a replica last held every published write
+     * @param index Replica index
+     */
+    std::chrono::nanoseconds staleness(size_t index) const;
+};
+
+#endif // READ_REPLICAS_HPP
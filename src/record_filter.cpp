@@ -0,0 +1,93 @@
+#include "record_filter.hpp"
+#include <cmath>
+#include <functional>
+#include <algorithm>
+
+namespace {
+
+const unsigned COUNTERS_PER_BLOCK = 128; // 64 bytes of 4-bit counters
+const uint64_t COUNTER_MAX = 15;
+
+inline uint64_t counterAt(const uint64_t* words, unsigned position) {
+    return (words[position / 16] >> ((position % 16) * 4)) & 0xF;
+}
+
+} // namespace
+
+RecordFilter::RecordFilter(size_t capacity, double falsePositiveRate) : capacity_(std::max<size_t>(capacity, 1)) {
+    falsePositiveRate = std::min(std::max(falsePositiveRate, 1e-6), 0.5);
+    
+    // Standard Bloom sizing: m/n = -ln(p) / ln(2)^2 counters per key, k = (m/n) ln(2) hashes
+    double countersPerKey = -std::log(falsePositiveRate) / (std::log(2.0) * std::log(2.0));
+    hashCount_ = static_cast<unsigned>(std::min(16.0, std::max(1.0, std::round(countersPerKey * std::log(2.0)))));
+    
+    size_t counters = static_cast<size_t>(std::ceil(countersPerKey * capacity_));
+    blocks_.assign((counters + COUNTERS_PER_BLOCK - 1) / COUNTERS_PER_BLOCK, Block{});
+}
+
+uint64_t RecordFilter::hashKey(const std::string& key) {
+    // Finalize std::hash (SplitMix64) so all bits are usable
+    uint64_t hash = std::hash<std::string>()(key);
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    return hash ^ (hash >> 31);
+}
+
+void RecordFilter::add(const std::string& key) {
+    uint64_t hash = hashKey(key);
+    uint64_t* words = blocks_[hash % blocks_.size()].words;
+    unsigned position = static_cast<unsigned>(hash >> 32);
+    unsigned step = static_cast<unsigned>(hash >> 48) | 1;
+    
+    for (unsigned i = 0; i < hashCount_; i++, position += step) {
+        unsigned counter = position % COUNTERS_PER_BLOCK;
+        if (counterAt(words, counter) < COUNTER_MAX) {
+            words[counter / 16] += uint64_t(1) << ((counter % 16) * 4);
+        }
+    }
+    keyCount_++;
+}
+
+void RecordFilter::remove(const std::string& key) {
+    uint64_t hash = hashKey(key);
+    uint64_t* words = blocks_[hash % blocks_.size()].words;
+    unsigned position = static_cast<unsigned>(hash >> 32);
+    unsigned step = static_cast<unsigned>(hash >> 48) | 1;
+    
+    for (unsigned i = 0; i < hashCount_; i++, position += step) {
+        unsigned counter = position % COUNTERS_PER_BLOCK;
+        uint64_t value = counterAt(words, counter);
+        if (value > 0 && value < COUNTER_MAX) { // Saturated counters no longer know their count
+            words[counter / 16] -= uint64_t(1) << ((counter % 16) * 4);
+        }
+    }
+    if (keyCount_ > 0) {
+        keyCount_--;
+    }
+}
+
+bool RecordFilter::mayContain(const std::string& key) const {
+    uint64_t hash = hashKey(key);
+    const uint64_t* words = blocks_[hash % blocks_.size()].words;
+    unsigned position = static_cast<unsigned>(hash >> 32);
+    unsigned step = static_cast<unsigned>(hash >> 48) | 1;
+    
+    for (unsigned i = 0; i < hashCount_; i++, position += step) {
+        if (counterAt(words, position % COUNTERS_PER_BLOCK) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t RecordFilter::size() const {
+    return keyCount_;
+}
+
+size_t RecordFilter::capacity() const {
+    return capacity_;
+}
+
+size_t RecordFilter::memoryBytes() const {
+    return blocks_.size() * sizeof(Block);
+}
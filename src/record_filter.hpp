@@ -0,0 +1,77 @@
+#ifndef RECORD_FILTER_HPP
+#define RECORD_FILTER_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Counting Bloom filter over record IDs, answering "definitely absent"
+ * without touching the record table (or a slower storage tier)
+ *
+ * Blocked layout: a key's counters all live in one 64-byte block, so a
+ * lookup costs a single cache miss. Counters are 4 bits, so keys can be
+ * removed; a counter that saturates stays saturated, which only makes the
+ * filter more conservative. The filter never reports a present key as absent.
+ */
+class RecordFilter {
+private:
+    struct alignas(64) Block {
+        uint64_t words[8];
+    };
+    
+    std::vector<Block> blocks_;
+    unsigned hashCount_;
+    size_t capacity_;
+    size_t keyCount_ = 0;
+    
+    /**
+     * Hash a key into its block and counter positions
+     */
+    static uint64_t hashKey(const std::string& key);
+
+public:
+    /**
+     * Constructor
+     * @param capacity Number of keys the filter is sized for
+     * @param falsePositiveRate Target rate of absent keys reported as possibly present at capacity
+     */
+    explicit RecordFilter(size_t capacity = 1024, double falsePositiveRate = 0.01);
+    
+    /**
+     * Add a key
+     * @param key Record ID
+     */
+    void add(const std::string& key);
+    
+    /**
+     * Remove a key previously added
+     * @param key Record ID
+     */
+    void remove(const std::string& key);
+    
+    /**
+     * Check if a key may be present
+     * @param key Record ID
+     * @return false only if the key was definitely never added (or has been removed)
+     */
+    bool mayContain(const std::string& key) const;
+    
+    /**
+     * Number of keys currently in the filter
+     */
+    size_t size() const;
+    
+    /**
+     * Number of keys the filter was sized for
+     */
+    size_t capacity() const;
+    
+    /**
+     * Memory used by the counters in bytes
+     */
+    size_t memoryBytes() const;
+};
+
+#endif // RECORD_FILTER_HPP
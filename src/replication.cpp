@@ -0,0 +1,621 @@
+#include "replication.hpp"
+#include <algorithm>
+#include <random>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+namespace {
+
+// Messages: TYPE(u8) PAYLOAD_SIZE(u32, little-endian) PAYLOAD
+// 'P' replica -> primary  STREAM_ID(u64) LAST_APPLIED_SEQ(u64)        sync request
+// 'C' primary -> replica  STREAM_ID(u64) SEQ(u64)                      partial resync from SEQ
+// 'F' primary -> replica  STREAM_ID(u64) SEQ(u64) SNAPSHOT_SIZE(u64)  full sync up to SEQ begins
+// 'S' primary -> replica  up to SNAPSHOT_CHUNK_SIZE snapshot bytes     full sync data
+// 'D' primary -> replica  (empty)                                      full sync complete
+// 'E' primary -> replica  encoded log entries                          events
+const char MSG_SYNC_REQUEST = 'P';
+const char MSG_CONTINUE = 'C';
+const char MSG_FULL_SYNC = 'F';
+const char MSG_SNAPSHOT_CHUNK = 'S';
+const char MSG_SNAPSHOT_DONE = 'D';
+const char MSG_EVENTS = 'E';
+
+const size_t EVENTS_PER_MESSAGE = 1024;
+// Snapshots and event batches are split so no message comes close to the frame limit
+const size_t SNAPSHOT_CHUNK_SIZE = 4 << 20;
+const size_t EVENTS_BATCH_SIZE = 4 << 20;
+// Largest payload a peer may announce; only a single oversized log entry can exceed it
+const uint32_t MAX_MESSAGE_SIZE = 64 << 20;
+const auto POLL_INTERVAL = std::chrono::milliseconds(100);
+const auto RECONNECT_DELAY = std::chrono::milliseconds(100);
+
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0;
+#endif
+
+void putU64(std::string& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+uint64_t getU64(const std::string& in, size_t pos) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(in[pos + i])) << (8 * i);
+    }
+    return value;
+}
+
+bool sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = ::send(fd, data, size, SEND_FLAGS);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool recvAll(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t received = ::recv(fd, data, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+bool sendMessage(int fd, char type, const char* data, size_t size) {
+    if (size > MAX_MESSAGE_SIZE) {
+        return false; // The receiver would reject it
+    }
+    char header[5];
+    header[0] = type;
+    for (int i = 0; i < 4; i++) {
+        header[1 + i] = static_cast<char>((size >> (8 * i)) & 0xFF);
+    }
+    return sendAll(fd, header, sizeof(header)) && sendAll(fd, data, size);
+}
+
+bool sendMessage(int fd, char type, const std::string& payload) {
+    return sendMessage(fd, type, payload.data(), payload.size());
+}
+
+bool recvMessage(int fd, char& type, std::string& payload) {
+    char header[5];
+    if (!recvAll(fd, header, sizeof(header))) return false;
+    
+    type = header[0];
+    uint32_t size = 0;
+    for (int i = 0; i < 4; i++) {
+        size |= static_cast<uint32_t>(static_cast<unsigned char>(header[1 + i])) << (8 * i);
+    }
+    if (size > MAX_MESSAGE_SIZE) {
+        return false; // Corrupt or hostile header: don't allocate for it
+    }
+    payload.resize(size);
+    return size == 0 || recvAll(fd, &payload[0], size);
+}
+
+void disableSigpipe(int fd) {
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+    (void)fd;
+#endif
+}
+
+/**
+ * Parsed "unix:<path>" or "tcp:<address>:<port>" endpoint
+ */
+struct Endpoint {
+    bool isUnix = false;
+    std::string path;
+    sockaddr_in inet{};
+    bool valid = false;
+};
+
+Endpoint parseEndpoint(const std::string& endpoint) {
+    Endpoint parsed;
+    if (endpoint.compare(0, 5, "unix:") == 0) {
+        parsed.isUnix = true;
+        parsed.path = endpoint.substr(5);
+        parsed.valid = !parsed.path.empty() && parsed.path.size() < sizeof(sockaddr_un::sun_path);
+    } else if (endpoint.compare(0, 4, "tcp:") == 0) {
+        size_t colon = endpoint.rfind(':');
+        std::string host = endpoint.substr(4, colon - 4);
+        parsed.inet.sin_family = AF_INET;
+        try {
+            parsed.inet.sin_port = htons(static_cast<uint16_t>(std::stoi(endpoint.substr(colon + 1))));
+            parsed.valid = colon > 4 && ::inet_pton(AF_INET, host.c_str(), &parsed.inet.sin_addr) == 1;
+        } catch (const std::exception&) {
+            parsed.valid = false;
+        }
+    }
+    return parsed;
+}
+
+int connectTo(const std::string& endpoint) {
+    Endpoint parsed = parseEndpoint(endpoint);
+    if (!parsed.valid) return -1;
+    
+    int fd = ::socket(parsed.isUnix ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    
+    int result;
+    if (parsed.isUnix) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, parsed.path.c_str(), sizeof(address.sun_path) - 1);
+        result = ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    } else {
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        result = ::connect(fd, reinterpret_cast<sockaddr*>(&parsed.inet), sizeof(parsed.inet));
+    }
+    
+    if (result != 0) {
+        ::close(fd);
+        return -1;
+    }
+    disableSigpipe(fd);
+    return fd;
+}
+
+uint64_t randomStreamId() {
+    std::random_device device;
+    std::mt19937_64 generator((static_cast<uint64_t>(device()) << 32) ^ device());
+    uint64_t id;
+    do {
+        id = generator();
+    } while (id == 0); // 0 means "no stream" in sync requests
+    return id;
+}
+
+} // namespace
+
+// Primary
+ReplicationPrimary::ReplicationPrimary(InMemoryDBImpl& db, const std::string& endpoint, size_t backlogSize)
+    : db_(db), stream_(db.changeStream() ? db.changeStream() : db.enableChangeStream(backlogSize)),
+      streamId_(randomStreamId()) {
+    Endpoint parsed = parseEndpoint(endpoint);
+    if (!parsed.valid) {
+        return;
+    }
+    
+    listenFd_ = ::socket(parsed.isUnix ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0) {
+        return;
+    }
+    
+    bool bound;
+    if (parsed.isUnix) {
+        ::unlink(parsed.path.c_str()); // Stale socket from a previous run
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, parsed.path.c_str(), sizeof(address.sun_path) - 1);
+        bound = ::bind(listenFd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        unixPath_ = parsed.path;
+        endpoint_ = endpoint;
+    } else {
+        int on = 1;
+        ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        bound = ::bind(listenFd_, reinterpret_cast<sockaddr*>(&parsed.inet), sizeof(parsed.inet)) == 0;
+        
+        sockaddr_in actual{};
+        socklen_t length = sizeof(actual);
+        if (bound && ::getsockname(listenFd_, reinterpret_cast<sockaddr*>(&actual), &length) == 0) {
+            char host[INET_ADDRSTRLEN];
+            ::inet_ntop(AF_INET, &actual.sin_addr, host, sizeof(host));
+            endpoint_ = "tcp:" + std::string(host) + ":" + std::to_string(ntohs(actual.sin_port));
+        }
+    }
+    
+    if (!bound || ::listen(listenFd_, 16) != 0) {
+        ::close(listenFd_);
+        listenFd_ = -1;
+        return;
+    }
+    
+    acceptThread_ = std::thread(&ReplicationPrimary::acceptLoop, this);
+}
+
+ReplicationPrimary::~ReplicationPrimary() {
+    {
+        std::lock_guard<std::mutex> lock(syncMutex_);
+        stopping_.store(true);
+    }
+    syncCondition_.notify_all();
+    
+    if (acceptThread_.joinable()) {
+        acceptThread_.join();
+    }
+    
+    // Senders that exit from here on find their entry gone and leave joining to this thread
+    std::vector<std::thread> senders;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex_);
+        senders.swap(finishedSenders_);
+        for (auto& sender : senders_) {
+            ::shutdown(sender.first, SHUT_RDWR);
+            senders.push_back(std::move(sender.second));
+        }
+        senders_.clear();
+    }
+    for (std::thread& sender : senders) {
+        sender.join();
+    }
+    
+    if (listenFd_ >= 0) {
+        ::close(listenFd_);
+    }
+    if (!unixPath_.empty()) {
+        ::unlink(unixPath_.c_str());
+    }
+}
+
+bool ReplicationPrimary::isListening() const {
+    return listenFd_ >= 0;
+}
+
+const std::string& ReplicationPrimary::endpoint() const {
+    return endpoint_;
+}
+
+size_t ReplicationPrimary::replicaCount() const {
+    return replicaCount_.load();
+}
+
+void ReplicationPrimary::disconnectReplicas() {
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    for (const auto& sender : senders_) {
+        ::shutdown(sender.first, SHUT_RDWR);
+    }
+}
+
+void ReplicationPrimary::reapSenders() {
+    std::vector<std::thread> finished;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex_);
+        finished.swap(finishedSenders_);
+    }
+    for (std::thread& sender : finished) {
+        sender.join(); // Already past its last use of the lock
+    }
+}
+
+void ReplicationPrimary::acceptLoop() {
+    while (!stopping_.load()) {
+        reapSenders();
+        pollfd pfd{listenFd_, POLLIN, 0};
+        if (::poll(&pfd, 1, static_cast<int>(POLL_INTERVAL.count())) <= 0) {
+            continue;
+        }
+        
+        int fd = ::accept(listenFd_, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        disableSigpipe(fd);
+        
+        std::lock_guard<std::mutex> lock(connectionsMutex_);
+        senders_.emplace(fd, std::thread(&ReplicationPrimary::serveReplica, this, fd));
+    }
+}
+
+size_t ReplicationPrimary::pump() {
+    std::vector<std::shared_ptr<FullSyncRequest>> requests;
+    {
+        std::lock_guard<std::mutex> lock(syncMutex_);
+        requests.swap(pendingSyncs_);
+    }
+    if (requests.empty()) {
+        return 0;
+    }
+    
+    // No mutation can run concurrently on the owning thread, so the snapshot
+    // covers exactly the events up to the current head; one snapshot serves
+    // every replica waiting for it
+    uint64_t seq = stream_->headSeq();
+    auto snapshotData = std::make_shared<const std::string>(db_.snapshot());
+    
+    {
+        std::lock_guard<std::mutex> lock(syncMutex_);
+        for (auto& request : requests) {
+            request->seq = seq;
+            request->snapshot = snapshotData;
+            request->ready = true;
+        }
+    }
+    syncCondition_.notify_all();
+    return requests.size();
+}
+
+bool ReplicationPrimary::sendFullSync(int fd, uint64_t& cursor) {
+    auto request = std::make_shared<FullSyncRequest>();
+    {
+        std::unique_lock<std::mutex> lock(syncMutex_);
+        pendingSyncs_.push_back(request);
+        syncCondition_.wait(lock, [&]() { return request->ready || stopping_.load(); });
+        if (!request->ready) {
+            return false;
+        }
+    }
+    
+    // Stream the snapshot in bounded chunks between a header and an end marker
+    const std::string& snapshotData = *request->snapshot;
+    std::string header;
+    putU64(header, streamId_);
+    putU64(header, request->seq);
+    putU64(header, snapshotData.size());
+    if (!sendMessage(fd, MSG_FULL_SYNC, header)) {
+        return false;
+    }
+    for (size_t pos = 0; pos < snapshotData.size(); pos += SNAPSHOT_CHUNK_SIZE) {
+        size_t size = std::min(SNAPSHOT_CHUNK_SIZE, snapshotData.size() - pos);
+        if (!sendMessage(fd, MSG_SNAPSHOT_CHUNK, snapshotData.data() + pos, size)) {
+            return false;
+        }
+    }
+    
+    cursor = request->seq;
+    return sendMessage(fd, MSG_SNAPSHOT_DONE, std::string());
+}
+
+void ReplicationPrimary::serveReplica(int fd) {
+    replicaCount_++;
+    
+    char type;
+    std::string payload;
+    uint64_t cursor = 0;
+    bool ok = recvMessage(fd, type, payload) && type == MSG_SYNC_REQUEST && payload.size() == 16;
+    
+    if (ok) {
+        uint64_t replicaStreamId = getU64(payload, 0);
+        uint64_t lastApplied = getU64(payload, 8);
+        
+        // Partial resync when the replica follows this stream and the backlog still holds what it misses
+        if (replicaStreamId == streamId_ && lastApplied + 1 >= stream_->oldestSeq() &&
+            lastApplied <= stream_->headSeq()) {
+            std::string reply;
+            putU64(reply, streamId_);
+            putU64(reply, lastApplied);
+            cursor = lastApplied;
+            ok = sendMessage(fd, MSG_CONTINUE, reply);
+        } else {
+            ok = sendFullSync(fd, cursor);
+        }
+    }
+    
+    std::vector<LogEntry> events;
+    while (ok && !stopping_.load()) {
+        if (!stream_->waitForEvents(cursor, POLL_INTERVAL)) {
+            continue;
+        }
+        
+        events.clear();
+        bool complete = stream_->read(cursor, events, EVENTS_PER_MESSAGE);
+        
+        // A restore on the primary (Clear) or a lapped backlog requires a full sync
+        bool needsFullSync = !complete;
+        std::string batch;
+        for (const LogEntry& event : events) {
+            if (event.op == LogOp::Clear) {
+                needsFullSync = true;
+                break;
+            }
+            encodeLogEntry(event, batch);
+            if (batch.size() >= EVENTS_BATCH_SIZE) {
+                ok = sendMessage(fd, MSG_EVENTS, batch);
+                batch.clear();
+                if (!ok) {
+                    break;
+                }
+            }
+        }
+        
+        if (ok && !batch.empty()) {
+            ok = sendMessage(fd, MSG_EVENTS, batch);
+        }
+        if (ok && needsFullSync) {
+            ok = sendFullSync(fd, cursor);
+        }
+    }
+    
+    replicaCount_--;
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    ::close(fd); // The fd can be reused by the next accept only once its entry is gone
+    auto self = senders_.find(fd);
+    if (self != senders_.end()) {
+        finishedSenders_.push_back(std::move(self->second));
+        senders_.erase(self);
+    }
+}
+
+// Replica
+ReplicationReplica::ReplicationReplica(const std::string& endpoint)
+    : endpoint_(endpoint), worker_(&ReplicationReplica::run, this) {
+}
+
+ReplicationReplica::~ReplicationReplica() {
+    stopping_.store(true);
+    {
+        std::lock_guard<std::mutex> lock(fdMutex_);
+        if (fd_ >= 0) {
+            ::shutdown(fd_, SHUT_RDWR);
+        }
+    }
+    worker_.join();
+}
+
+void ReplicationReplica::run() {
+    while (!stopping_.load()) {
+        int fd = connectTo(endpoint_);
+        if (fd >= 0) {
+            {
+                std::lock_guard<std::mutex> lock(fdMutex_);
+                fd_ = fd;
+            }
+            if (!stopping_.load()) {
+                replicate(fd);
+            }
+            {
+                std::lock_guard<std::mutex> lock(fdMutex_);
+                fd_ = -1;
+                ::close(fd);
+            }
+            connected_.store(false);
+        }
+        
+        if (!stopping_.load()) {
+            std::this_thread::sleep_for(RECONNECT_DELAY);
+        }
+    }
+}
+
+void ReplicationReplica::replicate(int fd) {
+    std::string request;
+    putU64(request, streamId_);
+    putU64(request, appliedSeq_.load());
+    if (!sendMessage(fd, MSG_SYNC_REQUEST, request)) {
+        return;
+    }
+    connected_.store(true);
+    
+    char type;
+    std::string payload;
+    
+    // Full sync in progress: the snapshot is gathered from its chunks before it is applied
+    bool receivingSnapshot = false;
+    uint64_t syncStreamId = 0;
+    uint64_t syncSeq = 0;
+    uint64_t syncSize = 0;
+    std::string snapshotData;
+    
+    while (!stopping_.load() && recvMessage(fd, type, payload)) {
+        if (receivingSnapshot) {
+            if (type == MSG_SNAPSHOT_CHUNK && payload.size() <= syncSize - snapshotData.size()) {
+                snapshotData.append(payload);
+            } else if (type == MSG_SNAPSHOT_DONE && snapshotData.size() == syncSize) {
+                // Decode off to the side while reads continue, then swap in
+                InMemoryDBImpl::Dataset staged;
+                if (!InMemoryDBImpl::prepareRestore(snapshotData, staged)) {
+                    return;
+                }
+                std::string().swap(snapshotData);
+                {
+                    std::unique_lock<std::shared_mutex> lock(dbMutex_);
+                    db_.commitRestore(staged);
+                }
+                fullSyncCount_++;
+                receivingSnapshot = false;
+                streamId_ = syncStreamId;
+                publishSeq(syncSeq);
+            } else {
+                return; // Protocol error
+            }
+        } else if (type == MSG_FULL_SYNC && payload.size() == 24) {
+            receivingSnapshot = true;
+            syncStreamId = getU64(payload, 0);
+            syncSeq = getU64(payload, 8);
+            syncSize = getU64(payload, 16);
+            snapshotData.clear();
+        } else if (type == MSG_CONTINUE && payload.size() == 16) {
+            streamId_ = getU64(payload, 0);
+            publishSeq(getU64(payload, 8));
+        } else if (type == MSG_EVENTS) {
+            std::vector<LogEntry> entries;
+            size_t pos = 0;
+            while (pos < payload.size()) {
+                LogEntry entry;
+                size_t consumed = decodeLogEntry(payload.data() + pos, payload.size() - pos, entry);
+                if (consumed == 0) {
+                    return; // Corrupt message: reconnect and resync
+                }
+                entries.push_back(std::move(entry));
+                pos += consumed;
+            }
+            
+            {
+                std::unique_lock<std::shared_mutex> lock(dbMutex_);
+                for (const LogEntry& entry : entries) {
+                    db_.applyLogEntry(entry);
+                }
+            }
+            if (!entries.empty()) {
+                publishSeq(entries.back().seq);
+            }
+        } else {
+            return; // Protocol error
+        }
+    }
+}
+
+std::optional<std::string> ReplicationReplica::get(const std::string& recordId, const std::string& field) const {
+    std::shared_lock<std::shared_mutex> lock(dbMutex_);
+    return db_.get(recordId, field);
+}
+
+std::vector<std::string> ReplicationReplica::getRecordsByFieldValue(const std::string& field,
+                                                                    const std::string& value) const {
+    std::shared_lock<std::shared_mutex> lock(dbMutex_);
+    return db_.getRecordsByFieldValue(field, value);
+}
+
+bool ReplicationReplica::hasRecord(const std::string& recordId) const {
+    std::shared_lock<std::shared_mutex> lock(dbMutex_);
+    return db_.hasRecord(recordId);
+}
+
+std::vector<std::string> ReplicationReplica::getAllRecordIds() const {
+    std::shared_lock<std::shared_mutex> lock(dbMutex_);
+    return db_.getAllRecordIds();
+}
+
+void ReplicationReplica::read(const std::function<void(const InMemoryDBImpl&)>& reader) const {
+    std::shared_lock<std::shared_mutex> lock(dbMutex_);
+    reader(db_);
+}
+
+uint64_t ReplicationReplica::appliedSeq() const {
+    return appliedSeq_.load();
+}
+
+void ReplicationReplica::publishSeq(uint64_t seq) {
+    {
+        std::lock_guard<std::mutex> lock(seqMutex_);
+        appliedSeq_.store(seq);
+    }
+    seqCondition_.notify_all();
+}
+
+bool ReplicationReplica::waitForSeq(uint64_t seq, std::chrono::milliseconds timeout) const {
+    std::unique_lock<std::mutex> lock(seqMutex_);
+    return seqCondition_.wait_for(lock, timeout, [this, seq] { return appliedSeq_.load() >= seq; });
+}
+
+bool ReplicationReplica::isConnected() const {
+    return connected_.load();
+}
+
+uint64_t ReplicationReplica::fullSyncCount() const {
+    return fullSyncCount_.load();
+}
@@ -0,0 +1,228 @@
+#ifndef REPLICATION_HPP
+#define REPLICATION_HPP
+
+#include "in_memory_db_imp.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <optional>
+#include <functional>
+#include <chrono>
+
+/**
+ * Primary side of local primary/replica replication
+ *
+ * Listens on a Unix socket ("unix:/path/to.sock") or TCP loopback endpoint
+ * ("tcp:127.0.0.1:7000", port 0 picks a free port) and ships the database's
+ * change stream to connected replicas. The change stream doubles as the
+ * replication backlog: a reconnecting replica whose last applied event is
+ * still retained resumes from there (partial resync); otherwise, or after a
+ * restore on the primary, it receives a snapshot streamed in bounded chunks (full sync).
+ *
+ * InMemoryDBImpl is single-threaded, so snapshots for full syncs are taken
+ * by pump(), which the thread owning the database must call regularly.
+ * Everything else runs on the primary's own threads.
+ */
+class ReplicationPrimary {
+private:
+    /**
+     * A full sync waiting for pump() to take a snapshot
+     */
+    struct FullSyncRequest {
+        bool ready = false;
+        uint64_t seq = 0;
+        std::shared_ptr<const std::string> snapshot;
+    };
+    
+    InMemoryDBImpl& db_;
+    std::shared_ptr<ChangeStream> stream_;
+    
+    // Identifies this primary's stream; replicas of another stream need a full sync
+    uint64_t streamId_;
+    
+    int listenFd_ = -1;
+    std::string endpoint_;
+    std::string unixPath_;
+    std::atomic<bool> stopping_{false};
+    std::thread acceptThread_;
+    
+    std::mutex syncMutex_;
+    std::condition_variable syncCondition_;
+    std::vector<std::shared_ptr<FullSyncRequest>> pendingSyncs_;
+    
+    mutable std::mutex connectionsMutex_;
+    std::unordered_map<int, std::thread> senders_; // Connected socket -> thread serving it
+    std::vector<std::thread> finishedSenders_;     // Moved here by serveReplica on exit, joined by acceptLoop
+    std::atomic<size_t> replicaCount_{0};
+    
+    /**
+     * Accept replica connections until stopped
+     */
+    void acceptLoop();
+    
+    /**
+     * Join the sender threads of replicas that disconnected
+     */
+    void reapSenders();
+    
+    /**
+     * Handshake with one replica and ship events to it until it disconnects
+     * @param fd Connected socket
+     */
+    void serveReplica(int fd);
+    
+    /**
+     * Send a snapshot to a replica, waiting for pump() to take it
+     * @param fd Connected socket
+     * @param cursor Receives the stream sequence number the snapshot covers
+     * @return true if the snapshot was sent
+     */
+    bool sendFullSync(int fd, uint64_t& cursor);
+
+public:
+    /**
+     * Start listening for replicas
+     * @param db Database to replicate; its change stream is enabled if needed
+     * @param endpoint "unix:<path>" or "tcp:<ipv4 address>:<port>"
+     * @param backlogSize Change stream capacity, i.e. how far behind a replica may fall
+     *                    and still resume with a partial resync
+     */
+    ReplicationPrimary(InMemoryDBImpl& db, const std::string& endpoint, size_t backlogSize = 65536);
+    
+    /**
+     * Destructor; disconnects all replicas
+     */
+    ~ReplicationPrimary();
+    
+    ReplicationPrimary(const ReplicationPrimary&) = delete;
+    ReplicationPrimary& operator=(const ReplicationPrimary&) = delete;
+    
+    /**
+     * Check if the endpoint could be bound
+     */
+    bool isListening() const;
+    
+    /**
+     * Endpoint replicas should connect to (with the actual port for "tcp:...:0")
+     */
+    const std::string& endpoint() const;
+    
+    /**
+     * Serve pending full syncs; must be called from the thread that owns the database
+     * @return Number of replicas that received the snapshot
+     */
+    size_t pump();
+    
+    /**
+     * Number of replicas currently connected
+     */
+    size_t replicaCount() const;
+    
+    /**
+     * Drop all replica connections; replicas reconnect and resync on their own
+     */
+    void disconnectReplicas();
+};
+
+/**
+ * Replica side of local primary/replica replication
+ *
+ * Owns a copy of the primary's database, kept up to date by a background
+ * thread that applies the shipped events, reconnecting (with partial
+ * resync when possible) if the link drops. Reads are served concurrently
+ * from the local copy.
+ */
+class ReplicationReplica {
+private:
+    std::string endpoint_;
+    
+    InMemoryDBImpl db_;
+    mutable std::shared_mutex dbMutex_;
+    
+    // Replication position, touched only by the worker thread except for the atomics
+    uint64_t streamId_ = 0;
+    std::atomic<uint64_t> appliedSeq_{0};
+    std::atomic<uint64_t> fullSyncCount_{0};
+    mutable std::mutex seqMutex_;
+    mutable std::condition_variable seqCondition_; // Signaled whenever appliedSeq_ advances
+    std::atomic<bool> connected_{false};
+    
+    std::atomic<bool> stopping_{false};
+    std::mutex fdMutex_;
+    int fd_ = -1;
+    std::thread worker_;
+    
+    /**
+     * Connect, handshake and apply events until stopped
+     */
+    void run();
+    
+    /**
+     * Handle one connection to the primary
+     * @param fd Connected socket
+     */
+    void replicate(int fd);
+    
+    /**
+     * Record the last applied sequence number and wake waitForSeq() callers
+     */
+    void publishSeq(uint64_t seq);
+
+public:
+    /**
+     * Start replicating from a primary
+     * @param endpoint Endpoint returned by ReplicationPrimary::endpoint()
+     */
+    explicit ReplicationReplica(const std::string& endpoint);
+    
+    /**
+     * Destructor; disconnects from the primary
+     */
+    ~ReplicationReplica();
+    
+    ReplicationReplica(const ReplicationReplica&) = delete;
+    ReplicationReplica& operator=(const ReplicationReplica&) = delete;
+    
+    // Reads served from the local copy
+    std::optional<std::string> get(const std::string& recordId, const std::string& field) const;
+    std::vector<std::string> getRecordsByFieldValue(const std::string& field, const std::string& value) const;
+    bool hasRecord(const std::string& recordId) const;
+    std::vector<std::string> getAllRecordIds() const;
+    
+    /**
+     * Run an arbitrary read against a consistent view of the local copy
+     * @param reader Called with the database while updates are held off
+     */
+    void read(const std::function<void(const InMemoryDBImpl&)>& reader) const;
+    
+    /**
+     * Stream sequence number of the last event applied
+     */
+    uint64_t appliedSeq() const;
+    
+    /**
+     * Block until the replica has applied an event
+     * @param seq Stream sequence number to wait for (e.g. the primary stream's headSeq())
+     * @param timeout Maximum time to wait
+     * @return true if the replica caught up in time
+     */
+    bool waitForSeq(uint64_t seq, std::chrono::milliseconds timeout) const;
+    
+    /**
+     * Check if the replica is connected to its primary
+     */
+    bool isConnected() const;
+    
+    /**
+     * Number of full syncs performed (initial sync included)
+     */
+    uint64_t fullSyncCount() const;
+};
+
+#endif // REPLICATION_HPP
@@ -0,0 +1,376 @@
+#include "sharded_db.hpp"
+#include "numa_util.hpp"
+#include <future>
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+/**
+ * Splits one backup (see InMemoryDBImpl::backup) into its record and TTL sections
+ */
+struct BackupSections {
+    size_t recordCount = 0;
+    std::string records;
+    size_t ttlCount = 0;
+    std::string ttls;
+};
+
+bool splitBackup(const std::string& backupData, BackupSections& sections) {
+    try {
+        size_t pos = 0;
+        auto nextLine = [&](std::string& line) {
+            size_t end = backupData.find('\n', pos);
+            if (end == std::string::npos) return false;
+            line = backupData.substr(pos, end - pos);
+            pos = end + 1;
+            return true;
+        };
+        auto skipLines = [&](size_t count) {
+            std::string line;
+            for (size_t i = 0; i < count; i++) {
+                if (!nextLine(line)) return false;
+            }
+            return true;
+        };
+        
+        std::string line;
+        if (!nextLine(line)) return false;
+        sections.recordCount = std::stoul(line);
+        
+        size_t recordsStart = pos;
+        for (size_t i = 0; i < sections.recordCount; i++) {
+            if (!skipLines(1) || !nextLine(line)) return false;
+            if (!skipLines(2 * std::stoul(line))) return false;
+        }
+        sections.records = backupData.substr(recordsStart, pos - recordsStart);
+        
+        if (!nextLine(line)) return false;
+        sections.ttlCount = std::stoul(line);
+        sections.ttls = backupData.substr(pos);
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+} // namespace
+
+ShardedInMemoryDB::ShardedInMemoryDB(size_t shardCount, ShardPlacement placement) : placement_(placement) {
+    if (shardCount == 0) {
+        shardCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<int> nodes = placement == ShardPlacement::None ? std::vector<int>{0} : numa::nodes();
+    
+    for (size_t i = 0; i < shardCount; i++) {
+        shards_.push_back(std::make_unique<Shard>());
+        shards_.back()->node = nodes[i % nodes.size()];
+    }
+    for (auto& shard : shards_) {
+        Shard* target = shard.get();
+        shard->owner = std::thread([this, target]() { run(*target); });
+    }
+}
+
+ShardedInMemoryDB::~ShardedInMemoryDB() {
+    for (auto& shard : shards_) {
+        {
+            std::lock_guard<std::mutex> lock(shard->queueMutex);
+            shard->stopping = true;
+        }
+        shard->queueCondition.notify_one();
+    }
+    for (auto& shard : shards_) {
+        shard->owner.join();
+    }
+}
+
+void ShardedInMemoryDB::run(Shard& shard) {
+    // Placement applies to everything this thread allocates, i.e. the whole shard
+    if (placement_ != ShardPlacement::None) {
+        numa::bindCurrentThreadToNode(shard.node);
+    }
+    if (placement_ == ShardPlacement::Interleaved) {
+        numa::interleaveCurrentThread();
+    }
+    
+    std::deque<std::function<void()>> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(shard.queueMutex);
+            shard.queueCondition.wait(lock, [&]() { return shard.stopping || !shard.queue.empty(); });
+            if (shard.queue.empty()) {
+                return; // Stopping with nothing left to do
+            }
+            batch.swap(shard.queue);
+        }
+        
+        for (auto& task : batch) {
+            task();
+        }
+        batch.clear();
+    }
+}
+
+void ShardedInMemoryDB::submit(Shard& shard, std::function<void()> task) const {
+    {
+        std::lock_guard<std::mutex> lock(shard.queueMutex);
+        shard.queue.push_back(std::move(task));
+    }
+    shard.queueCondition.notify_one();
+}
+
+template <typename Result>
+Result ShardedInMemoryDB::call(Shard& shard, const std::function<Result(InMemoryDBImpl&)>& request) const {
+    std::promise<Result> promise;
+    std::future<Result> future = promise.get_future();
+    submit(shard, [&]() { promise.set_value(request(shard.db)); });
+    return future.get();
+}
+
+template <typename Result>
+std::vector<Result> ShardedInMemoryDB::callAll(const std::function<Result(InMemoryDBImpl&)>& request) const {
+    std::vector<std::promise<Result>> promises(shards_.size());
+    for (size_t i = 0; i < shards_.size(); i++) {
+        Shard& shard = *shards_[i];
+        std::promise<Result>& promise = promises[i];
+        submit(shard, [&]() { promise.set_value(request(shard.db)); });
+    }
+    
+    std::vector<Result> results;
+    results.reserve(shards_.size());
+    for (auto& promise : promises) {
+        results.push_back(promise.get_future().get());
+    }
+    return results;
+}
+
+ShardedInMemoryDB::Shard& ShardedInMemoryDB::shardFor(const std::string& recordId) const {
+    return *shards_[shardOf(recordId)];
+}
+
+// Level 1: Basic operations
+void ShardedInMemoryDB::set(const std::string& recordId, const std::string& field, const std::string& value) {
+    call<bool>(shardFor(recordId), [&](InMemoryDBImpl& db) {
+        db.set(recordId, field, value);
+        return true;
+    });
+}
+
+std::optional<std::string> ShardedInMemoryDB::get(const std::string& recordId, const std::string& field) const {
+    return call<std::optional<std::string>>(shardFor(recordId), [&](InMemoryDBImpl& db) {
+        return db.get(recordId, field);
+    });
+}
+
+bool ShardedInMemoryDB::deleteField(const std::string& recordId, const std::string& field) {
+    return call<bool>(shardFor(recordId), [&](InMemoryDBImpl& db) { return db.deleteField(recordId, field); });
+}
+
+bool ShardedInMemoryDB::deleteRecord(const std::string& recordId) {
+    return call<bool>(shardFor(recordId), [&](InMemoryDBImpl& db) { return db.deleteRecord(recordId); });
+}
+
+std::vector<std::string> ShardedInMemoryDB::getFields(const std::string& recordId) const {
+    return call<std::vector<std::string>>(shardFor(recordId), [&](InMemoryDBImpl& db) {
+        return db.getFields(recordId);
+    });
+}
+
+bool ShardedInMemoryDB::hasRecord(const std::string& recordId) const {
+    return call<bool>(shardFor(recordId), [&](InMemoryDBImpl& db) { return db.hasRecord(recordId); });
+}
+
+std::vector<std::string> ShardedInMemoryDB::getAllRecordIds() const {
+    return mergeSortedIds(callAll<std::vector<std::string>>([](InMemoryDBImpl& db) { return db.getAllRecordIds(); }));
+}
+
+// Level 2: Filtering
+std::vector<std::string> ShardedInMemoryDB::getRecordsByFieldValue(const std::string& field,
+                                                                   const std::string& value) const {
+    return mergeSortedIds(callAll<std::vector<std::string>>([&](InMemoryDBImpl& db) {
+        return db.getRecordsByFieldValue(field, value);
+    }));
+}
+
+// Level 3: TTL
+void ShardedInMemoryDB::setTTL(const std::string& recordId, int ttlSeconds) {
+    call<bool>(shardFor(recordId), [&](InMemoryDBImpl& db) {
+        db.setTTL(recordId, ttlSeconds);
+        return true;
+    });
+}
+
+int ShardedInMemoryDB::expireRecords() {
+    int expired = 0;
+    for (int count : callAll<int>([](InMemoryDBImpl& db) { return db.expireRecords(); })) {
+        expired += count;
+    }
+    return expired;
+}
+
+// Level 4: Backup and restore
+std::string ShardedInMemoryDB::backup() const {
+    return mergeBackups(callAll<std::string>([](InMemoryDBImpl& db) { return db.backup(); }));
+}
+
+std::vector<std::string> ShardedInMemoryDB::mergeSortedIds(std::vector<std::vector<std::string>> parts) {
+    // Merge balanced pairs, so every ID is moved once per round and there are log2(shards) rounds;
+    // shards hold disjoint IDs, so the result has no duplicates
+    while (parts.size() > 1) {
+        std::vector<std::vector<std::string>> merged;
+        merged.reserve((parts.size() + 1) / 2);
+        for (size_t i = 0; i < parts.size(); i += 2) {
+            if (i + 1 == parts.size()) {
+                merged.push_back(std::move(parts[i]));
+                break;
+            }
+            std::vector<std::string> pair;
+            pair.reserve(parts[i].size() + parts[i + 1].size());
+            std::merge(std::make_move_iterator(parts[i].begin()), std::make_move_iterator(parts[i].end()),
+                       std::make_move_iterator(parts[i + 1].begin()), std::make_move_iterator(parts[i + 1].end()),
+                       std::back_inserter(pair));
+            merged.push_back(std::move(pair));
+        }
+        parts.swap(merged);
+    }
+    return parts.empty() ? std::vector<std::string>() : std::move(parts.front());
+}
+
+std::string ShardedInMemoryDB::mergeBackups(const std::vector<std::string>& parts) {
+    // Merge the shard backups section by section
+    BackupSections merged;
+    for (const std::string& part : parts) {
+        BackupSections sections;
+        if (!splitBackup(part, sections)) {
+            return "";
+        }
+        merged.recordCount += sections.recordCount;
+        merged.records += sections.records;
+        merged.ttlCount += sections.ttlCount;
+        merged.ttls += sections.ttls;
+    }
+    
+    return std::to_string(merged.recordCount) + "\n" + merged.records +
+           std::to_string(merged.ttlCount) + "\n" + merged.ttls;
+}
+
+bool ShardedInMemoryDB::restore(const std::string& backupData) {
+    InMemoryDBImpl::Dataset full;
+    if (!InMemoryDBImpl::prepareRestore(backupData, full)) {
+        return false;
+    }
+    
+    // Partition in one pass; each owner then copies its own partition, so shard
+    // memory is allocated by its own thread
+    std::vector<std::vector<const InMemoryDBImpl::RecordMap::value_type*>> partitions(shards_.size());
+    for (const auto& record : full.records) {
+        partitions[shardOf(record.first)].push_back(&record);
+    }
+    
+    std::vector<std::promise<void>> promises(shards_.size());
+    for (size_t i = 0; i < shards_.size(); i++) {
+        Shard& shard = *shards_[i];
+        std::promise<void>& promise = promises[i];
+        const auto& records = partitions[i];
+        submit(shard, [&]() {
+            InMemoryDBImpl::Dataset partition;
+            partition.records.reserve(records.size());
+            for (const auto* record : records) {
+                partition.records.insert(*record);
+                auto ttlIt = full.ttlMap.find(record->first);
+                if (ttlIt != full.ttlMap.end()) {
+                    partition.ttlMap.insert(*ttlIt);
+                }
+            }
+            shard.db.commitRestore(partition);
+            promise.set_value();
+        });
+    }
+    for (auto& promise : promises) {
+        promise.get_future().get();
+    }
+    return true;
+}
+
+size_t ShardedInMemoryDB::shardCount() const {
+    return shards_.size();
+}
+
+size_t ShardedInMemoryDB::shardOf(const std::string& recordId) const {
+    return std::hash<std::string>()(recordId) % shards_.size();
+}
+
+int ShardedInMemoryDB::shardNode(size_t shard) const {
+    return shards_[shard]->node;
+}
+
+void ShardedInMemoryDB::execute(size_t shard, const std::function<void(InMemoryDBImpl&)>& batch) {
+    call<bool>(*shards_[shard], [&](InMemoryDBImpl& db) {
+        batch(db);
+        return true;
+    });
+}
+
+void ShardedInMemoryDB::post(size_t shard, std::function<void(InMemoryDBImpl&)> task) {
+    Shard& target = *shards_[shard];
+    submit(target, [&target, task = std::move(task)]() { task(target.db); });
+}
+
+size_t ShardedInMemoryDB::getRecordCount() const {
+    size_t count = 0;
+    for (size_t shardRecords : callAll<size_t>([](InMemoryDBImpl& db) { return db.getRecordCount(); })) {
+        count += shardRecords;
+    }
+    return count;
+}
+
+void ShardedInMemoryDB::enableRecordFilter(double falsePositiveRate) {
+    callAll<bool>([&](InMemoryDBImpl& db) {
+        db.enableRecordFilter(falsePositiveRate);
+        return true;
+    });
+}
+
+void ShardedInMemoryDB::enableValueCompression(const std::string& field, size_t minSize) {
+    callAll<bool>([&](InMemoryDBImpl& db) {
+        db.enableValueCompression(field, minSize);
+        return true;
+    });
+}
+
+void ShardedInMemoryDB::enableValueInterning() {
+    callAll<bool>([](InMemoryDBImpl& db) {
+        db.enableValueInterning();
+        return true;
+    });
+}
+
+void ShardedInMemoryDB::enableRecordIndex() {
+    callAll<bool>([](InMemoryDBImpl& db) {
+        db.enableRecordIndex();
+        return true;
+    });
+}
+
+std::vector<std::string> ShardedInMemoryDB::getRecordIdsByPrefix(const std::string& prefix) const {
+    return mergeSortedIds(callAll<std::vector<std::string>>([&](InMemoryDBImpl& db) {
+        return db.getRecordIdsByPrefix(prefix);
+    }));
+}
+
+void ShardedInMemoryDB::enableLazyFree(size_t minFields) {
+    callAll<bool>([&](InMemoryDBImpl& db) {
+        db.enableLazyFree(minFields);
+        return true;
+    });
+}
+
+std::optional<InMemoryDBImpl::RateLimitResult> ShardedInMemoryDB::checkRateLimit(const std::string& recordId,
+                                                                                const std::string& field,
+                                                                                uint64_t limit, uint64_t windowMs,
+                                                                                uint64_t cost) {
+    return call<std::optional<InMemoryDBImpl::RateLimitResult>>(shardFor(recordId), [&](InMemoryDBImpl& db) {
+        return db.checkRateLimit(recordId, field, limit, windowMs, cost);
+    });
+}
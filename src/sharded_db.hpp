@@ -0,0 +1,220 @@
+#ifndef SHARDED_DB_HPP
+#define SHARDED_DB_HPP
+
+#include "in_memory_db_imp.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+
+/**
+ * Memory placement of shards on NUMA systems
+ */
+enum class ShardPlacement {
+    None,        // No pinning, default kernel policy
+    Local,       // Owner thread pinned to the shard's node, shard memory allocated there
+    Interleaved  // Owner thread pinned to the shard's node, shard memory interleaved over all nodes
+};
+
+/**
+ * Thread-safe database partitioned into shards by record ID
+ *
+ * Each shard is an InMemoryDBImpl owned by a single worker thread; every
+ * request for a shard is routed to and executed on its owner, so a shard is
+ * only ever touched (and allocated) by one thread. With Local placement,
+ * shards are spread over the NUMA nodes round-robin and each owner is
+ * pinned to its node's cores with node-local allocation, so shard memory
+ * never needs remote accesses. Operations spanning all records fan out to
+ * every shard in parallel.
+ */
+class ShardedInMemoryDB : public InMemoryDB {
+private:
+    /**
+     * One shard: its database and the owner thread executing its requests
+     */
+    struct Shard {
+        int node = 0;
+        InMemoryDBImpl db;
+        
+        std::mutex queueMutex;
+        std::condition_variable queueCondition;
+        std::deque<std::function<void()>> queue;
+        bool stopping = false;
+        
+        std::thread owner;
+    };
+    
+    std::vector<std::unique_ptr<Shard>> shards_;
+    ShardPlacement placement_;
+    
+    /**
+     * Owner thread loop: apply the placement, then execute queued requests
+     * @param shard Shard owned by the thread
+     */
+    void run(Shard& shard);
+    
+    /**
+     * Queue a request on a shard's owner thread
+     * @param shard Target shard
+     * @param task Request to execute
+     */
+    void submit(Shard& shard, std::function<void()> task) const;
+    
+    /**
+     * Execute a request on a shard's owner thread and wait for its result
+     * @param shard Target shard
+     * @param request Called with the shard's database
+     * @return The request's result
+     */
+    template <typename Result>
+    Result call(Shard& shard, const std::function<Result(InMemoryDBImpl&)>& request) const;
+    
+    /**
+     * Execute a request on every shard in parallel and wait for all results
+     * @param request Called with each shard's database
+     * @return Results in shard order
+     */
+    template <typename Result>
+    std::vector<Result> callAll(const std::function<Result(InMemoryDBImpl&)>& request) const;
+    
+    /**
+     * Shard holding a record
+     */
+    Shard& shardFor(const std::string& recordId) const;
+
+public:
+    /**
+     * Start the shard owner threads
+     * @param shardCount Number of shards (0 = hardware concurrency)
+     * @param placement NUMA placement of the shards
+     */
+    explicit ShardedInMemoryDB(size_t shardCount = 0, ShardPlacement placement = ShardPlacement::Local);
+    
+    /**
+     * Destructor; stops the owner threads
+     */
+    ~ShardedInMemoryDB() override;
+    
+    ShardedInMemoryDB(const ShardedInMemoryDB&) = delete;
+    ShardedInMemoryDB& operator=(const ShardedInMemoryDB&) = delete;
+    
+    // Level 1: Basic operations
+    void set(const std::string& recordId, const std::string& field, const std::string& value) override;
+    std::optional<std::string> get(const std::string& recordId, const std::string& field) const override;
+    bool deleteField(const std::string& recordId, const std::string& field) override;
+    bool deleteRecord(const std::string& recordId) override;
+    std::vector<std::string> getFields(const std::string& recordId) const override;
+    bool hasRecord(const std::string& recordId) const override;
+    std::vector<std::string> getAllRecordIds() const override;
+    
+    // Level 2: Filtering
+    std::vector<std::string> getRecordsByFieldValue(const std::string& field, const std::string& value) const override;
+    
+    // Level 3: TTL
+    void setTTL(const std::string& recordId, int ttlSeconds) override;
+    int expireRecords() override;
+    
+    // Level 4: Backup and restore (same format as InMemoryDBImpl; a failed restore keeps the current state)
+    std::string backup() const override;
+    bool restore(const std::string& backupData) override;
+    
+    /**
+     * Number of shards
+     */
+    size_t shardCount() const;
+    
+    /**
+     * Shard a record ID is routed to
+     * @param recordId Record identifier
+     */
+    size_t shardOf(const std::string& recordId) const;
+    
+    /**
+     * NUMA node a shard is placed on
+     * @param shard Shard index
+     */
+    int shardNode(size_t shard) const;
+    
+    /**
+     * Run a batch of operations on a shard's owner thread, avoiding one hand-off per operation
+     * @param shard Shard index
+     * @param batch Called on the owner thread with the shard's database
+     */
+    void execute(size_t shard, const std::function<void(InMemoryDBImpl&)>& batch);
+    
+    /**
+     * Queue an operation on a shard's owner thread without waiting for it;
+     * operations posted to one shard run in order
+     * @param shard Shard index
+     * @param task Called on the owner thread with the shard's database
+     */
+    void post(size_t shard, std::function<void(InMemoryDBImpl&)> task);
+    
+    /**
+     * Combine per-shard backups into one backup of the whole database
+     * @param parts Backup of every shard
+     * @return Empty string if a part is malformed
+     */
+    static std::string mergeBackups(const std::vector<std::string>& parts);
+    
+    /**
+     * Merge per-shard ID lists, each sorted, into one sorted list
+     * @param parts ID list of every shard
+     */
+    static std::vector<std::string> mergeSortedIds(std::vector<std::vector<std::string>> parts);
+    
+    /**
+     * Total number of records
+     */
+    size_t getRecordCount() const;
+    
+    /**
+     * Maintain a record filter on every shard (see InMemoryDBImpl::enableRecordFilter)
+     * @param falsePositiveRate Target fraction of absent IDs that still probe a shard's table
+     */
+    void enableRecordFilter(double falsePositiveRate = 0.01);
+    
+    /**
+     * Compress a field's large values on every shard (see InMemoryDBImpl::enableValueCompression)
+     * @param field Field to compress
+     * @param minSize Values shorter than this are stored as is
+     */
+    void enableValueCompression(const std::string& field, size_t minSize = 1024);
+    
+    /**
+     * Intern low-cardinality fields on every shard (see InMemoryDBImpl::enableValueInterning)
+     */
+    void enableValueInterning();
+    
+    /**
+     * Maintain a record index on every shard (see InMemoryDBImpl::enableRecordIndex)
+     */
+    void enableRecordIndex();
+    
+    /**
+     * Get the IDs of the records starting with a prefix, sorted; every shard
+     * lists its matches in parallel
+     * @param prefix ID prefix
+     */
+    std::vector<std::string> getRecordIdsByPrefix(const std::string& prefix) const;
+    
+    /**
+     * Free large deleted records in the background on every shard (see InMemoryDBImpl::enableLazyFree)
+     * @param minFields Smallest record freed in the background
+     */
+    void enableLazyFree(size_t minFields = 64);
+    
+    /**
+     * Check and count a request against a rate limit on the record's shard
+     * (see InMemoryDBImpl::checkRateLimit); concurrent callers are serialized
+     * by the shard's owner thread
+     */
+    std::optional<InMemoryDBImpl::RateLimitResult> checkRateLimit(const std::string& recordId, const std::string& field,
+                                                                  uint64_t limit, uint64_t windowMs, uint64_t cost = 1);
+};
+
+#endif // SHARDED_DB_HPP
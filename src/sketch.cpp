@@ -0,0 +1,165 @@
+#include "sketch.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Sketches are serialized as text without newlines so they fit the line-based backup format
+void putHex(std::string& out, uint64_t value, size_t digits) {
+    static const char DIGITS[] = "0123456789abcdef";
+    for (size_t i = digits; i > 0; i--) {
+        out.push_back(DIGITS[(value >> (4 * (i - 1))) & 0xF]);
+    }
+}
+
+bool getHex(const char* data, size_t digits, uint64_t& value) {
+    value = 0;
+    for (size_t i = 0; i < digits; i++) {
+        char c = data[i];
+        int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (digit < 0) {
+            return false;
+        }
+        value = (value << 4) | static_cast<uint64_t>(digit);
+    }
+    return true;
+}
+
+uint32_t saturatingAdd(uint32_t counter, uint64_t count) {
+    uint64_t sum = static_cast<uint64_t>(counter) + count;
+    return sum < count || sum > std::numeric_limits<uint32_t>::max() ? std::numeric_limits<uint32_t>::max()
+                                                                         : static_cast<uint32_t>(sum);
+}
+
+} // namespace
+
+uint64_t sketchHash(const std::string& element) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (char c : element) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001B3ULL;
+    }
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    return hash ^ (hash >> 31);
+}
+
+bool HyperLogLog::add(const std::string& element) {
+    uint64_t hash = sketchHash(element);
+    size_t index = static_cast<size_t>(hash >> (64 - PRECISION));
+    
+    // Leading zeros of the remaining bits plus one; the guard bit caps it at 64 - PRECISION + 1
+    uint64_t remaining = (hash << PRECISION) | (uint64_t(1) << (PRECISION - 1));
+    uint8_t rank = static_cast<uint8_t>(__builtin_clzll(remaining) + 1);
+    if (rank <= registers_[index]) {
+        return false;
+    }
+    registers_[index] = rank;
+    return true;
+}
+
+uint64_t HyperLogLog::count() const {
+    double sum = 0;
+    size_t zeros = 0;
+    for (uint8_t rank : registers_) {
+        sum += std::ldexp(1.0, -rank);
+        zeros += rank == 0 ? 1 : 0;
+    }
+    
+    const double m = static_cast<double>(REGISTERS);
+    double estimate = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        // Linear counting is more accurate while many registers are empty
+        estimate = m * std::log(m / static_cast<double>(zeros));
+    }
+    return static_cast<uint64_t>(std::llround(estimate));
+}
+
+bool HyperLogLog::merge(const HyperLogLog& other) {
+    bool changed = false;
+    for (size_t i = 0; i < REGISTERS; i++) {
+        if (other.registers_[i] > registers_[i]) {
+            registers_[i] = other.registers_[i];
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void HyperLogLog::serialize(std::string& out) const {
+    out.reserve(out.size() + SERIALIZED_SIZE);
+    for (uint8_t rank : registers_) {
+        out.push_back(static_cast<char>(REGISTER_BASE + rank));
+    }
+}
+
+bool HyperLogLog::deserialize(const char* data, size_t size) {
+    if (size != SERIALIZED_SIZE) {
+        return false;
+    }
+    for (size_t i = 0; i < REGISTERS; i++) {
+        int rank = data[i] - REGISTER_BASE;
+        if (rank < 0 || rank > 64 - PRECISION + 1) {
+            return false;
+        }
+        registers_[i] = static_cast<uint8_t>(rank);
+    }
+    return true;
+}
+
+size_t CountMinSketch::column(uint64_t hash, size_t row) {
+    uint64_t first = hash & 0xFFFFFFFFULL;
+    uint64_t step = (hash >> 32) | 1;
+    return static_cast<size_t>((first + row * step) % WIDTH);
+}
+
+void CountMinSketch::add(const std::string& element, uint64_t count) {
+    uint64_t hash = sketchHash(element);
+    for (size_t row = 0; row < DEPTH; row++) {
+        uint32_t& counter = counters_[row * WIDTH + column(hash, row)];
+        counter = saturatingAdd(counter, count);
+    }
+    total_ += count;
+}
+
+uint64_t CountMinSketch::estimate(const std::string& element) const {
+    uint64_t hash = sketchHash(element);
+    uint32_t minimum = std::numeric_limits<uint32_t>::max();
+    for (size_t row = 0; row < DEPTH; row++) {
+        minimum = std::min(minimum, counters_[row * WIDTH + column(hash, row)]);
+    }
+    return minimum;
+}
+
+void CountMinSketch::merge(const CountMinSketch& other) {
+    for (size_t i = 0; i < counters_.size(); i++) {
+        counters_[i] = saturatingAdd(counters_[i], other.counters_[i]);
+    }
+    total_ += other.total_;
+}
+
+void CountMinSketch::serialize(std::string& out) const {
+    out.reserve(out.size() + SERIALIZED_SIZE);
+    putHex(out, total_, 16);
+    for (uint32_t counter : counters_) {
+        putHex(out, counter, 8);
+    }
+}
+
+bool CountMinSketch::deserialize(const char* data, size_t size) {
+    if (size != SERIALIZED_SIZE) {
+        return false;
+    }
+    if (!getHex(data, 16, total_)) {
+        return false;
+    }
+    for (size_t i = 0; i < counters_.size(); i++) {
+        uint64_t counter = 0;
+        if (!getHex(data + 16 + 8 * i, 8, counter)) {
+            return false;
+        }
+        counters_[i] = static_cast<uint32_t>(counter);
+    }
+    return true;
+}
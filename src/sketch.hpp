@@ -0,0 +1,116 @@
+#ifndef SKETCH_HPP
+#define SKETCH_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Stable 64-bit hash of a sketch element
+ *
+ * Sketches are persisted in backups and logs, so the hash must not depend
+ * on the standard library's std::hash (FNV-1a, finalized with SplitMix64).
+ */
+uint64_t sketchHash(const std::string& element);
+
+/**
+ * HyperLogLog distinct-element counter: 2^PRECISION one-byte registers
+ * (4 KB) with a standard error of 1.04 / sqrt(2^PRECISION), about 1.6%
+ */
+class HyperLogLog {
+public:
+    static constexpr int PRECISION = 12;
+    static constexpr size_t REGISTERS = size_t(1) << PRECISION;
+    static constexpr size_t SERIALIZED_SIZE = REGISTERS;
+    static constexpr char REGISTER_BASE = '0'; // Registers are serialized as printable characters
+
+private:
+    std::vector<uint8_t> registers_;
+
+public:
+    HyperLogLog() : registers_(REGISTERS, 0) {}
+    
+    /**
+     * Add an element
+     * @return true if a register changed, so the estimate may have changed
+     */
+    bool add(const std::string& element);
+    
+    /**
+     * Estimate the number of distinct elements added
+     */
+    uint64_t count() const;
+    
+    /**
+     * Merge another counter, so this one counts the union of both
+     * @return true if a register changed
+     */
+    bool merge(const HyperLogLog& other);
+    
+    /**
+     * Append the registers, one character each (SERIALIZED_SIZE bytes, no newlines)
+     */
+    void serialize(std::string& out) const;
+    
+    /**
+     * Load registers written by serialize
+     * @return false if size is not SERIALIZED_SIZE or a register is out of range
+     */
+    bool deserialize(const char* data, size_t size);
+};
+
+/**
+ * Count-min sketch of element frequencies: DEPTH rows of WIDTH saturating
+ * 32-bit counters (16 KB). An estimate never undercounts and overcounts by
+ * at most e / WIDTH (about 0.27%) of the total count with probability
+ * 1 - e^-DEPTH (about 98%).
+ */
+class CountMinSketch {
+public:
+    static constexpr size_t WIDTH = 1024;
+    static constexpr size_t DEPTH = 4;
+    static constexpr size_t SERIALIZED_SIZE = 16 + WIDTH * DEPTH * 8;
+
+private:
+    std::vector<uint32_t> counters_; // Row-major, DEPTH x WIDTH
+    uint64_t total_ = 0;             // Sum of all counts added
+    
+    /**
+     * Column of an element in each row (double hashing)
+     */
+    static size_t column(uint64_t hash, size_t row);
+
+public:
+    CountMinSketch() : counters_(WIDTH * DEPTH, 0) {}
+    
+    /**
+     * Add count occurrences of an element
+     */
+    void add(const std::string& element, uint64_t count);
+    
+    /**
+     * Estimate how often an element was added
+     */
+    uint64_t estimate(const std::string& element) const;
+    
+    /**
+     * Merge another sketch, so this one counts the occurrences of both
+     */
+    void merge(const CountMinSketch& other);
+    
+    uint64_t total() const { return total_; }
+    
+    /**
+     * Append the total and counters as fixed-width hex (SERIALIZED_SIZE bytes, no newlines)
+     */
+    void serialize(std::string& out) const;
+    
+    /**
+     * Load a sketch written by serialize
+     * @return false if size is not SERIALIZED_SIZE or a digit is not hex
+     */
+    bool deserialize(const char* data, size_t size);
+};
+
+#endif // SKETCH_HPP
@@ -0,0 +1,368 @@
+#include "snapshot_codec.hpp"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef IMDB_WITH_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef IMDB_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// In-tree LZ77 format, a sequence of operations:
+// 0LLLLLLL                   literal run of L+1 bytes (1-128) follows
+// 1LLLLLLL OFFSET_LO OFFSET_HI  copy L+4 bytes (4-131) from OFFSET bytes back
+const size_t LZ_MIN_MATCH = 4;
+const size_t LZ_MAX_MATCH = LZ_MIN_MATCH + 127;
+const size_t LZ_MAX_LITERALS = 128;
+const size_t LZ_MAX_OFFSET = 0xFFFF;
+const int LZ_HASH_BITS = 14;
+
+// Dictionary training: candidate segments of samples, scored by their 8-byte substrings
+const size_t TRAIN_SEGMENT_SIZE = 64;
+const size_t TRAIN_SEGMENT_STRIDE = 32;
+const size_t TRAIN_SUBSTRING_SIZE = 8;
+
+uint32_t read32(const std::string& data, size_t pos) {
+    uint32_t value;
+    std::memcpy(&value, data.data() + pos, sizeof(value));
+    return value;
+}
+
+void flushLiterals(const std::string& input, size_t begin, size_t end, std::string& output) {
+    while (begin < end) {
+        size_t length = std::min(end - begin, LZ_MAX_LITERALS);
+        output.push_back(static_cast<char>(length - 1));
+        output.append(input, begin, length);
+        begin += length;
+    }
+}
+
+uint32_t hashSequence(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * Compress window[start..] as a sequence of literals and back-references;
+ * matches may reach into window[0..start), the preset history
+ * @param table Hash table of the most recent position (+1, 0 = empty) of each
+ *              4-byte sequence, already holding the history's positions
+ */
+void compressWindow(const std::string& window, size_t start, std::vector<uint32_t>& table, std::string& output) {
+    size_t literalStart = start;
+    size_t pos = start;
+    
+    output.clear();
+    output.reserve((window.size() - start) / 2);
+    
+    while (pos + LZ_MIN_MATCH <= window.size()) {
+        uint32_t sequence = read32(window, pos);
+        uint32_t hash = hashSequence(sequence);
+        size_t candidate = table[hash];
+        table[hash] = static_cast<uint32_t>(pos + 1);
+        
+        if (candidate != 0 && pos - (candidate - 1) <= LZ_MAX_OFFSET && read32(window, candidate - 1) == sequence) {
+            size_t matchStart = candidate - 1;
+            size_t length = LZ_MIN_MATCH;
+            while (pos + length < window.size() && length < LZ_MAX_MATCH &&
+                   window[matchStart + length] == window[pos + length]) {
+                length++;
+            }
+            
+            flushLiterals(window, literalStart, pos, output);
+            size_t offset = pos - matchStart;
+            output.push_back(static_cast<char>(0x80 | (length - LZ_MIN_MATCH)));
+            output.push_back(static_cast<char>(offset & 0xFF));
+            output.push_back(static_cast<char>(offset >> 8));
+            
+            pos += length;
+            literalStart = pos;
+            continue;
+        }
+        
+        pos++;
+    }
+    
+    flushLiterals(window, literalStart, window.size(), output);
+}
+
+void compressInTree(const std::string& input, std::string& output) {
+    std::vector<uint32_t> table(size_t(1) << LZ_HASH_BITS, 0);
+    compressWindow(input, 0, table, output);
+}
+
+/**
+ * Decompress an in-tree stream; back-references reaching before the start
+ * of the output continue into the preset history
+ */
+bool decompressInTree(const char* data, size_t size, size_t rawSize, std::string& output,
+                      const std::string& history = std::string()) {
+    output.resize(rawSize);
+    char* out = &output[0];
+    size_t produced = 0;
+    size_t pos = 0;
+    
+    while (pos < size) {
+        unsigned char control = static_cast<unsigned char>(data[pos++]);
+        
+        if ((control & 0x80) == 0) {
+            size_t length = control + 1;
+            if (size - pos < length || rawSize - produced < length) return false;
+            std::memcpy(out + produced, data + pos, length);
+            produced += length;
+            pos += length;
+        } else {
+            size_t length = (control & 0x7F) + LZ_MIN_MATCH;
+            if (size - pos < 2) return false;
+            size_t offset = static_cast<unsigned char>(data[pos]) |
+                            (static_cast<size_t>(static_cast<unsigned char>(data[pos + 1])) << 8);
+            pos += 2;
+            if (offset == 0 || offset > produced + history.size() || rawSize - produced < length) {
+                return false;
+            }
+            
+            if (offset > produced) {
+                // The match starts in the history
+                size_t fromHistory = std::min(length, offset - produced);
+                std::memcpy(out + produced, history.data() + history.size() - (offset - produced), fromHistory);
+                produced += fromHistory;
+                length -= fromHistory;
+            }
+            if (offset >= length) {
+                std::memcpy(out + produced, out + produced - offset, length);
+                produced += length;
+            } else {
+                // Byte-wise copy: the source overlaps the bytes being produced
+                for (size_t i = 0; i < length; i++, produced++) {
+                    out[produced] = out[produced - offset];
+                }
+            }
+        }
+    }
+    
+    return produced == rawSize;
+}
+
+} // namespace
+
+bool isCodecAvailable(SnapshotCodec codec) {
+    switch (codec) {
+        case SnapshotCodec::None:
+        case SnapshotCodec::InTree:
+            return true;
+        case SnapshotCodec::LZ4:
+#ifdef IMDB_WITH_LZ4
+            return true;
+#else
+            return false;
+#endif
+        case SnapshotCodec::Zstd:
+#ifdef IMDB_WITH_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+bool compressBlock(SnapshotCodec codec, const std::string& input, std::string& output) {
+    switch (codec) {
+        case SnapshotCodec::None:
+            output = input;
+            return true;
+        case SnapshotCodec::InTree:
+            compressInTree(input, output);
+            return true;
+        case SnapshotCodec::LZ4: {
+#ifdef IMDB_WITH_LZ4
+            output.resize(LZ4_compressBound(static_cast<int>(input.size())));
+            int written = LZ4_compress_default(input.data(), &output[0], static_cast<int>(input.size()),
+                                               static_cast<int>(output.size()));
+            if (written <= 0) return false;
+            output.resize(written);
+            return true;
+#else
+            return false;
+#endif
+        }
+        case SnapshotCodec::Zstd: {
+#ifdef IMDB_WITH_ZSTD
+            output.resize(ZSTD_compressBound(input.size()));
+            size_t written = ZSTD_compress(&output[0], output.size(), input.data(), input.size(), 3);
+            if (ZSTD_isError(written)) return false;
+            output.resize(written);
+            return true;
+#else
+            return false;
+#endif
+        }
+    }
+    return false;
+}
+
+bool decompressBlock(SnapshotCodec codec, const char* data, size_t size, size_t rawSize, std::string& output) {
+    switch (codec) {
+        case SnapshotCodec::None:
+            if (size != rawSize) return false;
+            output.assign(data, size);
+            return true;
+        case SnapshotCodec::InTree:
+            return decompressInTree(data, size, rawSize, output);
+        case SnapshotCodec::LZ4: {
+#ifdef IMDB_WITH_LZ4
+            output.resize(rawSize);
+            int read = LZ4_decompress_safe(data, &output[0], static_cast<int>(size), static_cast<int>(rawSize));
+            return read >= 0 && static_cast<size_t>(read) == rawSize;
+#else
+            return false;
+#endif
+        }
+        case SnapshotCodec::Zstd: {
+#ifdef IMDB_WITH_ZSTD
+            output.resize(rawSize);
+            size_t read = ZSTD_decompress(&output[0], rawSize, data, size);
+            return !ZSTD_isError(read) && read == rawSize;
+#else
+            return false;
+#endif
+        }
+    }
+    return false;
+}
+
+uint32_t blockChecksum(const char* data, size_t size, uint32_t previous) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> crcTable(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+            }
+            crcTable[i] = crc;
+        }
+        return crcTable;
+    }();
+    
+    uint32_t crc = previous ^ 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+CompressionDictionary CompressionDictionary::train(const std::vector<std::string>& samples, size_t maxSize) {
+    maxSize = std::min(maxSize, MAX_SIZE);
+    auto substringAt = [](const std::string& sample, size_t pos) {
+        uint64_t value;
+        std::memcpy(&value, sample.data() + pos, sizeof(value));
+        return value;
+    };
+    
+    // Number of samples each substring occurs in
+    std::unordered_map<uint64_t, uint32_t> frequency;
+    std::unordered_set<uint64_t> seen;
+    for (const std::string& sample : samples) {
+        seen.clear();
+        for (size_t pos = 0; pos + TRAIN_SUBSTRING_SIZE <= sample.size(); pos++) {
+            seen.insert(substringAt(sample, pos));
+        }
+        for (uint64_t substring : seen) {
+            frequency[substring]++;
+        }
+    }
+    
+    struct Segment {
+        uint64_t score;
+        uint32_t sample;
+        uint32_t offset;
+        bool operator<(const Segment& other) const { return score < other.score; }
+    };
+    
+    // A segment is worth the substrings it shares with other samples that no chosen segment covers
+    auto scoreOf = [&](const Segment& segment) {
+        const std::string& sample = samples[segment.sample];
+        uint64_t score = 0;
+        for (size_t pos = segment.offset; pos + TRAIN_SUBSTRING_SIZE <= segment.offset + TRAIN_SEGMENT_SIZE; pos++) {
+            auto it = frequency.find(substringAt(sample, pos));
+            if (it != frequency.end() && it->second > 1) {
+                score += it->second;
+            }
+        }
+        return score;
+    };
+    
+    std::priority_queue<Segment> candidates;
+    for (size_t i = 0; i < samples.size(); i++) {
+        if (samples[i].size() < TRAIN_SEGMENT_SIZE) {
+            continue;
+        }
+        for (size_t offset = 0;; offset += TRAIN_SEGMENT_STRIDE) {
+            offset = std::min(offset, samples[i].size() - TRAIN_SEGMENT_SIZE);
+            Segment segment{0, static_cast<uint32_t>(i), static_cast<uint32_t>(offset)};
+            segment.score = scoreOf(segment);
+            if (segment.score > 0) {
+                candidates.push(segment);
+            }
+            if (offset == samples[i].size() - TRAIN_SEGMENT_SIZE) {
+                break;
+            }
+        }
+    }
+    
+    // Lazy greedy selection: scores only drop as segments are chosen, so a
+    // candidate whose refreshed score still leads the queue is the best one
+    std::vector<Segment> chosen;
+    while (!candidates.empty() && (chosen.size() + 1) * TRAIN_SEGMENT_SIZE <= maxSize) {
+        Segment segment = candidates.top();
+        candidates.pop();
+        segment.score = scoreOf(segment);
+        if (segment.score == 0) {
+            continue;
+        }
+        if (!candidates.empty() && segment.score < candidates.top().score) {
+            candidates.push(segment);
+            continue;
+        }
+        
+        chosen.push_back(segment);
+        const std::string& sample = samples[segment.sample];
+        for (size_t pos = segment.offset; pos + TRAIN_SUBSTRING_SIZE <= segment.offset + TRAIN_SEGMENT_SIZE; pos++) {
+            frequency.erase(substringAt(sample, pos));
+        }
+    }
+    
+    std::string content;
+    for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) {
+        content.append(samples[it->sample], it->offset, TRAIN_SEGMENT_SIZE);
+    }
+    return CompressionDictionary(content);
+}
+
+CompressionDictionary::CompressionDictionary(const std::string& content)
+    : content_(content.size() > MAX_SIZE ? content.substr(content.size() - MAX_SIZE) : content),
+      primedTable_(size_t(1) << LZ_HASH_BITS, 0) {
+    for (size_t pos = 0; pos + LZ_MIN_MATCH <= content_.size(); pos++) {
+        primedTable_[hashSequence(read32(content_, pos))] = static_cast<uint32_t>(pos + 1);
+    }
+}
+
+void CompressionDictionary::compress(const std::string& input, std::string& output) const {
+    thread_local std::string window;
+    thread_local std::vector<uint32_t> table;
+    window.assign(content_);
+    window.append(input);
+    table = primedTable_;
+    compressWindow(window, content_.size(), table, output);
+}
+
+bool CompressionDictionary::decompress(const char* data, size_t size, size_t rawSize, std::string& output) const {
+    return decompressInTree(data, size, rawSize, output, content_);
+}
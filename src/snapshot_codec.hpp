@@ -0,0 +1,112 @@
+#ifndef SNAPSHOT_CODEC_HPP
+#define SNAPSHOT_CODEC_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Block compression codecs for snapshots
+ *
+ * LZ4 and zstd are used when the build enables them (IMDB_WITH_LZ4,
+ * IMDB_WITH_ZSTD); the in-tree LZ77 codec is always available.
+ */
+enum class SnapshotCodec : uint32_t {
+    None = 0,
+    InTree = 1,
+    LZ4 = 2,
+    Zstd = 3
+};
+
+/**
+ * Check whether a codec was compiled into this build
+ * @param codec Codec to check
+ * @return true if blocks can be compressed and decompressed with the codec
+ */
+bool isCodecAvailable(SnapshotCodec codec);
+
+/**
+ * Compress a block of data
+ * @param codec Codec to use (must be available)
+ * @param input Raw block data
+ * @param output Receives the compressed data
+ * @return true if the block was compressed, false if the codec failed or is unavailable
+ */
+bool compressBlock(SnapshotCodec codec, const std::string& input, std::string& output);
+
+/**
+ * Decompress a block of data
+ * @param codec Codec the block was compressed with
+ * @param data Compressed data
+ * @param size Size of the compressed data
+ * @param rawSize Expected size of the decompressed data
+ * @param output Receives the decompressed data
+ * @return true if the block decompressed to exactly rawSize bytes
+ */
+bool decompressBlock(SnapshotCodec codec, const char* data, size_t size, size_t rawSize, std::string& output);
+
+/**
+ * Compute the CRC-32 checksum of a block
+ * @param data Block data
+ * @param size Size of the block data
+ * @param previous Checksum of the bytes preceding data, to checksum non-contiguous ranges as one
+ * @return CRC-32 (IEEE) of the data
+ */
+uint32_t blockChecksum(const char* data, size_t size, uint32_t previous = 0);
+
+/**
+ * Preset dictionary for the in-tree codec
+ *
+ * Values of a few KB compressed one at a time lose most of the redundancy
+ * they share with each other (keys of a JSON schema, common phrases). A
+ * dictionary built from sample values serves as history every value can
+ * reference. Training keeps the sample segments whose 8-byte substrings
+ * occur in the most samples, placing the most useful ones last, closest
+ * to the data.
+ */
+class CompressionDictionary {
+private:
+    std::string content_;
+    std::vector<uint32_t> primedTable_; // Match table already holding the dictionary's positions
+
+public:
+    // Back-references are 16-bit, so the dictionary must leave room for the value itself
+    static constexpr size_t MAX_SIZE = 32 * 1024;
+    
+    /**
+     * Build a dictionary from sample values
+     * @param samples Representative values
+     * @param maxSize Dictionary size limit (at most MAX_SIZE)
+     * @return The dictionary; empty if the samples share nothing
+     */
+    static CompressionDictionary train(const std::vector<std::string>& samples, size_t maxSize = 16 * 1024);
+    
+    /**
+     * Constructor
+     * @param content Dictionary bytes (truncated to the last MAX_SIZE bytes)
+     */
+    explicit CompressionDictionary(const std::string& content = std::string());
+    
+    const std::string& content() const { return content_; }
+    size_t size() const { return content_.size(); }
+    
+    /**
+     * Compress data with the in-tree codec, referencing the dictionary
+     * @param input Raw data
+     * @param output Receives the compressed data
+     */
+    void compress(const std::string& input, std::string& output) const;
+    
+    /**
+     * Decompress data compressed with this dictionary
+     * @param data Compressed data
+     * @param size Size of the compressed data
+     * @param rawSize Expected size of the decompressed data
+     * @param output Receives the decompressed data
+     * @return true if the data decompressed to exactly rawSize bytes
+     */
+    bool decompress(const char* data, size_t size, size_t rawSize, std::string& output) const;
+};
+
+#endif // SNAPSHOT_CODEC_HPP
@@ -0,0 +1,87 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+/**
+ * Bounded lock-free queue for exactly one producer and one consumer thread
+ *
+ * A ring of power-of-two capacity. Producer and consumer positions sit on
+ * separate cache lines, and each side caches the other's position so it
+ * only reads the shared one when the queue looks full (or empty).
+ */
+template <typename T>
+class SpscQueue {
+private:
+    static constexpr size_t CACHE_LINE = 64;
+    
+    alignas(CACHE_LINE) std::atomic<size_t> head_{0}; // Next slot to pop (written by the consumer)
+    size_t cachedTail_ = 0;                             // Consumer's copy of tail_
+    
+    alignas(CACHE_LINE) std::atomic<size_t> tail_{0}; // Next slot to push (written by the producer)
+    size_t cachedHead_ = 0;                             // Producer's copy of head_
+    
+    alignas(CACHE_LINE) std::unique_ptr<T[]> slots_;
+    size_t mask_;
+
+public:
+    /**
+     * @param capacity Slots in the ring, rounded up to a power of two
+     */
+    explicit SpscQueue(size_t capacity) {
+        size_t rounded = 1;
+        while (rounded < capacity) {
+            rounded *= 2;
+        }
+        slots_.reset(new T[rounded]);
+        mask_ = rounded - 1;
+    }
+    
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    
+    /**
+     * Append a value (producer only)
+     * @return false if the queue is full
+     */
+    bool tryPush(const T& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cachedHead_ > mask_) {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            if (tail - cachedHead_ > mask_) {
+                return false;
+            }
+        }
+        slots_[tail & mask_] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+    
+    /**
+     * Remove the oldest value (consumer only)
+     * @return false if the queue is empty
+     */
+    bool tryPop(T& value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cachedTail_) {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            if (head == cachedTail_) {
+                return false;
+            }
+        }
+        value = slots_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    
+    /**
+     * Check for queued values from any thread; exact only for the consumer
+     */
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+};
+
+#endif // SPSC_QUEUE_HPP
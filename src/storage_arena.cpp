@@ -0,0 +1,253 @@
+#include "storage_arena.hpp"
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <vector>
+#include <sys/mman.h>
+
+namespace {
+
+const size_t CHUNK_SIZE = size_t(2) << 20;
+
+// Blocks up to MAX_SMALL_BLOCK bytes come from size classes 16 bytes apart
+const size_t SIZE_CLASS_STEP = 16;
+const size_t MAX_SMALL_BLOCK = 1024;
+const size_t SIZE_CLASS_COUNT = MAX_SMALL_BLOCK / SIZE_CLASS_STEP;
+
+// Blocks from one chunk up take whole chunks, rounded up, so the unused tail is
+// smaller than the block. Sizes in between are rare (mid-sized bucket arrays) and
+// would leave most of a chunk unused, so they stay on the regular heap.
+const size_t MIN_CHUNK_BLOCK = CHUNK_SIZE;
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+// Hot-path state, constant-initialized so it is valid before any static constructor runs
+std::atomic<int> activeMode{static_cast<int>(HugePageMode::Off)};
+std::atomic<uintptr_t> rangeBegin{0};
+std::atomic<uintptr_t> rangeEnd{0};
+
+/**
+ * Arena state shared by all threads, guarded by mutex
+ */
+struct SharedState {
+    std::mutex mutex;
+    char* base = nullptr;
+    size_t chunkLimit = 0;
+    size_t committedChunks = 0;
+    
+    // Freed multi-chunk blocks by chunk count
+    std::map<size_t, std::vector<char*>> freeRuns;
+    
+    // Free lists and unused chunk tails handed back by exited threads
+    FreeBlock* freeLists[SIZE_CLASS_COUNT] = {};
+    std::vector<std::pair<char*, char*>> partialChunks;
+    
+    StorageArena::Stats stats;
+};
+
+SharedState& shared() {
+    static SharedState* state = new SharedState(); // Never destroyed: blocks may be freed during exit
+    return *state;
+}
+
+/**
+ * Commit chunks at the end of the reservation; caller holds the mutex
+ * @return The chunks, or nullptr if the reservation is exhausted
+ */
+char* commitChunks(SharedState& state, size_t count) {
+    if (state.base == nullptr || state.committedChunks + count > state.chunkLimit) {
+        return nullptr;
+    }
+    char* start = state.base + state.committedChunks * CHUNK_SIZE;
+    size_t length = count * CHUNK_SIZE;
+    
+#ifdef MAP_HUGETLB
+    if (static_cast<HugePageMode>(activeMode.load()) == HugePageMode::HugeTLB &&
+        ::mmap(start, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0) ==
+            start) {
+        state.committedChunks += count;
+        state.stats.hugeTlbChunks += count;
+        state.stats.committedBytes += length;
+        return start;
+    }
+#endif
+    
+    // Replace whatever a failed hugetlb attempt left behind with regular pages
+    if (::mmap(start, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != start) {
+        return nullptr;
+    }
+#ifdef MADV_HUGEPAGE
+    if (::madvise(start, length, MADV_HUGEPAGE) == 0) {
+        state.stats.transparentChunks += count;
+    }
+#endif
+    state.committedChunks += count;
+    state.stats.committedBytes += length;
+    return start;
+}
+
+/**
+ * Per-thread size-class free lists and the chunk small blocks are carved from
+ */
+struct ThreadCache {
+    FreeBlock* freeLists[SIZE_CLASS_COUNT] = {};
+    char* carvePos = nullptr;
+    char* carveEnd = nullptr;
+    
+    ~ThreadCache() {
+        SharedState& state = shared();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (size_t sizeClass = 0; sizeClass < SIZE_CLASS_COUNT; sizeClass++) {
+            while (freeLists[sizeClass] != nullptr) {
+                FreeBlock* block = freeLists[sizeClass];
+                freeLists[sizeClass] = block->next;
+                block->next = state.freeLists[sizeClass];
+                state.freeLists[sizeClass] = block;
+            }
+        }
+        if (carvePos != carveEnd) {
+            state.partialChunks.emplace_back(carvePos, carveEnd);
+        }
+    }
+    
+    /**
+     * Get a block when the local free list is empty
+     * @return The block, or nullptr if the arena is exhausted
+     */
+    void* refill(size_t sizeClass, size_t blockSize) {
+        if (static_cast<size_t>(carveEnd - carvePos) < blockSize) {
+            SharedState& state = shared();
+            std::lock_guard<std::mutex> lock(state.mutex);
+            
+            // Adopt blocks left by exited threads first
+            if (state.freeLists[sizeClass] != nullptr) {
+                freeLists[sizeClass] = state.freeLists[sizeClass];
+                state.freeLists[sizeClass] = nullptr;
+                FreeBlock* block = freeLists[sizeClass];
+                freeLists[sizeClass] = block->next;
+                return block;
+            }
+            
+            // Continue in a chunk tail left by an exited thread or a fresh chunk; a tail too
+            // small for this class is dropped
+            while (static_cast<size_t>(carveEnd - carvePos) < blockSize) {
+                if (!state.partialChunks.empty()) {
+                    carvePos = state.partialChunks.back().first;
+                    carveEnd = state.partialChunks.back().second;
+                    state.partialChunks.pop_back();
+                    continue;
+                }
+                
+                char* chunk = commitChunks(state, 1);
+                if (chunk == nullptr) {
+                    return nullptr;
+                }
+                carvePos = chunk;
+                carveEnd = chunk + CHUNK_SIZE;
+            }
+        }
+        
+        void* block = carvePos;
+        carvePos += blockSize;
+        return block;
+    }
+};
+
+thread_local ThreadCache threadCache;
+
+} // namespace
+
+bool StorageArena::enable(HugePageMode mode, size_t reserveBytes) {
+    SharedState& state = shared();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    
+    if (mode != HugePageMode::Off && state.base == nullptr) {
+        // Reserve address space only; chunks are committed as they are needed
+        size_t chunks = (reserveBytes + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        size_t length = (chunks + 1) * CHUNK_SIZE;
+        void* reserved = ::mmap(nullptr, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (reserved == MAP_FAILED) {
+            return false;
+        }
+        
+        // Align to 2 MB so every chunk can be backed by a single huge page
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(reserved) + CHUNK_SIZE - 1) & ~(CHUNK_SIZE - 1);
+        state.base = reinterpret_cast<char*>(aligned);
+        state.chunkLimit = chunks;
+        state.stats.reservedBytes = chunks * CHUNK_SIZE;
+        rangeBegin.store(aligned);
+        rangeEnd.store(aligned + chunks * CHUNK_SIZE);
+    }
+    
+    activeMode.store(static_cast<int>(mode));
+    return true;
+}
+
+HugePageMode StorageArena::mode() {
+    return static_cast<HugePageMode>(activeMode.load());
+}
+
+void* StorageArena::allocate(size_t bytes) {
+    if (activeMode.load(std::memory_order_relaxed) == static_cast<int>(HugePageMode::Off) || bytes == 0 ||
+        (bytes > MAX_SMALL_BLOCK && bytes < MIN_CHUNK_BLOCK)) {
+        return ::operator new(bytes);
+    }
+    
+    void* block = nullptr;
+    if (bytes <= MAX_SMALL_BLOCK) {
+        size_t sizeClass = (bytes - 1) / SIZE_CLASS_STEP;
+        FreeBlock*& freeList = threadCache.freeLists[sizeClass];
+        if (freeList != nullptr) {
+            block = freeList;
+            freeList = freeList->next;
+        } else {
+            block = threadCache.refill(sizeClass, (sizeClass + 1) * SIZE_CLASS_STEP);
+        }
+    } else {
+        size_t chunks = (bytes + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        SharedState& state = shared();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        
+        auto runs = state.freeRuns.find(chunks);
+        if (runs != state.freeRuns.end() && !runs->second.empty()) {
+            block = runs->second.back();
+            runs->second.pop_back();
+        } else {
+            block = commitChunks(state, chunks);
+        }
+    }
+    
+    // Arena exhausted: fall back to the heap (deallocate() tells blocks apart by address)
+    return block != nullptr ? block : ::operator new(bytes);
+}
+
+void StorageArena::deallocate(void* block, size_t bytes) noexcept {
+    if (!owns(block)) {
+        ::operator delete(block);
+        return;
+    }
+    
+    if (bytes <= MAX_SMALL_BLOCK) {
+        FreeBlock* freed = static_cast<FreeBlock*>(block);
+        FreeBlock*& freeList = threadCache.freeLists[(bytes - 1) / SIZE_CLASS_STEP];
+        freed->next = freeList;
+        freeList = freed;
+    } else {
+        SharedState& state = shared();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.freeRuns[(bytes + CHUNK_SIZE - 1) / CHUNK_SIZE].push_back(static_cast<char*>(block));
+    }
+}
+
+bool StorageArena::owns(const void* block) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(block);
+    return address >= rangeBegin.load(std::memory_order_relaxed) && address < rangeEnd.load(std::memory_order_relaxed);
+}
+
+StorageArena::Stats StorageArena::stats() {
+    SharedState& state = shared();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.stats;
+}
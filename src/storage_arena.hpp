@@ -0,0 +1,110 @@
+#ifndef STORAGE_ARENA_HPP
+#define STORAGE_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+/**
+ * Page backing for record storage
+ */
+enum class HugePageMode {
+    Off,          // Regular heap allocations
+    Transparent,  // Arena chunks madvise'd for transparent huge pages
+    HugeTLB       // Arena chunks from the hugetlbfs pool, falling back to Transparent
+};
+
+/**
+ * Process-wide arena backing the record tables with 2 MB pages
+ *
+ * Large tables make TLB misses a big part of lookup latency; serving the
+ * record and field hash tables (nodes and bucket arrays) from 2 MB pages
+ * cuts the number of TLB entries they need by 512x.
+ *
+ * The arena reserves one contiguous, 2 MB-aligned range of address space
+ * up front and commits it chunk by chunk. Small blocks are carved from
+ * chunks into per-thread size-class free lists; blocks of 2 MB or more take
+ * whole chunks, and sizes in between stay on the regular heap. Memory is
+ * reused but not returned to the system.
+ *
+ * The mode may change at any time: a block is returned to whichever
+ * allocator it came from, decided by address.
+ */
+class StorageArena {
+public:
+    /**
+     * Mapping statistics
+     */
+    struct Stats {
+        size_t reservedBytes = 0;
+        size_t committedBytes = 0;
+        size_t hugeTlbChunks = 0;     // Chunks backed by the hugetlbfs pool
+        size_t transparentChunks = 0; // Chunks madvise'd for transparent huge pages
+    };
+    
+    /**
+     * Select the backing of subsequent storage allocations
+     * @param mode Page backing
+     * @param reserveBytes Address space to reserve on first use (not committed until used)
+     * @return true if the mode is active; false if the address space could not be reserved
+     */
+    static bool enable(HugePageMode mode, size_t reserveBytes = size_t(256) << 30);
+    
+    /**
+     * Current page backing
+     */
+    static HugePageMode mode();
+    
+    /**
+     * Allocate storage
+     * @param bytes Block size
+     * @return Block aligned to 16 bytes; throws std::bad_alloc when out of memory
+     */
+    static void* allocate(size_t bytes);
+    
+    /**
+     * Free storage
+     * @param block Block returned by allocate()
+     * @param bytes Size passed to allocate()
+     */
+    static void deallocate(void* block, size_t bytes) noexcept;
+    
+    /**
+     * Check if a block was allocated from the arena
+     */
+    static bool owns(const void* block);
+    
+    /**
+     * Current mapping statistics
+     */
+    static Stats stats();
+};
+
+/**
+ * Stateless allocator routing container storage through StorageArena
+ */
+template <typename T>
+struct StorageAllocator {
+    using value_type = T;
+    
+    StorageAllocator() noexcept = default;
+    
+    template <typename U>
+    StorageAllocator(const StorageAllocator<U>&) noexcept {}
+    
+    T* allocate(size_t count) {
+        return static_cast<T*>(StorageArena::allocate(count * sizeof(T)));
+    }
+    
+    void deallocate(T* block, size_t count) noexcept {
+        StorageArena::deallocate(block, count * sizeof(T));
+    }
+    
+    template <typename U>
+    bool operator==(const StorageAllocator<U>&) const noexcept { return true; }
+    
+    template <typename U>
+    bool operator!=(const StorageAllocator<U>&) const noexcept { return false; }
+};
+
+#endif // STORAGE_ARENA_HPP
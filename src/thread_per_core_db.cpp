@@ -0,0 +1,404 @@
+#include "thread_per_core_db.hpp"
+#include "sharded_db.hpp"
+#include "numa_util.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// Empty polls before an idle core parks
+const int IDLE_SPINS = 256;
+
+} // namespace
+
+thread_local ThreadPerCoreDB::ThreadRegistrations ThreadPerCoreDB::registrations_;
+
+ThreadPerCoreDB::ThreadRegistrations::~ThreadRegistrations() {
+    // Every call waits for its messages, so the released slot's queues are empty
+    for (const auto& registration : slots) {
+        registration.first->taken[registration.second].store(false, std::memory_order_release);
+    }
+}
+
+ThreadPerCoreDB::ThreadPerCoreDB(size_t coreCount, bool pinThreads) : slotTable_(std::make_shared<SlotTable>()) {
+    if (coreCount == 0) {
+        coreCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<int> cpus;
+    if (pinThreads) {
+        for (int node : numa::nodes()) {
+            std::vector<int> nodeCpus = numa::cpusOfNode(node);
+            cpus.insert(cpus.end(), nodeCpus.begin(), nodeCpus.end());
+        }
+    }
+    
+    for (size_t i = 0; i < coreCount; i++) {
+        cores_.push_back(std::make_unique<Core>());
+        cores_.back()->cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+    }
+    for (size_t i = 0; i < coreCount; i++) {
+        cores_[i]->owner = std::thread([this, i]() { run(i); });
+    }
+}
+
+ThreadPerCoreDB::~ThreadPerCoreDB() {
+    stopping_.store(true, std::memory_order_seq_cst);
+    for (auto& core : cores_) {
+        std::lock_guard<std::mutex> lock(core->parkMutex);
+        core->parked.notify_one();
+    }
+    for (auto& core : cores_) {
+        core->owner.join();
+    }
+}
+
+void ThreadPerCoreDB::run(size_t index) {
+    Core& core = *cores_[index];
+    if (core.cpu >= 0) {
+        numa::bindCurrentThreadToCpu(core.cpu);
+    }
+    
+    int idle = 0;
+    while (true) {
+        if (drain(index) > 0) {
+            idle = 0;
+            continue;
+        }
+        if (stopping_.load(std::memory_order_acquire) && !hasPending(index)) {
+            return;
+        }
+        if (++idle < IDLE_SPINS) {
+            std::this_thread::yield();
+            continue;
+        }
+        
+        // Park; a submitter that sees sleeping after queuing takes the lock to notify,
+        // so a message queued after the check below cannot be missed
+        std::unique_lock<std::mutex> lock(core.parkMutex);
+        core.sleeping.store(true, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        core.parked.wait(lock, [&]() { return hasPending(index) || stopping_.load(std::memory_order_acquire); });
+        core.sleeping.store(false, std::memory_order_relaxed);
+        idle = 0;
+    }
+}
+
+size_t ThreadPerCoreDB::drain(size_t index) {
+    Core& core = *cores_[index];
+    size_t ran = 0;
+    size_t submitterCount = slotTable_->used.load(std::memory_order_acquire);
+    for (size_t i = 0; i < submitterCount; i++) {
+        SpscQueue<Message*>& queue = *submitters_[i]->queues[index];
+        Message* message;
+        while (queue.tryPop(message)) {
+            message->run(core.db);
+            message->done.store(true, std::memory_order_release); // The submitter may free it from here on
+            ran++;
+        }
+    }
+    
+    if (core.hasOverflow.load(std::memory_order_acquire)) {
+        std::vector<Message*> overflow;
+        {
+            std::lock_guard<std::mutex> lock(core.overflowMutex);
+            overflow.swap(core.overflow);
+            core.hasOverflow.store(false, std::memory_order_relaxed);
+        }
+        for (Message* message : overflow) {
+            message->run(core.db);
+            message->done.store(true, std::memory_order_release);
+            ran++;
+        }
+    }
+    return ran;
+}
+
+bool ThreadPerCoreDB::hasPending(size_t index) const {
+    if (cores_[index]->hasOverflow.load(std::memory_order_acquire)) {
+        return true;
+    }
+    size_t submitterCount = slotTable_->used.load(std::memory_order_acquire);
+    for (size_t i = 0; i < submitterCount; i++) {
+        if (!submitters_[i]->queues[index]->empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ThreadPerCoreDB::Submitter* ThreadPerCoreDB::submitter() const {
+    std::vector<std::pair<std::shared_ptr<SlotTable>, size_t>>& slots = registrations_.slots;
+    for (const auto& registration : slots) {
+        if (registration.first == slotTable_) {
+            return submitters_[registration.second].get();
+        }
+    }
+    
+    // Forget engines that no longer exist before registering with this one
+    slots.erase(std::remove_if(slots.begin(), slots.end(),
+                               [](const auto& registration) { return registration.first.use_count() == 1; }),
+                slots.end());
+    
+    // Slots are released without the lock, but only taken and published under it, so every
+    // index below used has its queues before a core polls them
+    std::lock_guard<std::mutex> lock(registerMutex_);
+    SlotTable& table = *slotTable_;
+    for (size_t index = 0; index < MAX_SUBMITTERS; index++) {
+        bool expected = false;
+        if (table.taken[index].load(std::memory_order_relaxed) ||
+            !table.taken[index].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            continue;
+        }
+        if (!submitters_[index]) {
+            auto created = std::make_unique<Submitter>();
+            for (size_t i = 0; i < cores_.size(); i++) {
+                created->queues.push_back(std::make_unique<SpscQueue<Message*>>(QUEUE_CAPACITY));
+            }
+            submitters_[index] = std::move(created);
+        }
+        if (table.used.load(std::memory_order_relaxed) <= index) {
+            table.used.store(index + 1, std::memory_order_release); // Publishes the queues to the cores
+        }
+        slots.emplace_back(slotTable_, index);
+        return submitters_[index].get();
+    }
+    return nullptr; // Not registered, so a slot freed later can still be taken
+}
+
+void ThreadPerCoreDB::send(size_t index, Message& message) const {
+    Core& core = *cores_[index];
+    Submitter* own = submitter();
+    if (own) {
+        while (!own->queues[index]->tryPush(&message)) {
+            std::this_thread::yield(); // Full: the core is behind on this submitter's messages
+        }
+    } else {
+        std::lock_guard<std::mutex> lock(core.overflowMutex);
+        core.overflow.push_back(&message);
+        core.hasOverflow.store(true, std::memory_order_release);
+    }
+    
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (core.sleeping.load(std::memory_order_seq_cst)) {
+        std::lock_guard<std::mutex> lock(core.parkMutex);
+        core.parked.notify_one();
+    }
+}
+
+void ThreadPerCoreDB::wait(const Message& message) {
+    for (int spins = 0; !message.done.load(std::memory_order_acquire); spins++) {
+        if (spins >= 64) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+template <typename Result>
+Result ThreadPerCoreDB::call(size_t core, const std::function<Result(InMemoryDBImpl&)>& request) const {
+    std::optional<Result> result;
+    Message message;
+    message.run = [&](InMemoryDBImpl& db) { result = request(db); };
+    send(core, message);
+    wait(message);
+    return std::move(*result);
+}
+
+template <typename Result>
+std::vector<Result> ThreadPerCoreDB::callAll(const std::function<Result(InMemoryDBImpl&)>& request) const {
+    std::vector<std::optional<Result>> results(cores_.size());
+    std::vector<Message> messages(cores_.size());
+    for (size_t i = 0; i < cores_.size(); i++) {
+        messages[i].run = [&, i](InMemoryDBImpl& db) { results[i] = request(db); };
+        send(i, messages[i]);
+    }
+    
+    std::vector<Result> collected;
+    collected.reserve(cores_.size());
+    for (size_t i = 0; i < cores_.size(); i++) {
+        wait(messages[i]);
+        collected.push_back(std::move(*results[i]));
+    }
+    return collected;
+}
+
+ThreadPerCoreDB::Batch::Batch(const ThreadPerCoreDB& db) : db_(db), operations_(db.coreCount()) {}
+
+void ThreadPerCoreDB::Batch::reopen() {
+    if (submitted_) {
+        results_.clear();
+        submitted_ = false;
+    }
+}
+
+void ThreadPerCoreDB::Batch::set(const std::string& recordId, const std::string& field, const std::string& value) {
+    reopen();
+    operations_[db_.coreOf(recordId)].push_back([recordId, field, value](InMemoryDBImpl& db) {
+        db.set(recordId, field, value);
+    });
+}
+
+size_t ThreadPerCoreDB::Batch::get(const std::string& recordId, const std::string& field) {
+    reopen();
+    size_t index = results_.size();
+    results_.emplace_back();
+    operations_[db_.coreOf(recordId)].push_back([this, index, recordId, field](InMemoryDBImpl& db) {
+        results_[index] = db.get(recordId, field);
+    });
+    return index;
+}
+
+void ThreadPerCoreDB::Batch::submit() {
+    std::vector<Message> messages(operations_.size());
+    for (size_t core = 0; core < operations_.size(); core++) {
+        if (operations_[core].empty()) {
+            messages[core].done = true;
+            continue;
+        }
+        auto& operations = operations_[core];
+        messages[core].run = [&operations](InMemoryDBImpl& db) {
+            for (auto& operation : operations) {
+                operation(db);
+            }
+        };
+        db_.send(core, messages[core]);
+    }
+    for (size_t core = 0; core < operations_.size(); core++) {
+        wait(messages[core]);
+        operations_[core].clear();
+    }
+    submitted_ = true;
+}
+
+// Level 1: Basic operations
+void ThreadPerCoreDB::set(const std::string& recordId, const std::string& field, const std::string& value) {
+    call<bool>(coreOf(recordId), [&](InMemoryDBImpl& db) {
+        db.set(recordId, field, value);
+        return true;
+    });
+}
+
+std::optional<std::string> ThreadPerCoreDB::get(const std::string& recordId, const std::string& field) const {
+    return call<std::optional<std::string>>(coreOf(recordId), [&](InMemoryDBImpl& db) {
+        return db.get(recordId, field);
+    });
+}
+
+bool ThreadPerCoreDB::deleteField(const std::string& recordId, const std::string& field) {
+    return call<bool>(coreOf(recordId), [&](InMemoryDBImpl& db) { return db.deleteField(recordId, field); });
+}
+
+bool ThreadPerCoreDB::deleteRecord(const std::string& recordId) {
+    return call<bool>(coreOf(recordId), [&](InMemoryDBImpl& db) { return db.deleteRecord(recordId); });
+}
+
+std::vector<std::string> ThreadPerCoreDB::getFields(const std::string& recordId) const {
+    return call<std::vector<std::string>>(coreOf(recordId), [&](InMemoryDBImpl& db) {
+        return db.getFields(recordId);
+    });
+}
+
+bool ThreadPerCoreDB::hasRecord(const std::string& recordId) const {
+    return call<bool>(coreOf(recordId), [&](InMemoryDBImpl& db) { return db.hasRecord(recordId); });
+}
+
+std::vector<std::string> ThreadPerCoreDB::getAllRecordIds() const {
+    return ShardedInMemoryDB::mergeSortedIds(callAll<std::vector<std::string>>([](InMemoryDBImpl& db) {
+        return db.getAllRecordIds();
+    }));
+}
+
+// Level 2: Filtering
+std::vector<std::string> ThreadPerCoreDB::getRecordsByFieldValue(const std::string& field,
+                                                                 const std::string& value) const {
+    return ShardedInMemoryDB::mergeSortedIds(callAll<std::vector<std::string>>([&](InMemoryDBImpl& db) {
+        return db.getRecordsByFieldValue(field, value);
+    }));
+}
+
+// Level 3: TTL
+void ThreadPerCoreDB::setTTL(const std::string& recordId, int ttlSeconds) {
+    call<bool>(coreOf(recordId), [&](InMemoryDBImpl& db) {
+        db.setTTL(recordId, ttlSeconds);
+        return true;
+    });
+}
+
+int ThreadPerCoreDB::expireRecords() {
+    int expired = 0;
+    for (int count : callAll<int>([](InMemoryDBImpl& db) { return db.expireRecords(); })) {
+        expired += count;
+    }
+    return expired;
+}
+
+// Level 4: Backup and restore
+std::string ThreadPerCoreDB::backup() const {
+    return ShardedInMemoryDB::mergeBackups(callAll<std::string>([](InMemoryDBImpl& db) { return db.backup(); }));
+}
+
+bool ThreadPerCoreDB::restore(const std::string& backupData) {
+    InMemoryDBImpl::Dataset full;
+    if (!InMemoryDBImpl::prepareRestore(backupData, full)) {
+        return false;
+    }
+    
+    // Partition in one pass; each owner then copies its own partition, so partition
+    // memory is allocated by its own thread
+    std::vector<std::vector<const InMemoryDBImpl::RecordMap::value_type*>> partitions(cores_.size());
+    for (const auto& record : full.records) {
+        partitions[coreOf(record.first)].push_back(&record);
+    }
+    
+    std::vector<Message> messages(cores_.size());
+    for (size_t core = 0; core < cores_.size(); core++) {
+        const auto& records = partitions[core];
+        messages[core].run = [&full, &records](InMemoryDBImpl& db) {
+            InMemoryDBImpl::Dataset partition;
+            partition.records.reserve(records.size());
+            for (const auto* record : records) {
+                partition.records.insert(*record);
+                auto ttlIt = full.ttlMap.find(record->first);
+                if (ttlIt != full.ttlMap.end()) {
+                    partition.ttlMap.insert(*ttlIt);
+                }
+            }
+            db.commitRestore(partition);
+        };
+        send(core, messages[core]);
+    }
+    for (const Message& message : messages) {
+        wait(message);
+    }
+    return true;
+}
+
+size_t ThreadPerCoreDB::coreCount() const {
+    return cores_.size();
+}
+
+size_t ThreadPerCoreDB::coreOf(const std::string& recordId) const {
+    return std::hash<std::string>()(recordId) % cores_.size();
+}
+
+int ThreadPerCoreDB::coreCpu(size_t core) const {
+    return cores_[core]->cpu;
+}
+
+void ThreadPerCoreDB::execute(size_t core, const std::function<void(InMemoryDBImpl&)>& batch) {
+    call<bool>(core, [&](InMemoryDBImpl& db) {
+        batch(db);
+        return true;
+    });
+}
+
+size_t ThreadPerCoreDB::getRecordCount() const {
+    size_t count = 0;
+    for (size_t coreRecords : callAll<size_t>([](InMemoryDBImpl& db) { return db.getRecordCount(); })) {
+        count += coreRecords;
+    }
+    return count;
+}
+
+size_t ThreadPerCoreDB::submittersScanned() const {
+    return slotTable_->used.load(std::memory_order_relaxed);
+}
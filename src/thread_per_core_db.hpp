@@ -0,0 +1,263 @@
+#ifndef THREAD_PER_CORE_DB_HPP
+#define THREAD_PER_CORE_DB_HPP
+
+#include "in_memory_db_imp.hpp"
+#include "spsc_queue.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <optional>
+
+/**
+ * Shared-nothing database with one owner thread per core
+ *
+ * Each core owns a partition of the record IDs and is the only thread that
+ * touches it, pinned to its CPU. Other threads never take a lock to reach
+ * a partition: every submitting thread gets its own single-producer,
+ * single-consumer queue to each core, and the cores poll those queues.
+ * A submitter waits for its results by spinning on a flag in its own
+ * message. Idle cores park after a short spin, so submitters only touch
+ * a lock to wake one.
+ *
+ * Unlike ShardedInMemoryDB, whose shards are fed through one locked queue
+ * each, no two submitters contend on a queue. A Batch sends many
+ * operations to a core as one message.
+ */
+class ThreadPerCoreDB : public InMemoryDB {
+public:
+    /**
+     * Threads submitting beyond this many at once share one locked queue per core
+     */
+    static constexpr size_t MAX_SUBMITTERS = 64;
+    
+    /**
+     * Messages a submitter can have queued to one core before it waits for room
+     */
+    static constexpr size_t QUEUE_CAPACITY = 256;
+
+private:
+    /**
+     * Work sent to a core; lives in the submitter's frame until done is set
+     */
+    struct Message {
+        std::function<void(InMemoryDBImpl&)> run;
+        std::atomic<bool> done{false};
+    };
+    
+    /**
+     * One core: its partition, owner thread and parking state
+     */
+    struct Core {
+        int cpu = -1;
+        InMemoryDBImpl db;
+        
+        std::mutex parkMutex;
+        std::condition_variable parked;
+        std::atomic<bool> sleeping{false};
+        
+        // Fallback for submitters past MAX_SUBMITTERS
+        std::mutex overflowMutex;
+        std::vector<Message*> overflow;
+        std::atomic<bool> hasOverflow{false};
+        
+        std::thread owner;
+    };
+    
+    /**
+     * A submitting thread's queues, one per core
+     */
+    struct Submitter {
+        std::vector<std::unique_ptr<SpscQueue<Message*>>> queues;
+    };
+    
+    /**
+     * Which submitter slots are taken; shared with the registered threads, so
+     * a thread exiting after the engine is gone can still release its slot
+     */
+    struct SlotTable {
+        std::atomic<bool> taken[MAX_SUBMITTERS];
+        std::atomic<size_t> used{0}; // One past the highest index ever taken; cores poll this many
+        
+        SlotTable() {
+            for (auto& slot : taken) {
+                slot.store(false, std::memory_order_relaxed);
+            }
+        }
+    };
+    
+    /**
+     * The calling thread's submitter slots, one per engine it used; released when the thread exits
+     */
+    struct ThreadRegistrations {
+        std::vector<std::pair<std::shared_ptr<SlotTable>, size_t>> slots;
+        ~ThreadRegistrations();
+    };
+    
+    static thread_local ThreadRegistrations registrations_;
+    
+    std::vector<std::unique_ptr<Core>> cores_;
+    // Created when their slot is first taken and reused by later holders, whose queues are then empty
+    mutable std::unique_ptr<Submitter> submitters_[MAX_SUBMITTERS];
+    mutable std::mutex registerMutex_;
+    std::shared_ptr<SlotTable> slotTable_;
+    std::atomic<bool> stopping_{false};
+    
+    /**
+     * Owner thread loop: pin, then run messages until stopped
+     */
+    void run(size_t core);
+    
+    /**
+     * Run every message queued to a core
+     * @return Number of messages run
+     */
+    size_t drain(size_t core);
+    
+    /**
+     * Check if any message is queued to a core
+     */
+    bool hasPending(size_t core) const;
+    
+    /**
+     * Get the calling thread's queues, taking a free slot on first use
+     * @return nullptr while every slot is taken
+     */
+    Submitter* submitter() const;
+    
+    /**
+     * Queue a message to a core and wake it if parked; does not wait
+     */
+    void send(size_t core, Message& message) const;
+    
+    /**
+     * Wait for a sent message to be run
+     */
+    static void wait(const Message& message);
+    
+    /**
+     * Run a request on a core's owner thread and wait for its result
+     */
+    template <typename Result>
+    Result call(size_t core, const std::function<Result(InMemoryDBImpl&)>& request) const;
+    
+    /**
+     * Run a request on every core in parallel and wait for all results
+     * @return Results in core order
+     */
+    template <typename Result>
+    std::vector<Result> callAll(const std::function<Result(InMemoryDBImpl&)>& request) const;
+
+public:
+    /**
+     * Operations collected by one thread and sent as one message per core
+     *
+     * Results of gets are available after submit, by the index get returned.
+     * A batch is used by one thread at a time.
+     */
+    class Batch {
+    private:
+        const ThreadPerCoreDB& db_;
+        std::vector<std::vector<std::function<void(InMemoryDBImpl&)>>> operations_; // Per core
+        std::vector<std::optional<std::string>> results_;
+        bool submitted_ = false;
+        
+        /**
+         * Start collecting a new batch after a submit
+         */
+        void reopen();
+    
+    public:
+        explicit Batch(const ThreadPerCoreDB& db);
+        
+        void set(const std::string& recordId, const std::string& field, const std::string& value);
+        
+        /**
+         * Queue a get
+         * @return Index of its result
+         */
+        size_t get(const std::string& recordId, const std::string& field);
+        
+        /**
+         * Send the operations to their cores, all cores in parallel, and wait for them;
+         * the get results are kept until the next operation is queued
+         */
+        void submit();
+        
+        const std::optional<std::string>& result(size_t index) const { return results_[index]; }
+    };
+    
+    /**
+     * Start one owner thread per core
+     * @param coreCount Number of cores (0 = hardware concurrency)
+     * @param pinThreads Pin each owner to its own CPU
+     */
+    explicit ThreadPerCoreDB(size_t coreCount = 0, bool pinThreads = true);
+    
+    /**
+     * Destructor; finishes queued messages and stops the owner threads
+     */
+    ~ThreadPerCoreDB() override;
+    
+    ThreadPerCoreDB(const ThreadPerCoreDB&) = delete;
+    ThreadPerCoreDB& operator=(const ThreadPerCoreDB&) = delete;
+    
+    // Level 1: Basic operations
+    void set(const std::string& recordId, const std::string& field, const std::string& value) override;
+    std::optional<std::string> get(const std::string& recordId, const std::string& field) const override;
+    bool deleteField(const std::string& recordId, const std::string& field) override;
+    bool deleteRecord(const std::string& recordId) override;
+    std::vector<std::string> getFields(const std::string& recordId) const override;
+    bool hasRecord(const std::string& recordId) const override;
+    std::vector<std::string> getAllRecordIds() const override;
+    
+    // Level 2: Filtering
+    std::vector<std::string> getRecordsByFieldValue(const std::string& field, const std::string& value) const override;
+    
+    // Level 3: TTL
+    void setTTL(const std::string& recordId, int ttlSeconds) override;
+    int expireRecords() override;
+    
+    // Level 4: Backup and restore (same format as InMemoryDBImpl; a failed restore keeps the current state)
+    std::string backup() const override;
+    bool restore(const std::string& backupData) override;
+    
+    /**
+     * Number of cores
+     */
+    size_t coreCount() const;
+    
+    /**
+     * Core owning a record
+     * @param recordId Record identifier
+     */
+    size_t coreOf(const std::string& recordId) const;
+    
+    /**
+     * CPU a core's owner thread is pinned to (-1 if not pinned)
+     */
+    int coreCpu(size_t core) const;
+    
+    /**
+     * Run a batch of operations on a core's owner thread and wait for it
+     * @param core Core index
+     * @param batch Called on the owner thread with the core's partition
+     */
+    void execute(size_t core, const std::function<void(InMemoryDBImpl&)>& batch);
+    
+    /**
+     * Total number of records
+     */
+    size_t getRecordCount() const;
+    
+    /**
+     * Number of submitter slots the cores poll: one past the highest slot index taken so far
+     */
+    size_t submittersScanned() const;
+};
+
+#endif // THREAD_PER_CORE_DB_HPP
@@ -0,0 +1,516 @@
+#include "tier_store.hpp"
+#include "snapshot_codec.hpp"
+#include <algorithm>
+#include <vector>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// Frame layout (little-endian): BODY_SIZE(u32) CRC32(u32) BODY
+// Body: RECORD_ID_LENGTH(u32) RECORD_ID PAYLOAD
+const size_t FRAME_HEADER_SIZE = 8;
+const size_t WRITE_BUFFER_BYTES = 64 * 1024;
+const uint64_t COMPACT_MIN_BYTES = 1024 * 1024;
+const size_t COMPACT_WINDOW_BYTES = 1024 * 1024;
+
+void putU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+uint32_t getU32(const char* data) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+bool writeAll(int fd, const char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t written = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+size_t readUpTo(int fd, char* data, size_t size, uint64_t offset) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t count = ::pread(fd, data + total, size - total, static_cast<off_t>(offset + total));
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (count == 0) break;
+        total += count;
+    }
+    return total;
+}
+
+/**
+ * Validate a frame and return a view of its body
+ * @return false if the frame is truncated or fails its checksum
+ */
+bool frameBody(const char* data, size_t size, const char*& body, size_t& bodySize) {
+    if (size < FRAME_HEADER_SIZE) return false;
+    bodySize = getU32(data);
+    if (size - FRAME_HEADER_SIZE < bodySize) return false;
+    body = data + FRAME_HEADER_SIZE;
+    return blockChecksum(body, bodySize) == getU32(data + 4);
+}
+
+/**
+ * Split a frame body into its record ID and payload
+ * @return false if the body does not belong to the record
+ */
+bool unpackBody(const char* body, size_t bodySize, const std::string& recordId, std::string& payload) {
+    if (bodySize < 4) return false;
+    uint32_t idLength = getU32(body);
+    if (bodySize - 4 < idLength || recordId.compare(0, std::string::npos, body + 4, idLength) != 0) {
+        return false;
+    }
+    payload.assign(body + 4 + idLength, bodySize - 4 - idLength);
+    return true;
+}
+
+} // namespace
+
+TierStore::TierStore(size_t readaheadBytes) : readaheadBytes_(readaheadBytes) {
+    if (readaheadBytes_ > 0) {
+        readaheadThread_ = std::thread(&TierStore::readaheadLoop, this);
+    }
+}
+
+TierStore::~TierStore() {
+    abandonCompaction();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (readaheadThread_.joinable()) {
+        readaheadThread_.join();
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        ::unlink(path_.c_str());
+    }
+}
+
+bool TierStore::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    
+    abandonCompaction();
+    std::unique_lock<std::mutex> lock(mutex_);
+    quiesceReadahead(lock);
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    fd_ = fd;
+    path_ = path;
+    flushedBytes_ = 0;
+    lock.unlock();
+    
+    index_.clear();
+    writeBuffer_.clear();
+    garbageBytes_ = 0;
+    return true;
+}
+
+void TierStore::quiesceReadahead(std::unique_lock<std::mutex>& lock) {
+    pendingOffset_ = NO_OFFSET;
+    idle_.wait(lock, [this] { return !readaheadBusy_; });
+    readaheadCache_.clear();
+    readaheadCacheBytes_ = 0;
+}
+
+bool TierStore::store(const std::string& recordId, const std::string& payload) {
+    if (fd_ < 0) {
+        return false;
+    }
+    
+    size_t bodySize = 4 + recordId.size() + payload.size();
+    if (bodySize > UINT32_MAX - FRAME_HEADER_SIZE) {
+        return false;
+    }
+    
+    if (writeBuffer_.size() >= WRITE_BUFFER_BYTES && !flush()) {
+        return false;
+    }
+    
+    uint64_t offset = flushedBytes_ + writeBuffer_.size();
+    size_t start = writeBuffer_.size();
+    putU32(writeBuffer_, static_cast<uint32_t>(bodySize));
+    putU32(writeBuffer_, 0); // Checksum, filled in below
+    putU32(writeBuffer_, static_cast<uint32_t>(recordId.size()));
+    writeBuffer_.append(recordId);
+    writeBuffer_.append(payload);
+    
+    uint32_t checksum = blockChecksum(&writeBuffer_[start + FRAME_HEADER_SIZE], bodySize);
+    for (int i = 0; i < 4; i++) {
+        writeBuffer_[start + 4 + i] = static_cast<char>((checksum >> (8 * i)) & 0xFF);
+    }
+    
+    Location location{offset, static_cast<uint32_t>(FRAME_HEADER_SIZE + bodySize)};
+    auto inserted = index_.emplace(recordId, location);
+    if (!inserted.second) {
+        garbageBytes_ += inserted.first->second.length;
+        if (compacting_) {
+            compactGarbage_ += inserted.first->second.length;
+        }
+        inserted.first->second = location;
+    }
+    maybeCompact();
+    return true;
+}
+
+bool TierStore::flush() {
+    if (writeBuffer_.empty()) {
+        return true;
+    }
+    if (!writeAll(fd_, writeBuffer_.data(), writeBuffer_.size(), flushedBytes_)) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    flushedBytes_ += writeBuffer_.size();
+    writeBuffer_.clear();
+    return true;
+}
+
+bool TierStore::load(const std::string& recordId, std::string& payload) {
+    auto it = index_.find(recordId);
+    if (it == index_.end()) {
+        return false;
+    }
+    const Location location = it->second;
+    
+    // Frames still in the write buffer are read from memory
+    if (location.offset >= flushedBytes_) {
+        const char* body;
+        size_t bodySize;
+        const char* frame = writeBuffer_.data() + (location.offset - flushedBytes_);
+        return frameBody(frame, location.length, body, bodySize) && unpackBody(body, bodySize, recordId, payload);
+    }
+    
+    uint64_t next = location.offset + location.length;
+    bool sequential = location.offset == expectedOffset_;
+    expectedOffset_ = next;
+    std::string cached;
+    bool hit = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto cacheIt = readaheadCache_.find(location.offset);
+        if (cacheIt != readaheadCache_.end()) {
+            cached.swap(cacheIt->second);
+            readaheadCacheBytes_ -= cached.size();
+            readaheadCache_.erase(cacheIt);
+            readaheadHits_++;
+            hit = true;
+        }
+        
+        // Keep the readahead window ahead of sequential loads
+        if ((hit || sequential) && readaheadBytes_ > 0 && next < flushedBytes_ && readaheadCache_.count(next) == 0) {
+            pendingOffset_ = next;
+            wake_.notify_one();
+        }
+    }
+    if (hit) {
+        return unpackBody(cached.data(), cached.size(), recordId, payload);
+    }
+    
+    std::string frame(location.length, '\0');
+    diskReads_++;
+    const char* body;
+    size_t bodySize;
+    return readUpTo(fd_, &frame[0], frame.size(), location.offset) == frame.size() &&
+           frameBody(frame.data(), frame.size(), body, bodySize) && unpackBody(body, bodySize, recordId, payload);
+}
+
+void TierStore::drop(const std::string& recordId) {
+    auto it = index_.find(recordId);
+    if (it == index_.end()) {
+        return;
+    }
+    
+    garbageBytes_ += it->second.length;
+    if (compacting_) {
+        compactGarbage_ += it->second.length;
+    }
+    uint64_t offset = it->second.offset;
+    index_.erase(it);
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto cacheIt = readaheadCache_.find(offset);
+        if (cacheIt != readaheadCache_.end()) {
+            readaheadCacheBytes_ -= cacheIt->second.size();
+            readaheadCache_.erase(cacheIt);
+        }
+    }
+    maybeCompact();
+}
+
+void TierStore::clear() {
+    abandonCompaction();
+    std::unique_lock<std::mutex> lock(mutex_);
+    quiesceReadahead(lock);
+    if (fd_ < 0 || ::ftruncate(fd_, 0) == 0) {
+        flushedBytes_ = 0;
+    }
+    lock.unlock();
+    
+    index_.clear();
+    writeBuffer_.clear();
+    // If the truncate failed, appends continue after the old frames, which compaction drops as garbage
+    garbageBytes_ = flushedBytes_;
+}
+
+void TierStore::maybeCompact() {
+    if (compacting_) {
+        if (compactDone_.load(std::memory_order_acquire)) {
+            finishCompaction();
+        }
+        return;
+    }
+    uint64_t fileBytes = flushedBytes_ + writeBuffer_.size();
+    if (fileBytes >= COMPACT_MIN_BYTES && garbageBytes_ > fileBytes / 2) {
+        startCompaction();
+    }
+}
+
+void TierStore::startCompaction() {
+    if (!flush()) {
+        return;
+    }
+    
+    int tempFd = ::open((path_ + ".compact").c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (tempFd < 0) {
+        return;
+    }
+    
+    // Only the frame locations are copied here; sorting and copying happen on the thread
+    compactFrames_.clear();
+    compactFrames_.reserve(index_.size());
+    for (const auto& entry : index_) {
+        compactFrames_.push_back(entry.second);
+    }
+    compactFd_ = tempFd;
+    compactEnd_ = flushedBytes_;
+    compactGarbage_ = 0;
+    compactOk_ = false;
+    compactDone_.store(false, std::memory_order_relaxed);
+    compactCancel_.store(false, std::memory_order_relaxed);
+    compacting_ = true;
+    compactThread_ = std::thread(&TierStore::compactWorker, this, fd_);
+}
+
+void TierStore::compactWorker(int fd) {
+    // Copy the live frames in file order, so records evicted together stay together
+    std::sort(compactFrames_.begin(), compactFrames_.end(),
+              [](const Location& a, const Location& b) { return a.offset < b.offset; });
+    compactOffsets_.clear();
+    compactOffsets_.reserve(compactFrames_.size());
+    
+    // Read the old file in large windows rather than frame by frame
+    std::string window;
+    uint64_t windowStart = 0;
+    std::string buffer;
+    uint64_t written = 0;
+    bool ok = true;
+    for (const Location& frame : compactFrames_) {
+        if (compactCancel_.load(std::memory_order_relaxed)) {
+            ok = false;
+            break;
+        }
+        if (frame.offset < windowStart || frame.offset + frame.length > windowStart + window.size()) {
+            windowStart = frame.offset;
+            window.resize(std::max<size_t>(COMPACT_WINDOW_BYTES, frame.length));
+            window.resize(readUpTo(fd, &window[0], window.size(), windowStart));
+            if (window.size() < frame.length) {
+                ok = false;
+                break;
+            }
+        }
+        compactOffsets_.push_back(written + buffer.size());
+        buffer.append(window, frame.offset - windowStart, frame.length);
+        if (buffer.size() >= WRITE_BUFFER_BYTES) {
+            if (!writeAll(compactFd_, buffer.data(), buffer.size(), written)) {
+                ok = false;
+                break;
+            }
+            written += buffer.size();
+            buffer.clear();
+        }
+    }
+    ok = ok && writeAll(compactFd_, buffer.data(), buffer.size(), written);
+    compactWritten_ = written + buffer.size();
+    compactOk_ = ok;
+    compactDone_.store(true, std::memory_order_release);
+}
+
+bool TierStore::finishCompaction() {
+    compactThread_.join();
+    compacting_ = false;
+    std::string tempPath = path_ + ".compact";
+    
+    // Append the frames written since the start; the old offsets beyond compactEnd_ shift by a constant
+    bool ok = compactOk_ && flush();
+    std::string window;
+    for (uint64_t pos = compactEnd_; ok && pos < flushedBytes_; pos += window.size()) {
+        window.resize(static_cast<size_t>(std::min<uint64_t>(COMPACT_WINDOW_BYTES, flushedBytes_ - pos)));
+        ok = readUpTo(fd_, &window[0], window.size(), pos) == window.size() &&
+             writeAll(compactFd_, window.data(), window.size(), compactWritten_ + (pos - compactEnd_));
+    }
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    quiesceReadahead(lock);
+    if (!ok || ::rename(tempPath.c_str(), path_.c_str()) != 0) {
+        lock.unlock();
+        ::close(compactFd_);
+        ::unlink(tempPath.c_str());
+        compactFd_ = -1;
+        return false;
+    }
+    
+    ::close(fd_);
+    fd_ = compactFd_;
+    compactFd_ = -1;
+    flushedBytes_ = compactWritten_ + (flushedBytes_ - compactEnd_);
+    lock.unlock();
+    
+    for (auto& entry : index_) {
+        Location& location = entry.second;
+        if (location.offset >= compactEnd_) {
+            location.offset = location.offset - compactEnd_ + compactWritten_;
+            continue;
+        }
+        auto it = std::lower_bound(compactFrames_.begin(), compactFrames_.end(), location.offset,
+                                   [](const Location& frame, uint64_t offset) { return frame.offset < offset; });
+        location.offset = compactOffsets_[it - compactFrames_.begin()];
+    }
+    compactFrames_.clear();
+    compactOffsets_.clear();
+    garbageBytes_ = compactGarbage_;
+    expectedOffset_ = NO_OFFSET;
+    compactions_++;
+    return true;
+}
+
+void TierStore::abandonCompaction() {
+    if (!compacting_) {
+        return;
+    }
+    compactCancel_.store(true, std::memory_order_relaxed);
+    compactThread_.join();
+    compacting_ = false;
+    ::close(compactFd_);
+    ::unlink((path_ + ".compact").c_str());
+    compactFd_ = -1;
+    compactFrames_.clear();
+    compactOffsets_.clear();
+}
+
+void TierStore::readaheadLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::string buffer;
+    std::vector<std::pair<uint64_t, std::string>> frames;
+    
+    while (true) {
+        wake_.wait(lock, [this] { return stopping_ || pendingOffset_ != NO_OFFSET; });
+        if (stopping_) {
+            return;
+        }
+        
+        uint64_t offset = pendingOffset_;
+        pendingOffset_ = NO_OFFSET;
+        size_t length = static_cast<size_t>(std::min<uint64_t>(readaheadBytes_, flushedBytes_ - offset));
+        int fd = fd_;
+        readaheadBusy_ = true;
+        lock.unlock();
+        
+        // The file below flushedBytes_ is immutable until the owner quiesces this thread
+        buffer.resize(length);
+        size_t available = readUpTo(fd, &buffer[0], length, offset);
+        frames.clear();
+        size_t pos = 0;
+        const char* body;
+        size_t bodySize;
+        while (frameBody(buffer.data() + pos, available - pos, body, bodySize)) {
+            frames.emplace_back(offset + pos, std::string(body, bodySize));
+            pos += FRAME_HEADER_SIZE + bodySize;
+        }
+        
+        lock.lock();
+        readaheadBusy_ = false;
+        // Bound the cache; frames that were never claimed are the oldest readahead
+        if (readaheadCacheBytes_ > 4 * readaheadBytes_) {
+            readaheadCache_.clear();
+            readaheadCacheBytes_ = 0;
+        }
+        for (auto& frame : frames) {
+            auto inserted = readaheadCache_.emplace(frame.first, std::string());
+            if (inserted.second) {
+                readaheadCacheBytes_ += frame.second.size();
+                inserted.first->second.swap(frame.second);
+            }
+        }
+        idle_.notify_all();
+    }
+}
+
+TierStore::Stats TierStore::stats() const {
+    Stats stats;
+    stats.records = index_.size();
+    stats.fileBytes = flushedBytes_ + writeBuffer_.size();
+    stats.garbageBytes = garbageBytes_;
+    stats.diskReads = diskReads_;
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.readaheadHits = readaheadHits_;
+    stats.compactions = compactions_;
+    return stats;
+}
+
+void RecencyList::touch(const std::string& recordId, size_t bytes) {
+    auto it = entries_.find(recordId);
+    if (it == entries_.end()) {
+        order_.push_front(recordId);
+        entries_.emplace(recordId, Entry{order_.begin(), bytes});
+        totalBytes_ += bytes;
+        return;
+    }
+    
+    order_.splice(order_.begin(), order_, it->second.position);
+    totalBytes_ = totalBytes_ - it->second.bytes + bytes;
+    it->second.bytes = bytes;
+}
+
+void RecencyList::remove(const std::string& recordId) {
+    auto it = entries_.find(recordId);
+    if (it == entries_.end()) {
+        return;
+    }
+    totalBytes_ -= it->second.bytes;
+    order_.erase(it->second.position);
+    entries_.erase(it);
+}
+
+void RecencyList::clear() {
+    order_.clear();
+    entries_.clear();
+    totalBytes_ = 0;
+}
@@ -0,0 +1,238 @@
+#ifndef TIER_STORE_HPP
+#define TIER_STORE_HPP
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+/**
+ * Append-only on-disk segment log holding cold records
+ *
+ * Each stored record is one framed, checksummed entry appended to the file;
+ * an in-memory index maps record IDs to their latest frame. Dropping or
+ * re-storing a record leaves garbage behind, and the file is compacted once
+ * garbage makes up most of it. Appends are batched in a write buffer.
+ *
+ * Compaction copies the live frames to a new file on a background thread;
+ * the owner keeps appending meanwhile and, on a later store or drop, only
+ * copies the frames appended since then and switches to the new file.
+ *
+ * Once loads turn sequential, a background thread reads ahead the frames
+ * that follow, so records evicted together (and therefore stored next to
+ * each other) are served from memory when they are loaded back together.
+ *
+ * The file is a spill area, not a durability mechanism: it is truncated on
+ * open and its contents are meaningless without the in-memory index.
+ * All methods must be called from the owning thread.
+ */
+class TierStore {
+public:
+    struct Stats {
+        size_t records = 0;         // Records currently held on disk
+        uint64_t fileBytes = 0;     // Size of the segment log, including the write buffer
+        uint64_t garbageBytes = 0;  // Bytes of dropped or superseded frames
+        uint64_t diskReads = 0;     // Loads served by reading the file
+        uint64_t readaheadHits = 0; // Loads served from the readahead cache
+        uint64_t compactions = 0;
+    };
+
+private:
+    static constexpr uint64_t NO_OFFSET = ~0ULL;
+    
+    struct Location {
+        uint64_t offset;
+        uint32_t length; // Whole frame, header included
+    };
+    
+    std::string path_;
+    int fd_ = -1;
+    std::unordered_map<std::string, Location> index_;
+    std::string writeBuffer_;       // Frames appended after flushedBytes_
+    uint64_t garbageBytes_ = 0;
+    uint64_t diskReads_ = 0;
+    uint64_t compactions_ = 0;
+    uint64_t expectedOffset_ = NO_OFFSET; // Frame following the last one loaded
+    size_t readaheadBytes_;
+    
+    // Background compaction; the owner touches the frames and offsets only once the thread has finished
+    std::thread compactThread_;
+    std::atomic<bool> compactDone_{false};
+    std::atomic<bool> compactCancel_{false};
+    bool compacting_ = false;
+    bool compactOk_ = false;
+    int compactFd_ = -1;
+    uint64_t compactEnd_ = 0;       // Old file bytes the thread copies from
+    uint64_t compactWritten_ = 0;   // Bytes the thread wrote to the new file
+    uint64_t compactGarbage_ = 0;   // Frames superseded since the start, garbage in the new file
+    std::vector<Location> compactFrames_;  // Live frames at the start, sorted by offset by the thread
+    std::vector<uint64_t> compactOffsets_; // New offset of each frame
+    
+    // Shared with the readahead thread
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::thread readaheadThread_;
+    uint64_t flushedBytes_ = 0;     // Bytes written to the file
+    uint64_t pendingOffset_ = NO_OFFSET; // Next readahead request
+    bool readaheadBusy_ = false;
+    bool stopping_ = false;
+    std::unordered_map<uint64_t, std::string> readaheadCache_; // Frame offset -> frame body
+    size_t readaheadCacheBytes_ = 0;
+    uint64_t readaheadHits_ = 0;
+    
+    /**
+     * Background loop serving readahead requests
+     */
+    void readaheadLoop();
+    
+    /**
+     * Write the buffered frames to the file
+     * @return true if the buffer was written
+     */
+    bool flush();
+    
+    /**
+     * Start copying the live frames to a new file on the compaction thread
+     */
+    void startCompaction();
+    
+    /**
+     * Background loop copying the live frames, in file order, to the new file
+     * @param fd Old file, immutable below compactEnd_
+     */
+    void compactWorker(int fd);
+    
+    /**
+     * Copy the frames appended since the compaction started and switch to the new file
+     * @return true if the file was compacted
+     */
+    bool finishCompaction();
+    
+    /**
+     * Stop a running compaction and remove its file
+     */
+    void abandonCompaction();
+    
+    /**
+     * Start a compaction if garbage dominates the file, or finish one whose copy is done
+     */
+    void maybeCompact();
+    
+    /**
+     * Cancel any readahead request and wait for the thread to go idle
+     * @param lock Held lock on mutex_
+     */
+    void quiesceReadahead(std::unique_lock<std::mutex>& lock);
+
+public:
+    /**
+     * Constructor
+     * @param readaheadBytes Bytes read ahead after each load (0 disables readahead)
+     */
+    explicit TierStore(size_t readaheadBytes = 256 * 1024);
+    
+    /**
+     * Destructor; stops the background threads and removes the file
+     */
+    ~TierStore();
+    
+    TierStore(const TierStore&) = delete;
+    TierStore& operator=(const TierStore&) = delete;
+    
+    /**
+     * Create or truncate the segment log
+     * @param path File path
+     * @return true if the file was opened
+     */
+    bool open(const std::string& path);
+    
+    /**
+     * Check if the segment log is open
+     */
+    bool isOpen() const { return fd_ >= 0; }
+    
+    /**
+     * Store a record, replacing any earlier copy
+     * @param recordId Record ID
+     * @param payload Encoded record
+     * @return true if the record was appended
+     */
+    bool store(const std::string& recordId, const std::string& payload);
+    
+    /**
+     * Read a record back; it stays in the store
+     * @param recordId Record ID
+     * @param payload Receives the encoded record
+     * @return false if the record is not stored or its frame is unreadable
+     */
+    bool load(const std::string& recordId, std::string& payload);
+    
+    /**
+     * Forget a record
+     * @param recordId Record ID
+     */
+    void drop(const std::string& recordId);
+    
+    /**
+     * Check if a record is stored
+     */
+    bool contains(const std::string& recordId) const { return index_.count(recordId) > 0; }
+    
+    /**
+     * Forget every record and truncate the file
+     */
+    void clear();
+    
+    /**
+     * Get store statistics
+     */
+    Stats stats() const;
+};
+
+/**
+ * Least-recently-used ordering of record IDs with a byte estimate per record
+ */
+class RecencyList {
+private:
+    struct Entry {
+        std::list<std::string>::iterator position;
+        size_t bytes;
+    };
+    
+    std::list<std::string> order_; // Most recently used first
+    std::unordered_map<std::string, Entry> entries_;
+    size_t totalBytes_ = 0;
+
+public:
+    /**
+     * Mark a record as most recently used
+     * @param recordId Record ID
+     * @param bytes Current size estimate of the record
+     */
+    void touch(const std::string& recordId, size_t bytes);
+    
+    /**
+     * Stop tracking a record
+     * @param recordId Record ID
+     */
+    void remove(const std::string& recordId);
+    
+    /**
+     * Get the least recently used record
+     * @return nullptr if nothing is tracked
+     */
+    const std::string* coldest() const { return order_.empty() ? nullptr : &order_.back(); }
+    
+    void clear();
+    size_t size() const { return entries_.size(); }
+    size_t totalBytes() const { return totalBytes_; }
+};
+
+#endif // TIER_STORE_HPP
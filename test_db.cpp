@@ -1,8 +1,37 @@
 #include "src/in_memory_db_imp.hpp"
+#include "src/replication.hpp"
+#include "src/read_replicas.hpp"
+#include "src/numa_util.hpp"
+#include "src/sharded_db.hpp"
+#include "src/storage_arena.hpp"
+#include "src/async_db.hpp"
+#include "src/thread_per_core_db.hpp"
+#include "src/combining_db.hpp"
 #include <iostream>
 #include <cassert>
+#include <algorithm>
 #include <thread>
 #include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <cmath>
+#include <set>
+#include <random>
+
+#ifdef IMDB_HAS_COROUTINES
+/**
+ * Minimal eager coroutine for the async tests; callers poll done
+ */
+struct TestCoroutine {
+    struct promise_type {
+        TestCoroutine get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+#endif
 
 class DatabaseTester {
 private:
@@ -28,6 +57,31 @@ public:
         testLevel2();
         testLevel3();
         testLevel4();
+        testIncrementalBackup();
+        testSnapshotRestore();
+        testSnapshotCompression();
+        testAtomicRestore();
+        testAppendLog();
+        testCheckpointRecovery();
+        testChangeStream();
+        testReplication();
+        testReadReplicas();
+        testShardedDB();
+        testHugePageStorage();
+        testBatchedLookups();
+        testRecordFilter();
+        testTieredStorage();
+        testValueCompression();
+        testValueInterning();
+        testRecordLayout();
+        testNativeCollections();
+        testProbabilisticFields();
+        testRateLimiter();
+        testAsyncAPI();
+        testThreadPerCore();
+        testFlatCombining();
+        testLazyFree();
+        testRecordIndex();
         
         std::cout << std::endl << "Test Summary: " << passedTests << "/" << testCount << " tests passed" << std::endl;
         
@@ -214,6 +268,1711 @@ public:
         
         std::cout << std::endl;
     }
+    
+    void testIncrementalBackup() {
+        std::cout << "=== Incremental Backups ===" << std::endl;
+        
+        InMemoryDBImpl source;
+        source.set("inc1", "name", "Alice");
+        source.set("inc2", "name", "Bob");
+        source.set("inc3", "name", "Carol");
+        
+        std::string base = source.backup();
+        uint64_t token = source.backupToken();
+        
+        // First delta: modify one record, delete another
+        source.set("inc1", "name", "Alicia");
+        source.deleteRecord("inc2");
+        std::string delta1 = source.backupIncremental(token);
+        token = source.backupToken();
+        
+        assert_test(delta1.find("inc3") == std::string::npos, "Delta omits unchanged records");
+        assert_test(delta1.find("inc1") != std::string::npos, "Delta contains modified record");
+        
+        // Second delta: add a record with TTL
+        source.set("inc4", "name", "Dave");
+        source.setTTL("inc4", 3600);
+        std::string delta2 = source.backupIncremental(token);
+        
+        InMemoryDBImpl target;
+        bool restored = target.restoreIncremental(base, {delta1, delta2});
+        assert_test(restored, "Base plus delta chain restores successfully");
+        assert_test(target.getAllRecordIds() == source.getAllRecordIds(), "Delta chain reproduces record set");
+        
+        auto name1 = target.get("inc1", "name");
+        auto name4 = target.get("inc4", "name");
+        assert_test(name1.has_value() && name1.value() == "Alicia", "Delta chain applies modifications");
+        assert_test(!target.hasRecord("inc2"), "Delta chain applies deletions");
+        assert_test(name4.has_value() && name4.value() == "Dave", "Delta chain applies new records");
+        
+        // Malformed delta leaves the state untouched
+        bool invalidApply = target.applyIncremental("DELTA\ngarbage");
+        assert_test(!invalidApply && target.hasRecord("inc1"), "Malformed delta is rejected without changes");
+        
+        // A token from before a restore yields a delta that replaces the state
+        uint64_t staleToken = target.backupToken();
+        target.restore(base);
+        InMemoryDBImpl mirror;
+        mirror.set("stale", "name", "Old");
+        mirror.applyIncremental(target.backupIncremental(staleToken - 1));
+        assert_test(!mirror.hasRecord("stale") && mirror.getAllRecordIds().size() == 3,
+                    "Delta since a pre-restore token resets the state");
+        
+        std::cout << std::endl;
+    }
+    
+    void testSnapshotRestore() {
+        std::cout << "=== Block Snapshots ===" << std::endl;
+        
+        InMemoryDBImpl source;
+        for (int i = 0; i < 100; i++) {
+            source.set("snap" + std::to_string(i), "index", std::to_string(i));
+        }
+        source.set("snap0", "multiline", "line1\nline2");
+        source.setTTL("snap1", 3600);
+        
+        std::string snapshotData = source.snapshot(16);
+        
+        InMemoryDBImpl target;
+        bool restored = target.restoreSnapshot(snapshotData, 4);
+        assert_test(restored, "Multi-threaded snapshot restore succeeds");
+        assert_test(target.getAllRecordIds() == source.getAllRecordIds(), "Snapshot restores every record");
+        
+        auto multiline = target.get("snap0", "multiline");
+        auto index = target.get("snap99", "index");
+        assert_test(multiline.has_value() && multiline.value() == "line1\nline2", "Snapshot preserves values with newlines");
+        assert_test(index.has_value() && index.value() == "99", "Snapshot restores field values");
+        
+        std::string truncated = snapshotData.substr(0, snapshotData.size() - 3);
+        bool truncatedRestore = target.restoreSnapshot(truncated, 4);
+        assert_test(!truncatedRestore && target.getAllRecordIds().size() == 100,
+                    "Truncated snapshot fails and keeps current state");
+        
+        // Counts in the headers are bounded by the bytes that follow, not trusted for allocation
+        auto setU32 = [](std::string& data, size_t offset, uint32_t value) {
+            for (int i = 0; i < 4; i++) {
+                data[offset + i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+            }
+        };
+        std::string hugeTotal = snapshotData;
+        setU32(hugeTotal, 12, 0xFFFFFFFF);
+        InMemoryDBImpl hugeTotalTarget;
+        assert_test(hugeTotalTarget.restoreSnapshot(hugeTotal, 4) && hugeTotalTarget.getAllRecordIds().size() == 100,
+                    "Oversized total record count is only a hint");
+        
+        std::string hugeBlock = snapshotData;
+        setU32(hugeBlock, 20, 0xFFFFFFFF);
+        bool hugeBlockRestore = target.restoreSnapshot(hugeBlock, 4);
+        assert_test(!hugeBlockRestore && target.getAllRecordIds().size() == 100,
+                    "Oversized block record count fails instead of allocating");
+        
+        std::cout << std::endl;
+    }
+    
+    void testSnapshotCompression() {
+        std::cout << "=== Snapshot Compression ===" << std::endl;
+        
+        InMemoryDBImpl source;
+        for (int i = 0; i < 200; i++) {
+            source.set("doc" + std::to_string(i), "body",
+                       "{\"status\": \"active\", \"plan\": \"premium\", \"country\": \"US\", \"id\": " +
+                       std::to_string(i) + "}");
+        }
+        
+        std::string plain = source.snapshot(32, SnapshotCodec::None);
+        std::string compressed = source.snapshot(32, SnapshotCodec::InTree);
+        assert_test(compressed.size() < plain.size() / 2, "In-tree codec shrinks repetitive snapshots");
+        
+        InMemoryDBImpl target;
+        bool restored = target.restoreSnapshot(compressed, 2);
+        auto body = target.get("doc7", "body");
+        assert_test(restored && target.getAllRecordIds().size() == 200, "Compressed snapshot restores every record");
+        assert_test(body.has_value() && body == source.get("doc7", "body"), "Compressed snapshot restores values");
+        
+        // Unavailable codecs fall back to one that is compiled in
+        std::string fallback = source.snapshot(32, SnapshotCodec::Zstd);
+        InMemoryDBImpl fallbackTarget;
+        assert_test(fallbackTarget.restoreSnapshot(fallback), "Snapshot with requested zstd codec restores");
+        
+        // Flip one byte in the last block: its checksum must catch it
+        std::string corrupt = compressed;
+        corrupt[corrupt.size() - 5] ^= 0x20;
+        bool corruptRestore = target.restoreSnapshot(corrupt, 2);
+        assert_test(!corruptRestore && target.getAllRecordIds().size() == 200,
+                    "Corrupt block is detected and current state is kept");
+        
+        // The checksum covers the block header too: a corrupt raw size fails before decompressing
+        std::string corruptHeader = compressed;
+        corruptHeader[16 + 12 + 3] ^= 0x40;
+        bool corruptHeaderRestore = target.restoreSnapshot(corruptHeader, 2);
+        assert_test(!corruptHeaderRestore && target.getAllRecordIds().size() == 200,
+                    "Corrupt block header is detected");
+        
+        std::cout << std::endl;
+    }
+    
+    void testAtomicRestore() {
+        std::cout << "=== Online Restore ===" << std::endl;
+        
+        InMemoryDBImpl source;
+        source.set("new1", "name", "Restored");
+        source.setTTL("new1", 3600);
+        std::string backupData = source.backup();
+        
+        InMemoryDBImpl live;
+        live.set("old1", "name", "Live");
+        
+        // Failed restore keeps the old data
+        bool invalidRestore = live.restoreAtomic("3\nincomplete");
+        auto oldName = live.get("old1", "name");
+        assert_test(!invalidRestore && oldName.has_value() && oldName.value() == "Live",
+                    "Failed atomic restore leaves old data intact");
+        
+        // Prepare on another thread while the live database keeps serving reads
+        InMemoryDBImpl::Dataset staged;
+        bool prepared = false;
+        std::thread loader([&]() { prepared = InMemoryDBImpl::prepareRestore(backupData, staged); });
+        bool servedDuringLoad = true;
+        for (int i = 0; i < 1000; i++) {
+            servedDuringLoad = servedDuringLoad && live.get("old1", "name").has_value();
+        }
+        loader.join();
+        
+        assert_test(prepared && servedDuringLoad, "Restore is prepared while old data stays readable");
+        
+        live.commitRestore(staged);
+        auto newName = live.get("new1", "name");
+        assert_test(newName.has_value() && !live.hasRecord("old1"), "Commit swaps in the new dataset");
+        assert_test(staged.records.count("old1") == 1, "Commit hands the old dataset back to the caller");
+        
+        bool snapshotRestore = live.restoreAtomic(source.snapshot());
+        assert_test(snapshotRestore && live.hasRecord("new1"), "Atomic restore accepts snapshots");
+        
+        std::cout << std::endl;
+    }
+    
+    void testAppendLog() {
+        std::cout << "=== Append-Only Log ===" << std::endl;
+        
+        const std::string logPath = "test_db_append.log";
+        std::remove(logPath.c_str());
+        
+        uint64_t sizeBeforeRewrite = 0;
+        {
+            InMemoryDBImpl primary;
+            assert_test(primary.openAppendLog(logPath), "Append log opens");
+            
+            for (int i = 0; i < 500; i++) {
+                primary.set("counters", "hits", std::to_string(i));
+            }
+            primary.set("user1", "name", "Alice");
+            primary.set("user1", "email", "alice@example.com");
+            primary.deleteField("user1", "email");
+            primary.set("session", "token", "abc");
+            primary.setTTL("session", 3600);
+            primary.set("gone", "x", "y");
+            primary.deleteRecord("gone");
+            primary.flushAppendLog();
+            sizeBeforeRewrite = primary.appendLogSize();
+            
+            InMemoryDBImpl replayed;
+            replayed.openAppendLog(logPath);
+            auto hits = replayed.get("counters", "hits");
+            assert_test(hits.has_value() && hits.value() == "499", "Replay restores the latest value");
+            assert_test(!replayed.get("user1", "email").has_value() && !replayed.hasRecord("gone"),
+                        "Replay applies deletions");
+            
+            // Writes made while the rewrite runs must survive the file switch
+            assert_test(primary.rewriteAppendLog(), "Log rewrite starts");
+            primary.set("counters", "hits", "500");
+            primary.set("late", "field", "written during rewrite");
+            primary.waitForAppendLogRewrite();
+            primary.set("after", "field", "written after rewrite");
+            primary.flushAppendLog();
+            
+            assert_test(primary.appendLogSize() < sizeBeforeRewrite / 4, "Rewritten log is proportional to live data");
+        }
+        
+        // Simulate a torn write at the end of the log
+        {
+            std::ofstream log(logPath, std::ios::binary | std::ios::app);
+            log << "\x20\x00\x00";
+        }
+        
+        InMemoryDBImpl recovered;
+        bool reopened = recovered.openAppendLog(logPath);
+        auto hits = recovered.get("counters", "hits");
+        auto name = recovered.get("user1", "name");
+        assert_test(reopened && hits.has_value() && hits.value() == "500", "Rewritten log replays buffered writes");
+        assert_test(recovered.hasRecord("late") && recovered.hasRecord("after"), "Writes around the switch are kept");
+        assert_test(name.has_value() && recovered.hasRecord("session"), "Rewritten log keeps live records");
+        std::remove(logPath.c_str());
+        
+        // A TTL that passes while the log is closed expires the whole record on reopen
+        {
+            InMemoryDBImpl primary;
+            primary.openAppendLog(logPath);
+            primary.set("r", "a", "1");
+            primary.setTTL("r", 1);
+            primary.set("r", "b", "2");
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+        bool expiredOnReopen = false;
+        {
+            InMemoryDBImpl reopenedAfterTTL;
+            reopenedAfterTTL.openAppendLog(logPath);
+            expiredOnReopen = !reopenedAfterTTL.hasRecord("r") && !reopenedAfterTTL.get("r", "b") &&
+                              reopenedAfterTTL.expireRecords() == 0;
+            reopenedAfterTTL.set("r", "c", "3");
+        }
+        InMemoryDBImpl reopenedTwice;
+        reopenedTwice.openAppendLog(logPath);
+        assert_test(expiredOnReopen && reopenedTwice.getFields("r") == std::vector<std::string>{"c"},
+                    "Replay keeps TTLs that passed while the log was closed");
+        std::remove(logPath.c_str());
+        
+        // The rewrite base is the state at its start, captured in steps; records
+        // changed meanwhile are captured before the change, so non-idempotent
+        // updates are not applied twice
+        {
+            InMemoryDBImpl primary;
+            primary.openAppendLog(logPath);
+            primary.setAutoRewrite(0, 0);
+            for (int i = 0; i < 6000; i++) {
+                primary.set("w" + std::to_string(i), "n", std::to_string(i));
+            }
+            primary.listPush("queue", "items", "a");
+            primary.listPush("queue", "items", "b");
+            
+            assert_test(primary.rewriteAppendLog() && !primary.rewriteAppendLog(), "Log rewrite starts once");
+            primary.listPush("queue", "items", "c");
+            primary.set("w1", "n", "changed");
+            primary.deleteRecord("w2");
+            primary.set("fresh", "n", "new");
+            primary.flushAppendLog(); // Captures one bounded step
+            primary.listPush("queue", "items", "d");
+            primary.set("w5999", "n", "late");
+            primary.waitForAppendLogRewrite();
+        }
+        {
+            InMemoryDBImpl replayed;
+            replayed.openAppendLog(logPath);
+            assert_test(replayed.listRange("queue", "items", 0, 10) == std::vector<std::string>{"a", "b", "c", "d"} &&
+                        replayed.get("w1", "n") == "changed" && !replayed.hasRecord("w2") &&
+                        replayed.get("w3", "n") == "3" && replayed.get("w5999", "n") == "late" &&
+                        replayed.get("fresh", "n") == "new" && replayed.getRecordCount() == 6001,
+                        "Records changed during a rewrite replay exactly once");
+        }
+        std::remove(logPath.c_str());
+        
+        // Automatic rewrites are only marked due by writes and start on the next flush
+        {
+            InMemoryDBImpl primary;
+            primary.openAppendLog(logPath);
+            primary.setAutoRewrite(100, 1024);
+            uint64_t previous = 0;
+            bool grew = true;
+            for (int i = 0; i < 2000; i++) {
+                primary.set("hot", "n", std::to_string(i));
+                grew = grew && primary.appendLogSize() > previous;
+                previous = primary.appendLogSize();
+            }
+            primary.flushAppendLog();
+            primary.waitForAppendLogRewrite();
+            assert_test(grew && primary.appendLogSize() < previous / 10, "Due automatic rewrite runs from the flush");
+        }
+        
+        std::remove(logPath.c_str());
+        std::cout << std::endl;
+    }
+    
+    void testCheckpointRecovery() {
+        std::cout << "=== Checkpoint Recovery ===" << std::endl;
+        
+        const std::string logPath = "test_db_recovery.log";
+        const std::string checkpointPath = "test_db_recovery.checkpoint";
+        std::remove(logPath.c_str());
+        std::remove(checkpointPath.c_str());
+        std::remove((checkpointPath + ".snapshot").c_str());
+        
+        {
+            InMemoryDBImpl primary;
+            primary.openAppendLog(logPath);
+            for (int i = 0; i < 50; i++) {
+                primary.set("rec" + std::to_string(i), "value", "before");
+            }
+            primary.setTTL("rec0", 3600);
+            assert_test(primary.checkpoint(checkpointPath), "Checkpoint writes snapshot and metadata");
+            
+            // Log tail after the checkpoint
+            primary.set("rec1", "value", "after");
+            primary.deleteRecord("rec2");
+            primary.set("tail", "value", "new");
+            primary.flushAppendLog();
+        }
+        
+        InMemoryDBImpl recovered;
+        bool ok = recovered.recover(checkpointPath, logPath);
+        auto rec1 = recovered.get("rec1", "value");
+        auto rec3 = recovered.get("rec3", "value");
+        assert_test(ok && recovered.getAllRecordIds().size() == 50, "Recovery restores snapshot plus log tail");
+        assert_test(rec1.has_value() && rec1.value() == "after", "Recovery applies tail updates");
+        assert_test(!recovered.hasRecord("rec2") && recovered.hasRecord("tail"), "Recovery applies tail deletes and inserts");
+        assert_test(rec3.has_value() && rec3.value() == "before", "Recovery keeps snapshot data");
+        
+        // Recovered database keeps logging to the same log
+        recovered.set("post", "value", "recovery");
+        recovered.flushAppendLog();
+        
+        // A snapshot that no longer matches its metadata falls back to full replay
+        {
+            std::ofstream snapshotFile(checkpointPath + ".snapshot", std::ios::binary | std::ios::app);
+            snapshotFile << "x";
+        }
+        InMemoryDBImpl fallback;
+        bool fallbackOk = fallback.recover(checkpointPath, logPath);
+        assert_test(fallbackOk && fallback.getAllRecordIds() == recovered.getAllRecordIds(),
+                    "Inconsistent checkpoint falls back to full log replay");
+        
+        // A corrupt entry covered by a checkpoint still ends the valid log, as it would without the checkpoint
+        std::string frames;
+        size_t firstFrame = 0;
+        for (uint64_t seq = 1; seq <= 3; seq++) {
+            LogEntry entry;
+            entry.seq = seq;
+            entry.op = LogOp::Set;
+            entry.recordId = "frame" + std::to_string(seq);
+            entry.field = "value";
+            entry.value = "v";
+            encodeLogEntry(entry, frames);
+            if (seq == 1) firstFrame = frames.size();
+        }
+        frames[frames.size() * 2 / 3 - 2] ^= 0x40; // Inside the second frame's payload
+        {
+            std::ofstream corrupt(logPath, std::ios::binary | std::ios::trunc);
+            corrupt << frames;
+        }
+        std::vector<uint64_t> replayed[2];
+        uint64_t validBytes[2];
+        for (int covered = 0; covered < 2; covered++) {
+            replayLogFile(logPath, [&](const LogEntry& entry) { replayed[covered].push_back(entry.seq); },
+                          &validBytes[covered], covered ? 2 : 0);
+        }
+        assert_test(replayed[0] == std::vector<uint64_t>{1} && replayed[1].empty() && validBytes[0] == firstFrame &&
+                    validBytes[1] == firstFrame,
+                    "Replay checksums entries skipped by a checkpoint and stops at a corrupt one");
+        
+        std::remove(logPath.c_str());
+        std::remove(checkpointPath.c_str());
+        std::remove((checkpointPath + ".snapshot").c_str());
+        std::cout << std::endl;
+    }
+    
+    void testChangeStream() {
+        std::cout << "=== Change Data Capture ===" << std::endl;
+        
+        InMemoryDBImpl source;
+        auto stream = source.enableChangeStream(8);
+        
+        source.set("cdc1", "name", "Alice");
+        source.deleteField("cdc1", "name");
+        source.set("cdc2", "name", "Bob");
+        source.deleteRecord("cdc2");
+        source.set("cdc3", "name", "Temp");
+        source.setTTL("cdc3", 0);
+        source.expireRecords();
+        
+        uint64_t cursor = 0;
+        std::vector<LogEntry> events;
+        bool complete = stream->read(cursor, events);
+        
+        bool typesMatch = events.size() == 7 && events[0].op == LogOp::Set && events[1].op == LogOp::DeleteField &&
+                          events[3].op == LogOp::DeleteRecord && events[5].op == LogOp::SetTTL &&
+                          events[6].op == LogOp::Expire && events[6].recordId == "cdc3";
+        assert_test(complete && typesMatch, "Stream emits set/deleteField/deleteRecord/expire events in order");
+        assert_test(events.front().seq == 1 && events.back().seq == 7 && cursor == 7, "Events carry consecutive sequence numbers");
+        
+        // A second reader consumes independently from its own cursor
+        uint64_t otherCursor = 5;
+        std::vector<LogEntry> otherEvents;
+        stream->read(otherCursor, otherEvents, 1);
+        assert_test(otherEvents.size() == 1 && otherEvents[0].seq == 6 && otherCursor == 6,
+                    "Readers consume at their own pace");
+        
+        // The writer laps a slow reader: the reader is told it lost events
+        for (int i = 0; i < 20; i++) {
+            source.set("hot", "counter", std::to_string(i));
+        }
+        std::vector<LogEntry> lapped;
+        bool notLost = stream->read(otherCursor, lapped);
+        assert_test(!notLost && otherCursor + 1 == stream->oldestSeq(), "Slow reader detects overwritten events");
+        
+        // A reader on another thread is woken by new events
+        uint64_t threadCursor = stream->headSeq();
+        std::vector<LogEntry> received;
+        std::thread consumer([&]() {
+            if (stream->waitForEvents(threadCursor, std::chrono::milliseconds(2000))) {
+                stream->read(threadCursor, received);
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        source.set("wake", "field", "value");
+        consumer.join();
+        assert_test(received.size() == 1 && received[0].recordId == "wake", "Waiting reader receives new events");
+        
+        std::cout << std::endl;
+    }
+    
+    void testReplication() {
+        std::cout << "=== Replication ===" << std::endl;
+        
+        InMemoryDBImpl source;
+        source.set("rep1", "name", "Alice");
+        source.set("rep2", "name", "Bob");
+        
+        ReplicationPrimary primary(source, "unix:test_replication.sock", 64);
+        assert_test(primary.isListening(), "Primary listens on a Unix socket");
+        
+        // The primary's owner pumps full syncs while waiting
+        auto waitFor = [&](const std::function<bool()>& condition) {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (!condition() && std::chrono::steady_clock::now() < deadline) {
+                primary.pump();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return condition();
+        };
+        auto stream = source.changeStream();
+        
+        ReplicationReplica replica(primary.endpoint());
+        bool synced = waitFor([&]() { return replica.fullSyncCount() == 1; });
+        assert_test(synced && replica.get("rep1", "name") == "Alice" && replica.getAllRecordIds().size() == 2,
+                    "Replica loads existing data with a full sync");
+        
+        source.set("rep3", "name", "Carol");
+        source.deleteField("rep1", "name");
+        source.deleteRecord("rep2");
+        bool caughtUp = waitFor([&]() { return replica.appliedSeq() == stream->headSeq(); });
+        assert_test(caughtUp && replica.get("rep3", "name") == "Carol" && !replica.hasRecord("rep1") &&
+                    !replica.hasRecord("rep2"), "Replica applies shipped mutations");
+        
+        // Drop the link and write meanwhile: the replica resumes from the backlog
+        primary.disconnectReplicas();
+        source.set("rep4", "name", "Dave");
+        caughtUp = waitFor([&]() { return replica.appliedSeq() == stream->headSeq(); });
+        assert_test(caughtUp && replica.get("rep4", "name") == "Dave" && replica.fullSyncCount() == 1,
+                    "Reconnecting replica performs a partial resync");
+        
+        // Falling further behind than the backlog forces a full sync
+        primary.disconnectReplicas();
+        for (int i = 0; i < 200; i++) {
+            source.set("bulk" + std::to_string(i), "n", std::to_string(i));
+        }
+        synced = waitFor([&]() { return replica.fullSyncCount() == 2 && replica.appliedSeq() == stream->headSeq(); });
+        assert_test(synced && replica.get("bulk199", "n") == "199", "Lapped replica falls back to a full sync");
+
+        source.set("signal", "n", "1");
+        bool woken = replica.waitForSeq(stream->headSeq(), std::chrono::milliseconds(2000));
+        assert_test(woken && replica.get("signal", "n") == "1" &&
+                    !replica.waitForSeq(stream->headSeq() + 1, std::chrono::milliseconds(20)),
+                    "waitForSeq wakes on applied events and times out otherwise");
+
+        // A restore on the primary replaces the replica's data as well
+        // The blob spans several snapshot chunks
+        InMemoryDBImpl other;
+        other.set("restored", "name", "Eve");
+        other.set("restored", "blob", std::string(9 << 20, 'b'));
+        source.restore(other.backup());
+        synced = waitFor([&]() { return replica.fullSyncCount() == 3 && replica.appliedSeq() == stream->headSeq(); });
+        assert_test(synced && replica.getAllRecordIds() == std::vector<std::string>{"restored"},
+                    "Restore on the primary triggers a full sync");
+        assert_test(replica.get("restored", "blob").value_or("").size() == (9u << 20),
+                    "Large snapshots arrive in bounded chunks");
+        
+        size_t count = 0;
+        replica.read([&](const InMemoryDBImpl& copy) { count = copy.getRecordCount(); });
+        assert_test(count == 1 && primary.replicaCount() == 1, "Replica serves consistent reads");
+        
+        std::cout << std::endl;
+    }
+    
+    void testReadReplicas() {
+        std::cout << "=== In-Process Read Replicas ===" << std::endl;
+        
+        assert_test(numa::parseList("0-2,5") == std::vector<int>{0, 1, 2, 5} && !numa::nodes().empty(),
+                    "NUMA topology helpers parse kernel lists");
+        
+        InMemoryDBImpl source;
+        source.set("rr1", "city", "Paris");
+        source.set("rr2", "city", "Oslo");
+        
+        ReadReplicaSet replicas(source, 2, std::chrono::milliseconds(0), true, 64);
+        
+        // The database owner pumps full syncs until every replica is current
+        auto waitForReplicas = [&]() {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            auto current = [&]() {
+                for (size_t i = 0; i < replicas.size(); i++) {
+                    if (replicas.staleness(i).count() != 0) return false;
+                }
+                return true;
+            };
+            while (!current() && std::chrono::steady_clock::now() < deadline) {
+                replicas.pump();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return current();
+        };
+        
+        std::vector<int> nodes = numa::nodes();
+        bool placed = std::find(nodes.begin(), nodes.end(), replicas.replicaNode(1)) != nodes.end();
+        assert_test(waitForReplicas() && placed && replicas.get("rr1", "city") == "Paris",
+                    "Replicas load existing data on their nodes");
+        
+        // Zero staleness gives read-your-writes
+        source.set("rr3", "city", "Paris");
+        source.deleteRecord("rr2");
+        std::vector<std::string> paris = replicas.getRecordsByFieldValue("city", "Paris");
+        std::sort(paris.begin(), paris.end());
+        assert_test(paris == std::vector<std::string>{"rr1", "rr3"} && !replicas.hasRecord("rr2"),
+                    "Reads with zero staleness see the latest writes");
+        
+        // Readers on other threads run while the writer keeps writing
+        replicas.setMaxStaleness(std::chrono::milliseconds(50));
+        std::atomic<int> readsDone{0};
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 2; t++) {
+            readers.emplace_back([&]() {
+                for (int i = 0; i < 200; i++) {
+                    if (replicas.get("rr1", "city") == "Paris") readsDone++;
+                }
+            });
+        }
+        for (int i = 0; i < 500; i++) {
+            source.set("counter", "value", std::to_string(i));
+        }
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        bool caughtUp = waitForReplicas();
+        assert_test(readsDone == 400 && caughtUp && replicas.get("counter", "value") == "499",
+                    "Concurrent reads are served while replicas apply writes");
+        
+        // A restore on the writer resynchronizes every replica
+        InMemoryDBImpl other;
+        other.set("fresh", "city", "Rome");
+        source.restore(other.backup());
+        caughtUp = waitForReplicas();
+        assert_test(caughtUp && replicas.get("fresh", "city") == "Rome" && !replicas.hasRecord("rr1") &&
+                    replicas.appliedSeq(0) == source.changeStream()->headSeq(),
+                    "Restore on the writer triggers a full sync of every replica");
+        
+        std::cout << std::endl;
+    }
+    
+    void testShardedDB() {
+        std::cout << "=== NUMA-Aware Sharding ===" << std::endl;
+        
+        ShardedInMemoryDB sharded(4, ShardPlacement::Local);
+        std::vector<int> nodes = numa::nodes();
+        bool placed = true;
+        for (size_t shard = 0; shard < sharded.shardCount(); shard++) {
+            placed = placed && sharded.shardNode(shard) == nodes[shard % nodes.size()];
+        }
+        assert_test(sharded.shardCount() == 4 && placed, "Shards are spread over NUMA nodes");
+        
+        // Concurrent writers route requests to the shard owners
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; t++) {
+            writers.emplace_back([&, t]() {
+                for (int i = 0; i < 100; i++) {
+                    std::string recordId = "s" + std::to_string(t) + ":" + std::to_string(i);
+                    sharded.set(recordId, "team", i % 2 == 0 ? "even" : "odd");
+                }
+            });
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        assert_test(sharded.getRecordCount() == 400 && sharded.get("s3:99", "team") == "odd",
+                    "Concurrent writes are routed to their shards");
+        std::vector<std::string> evenIds = sharded.getRecordsByFieldValue("team", "even");
+        std::vector<std::string> allIds = sharded.getAllRecordIds();
+        assert_test(evenIds.size() == 200 && allIds.size() == 400, "Queries fan out to every shard");
+        assert_test(std::is_sorted(evenIds.begin(), evenIds.end()) && std::is_sorted(allIds.begin(), allIds.end()),
+                    "Fanned-out queries return IDs sorted like a single database");
+        
+        size_t perShard = 0;
+        sharded.execute(sharded.shardOf("s0:0"), [&](InMemoryDBImpl& shard) { perShard = shard.hasRecord("s0:0"); });
+        assert_test(perShard == 1 && sharded.deleteRecord("s0:0") && !sharded.hasRecord("s0:0"),
+                    "Records live on the shard they are routed to");
+        
+        // Backups merge the shards and restore into any shard layout
+        sharded.setTTL("s1:1", 3600);
+        std::string data = sharded.backup();
+        InMemoryDBImpl single;
+        bool singleRestored = single.restore(data);
+        ShardedInMemoryDB resharded(3, ShardPlacement::Interleaved);
+        bool reshardedRestored = resharded.restore(data);
+        assert_test(singleRestored && single.getRecordCount() == 399 && reshardedRestored &&
+                    resharded.getRecordCount() == 399 && resharded.get("s2:5", "team") == "odd",
+                    "Sharded backup restores across layouts");
+        std::vector<std::string> reshardedIds = resharded.getAllRecordIds();
+        assert_test(reshardedIds.size() == 399 && std::is_sorted(reshardedIds.begin(), reshardedIds.end()) &&
+                    std::adjacent_find(reshardedIds.begin(), reshardedIds.end()) == reshardedIds.end(),
+                    "Odd shard counts merge into one sorted ID list");
+        assert_test(resharded.backup().find("s1:1\n35") != std::string::npos, "TTL survives sharded backup");
+        assert_test(!resharded.restore("garbage") && resharded.getRecordCount() == 399,
+                    "Failed restore keeps the sharded state");
+        
+        std::cout << std::endl;
+    }
+    
+    void testHugePageStorage() {
+        std::cout << "=== Huge Page Storage ===" << std::endl;
+        
+        InMemoryDBImpl heapDb;
+        heapDb.set("before", "name", "heap");
+        
+        bool enabled = StorageArena::enable(HugePageMode::Transparent);
+        InMemoryDBImpl arenaDb;
+        for (int i = 0; i < 1000; i++) {
+            arenaDb.set("page" + std::to_string(i), "value", std::to_string(i));
+        }
+        heapDb.set("after", "name", "arena");
+        StorageArena::Stats stats = StorageArena::stats();
+        assert_test(enabled && StorageArena::mode() == HugePageMode::Transparent && stats.committedBytes > 0 &&
+                    stats.committedBytes % (2 << 20) == 0, "Storage is committed in 2 MB chunks");
+        assert_test(arenaDb.get("page999", "value") == "999" && heapDb.get("before", "name") == "heap" &&
+                    heapDb.get("after", "name") == "arena", "Records read back from arena and heap storage");
+        
+        // Whole-chunk blocks are reused after being freed
+        StorageAllocator<char> allocator;
+        char* large = allocator.allocate(4 << 20);
+        allocator.deallocate(large, 4 << 20);
+        char* reused = allocator.allocate(4 << 20);
+        assert_test(StorageArena::owns(large) && reused == large, "Large blocks take reusable chunk runs");
+        allocator.deallocate(reused, 4 << 20);
+        
+        // Below a chunk, a block would waste most of one: it stays on the heap
+        char* medium = allocator.allocate(1 << 20);
+        assert_test(!StorageArena::owns(medium), "Blocks smaller than a chunk do not take whole chunks");
+        allocator.deallocate(medium, 1 << 20);
+        
+        // Switching back off: arena blocks are still freed correctly, new storage uses the heap
+        StorageArena::enable(HugePageMode::Off);
+        for (int i = 0; i < 500; i++) {
+            arenaDb.deleteRecord("page" + std::to_string(i));
+        }
+        InMemoryDBImpl copy;
+        bool restored = copy.restore(arenaDb.backup());
+        char* small = allocator.allocate(64);
+        assert_test(restored && copy.getRecordCount() == 500 && copy.get("page500", "value") == "500" &&
+                    !StorageArena::owns(small), "Storage mode can change with live records");
+        allocator.deallocate(small, 64);
+        
+        std::cout << std::endl;
+    }
+    
+    void testBatchedLookups() {
+        std::cout << "=== Batched Lookups ===" << std::endl;
+        
+        InMemoryDBImpl batchDb;
+        std::vector<std::string> recordIds;
+        for (int i = 0; i < 100; i++) {
+            std::string recordId = "batch" + std::to_string(i);
+            if (i % 3 != 0) {
+                batchDb.set(recordId, i % 5 == 0 ? "other" : "color", "c" + std::to_string(i));
+            }
+            recordIds.push_back(recordId);
+        }
+        batchDb.set("batch1", "color", "expired");
+        batchDb.setTTL("batch1", 0);
+        recordIds.push_back("batch2"); // Duplicates are answered independently
+        
+        std::vector<std::optional<std::string>> values = batchDb.getMany(recordIds, "color");
+        std::vector<bool> present = batchDb.hasRecords(recordIds);
+        bool matchesGet = values.size() == recordIds.size() && present.size() == recordIds.size();
+        for (size_t i = 0; matchesGet && i < recordIds.size(); i++) {
+            matchesGet = values[i] == batchDb.get(recordIds[i], "color") &&
+                         present[i] == batchDb.hasRecord(recordIds[i]);
+        }
+        assert_test(matchesGet, "getMany/hasRecords match get/hasRecord across groups");
+        assert_test(!values[1] && !present[1] && !values[3] && !values[5] && values[2] == "c2" && values[100] == "c2",
+                    "Batched lookups skip expired, missing and fieldless records");
+        assert_test(batchDb.getMany({}, "color").empty() && InMemoryDBImpl().getMany({"x"}, "y")[0] == std::nullopt,
+                    "Batched lookups handle empty inputs and tables");
+        
+        std::cout << std::endl;
+    }
+    
+    void testRecordFilter() {
+        std::cout << "=== Record Filter ===" << std::endl;
+        
+        RecordFilter filter(1000, 0.01);
+        for (int i = 0; i < 1000; i++) {
+            filter.add("key" + std::to_string(i));
+        }
+        int falsePositives = 0;
+        for (int i = 0; i < 10000; i++) {
+            falsePositives += filter.mayContain("absent" + std::to_string(i));
+        }
+        for (int i = 0; i < 500; i++) {
+            filter.remove("key" + std::to_string(i));
+        }
+        bool noFalseNegatives = true;
+        for (int i = 500; i < 1000; i++) {
+            noFalseNegatives = noFalseNegatives && filter.mayContain("key" + std::to_string(i));
+        }
+        assert_test(falsePositives < 300 && noFalseNegatives && filter.size() == 500,
+                    "Counting filter has no false negatives and a low false-positive rate");
+        
+        InMemoryDBImpl filtered;
+        filtered.set("early", "name", "before filter");
+        filtered.enableRecordFilter(0.01);
+        for (int i = 0; i < 3000; i++) {
+            filtered.set("rf" + std::to_string(i), "n", std::to_string(i));
+        }
+        bool allFound = filtered.hasRecord("early");
+        for (int i = 0; i < 3000; i++) {
+            allFound = allFound && filtered.get("rf" + std::to_string(i), "n") == std::to_string(i);
+        }
+        InMemoryDBImpl::RecordFilterStats stats = filtered.recordFilterStats();
+        assert_test(allFound && stats.enabled && stats.keys == 3001 && stats.capacity >= 3001,
+                    "Filter grows with the dataset and keeps every record reachable");
+        
+        for (int i = 0; i < 1000; i++) {
+            filtered.get("missing" + std::to_string(i), "n");
+        }
+        uint64_t misses = filtered.recordFilterStats().definiteMisses;
+        assert_test(misses > 900 && !filtered.hasRecord("missing1") && filtered.getMany({"missing2"}, "n")[0] == std::nullopt,
+                    "Absent records are answered by the filter");
+        
+        filtered.deleteRecord("rf0");
+        filtered.deleteField("rf1", "n");
+        filtered.set("rf0", "n", "back");
+        bool tracked = filtered.get("rf0", "n") == "back" && !filtered.hasRecord("rf1") &&
+                       filtered.recordFilterStats().keys == 3000;
+        InMemoryDBImpl other;
+        other.set("restored", "n", "1");
+        filtered.restore(other.backup());
+        assert_test(tracked && filtered.hasRecord("restored") && filtered.recordFilterStats().keys == 1,
+                    "Filter follows deletes, re-inserts and restores");
+        
+        ShardedInMemoryDB sharded(2, ShardPlacement::None);
+        sharded.set("s1", "n", "1");
+        sharded.enableRecordFilter();
+        sharded.set("s2", "n", "2");
+        assert_test(sharded.get("s1", "n") == "1" && sharded.get("s2", "n") == "2" && !sharded.hasRecord("s3"),
+                    "Sharded database keeps a filter per shard");
+        
+        std::cout << std::endl;
+    }
+    
+    void testTieredStorage() {
+        std::cout << "=== Tiered Storage ===" << std::endl;
+        
+        const std::string tierPath = "test_db_tier.seg";
+        const std::string value(200, 'v');
+        InMemoryDBImpl tiered;
+        for (int i = 0; i < 2000; i++) {
+            tiered.set("t" + std::to_string(i), "a", value + std::to_string(i));
+            tiered.set("t" + std::to_string(i), "b", std::to_string(i % 7));
+        }
+        bool enabled = tiered.enableTiering(tierPath, 64 * 1024);
+        InMemoryDBImpl::TieringStats stats = tiered.tieringStats();
+        assert_test(enabled && stats.coldRecords > 1500 && stats.residentBytes <= 64 * 1024 &&
+                    stats.coldRecords + stats.residentRecords == 2000 && tiered.getRecordCount() == 2000,
+                    "Cold records are evicted to disk under the memory cap");
+        
+        // The first pass evicts records in ID order, so the second pass loads them sequentially
+        bool allFound = true;
+        for (int pass = 0; pass < 2; pass++) {
+            for (int i = 0; i < 2000; i++) {
+                allFound = allFound && tiered.get("t" + std::to_string(i), "a") == value + std::to_string(i);
+            }
+        }
+        stats = tiered.tieringStats();
+        assert_test(allFound && stats.residentBytes <= 64 * 1024 && stats.diskReads + stats.readaheadHits >= 3000 &&
+                    stats.readaheadHits > 0,
+                    "Cold records load back transparently, with readahead for sequential loads");
+        
+        tiered.set("t5", "c", "new");
+        tiered.deleteField("t6", "b");
+        tiered.deleteRecord("t7");
+        std::vector<std::string> sixes = tiered.getRecordsByFieldValue("b", "6");
+        bool scanned = sixes.size() == 284 && tiered.getFields("t5").size() == 3 &&
+                       tiered.getFields("t6") == std::vector<std::string>{"a"} && !tiered.hasRecord("t7");
+        
+        InMemoryDBImpl copy;
+        bool restored = copy.restore(tiered.backup()) && copy.getRecordCount() == 1999 &&
+                        copy.get("t1234", "a") == value + "1234" && copy.get("t5", "c") == "new";
+        assert_test(scanned && restored, "Writes, scans and backups see cold records");
+        
+        tiered.restore(copy.backup());
+        stats = tiered.tieringStats();
+        bool reset = stats.coldRecords + stats.residentRecords == 1999 && tiered.get("t0", "b") == "0";
+        tiered.disableTiering();
+        std::ifstream removed(tierPath);
+        assert_test(reset && !tiered.tieringStats().enabled && tiered.get("t1999", "a") == value + "1999" &&
+                    tiered.getRecordCount() == 1999 && !removed.good(),
+                    "Restores reset the tier and disabling it loads every record back");
+
+        // Compaction copies on a background thread while stores keep appending
+        const std::string segmentValue(1000, 's');
+        TierStore segments(0);
+        segments.open("test_db_compact.seg");
+        for (int round = 0; round < 3; round++) {
+            for (int i = 0; i < 1000; i++) {
+                segments.store("c" + std::to_string(i), segmentValue + std::to_string(round));
+            }
+        }
+        std::string moving = "start";
+        segments.store("moving", moving);
+        for (int i = 0; segments.stats().compactions == 0 && i < 5000; i++) {
+            moving = std::to_string(i);
+            segments.store("moving", moving);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::string loaded;
+        bool compactedIntact = segments.load("moving", loaded) && loaded == moving;
+        for (int i = 0; i < 1000; i++) {
+            compactedIntact = compactedIntact && segments.load("c" + std::to_string(i), loaded) && loaded == segmentValue + "2";
+        }
+        TierStore::Stats segmentStats = segments.stats();
+        assert_test(segmentStats.compactions >= 1 && compactedIntact && segmentStats.records == 1001 &&
+                    segmentStats.garbageBytes < segmentStats.fileBytes / 2,
+                    "Background compaction keeps every record, including ones stored while it ran");
+        for (int round = 0; round < 2; round++) {
+            for (int i = 0; i < 1000; i++) {
+                segments.store("c" + std::to_string(i), segmentValue);
+            }
+        }
+        segments.clear();
+        segments.store("after", "clear");
+        assert_test(segments.stats().records == 1 && !segments.contains("c0") && segments.load("after", loaded) &&
+                    loaded == "clear", "Clearing the tier drops a compaction in progress");
+
+        std::cout << std::endl;
+    }
+    
+    void testValueCompression() {
+        std::cout << "=== Value Compression ===" << std::endl;
+        
+        auto profileJson = [](int i) {
+            std::string json = "{\"id\":" + std::to_string(i) + ",\"name\":\"User " + std::to_string(i) +
+                               "\",\"plan\":\"" + (i % 3 == 0 ? "premium" : "basic") + "\",\"history\":[";
+            for (int j = 0; j < 25; j++) {
+                json += "{\"event\":\"page_view\",\"path\":\"/products/" + std::to_string((i * 7 + j) % 50) +
+                        "\",\"timestamp\":" + std::to_string(1700000000 + i * 100 + j) + ",\"device\":\"" +
+                        (j % 3 == 0 ? "mobile" : "desktop") + "\"},";
+            }
+            return json + "{}]}";
+        };
+        
+        InMemoryDBImpl db;
+        db.set("early", "profile", profileJson(1000));
+        db.enableValueCompression("profile", 512);
+        for (int i = 0; i < 100; i++) {
+            db.set("p" + std::to_string(i), "profile", profileJson(i));
+            db.set("p" + std::to_string(i), "note", profileJson(i));
+        }
+        bool roundTrip = db.get("early", "profile") == profileJson(1000);
+        for (int i = 0; i < 100; i++) {
+            roundTrip = roundTrip && db.get("p" + std::to_string(i), "profile") == profileJson(i);
+        }
+        InMemoryDBImpl::ValueCompressionStats stats = db.valueCompressionStats("profile");
+        assert_test(roundTrip && stats.compressedValues == 101 && stats.dictionaryBytes > 0 &&
+                    stats.rawBytes > 4 * stats.storedBytes && !db.valueCompressionStats("note").enabled,
+                    "Large values are compressed with a trained dictionary and read back unchanged");
+        
+        const std::string tagged = std::string("\x01") + "raw";
+        const std::string longTagged = std::string("\x02") + std::string(600, 'x');
+        db.set("odd", "profile", tagged);
+        db.set("odd2", "profile", longTagged);
+        db.set("small", "profile", "tiny");
+        assert_test(db.get("odd", "profile") == tagged && db.get("odd2", "profile") == longTagged &&
+                    db.get("small", "profile") == "tiny" &&
+                    db.getRecordsByFieldValue("profile", profileJson(42)) == std::vector<std::string>{"p42"} &&
+                    db.getRecordsByFieldValue("profile", tagged) == std::vector<std::string>{"odd"} &&
+                    db.getMany({"p7", "small"}, "profile")[0] == profileJson(7),
+                    "Small and tag-like values are stored safely and lookups see plain values");
+        
+        InMemoryDBImpl copy;
+        copy.enableValueCompression("profile", 512);
+        bool restored = copy.restore(db.backup()) && copy.get("p99", "profile") == profileJson(99) &&
+                        copy.get("odd", "profile") == tagged && copy.valueCompressionStats("profile").compressedValues > 100;
+        InMemoryDBImpl fromSnapshot;
+        bool snapshotted = fromSnapshot.restoreSnapshot(db.snapshot()) &&
+                           fromSnapshot.get("p3", "profile") == profileJson(3);
+        assert_test(restored && snapshotted, "Backups and snapshots carry plain values; restores compress them");
+        
+        db.disableValueCompression("profile");
+        bool plain = !db.valueCompressionStats("profile").enabled && db.get("p5", "profile") == profileJson(5) &&
+                     db.get("odd", "profile") == tagged;
+        ShardedInMemoryDB sharded(2, ShardPlacement::None);
+        sharded.enableValueCompression("profile", 512);
+        sharded.set("s1", "profile", profileJson(1));
+        assert_test(plain && sharded.get("s1", "profile") == profileJson(1),
+                    "Disabling compression restores plain values; sharded databases compress per shard");
+        
+        std::cout << std::endl;
+    }
+    
+    void testValueInterning() {
+        std::cout << "=== Value Interning ===" << std::endl;
+        
+        const std::string plans[] = {"free", "basic-monthly-subscription", "premium-annual-subscription"};
+        InMemoryDBImpl db;
+        db.set("u0", "plan", plans[0]);
+        db.enableValueInterning();
+        for (int i = 1; i < 2000; i++) {
+            db.set("u" + std::to_string(i), "plan", plans[i % 3]);
+            db.set("u" + std::to_string(i), "email", "user" + std::to_string(i) + "@example.com");
+        }
+        InMemoryDBImpl::InternStats stats = db.internStats("plan");
+        assert_test(stats.interned && stats.distinctValues == 3 && stats.references == 2000 &&
+                    !db.internStats("email").interned && db.get("u0", "plan") == plans[0] &&
+                    db.get("u1000", "plan") == plans[1] && db.get("u7", "email") == "user7@example.com",
+                    "Low-cardinality fields are interned; unique fields are not");
+        
+        db.set("u1", "plan", "enterprise");
+        db.deleteRecord("u2");
+        db.deleteField("u3", "plan");
+        db.set("u4", "plan", plans[1]);
+        stats = db.internStats("plan");
+        assert_test(stats.distinctValues == 4 && stats.references == 1998 &&
+                    db.getRecordsByFieldValue("plan", "enterprise") == std::vector<std::string>{"u1"} &&
+                    db.getRecordsByFieldValue("plan", "missing").empty() &&
+                    db.getRecordsByFieldValue("plan", plans[2]).size() == 665,
+                    "Overwrites and deletes release references; lookups compare handles");
+        
+        db.set("u1", "plan", plans[0]);
+        InMemoryDBImpl copy;
+        copy.enableValueInterning();
+        for (int i = 0; i < 1100; i++) {
+            copy.set("c" + std::to_string(i), "plan", plans[0]);
+        }
+        bool restored = copy.restore(db.backup()) && copy.get("u1000", "plan") == plans[1] &&
+                        copy.internStats("plan").references == 1998 && copy.internStats("plan").distinctValues == 3;
+        assert_test(db.internStats("plan").distinctValues == 3 && restored,
+                    "Unreferenced values leave the pool; restores intern the restored values");
+        
+        InMemoryDBImpl tiered;
+        tiered.enableValueInterning();
+        tiered.enableTiering("test_db_intern.seg", 16 * 1024);
+        for (int i = 0; i < 1500; i++) {
+            tiered.set("t" + std::to_string(i), "plan", plans[i % 3]);
+        }
+        tiered.deleteRecord("t0");
+        bool tieredOk = tiered.tieringStats().coldRecords > 0 && tiered.internStats("plan").references == 1499 &&
+                        tiered.get("t1", "plan") == plans[1] &&
+                        tiered.getRecordsByFieldValue("plan", plans[0]).size() == 499;
+        db.disableValueInterning();
+        assert_test(tieredOk && !db.internStats("plan").interned && db.get("u5", "plan") == plans[2] &&
+                    db.getRecordsByFieldValue("plan", plans[2]).size() == 665,
+                    "Cold records keep their references; disabling interning restores plain values");
+        
+        std::cout << std::endl;
+    }
+    
+    void testRecordLayout() {
+        std::cout << "=== Record Layout ===" << std::endl;
+        
+        InMemoryDBImpl db;
+        for (int i : {3, 0, 5, 1, 4, 2}) {
+            db.set("small", "f" + std::to_string(i), "v" + std::to_string(i));
+        }
+        db.deleteField("small", "f1");
+        db.set("small", "f3", "updated");
+        InMemoryDBImpl::RecordLayoutStats stats = db.recordLayoutStats();
+        assert_test(stats.packedRecords == 1 && stats.hashedRecords == 0 &&
+                    db.getFields("small") == std::vector<std::string>{"f0", "f2", "f3", "f4", "f5"} &&
+                    db.get("small", "f3") == "updated" && db.get("small", "f5") == "v5" && !db.get("small", "f1"),
+                    "Small records use the packed layout; deletes keep the other fields");
+        
+        // Deleting fills the hole with the last pair; the first, last and re-added fields must all survive it
+        db.deleteField("small", "f3");  // First pair
+        db.deleteField("small", "f2");  // Last pair
+        db.set("small", "f1", "back");
+        db.set("small", "f0", "v0 again");
+        bool overwritten = db.getFields("small") == std::vector<std::string>{"f0", "f1", "f4", "f5"} &&
+                           db.get("small", "f0") == "v0 again" && db.get("small", "f1") == "back" &&
+                           db.get("small", "f4") == "v4" && db.get("small", "f5") == "v5" && !db.get("small", "f3") &&
+                           !db.deleteField("small", "f3");
+        for (const std::string& field : db.getFields("small")) {
+            db.deleteField("small", field);
+        }
+        assert_test(overwritten && !db.hasRecord("small") && db.recordLayoutStats().packedRecords == 0,
+                    "Overwrites and deletes inside a packed record keep every other pair");
+        
+        const std::string withNul("a\0b\0", 4);
+        db.set("bytes", "empty", "");
+        db.set("bytes", "nul", withNul);
+        db.set("bytes", std::string("key\0x", 5), "odd name");
+        bool binary = db.get("bytes", "empty") == "" && db.get("bytes", "nul") == withNul &&
+                      db.get("bytes", std::string("key\0x", 5)) == "odd name" && !db.get("bytes", "key") &&
+                      db.getRecordsByFieldValue("nul", withNul) == std::vector<std::string>{"bytes"} &&
+                      db.getRecordsByFieldValue("empty", "") == std::vector<std::string>{"bytes"};
+        assert_test(binary && db.getFields("bytes").size() == 3, "Packed records keep empty values and embedded NULs");
+        
+        // Promoted at PACKED_MAX_FIELDS + 1 fields, packed again once deletes leave half as many
+        const size_t packedMax = InMemoryDBImpl::FieldMap::PACKED_MAX_FIELDS;
+        for (size_t i = 0; i < packedMax; i++) {
+            db.set("wide", "f" + std::to_string(i), "value " + std::to_string(i));
+        }
+        bool packedAtMax = db.recordLayoutStats().hashedRecords == 0;
+        db.set("wide", "f" + std::to_string(packedMax), "value " + std::to_string(packedMax));
+        bool promoted = packedAtMax && db.recordLayoutStats().hashedRecords == 1 && db.getFields("wide").size() == 9 &&
+                        db.get("wide", "f8") == "value 8" && db.get("wide", "f0") == "value 0";
+        assert_test(promoted, "Records past the field threshold are promoted to a hash table");
+        
+        for (size_t i = packedMax; i > packedMax / 2; i--) {
+            db.deleteField("wide", "f" + std::to_string(i));
+        }
+        bool staysHashed = db.recordLayoutStats().hashedRecords == 1 && db.getFields("wide").size() == 5;
+        db.deleteField("wide", "f4");
+        db.set("wide", "f1", "value 1 again");
+        bool demoted = staysHashed && db.recordLayoutStats().hashedRecords == 0 &&
+                       db.getFields("wide") == std::vector<std::string>{"f0", "f1", "f2", "f3"} &&
+                       db.get("wide", "f1") == "value 1 again" && db.get("wide", "f3") == "value 3" &&
+                       !db.get("wide", "f4");
+        assert_test(demoted, "Deletes return a promoted record to the packed layout at half the threshold");
+        
+        for (size_t i = 0; i <= packedMax; i++) {
+            db.set("hashed", "f" + std::to_string(i), i == 3 ? withNul : "h" + std::to_string(i));
+        }
+        InMemoryDBImpl copy;
+        stats = db.recordLayoutStats();
+        bool restored = copy.restore(db.backup()) && stats.packedRecords == 2 && stats.hashedRecords == 1 &&
+                        copy.recordLayoutStats().packedRecords == 2 && copy.recordLayoutStats().hashedRecords == 1 &&
+                        copy.getFields("wide") == db.getFields("wide") && copy.get("wide", "f1") == "value 1 again" &&
+                        copy.get("bytes", "empty") == "" && copy.get("bytes", "nul") == withNul &&
+                        copy.get("bytes", std::string("key\0x", 5)) == "odd name" &&
+                        copy.get("hashed", "f3") == withNul &&
+                        copy.getMany({"wide", "hashed", "none"}, "f2") ==
+                            std::vector<std::optional<std::string>>{"value 2", "h2", std::nullopt};
+        assert_test(restored, "Backups round-trip packed and hashed records");
+        
+        std::cout << std::endl;
+    }    
+    void testNativeCollections() {
+        std::cout << "=== Native Collections ===" << std::endl;
+        
+        const std::string logPath = "test_db_collections.log";
+        std::remove(logPath.c_str());
+        
+        InMemoryDBImpl db;
+        db.openAppendLog(logPath);
+        db.listPush("queue", "jobs", "b");
+        db.listPush("queue", "jobs", "c");
+        db.listPush("queue", "jobs", "a", true);
+        auto first = db.listPop("queue", "jobs", true);
+        assert_test(first == "a" && db.listRange("queue", "jobs", 0, 10) == std::vector<std::string>{"b", "c"} &&
+                    db.listRange("queue", "jobs", 1, 1) == std::vector<std::string>{"c"} &&
+                    db.collectionSize("queue", "jobs") == 2,
+                    "Lists push and pop at both ends");
+        
+        bool added = db.setAdd("user1", "tags", "admin") && db.setAdd("user1", "tags", "beta") &&
+                     !db.setAdd("user1", "tags", "admin");
+        bool removed = db.setRemove("user1", "tags", "beta") && !db.setRemove("user1", "tags", "beta");
+        assert_test(added && removed && db.setContains("user1", "tags", "admin") &&
+                    !db.setContains("user1", "tags", "beta") &&
+                    db.setMembers("user1", "tags") == std::vector<std::string>{"admin"},
+                    "Sets add, remove and test members");
+        
+        for (int i = 0; i < 100; i++) {
+            db.sortedSetAdd("board", "scores", "p" + std::to_string(i), 100 - i);
+        }
+        db.sortedSetAdd("board", "scores", "p0", 0.5);
+        auto top = db.sortedSetRange("board", "scores", 0, 2);
+        assert_test(db.sortedSetRank("board", "scores", "p0") == size_t(0) &&
+                    db.sortedSetRank("board", "scores", "p99") == size_t(1) &&
+                    db.sortedSetRank("board", "scores", "p1") == size_t(99) &&
+                    db.sortedSetScore("board", "scores", "p0") == 0.5 && top.size() == 3 &&
+                    top[2].first == "p98" && !db.sortedSetAdd("board", "scores", "bad", std::nan("")),
+                    "Sorted sets order members by score with O(log n) rank");
+        
+        db.set("user1", "name", "Alice");
+        bool mismatched = !db.listPush("user1", "tags", "x") && !db.setAdd("user1", "name", "x") &&
+                          !db.listPop("user1", "name") && db.setMembers("queue", "jobs").empty();
+        db.listPop("queue", "jobs");
+        db.listPop("queue", "jobs");
+        assert_test(mismatched && !db.hasRecord("queue") && db.collectionSize("queue", "jobs") == 0,
+                    "Type mismatches are rejected and emptied collections are removed");
+        
+        InMemoryDBImpl copy;
+        bool restored = copy.restore(db.backup()) && copy.setContains("user1", "tags", "admin") &&
+                        copy.sortedSetRank("board", "scores", "p99") == size_t(1) &&
+                        copy.get("user1", "tags") == db.get("user1", "tags");
+        db.flushAppendLog();
+        InMemoryDBImpl replayed;
+        replayed.openAppendLog(logPath);
+        assert_test(restored && replayed.sortedSetScore("board", "scores", "p0") == 0.5 &&
+                    replayed.setMembers("user1", "tags") == std::vector<std::string>{"admin"} &&
+                    !replayed.hasRecord("queue"),
+                    "Collections survive backup and log replay");
+        
+        // A plain value shaped like a serialized collection stays a plain value everywhere
+        std::string lookalike = *db.get("user1", "tags");
+        db.set("user2", "tags", lookalike);
+        db.set("user2", "note", std::string(1, '\x02') + "escaped");
+        InMemoryDBImpl fromBackup;
+        InMemoryDBImpl fromSnapshot;
+        fromBackup.restore(db.backup());
+        fromSnapshot.restoreSnapshot(db.snapshot());
+        db.flushAppendLog();
+        InMemoryDBImpl fromLog;
+        fromLog.openAppendLog(logPath);
+        bool opaque = true;
+        for (const InMemoryDBImpl* copyDb : std::vector<const InMemoryDBImpl*>{&db, &fromBackup, &fromSnapshot, &fromLog}) {
+            opaque = opaque && copyDb->get("user2", "tags") == lookalike &&
+                     copyDb->get("user2", "note") == std::string(1, '\x02') + "escaped" &&
+                     !copyDb->setContains("user2", "tags", "admin") &&
+                     copyDb->setContains("user1", "tags", "admin");
+        }
+        assert_test(opaque, "Set never turns a plain value into a collection");
+        std::remove(logPath.c_str());
+        
+        std::cout << std::endl;
+    }    
+    void testProbabilisticFields() {
+        std::cout << "=== Probabilistic Fields ===" << std::endl;
+        
+        const std::string logPath = "test_db_sketches.log";
+        std::remove(logPath.c_str());
+        
+        InMemoryDBImpl db;
+        db.openAppendLog(logPath);
+        for (int i = 0; i < 20000; i++) {
+            db.hllAdd("page:home", "visitors", "visitor" + std::to_string(i % 10000));
+            db.hllAdd("page:about", "visitors", "visitor" + std::to_string(5000 + i % 10000));
+        }
+        uint64_t home = db.hllCount("page:home", "visitors").value_or(0);
+        assert_test(home > 9500 && home < 10500 && !db.hllAdd("page:home", "visitors", "visitor1") &&
+                    db.hllCount("page:none", "visitors") == std::nullopt,
+                    "HyperLogLog estimates distinct elements within a few percent");
+        
+        bool merged = db.hllMerge("site", "visitors", "page:home", "visitors") &&
+                      db.hllMerge("site", "visitors", "page:about", "visitors") &&
+                      !db.hllMerge("site", "visitors", "page:none", "visitors");
+        uint64_t site = db.hllCount("site", "visitors").value_or(0);
+        assert_test(merged && site > 14250 && site < 15750, "Merged HyperLogLogs count the union");
+        
+        for (int i = 0; i < 1000; i++) {
+            db.countMinAdd("page:home", "referrers", "ref" + std::to_string(i), 1 + i % 3);
+        }
+        db.countMinAdd("page:home", "referrers", "search", 5000);
+        db.countMinAdd("page:other", "referrers", "search", 250);
+        db.countMinMerge("page:home", "referrers", "page:other", "referrers");
+        uint64_t search = db.countMinEstimate("page:home", "referrers", "search").value_or(0);
+        uint64_t rare = db.countMinEstimate("page:home", "referrers", "ref4").value_or(0);
+        assert_test(search >= 5250 && search < 5250 + 30 && rare >= 2 && rare < 2 + 30 &&
+                    db.countMinEstimate("page:home", "referrers", "never").value_or(99) < 30 &&
+                    !db.countMinAdd("page:home", "visitors", "x") && !db.hllAdd("page:home", "referrers", "x"),
+                    "Count-min sketch never undercounts and rejects other kinds");
+        
+        InMemoryDBImpl copy;
+        bool restored = copy.restore(db.backup()) && copy.hllCount("site", "visitors") == site &&
+                        copy.countMinEstimate("page:home", "referrers", "search") == search;
+        db.flushAppendLog();
+        InMemoryDBImpl replayed;
+        replayed.openAppendLog(logPath);
+        assert_test(restored && replayed.hllCount("site", "visitors") == site &&
+                    replayed.hllCount("page:home", "visitors") == home &&
+                    replayed.countMinEstimate("page:home", "referrers", "search") == search,
+                    "Sketches survive backup and log replay");
+        std::remove(logPath.c_str());
+        
+        std::cout << std::endl;
+    }    
+    void testRateLimiter() {
+        std::cout << "=== Rate Limiter ===" << std::endl;
+        
+        InMemoryDBImpl db;
+        const uint64_t hour = 3600 * 1000;
+        int allowed = 0;
+        std::optional<InMemoryDBImpl::RateLimitResult> last;
+        for (int i = 0; i < 8; i++) {
+            last = db.checkRateLimit("limit:user1", "api", 5, hour);
+            allowed += last && last->allowed ? 1 : 0;
+        }
+        assert_test(allowed == 5 && last && !last->allowed && last->remaining == 0 && last->retryAfterMs > 0,
+                    "Rate limiter admits the limit and then denies with a retry hint");
+        
+        auto heavy = db.checkRateLimit("limit:user2", "api", 10, hour, 4);
+        auto tooHeavy = db.checkRateLimit("limit:user3", "api", 10, hour, 11);
+        db.set("user4", "api", "not a counter");
+        assert_test(heavy && heavy->allowed && heavy->remaining == 6 && tooHeavy && !tooHeavy->allowed &&
+                    !db.hasRecord("limit:user3") && !db.checkRateLimit("user4", "api", 10, hour) &&
+                    !db.checkRateLimit("limit:user2", "api", 10, 0),
+                    "Costs count against the limit; other values are rejected");
+        
+        db.checkRateLimit("limit:short", "api", 5, 50);
+        db.set("profile", "name", "Alice");
+        db.checkRateLimit("profile", "api", 5, 50);
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        auto fresh = db.checkRateLimit("limit:user1", "login", 5, 50);
+        assert_test(!db.hasRecord("limit:short") && db.get("profile", "name") == "Alice" && fresh &&
+                    fresh->allowed,
+                    "Idle limiter records expire; other records keep no TTL");
+        
+        ShardedInMemoryDB sharded(4);
+        std::atomic<int> admitted{0};
+        std::vector<std::thread> clients;
+        for (int t = 0; t < 4; t++) {
+            clients.emplace_back([&] {
+                for (int i = 0; i < 100; i++) {
+                    auto result = sharded.checkRateLimit("limit:shared", "api", 150, hour);
+                    admitted += result && result->allowed ? 1 : 0;
+                }
+            });
+        }
+        for (std::thread& client : clients) {
+            client.join();
+        }
+        assert_test(admitted == 150, "Concurrent checks on a sharded database admit exactly the limit");
+        
+        std::cout << std::endl;
+    }    
+#ifdef IMDB_HAS_COROUTINES
+    static TestCoroutine copyProfile(AsyncInMemoryDB& db, ShardedInMemoryDB& sharded, std::thread::id& resumedOn,
+                                     bool& done) {
+        std::optional<std::string> name = co_await db.asyncGet("async:1", "name");
+        co_await db.asyncSet("async:copy", "name", name.value_or("missing"));
+        resumedOn = std::this_thread::get_id();
+        // Resumed off the shard thread, so a blocking call to the same shard cannot deadlock
+        bool copied = sharded.get("async:copy", "name") == name;
+        done = copied && co_await db.asyncHasRecord("async:copy");
+    }
+#endif
+    
+    void testAsyncAPI() {
+        std::cout << "=== Asynchronous API ===" << std::endl;
+        
+        ShardedInMemoryDB sharded(4);
+        CompletionQueue completions;
+        AsyncInMemoryDB db(sharded, completions.executor());
+        
+        // Keep many operations in flight, then collect the results
+        std::vector<AsyncResult<bool>> writes;
+        for (int i = 0; i < 200; i++) {
+            writes.push_back(db.asyncSet("async:" + std::to_string(i), "name", "user" + std::to_string(i)));
+        }
+        std::vector<AsyncResult<std::optional<std::string>>> reads;
+        for (int i = 0; i < 200; i++) {
+            reads.push_back(db.asyncGet("async:" + std::to_string(i), "name"));
+        }
+        bool allRead = true;
+        for (int i = 0; i < 200; i++) {
+            allRead = allRead && writes[i].get() && reads[i].get() == "user" + std::to_string(i);
+        }
+        assert_test(allRead && sharded.getRecordCount() == 200, "Futures deliver in-flight results in issue order");
+        
+        std::thread::id callbackThread;
+        std::vector<std::string> fields;
+        db.asyncGetFields("async:7").then([&](std::vector<std::string> result) {
+            callbackThread = std::this_thread::get_id();
+            fields = std::move(result);
+        });
+        size_t ran = completions.waitAndRun(std::chrono::seconds(5));
+        assert_test(ran == 1 && callbackThread == std::this_thread::get_id() &&
+                    fields == std::vector<std::string>{"name"},
+                    "Callbacks run on the caller's executor");
+        
+        // Continuations run off the shard thread, so they may block on that same shard
+        std::optional<std::string> reentrant;
+        db.asyncSet("async:7", "seen", "1").then([&](bool) { reentrant = sharded.get("async:7", "seen"); });
+        ran = completions.waitAndRun(std::chrono::seconds(5));
+        assert_test(ran == 1 && reentrant == "1", "Continuations can make blocking calls to their own shard");
+        
+        AsyncResult<std::string> backup = db.asyncBackup();
+        InMemoryDBImpl copy;
+        bool restored = copy.restore(backup.get()) && copy.getRecordCount() == 200 && copy.get("async:42", "name") == "user42";
+        assert_test(restored && db.asyncDeleteRecord("async:42").get() && !db.asyncHasRecord("async:42").get(),
+                    "Asynchronous backup merges every shard");
+        
+#ifdef IMDB_HAS_COROUTINES
+        std::thread::id resumedOn;
+        bool done = false;
+        copyProfile(db, sharded, resumedOn, done);
+        for (int i = 0; i < 100 && !done; i++) {
+            completions.waitAndRun(std::chrono::milliseconds(50));
+        }
+        assert_test(done && resumedOn == std::this_thread::get_id() && sharded.get("async:copy", "name") == "user1",
+                    "Coroutines resume on the caller's executor");
+#endif
+        
+        std::cout << std::endl;
+    }    
+    void testThreadPerCore() {
+        std::cout << "=== Thread-Per-Core Engine ===" << std::endl;
+        
+        ThreadPerCoreDB engine(4, false);
+        InMemoryDB& db = engine;
+        std::vector<std::thread> submitters;
+        for (int t = 0; t < 6; t++) {
+            submitters.emplace_back([&, t]() {
+                for (int i = 0; i < 200; i++) {
+                    std::string recordId = "c" + std::to_string(t) + ":" + std::to_string(i);
+                    db.set(recordId, "parity", i % 2 == 0 ? "even" : "odd");
+                    db.set(recordId, "owner", std::to_string(t));
+                }
+            });
+        }
+        for (auto& submitter : submitters) {
+            submitter.join();
+        }
+        assert_test(engine.getRecordCount() == 1200 && db.get("c5:199", "owner") == "5" &&
+                    db.getRecordsByFieldValue("parity", "odd").size() == 600 && db.getAllRecordIds().size() == 1200,
+                    "Concurrent submitters reach every core through their own queues");
+        std::vector<std::string> oddIds = db.getRecordsByFieldValue("parity", "odd");
+        std::vector<std::string> allIds = db.getAllRecordIds();
+        assert_test(std::is_sorted(oddIds.begin(), oddIds.end()) && std::is_sorted(allIds.begin(), allIds.end()),
+                    "Fanned-out queries return IDs sorted like a single database");
+        
+        ThreadPerCoreDB::Batch batch(engine);
+        for (int i = 0; i < 50; i++) {
+            batch.set("b" + std::to_string(i), "value", std::to_string(i * i));
+        }
+        batch.submit();
+        size_t hit = batch.get("b7", "value");
+        size_t miss = batch.get("b70", "value");
+        batch.submit();
+        assert_test(batch.result(hit) == "49" && !batch.result(miss) && db.hasRecord("b49") &&
+                    db.deleteRecord("b49") && !db.hasRecord("b49"),
+                    "Batches send one message per core");
+        
+        // Exited threads release their slots, so a stream of short-lived submitters reuses them
+        size_t scannedBefore = engine.submittersScanned();
+        size_t applied = 0;
+        for (size_t t = 0; t < ThreadPerCoreDB::MAX_SUBMITTERS + 4; t++) {
+            std::thread([&, t]() { db.set("overflow", "writer", std::to_string(t)); }).join();
+            applied += db.get("overflow", "writer") == std::to_string(t) ? 1 : 0;
+        }
+        assert_test(applied == ThreadPerCoreDB::MAX_SUBMITTERS + 4 && scannedBefore <= 7 &&
+                    engine.submittersScanned() == scannedBefore,
+                    "Submitter slots of exited threads are reused");
+        
+        // Threads past MAX_SUBMITTERS at once share the locked fallback queues
+        std::atomic<size_t> registered{0};
+        std::vector<std::thread> crowd;
+        for (size_t t = 0; t < ThreadPerCoreDB::MAX_SUBMITTERS + 4; t++) {
+            crowd.emplace_back([&, t]() {
+                db.set("crowd", "w" + std::to_string(t), "1");
+                registered++;
+                while (registered.load() < ThreadPerCoreDB::MAX_SUBMITTERS + 4) {
+                    std::this_thread::yield();
+                }
+                db.set("crowd", "w" + std::to_string(t), "2");
+            });
+        }
+        for (auto& thread : crowd) {
+            thread.join();
+        }
+        bool allApplied = db.getFields("crowd").size() == ThreadPerCoreDB::MAX_SUBMITTERS + 4;
+        for (size_t t = 0; t < ThreadPerCoreDB::MAX_SUBMITTERS + 4; t++) {
+            allApplied = allApplied && db.get("crowd", "w" + std::to_string(t)) == "2";
+        }
+        assert_test(allApplied && engine.submittersScanned() == ThreadPerCoreDB::MAX_SUBMITTERS &&
+                    db.deleteRecord("crowd"),
+                    "Submitters beyond the queue slots still run");
+        
+        db.setTTL("c0:0", 3600);
+        InMemoryDBImpl plain;
+        bool restored = plain.restore(db.backup()) && plain.getRecordCount() == engine.getRecordCount();
+        ThreadPerCoreDB copy(3, false);
+        restored = restored && copy.restore(db.backup()) && copy.getRecordCount() == engine.getRecordCount() &&
+                   copy.get("c3:10", "parity") == "even" && copy.getAllRecordIds() == db.getAllRecordIds() &&
+                   plain.restore(copy.backup()) && plain.getRecordCount() == engine.getRecordCount();
+        assert_test(restored, "Backups merge and restore across core partitions");
+        
+        std::cout << std::endl;
+    }
+    
+    void testFlatCombining() {
+        std::cout << "=== Flat Combining ===" << std::endl;
+        
+        // Every thread updates the same hot record; read-modify-writes must not be lost
+        for (bool combining : {true, false}) {
+            CombiningDB engine(2, combining);
+            InMemoryDB& db = engine;
+            std::vector<std::thread> writers;
+            for (int t = 0; t < 8; t++) {
+                writers.emplace_back([&, t]() {
+                    for (int i = 0; i < 500; i++) {
+                        db.set("counters", "writer" + std::to_string(t), std::to_string(i));
+                        engine.execute(engine.shardOf("counters"), [](InMemoryDBImpl& shard) {
+                            auto hits = shard.get("counters", "hits");
+                            shard.set("counters", "hits", std::to_string(hits ? std::stoi(*hits) + 1 : 1));
+                        });
+                    }
+                });
+            }
+            for (auto& writer : writers) {
+                writer.join();
+            }
+            CombiningDB::CombiningStats stats = engine.combiningStats();
+            assert_test(db.get("counters", "hits") == "4000" && db.get("counters", "writer7") == "499" &&
+                        db.getFields("counters").size() == 9 && stats.operations >= 8000 &&
+                        stats.lockAcquisitions <= stats.operations,
+                        combining ? "Combined writes to a hot record are all applied once"
+                                  : "Locked writes to a hot record are all applied once");
+        }
+        
+        // Exited threads hand their slot to the next thread
+        CombiningDB engine(2);
+        InMemoryDB& db = engine;
+        size_t applied = 0;
+        for (size_t t = 0; t < CombiningDB::MAX_THREADS + 4; t++) {
+            std::thread([&, t]() { db.set("overflow", "writer", std::to_string(t)); }).join();
+            applied += db.get("overflow", "writer") == std::to_string(t) ? 1 : 0;
+        }
+        assert_test(applied == CombiningDB::MAX_THREADS + 4 && engine.slotsScanned() == 2,
+                    "Slots of exited threads are reused");
+        
+        // Threads past MAX_THREADS at once lock for each operation instead of publishing
+        std::atomic<size_t> registered{0};
+        std::vector<std::thread> crowd;
+        for (size_t t = 0; t < CombiningDB::MAX_THREADS + 4; t++) {
+            crowd.emplace_back([&, t]() {
+                db.set("crowd", "w" + std::to_string(t), "1");
+                registered++;
+                while (registered.load() < CombiningDB::MAX_THREADS + 4) {
+                    std::this_thread::yield();
+                }
+                db.set("crowd", "w" + std::to_string(t), "2");
+            });
+        }
+        for (auto& thread : crowd) {
+            thread.join();
+        }
+        bool allApplied = db.getFields("crowd").size() == CombiningDB::MAX_THREADS + 4;
+        for (size_t t = 0; t < CombiningDB::MAX_THREADS + 4; t++) {
+            allApplied = allApplied && db.get("crowd", "w" + std::to_string(t)) == "2";
+        }
+        assert_test(allApplied && engine.slotsScanned() == CombiningDB::MAX_THREADS && db.deleteRecord("crowd"),
+                    "Threads beyond the publication slots still run");
+        
+        for (int i = 0; i < 20; i++) {
+            db.set("r" + std::to_string(i), "parity", i % 2 == 0 ? "even" : "odd");
+        }
+        db.setTTL("r0", 3600);
+        CombiningDB copy(3);
+        assert_test(copy.restore(db.backup()) && copy.getRecordCount() == 21 &&
+                    copy.getRecordsByFieldValue("parity", "odd").size() == 10 && copy.deleteRecord("r1") &&
+                    !copy.hasRecord("r1") && !copy.restore("garbage") && copy.getRecordCount() == 20,
+                    "Backups merge and restore across combining shards");
+        std::vector<std::string> oddIds = copy.getRecordsByFieldValue("parity", "odd");
+        std::vector<std::string> allIds = copy.getAllRecordIds();
+        assert_test(std::is_sorted(oddIds.begin(), oddIds.end()) && std::is_sorted(allIds.begin(), allIds.end()),
+                    "Combining shards return IDs sorted like a single database");
+        
+        std::cout << std::endl;
+    }
+    
+    void testLazyFree() {
+        std::cout << "=== Lazy Freeing ===" << std::endl;
+        
+        InMemoryDBImpl db;
+        db.enableLazyFree(100);
+        for (int i = 0; i < 1000; i++) {
+            db.set("big", "f" + std::to_string(i), std::string(32, 'x'));
+            db.set("expiring", "f" + std::to_string(i), "v");
+        }
+        for (int i = 0; i < 100; i++) {
+            db.set("edge", "f" + std::to_string(i), "v");
+            if (i < 99) db.set("under", "f" + std::to_string(i), "v");
+        }
+        db.set("small", "name", "Ada");
+        
+        // The deleting call only unlinks the record; its fields are gone before the freer runs
+        bool deleted = db.deleteRecord("big");
+        InMemoryDBImpl::LazyFreeStats stats = db.lazyFreeStats();
+        bool handedOver = stats.pendingRecords + stats.lazyFreedRecords == 1 && stats.syncFreedRecords == 0;
+        bool goneAtOnce = !db.hasRecord("big") && db.getFields("big").empty() && !db.get("big", "f7").has_value() &&
+                          db.getRecordsByFieldValue("f7", std::string(32, 'x')).empty();
+        db.waitForLazyFree();
+        stats = db.lazyFreeStats();
+        assert_test(deleted && handedOver && goneAtOnce && stats.enabled && stats.pendingRecords == 0 &&
+                    stats.lazyFreedRecords == 1 && stats.lazyFreedFields == 1000,
+                    "Large records are unlinked at once and freed in the background");
+        
+        db.set("big", "fresh", "1");
+        assert_test(db.getFields("big") == std::vector<std::string>{"fresh"} && db.get("big", "f7") == std::nullopt,
+                    "A record recreated after a lazy delete starts empty");
+        
+        // minFields is inclusive; smaller records are freed by the deleting call
+        db.deleteRecord("edge");
+        db.deleteRecord("under");
+        db.deleteRecord("small");
+        db.waitForLazyFree();
+        stats = db.lazyFreeStats();
+        assert_test(stats.lazyFreedRecords == 2 && stats.lazyFreedFields == 1100 && stats.syncFreedRecords == 2 &&
+                    !db.hasRecord("edge") && !db.hasRecord("under") && !db.hasRecord("small"),
+                    "Records below the threshold are counted as freed synchronously");
+        
+        db.setTTL("expiring", 0);
+        bool expired = db.expireRecords() == 1 && !db.hasRecord("expiring");
+        db.waitForLazyFree();
+        stats = db.lazyFreeStats();
+        assert_test(expired && stats.lazyFreedRecords == 3 && stats.lazyFreedFields == 2100 && stats.syncFreedRecords == 2,
+                    "Expiry hands large records to the freer");
+        
+        // Records deleted by an incremental delta go through the freer too
+        InMemoryDBImpl source;
+        for (int i = 0; i < 500; i++) {
+            source.set("wide", "f" + std::to_string(i), "v");
+        }
+        source.set("narrow", "name", "Bob");
+        db.restore(source.backup());
+        uint64_t token = source.backupToken();
+        source.deleteRecord("wide");
+        source.deleteRecord("narrow");
+        bool applied = db.applyIncremental(source.backupIncremental(token));
+        db.waitForLazyFree();
+        stats = db.lazyFreeStats();
+        assert_test(applied && db.getRecordCount() == 0 && stats.lazyFreedRecords == 4 && stats.lazyFreedFields == 2600 &&
+                    stats.syncFreedRecords == 3,
+                    "Incremental restores hand deleted records to the freer");
+
+        // Collection members count toward the threshold, and large collections are handed over with the record
+        for (int i = 0; i < 500; i++) {
+            db.sortedSetAdd("ranking", "scores", "player" + std::to_string(i), i);
+            db.setAdd("tags", "all", "tag" + std::to_string(i));
+            db.listPush("queue", "jobs", "job" + std::to_string(i));
+        }
+        db.set("ranking", "title", "weekly");
+        db.set("tags", "owner", "ops");
+        db.setAdd("tags", "few", "a");
+        db.set("queue", "owner", "ops");
+        InMemoryDBImpl::LazyFreeStats before = db.lazyFreeStats();
+        bool unlinked = db.deleteRecord("ranking") && !db.hasRecord("ranking") &&
+                        db.collectionSize("ranking", "scores") == 0;
+        db.waitForLazyFree();
+        stats = db.lazyFreeStats();
+        assert_test(unlinked && stats.lazyFreedRecords == before.lazyFreedRecords + 1 &&
+                    stats.lazyFreedCollections == before.lazyFreedCollections + 1 &&
+                    stats.syncFreedRecords == before.syncFreedRecords,
+                    "A record holding a large collection is freed in the background");
+
+        // Deleting or overwriting a large collection field hands just the collection over
+        bool fieldsDropped = db.deleteField("tags", "all") && db.deleteField("tags", "few") &&
+                             !db.setContains("tags", "all", "tag7") && db.get("tags", "owner") == "ops";
+        db.set("queue", "jobs", "none");
+        db.setAdd("fresh", "members", "m");
+        db.waitForLazyFree();
+        stats = db.lazyFreeStats();
+        assert_test(fieldsDropped && db.get("queue", "jobs") == "none" && db.collectionSize("fresh", "members") == 1 &&
+                    stats.lazyFreedCollections == before.lazyFreedCollections + 3 &&
+                    stats.lazyFreedRecords == before.lazyFreedRecords + 1 && stats.pendingRecords == 0,
+                    "Large collection fields are freed in the background when deleted or overwritten");
+        db.deleteRecord("tags");
+        db.deleteRecord("queue");
+        db.deleteRecord("fresh");
+
+        // Interned values are released by the deleting call, before the map is handed over
+        db.enableValueInterning();
+        for (int i = 0; i < 1100; i++) {
+            db.set("user:" + std::to_string(i), "status", "active");
+        }
+        db.set("tagged", "status", "active");
+        for (int i = 0; i < 200; i++) {
+            db.set("tagged", "note" + std::to_string(i), "n");
+        }
+        bool interned = db.internStats("status").references == 1101;
+        db.deleteRecord("tagged");
+        db.disableLazyFree();
+        assert_test(interned && db.internStats("status").references == 1100 && db.get("user:7", "status") == "active" &&
+                    !db.lazyFreeStats().enabled,
+                    "Lazy freeing keeps interned values consistent");
+        
+        std::cout << std::endl;
+    }
+    
+    void testRecordIndex() {
+        std::cout << "=== Record ID Index ===" << std::endl;
+        
+        // Random inserts and erases against a sorted reference, with many children per node
+        RadixIndex index;
+        std::set<std::string> reference;
+        std::mt19937 rng(7);
+        bool consistent = true;
+        for (int i = 0; i < 20000; i++) {
+            std::string key = "t:" + std::to_string(rng() % 4) + ":" + std::string(1, static_cast<char>(rng() % 80 + 40)) +
+                              std::to_string(rng() % 50);
+            if (rng() % 3 == 0) {
+                consistent = consistent && index.erase(key) == (reference.erase(key) == 1);
+            } else {
+                consistent = consistent && index.insert(key) == reference.insert(key).second;
+            }
+        }
+        bool matches = consistent && index.size() == reference.size() &&
+                       index.keysWithPrefix("") == std::vector<std::string>(reference.begin(), reference.end());
+        for (const std::string prefix : {"t:1", "t:2:A", "t:3:", "t:0:P1", "u", "t:1:Z49x"}) {
+            std::vector<std::string> expected;
+            for (const std::string& key : reference) {
+                if (key.compare(0, prefix.size(), prefix) == 0) {
+                    expected.push_back(key);
+                }
+            }
+            matches = matches && index.keysWithPrefix(prefix) == expected;
+        }
+        assert_test(matches, "Radix index matches a sorted set under inserts and erases");
+        
+        // Labels longer than the inline buffer; child arrays shrink back as keys leave
+        RadixIndex layout;
+        size_t emptyBytes = layout.memoryBytes();
+        std::string longPrefix = "organization:northwind:region:emea:tenant:";
+        for (int i = 0; i < 1000; i++) {
+            layout.insert(longPrefix + std::to_string(i));
+        }
+        size_t fullBytes = layout.memoryBytes();
+        bool listed = layout.keysWithPrefix(longPrefix + "99").size() == 11 && layout.contains(longPrefix + "500");
+        for (int i = 0; i < 1000; i++) {
+            layout.erase(longPrefix + std::to_string(i));
+        }
+        assert_test(listed && fullBytes < 1000 * 64 && layout.memoryBytes() == emptyBytes && layout.nodeCount() == 1,
+                    "Radix nodes stay compact and are freed as keys are erased");
+
+        InMemoryDBImpl db;
+        db.set("tenant:42:user:1001", "name", "Ada");
+        db.enableRecordIndex();
+        for (int i = 0; i < 100; i++) {
+            db.set("tenant:42:user:" + std::to_string(i), "name", "u");
+            db.set("tenant:7:user:" + std::to_string(i), "name", "u");
+        }
+        db.set("tenant:42:order:1", "total", "10");
+        db.deleteRecord("tenant:42:user:5");
+        db.deleteField("tenant:42:user:6", "name");
+        db.set("tenant:42:user:7", "expires", "soon");
+        db.setTTL("tenant:42:user:7", 0);
+        std::vector<std::string> users = db.getRecordIdsByPrefix("tenant:42:user:");
+        InMemoryDBImpl::RecordIndexStats stats = db.recordIndexStats();
+        assert_test(users.size() == 98 && std::is_sorted(users.begin(), users.end()) &&
+                    users.front() == "tenant:42:user:0" && users.back() == "tenant:42:user:99" &&
+                    db.getRecordIdsByPrefix("tenant:42:").size() == 99 && db.getRecordIdsByPrefix("tenant:9").empty() &&
+                    stats.enabled && stats.keys == 200 && stats.labelBytes < stats.keyBytes / 2,
+                    "Prefix listing returns sorted, live record IDs");
+        
+        std::string backup = db.backup();
+        db.disableRecordIndex();
+        bool scanned = db.getRecordIdsByPrefix("tenant:42:user:") == users && !db.recordIndexStats().enabled;
+        db.enableRecordIndex();
+        db.restore("garbage");
+        bool cleared = db.getRecordIdsByPrefix("").empty();
+        db.restore(backup);
+        assert_test(scanned && cleared && db.getRecordIdsByPrefix("tenant:7:").size() == 100,
+                    "Record index follows restores and matches the unindexed scan");
+        
+        ShardedInMemoryDB sharded(3, ShardPlacement::None);
+        sharded.enableRecordIndex();
+        sharded.restore(backup);
+        assert_test(sharded.getRecordIdsByPrefix("tenant:42:user:") == db.getRecordIdsByPrefix("tenant:42:user:"),
+                    "Sharded prefix listings merge in order");
+        
+        std::cout << std::endl;
+    }
 };
 
 int main() {